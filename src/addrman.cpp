@@ -5,10 +5,53 @@
 
 #include <addrman.h>
 
+#include <crypto/siphash.h>
 #include <hash.h>
 #include <logging.h>
 #include <serialize.h>
 
+#include <limits>
+
+namespace {
+/** Stream that feeds serialized data into a SipHash computation. */
+class SipHashWriter
+{
+private:
+    CSipHasher m_hasher;
+
+public:
+    SipHashWriter(uint64_t k0, uint64_t k1) : m_hasher(k0, k1) {}
+
+    int GetType() const { return SER_GETHASH; }
+    int GetVersion() const { return ADDRV2_FORMAT; }
+
+    void write(const char* pch, size_t size)
+    {
+        m_hasher.Write((const unsigned char*)pch, size);
+    }
+
+    template <typename T>
+    SipHashWriter& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj);
+        return *this;
+    }
+
+    uint64_t GetHash() const
+    {
+        return m_hasher.Finalize();
+    }
+};
+} // namespace
+
+SaltedNetAddrHasher::SaltedNetAddrHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+size_t SaltedNetAddrHasher::operator()(const CNetAddr& addr) const
+{
+    // Equal addresses have the same network and raw address, and thus the same serialization.
+    return (SipHashWriter(k0, k1) << addr).GetHash();
+}
+
 int CAddrInfo::GetTriedBucket(const uint256& nKey, const std::vector<bool> &asmap) const
 {
     uint64_t hash1 = (CHashWriter(SER_GETHASH, 0) << nKey << GetKey()).GetCheapHash();
@@ -71,29 +114,55 @@ double CAddrInfo::GetChance(int64_t nNow) const
     return fChance;
 }
 
+CAddrMan::BucketPosition CAddrMan::GetNewPosition(const uint256& key, const CAddrInfo& info, const CNetAddr& source) const
+{
+    BucketPosition ret;
+    ret.key = key;
+    ret.bucket = info.GetNewBucket(key, source, m_asmap);
+    ret.pos = info.GetBucketPosition(key, true, ret.bucket);
+    return ret;
+}
+
+CAddrMan::BucketPosition CAddrMan::GetTriedPosition(const uint256& key, const CAddrInfo& info) const
+{
+    BucketPosition ret;
+    ret.key = key;
+    ret.bucket = info.GetTriedBucket(key, m_asmap);
+    ret.pos = info.GetBucketPosition(key, false, ret.bucket);
+    return ret;
+}
+
 CAddrInfo* CAddrMan::Find(const CNetAddr& addr, int* pnId)
 {
-    std::map<CNetAddr, int>::iterator it = mapAddr.find(addr);
+    const auto it = mapAddr.find(addr);
     if (it == mapAddr.end())
         return nullptr;
     if (pnId)
         *pnId = (*it).second;
-    std::map<int, CAddrInfo>::iterator it2 = mapInfo.find((*it).second);
-    if (it2 != mapInfo.end())
-        return &(*it2).second;
+    if (Exists(it->second))
+        return &vInfo[it->second];
     return nullptr;
 }
 
 CAddrInfo* CAddrMan::Create(const CAddress& addr, const CNetAddr& addrSource, int* pnId)
 {
-    int nId = nIdCount++;
-    mapInfo[nId] = CAddrInfo(addr, addrSource);
+    int nId;
+    if (!vFreeIds.empty()) {
+        nId = vFreeIds.back();
+        vFreeIds.pop_back();
+    } else {
+        nId = vInfo.size();
+        vInfo.emplace_back();
+        vNewPositions.emplace_back();
+    }
+    CAddrInfo& info = vInfo[nId];
+    info = CAddrInfo(addr, addrSource);
     mapAddr[addr] = nId;
-    mapInfo[nId].nRandomPos = vRandom.size();
+    info.nRandomPos = vRandom.size();
     vRandom.push_back(nId);
     if (pnId)
         *pnId = nId;
-    return &mapInfo[nId];
+    return &info;
 }
 
 void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2)
@@ -106,11 +175,11 @@ void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2)
     int nId1 = vRandom[nRndPos1];
     int nId2 = vRandom[nRndPos2];
 
-    assert(mapInfo.count(nId1) == 1);
-    assert(mapInfo.count(nId2) == 1);
+    assert(Exists(nId1));
+    assert(Exists(nId2));
 
-    mapInfo[nId1].nRandomPos = nRndPos2;
-    mapInfo[nId2].nRandomPos = nRndPos1;
+    vInfo[nId1].nRandomPos = nRndPos2;
+    vInfo[nId2].nRandomPos = nRndPos1;
 
     vRandom[nRndPos1] = nId2;
     vRandom[nRndPos2] = nId1;
@@ -118,61 +187,84 @@ void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2)
 
 void CAddrMan::Delete(int nId)
 {
-    assert(mapInfo.count(nId) != 0);
-    CAddrInfo& info = mapInfo[nId];
+    assert(Exists(nId));
+    CAddrInfo& info = vInfo[nId];
     assert(!info.fInTried);
     assert(info.nRefCount == 0);
 
     SwapRandom(info.nRandomPos, vRandom.size() - 1);
     vRandom.pop_back();
     mapAddr.erase(info);
-    mapInfo.erase(nId);
+    // The nId will be reused, so it must not linger as a pending collision.
+    m_tried_collisions.erase(nId);
+    info = CAddrInfo();
+    vFreeIds.push_back(nId);
     nNew--;
 }
 
+void CAddrMan::SetNew(int nUBucket, int nUBucketPos, int nId)
+{
+    assert(vvNew[nUBucket][nUBucketPos] == -1);
+    CAddrInfo& info = vInfo[nId];
+    assert(info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS);
+    vNewPositions[nId][info.nRefCount] = nUBucket * ADDRMAN_BUCKET_SIZE + nUBucketPos;
+    info.nRefCount++;
+    vvNew.Set(nUBucket, nUBucketPos, nId);
+}
+
+void CAddrMan::UnsetNew(int nUBucket, int nUBucketPos)
+{
+    const int nId = vvNew[nUBucket][nUBucketPos];
+    assert(nId != -1);
+    CAddrInfo& info = vInfo[nId];
+    assert(info.nRefCount > 0);
+    std::array<int, ADDRMAN_NEW_BUCKETS_PER_ADDRESS>& positions = vNewPositions[nId];
+    const int position = nUBucket * ADDRMAN_BUCKET_SIZE + nUBucketPos;
+    for (int i = 0; i < info.nRefCount; i++) {
+        if (positions[i] == position) {
+            positions[i] = positions[info.nRefCount - 1];
+            break;
+        }
+    }
+    info.nRefCount--;
+    vvNew.Set(nUBucket, nUBucketPos, -1);
+}
+
 void CAddrMan::ClearNew(int nUBucket, int nUBucketPos)
 {
     // if there is an entry in the specified bucket, delete it.
     if (vvNew[nUBucket][nUBucketPos] != -1) {
         int nIdDelete = vvNew[nUBucket][nUBucketPos];
-        CAddrInfo& infoDelete = mapInfo[nIdDelete];
-        assert(infoDelete.nRefCount > 0);
-        infoDelete.nRefCount--;
-        vvNew[nUBucket][nUBucketPos] = -1;
-        if (infoDelete.nRefCount == 0) {
+        UnsetNew(nUBucket, nUBucketPos);
+        if (vInfo[nIdDelete].nRefCount == 0) {
             Delete(nIdDelete);
         }
     }
 }
 
-void CAddrMan::MakeTried(CAddrInfo& info, int nId)
+void CAddrMan::MakeTried(CAddrInfo& info, int nId, const BucketPosition& tried_pos)
 {
     // remove the entry from all new buckets
-    for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
-        int pos = info.GetBucketPosition(nKey, true, bucket);
-        if (vvNew[bucket][pos] == nId) {
-            vvNew[bucket][pos] = -1;
-            info.nRefCount--;
-        }
+    while (info.nRefCount > 0) {
+        const int position = vNewPositions[nId][info.nRefCount - 1];
+        UnsetNew(position / ADDRMAN_BUCKET_SIZE, position % ADDRMAN_BUCKET_SIZE);
     }
     nNew--;
 
-    assert(info.nRefCount == 0);
-
     // which tried bucket to move the entry to
-    int nKBucket = info.GetTriedBucket(nKey, m_asmap);
-    int nKBucketPos = info.GetBucketPosition(nKey, false, nKBucket);
+    int nKBucket = tried_pos.bucket;
+    int nKBucketPos = tried_pos.pos;
 
     // first make space to add it (the existing tried entry there is moved to new, deleting whatever is there).
     if (vvTried[nKBucket][nKBucketPos] != -1) {
         // find an item to evict
         int nIdEvict = vvTried[nKBucket][nKBucketPos];
-        assert(mapInfo.count(nIdEvict) == 1);
-        CAddrInfo& infoOld = mapInfo[nIdEvict];
+        assert(Exists(nIdEvict));
+        CAddrInfo& infoOld = vInfo[nIdEvict];
 
         // Remove the to-be-evicted item from the tried set.
         infoOld.fInTried = false;
-        vvTried[nKBucket][nKBucketPos] = -1;
+        vvTried.Set(nKBucket, nKBucketPos, -1);
         nTried--;
 
         // find which new bucket it belongs to
@@ -182,18 +274,17 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
         assert(vvNew[nUBucket][nUBucketPos] == -1);
 
         // Enter it into the new set again.
-        infoOld.nRefCount = 1;
-        vvNew[nUBucket][nUBucketPos] = nIdEvict;
+        SetNew(nUBucket, nUBucketPos, nIdEvict);
         nNew++;
     }
     assert(vvTried[nKBucket][nKBucketPos] == -1);
 
-    vvTried[nKBucket][nKBucketPos] = nId;
+    vvTried.Set(nKBucket, nKBucketPos, nId);
     nTried++;
     info.fInTried = true;
 }
 
-void CAddrMan::Good_(const CService& addr, bool test_before_evict, int64_t nTime)
+void CAddrMan::Good_(const CService& addr, bool test_before_evict, int64_t nTime, const BucketPosition& tried_pos)
 {
     int nId;
 
@@ -222,32 +313,21 @@ void CAddrMan::Good_(const CService& addr, bool test_before_evict, int64_t nTime
     if (info.fInTried)
         return;
 
-    // find a bucket it is in now
-    int nRnd = insecure_rand.randrange(ADDRMAN_NEW_BUCKET_COUNT);
-    int nUBucket = -1;
-    for (unsigned int n = 0; n < ADDRMAN_NEW_BUCKET_COUNT; n++) {
-        int nB = (n + nRnd) % ADDRMAN_NEW_BUCKET_COUNT;
-        int nBpos = info.GetBucketPosition(nKey, true, nB);
-        if (vvNew[nB][nBpos] == nId) {
-            nUBucket = nB;
-            break;
-        }
-    }
-
-    // if no bucket is found, something bad happened;
+    // if it is in no new bucket, something bad happened;
     // TODO: maybe re-add the node, but for now, just bail out
-    if (nUBucket == -1)
+    if (info.nRefCount == 0)
         return;
 
     // which tried bucket to move the entry to
-    int tried_bucket = info.GetTriedBucket(nKey, m_asmap);
-    int tried_bucket_pos = info.GetBucketPosition(nKey, false, tried_bucket);
+    const BucketPosition pos = (tried_pos.bucket != -1 && tried_pos.key == nKey) ? tried_pos : GetTriedPosition(nKey, info);
+    int tried_bucket = pos.bucket;
+    int tried_bucket_pos = pos.pos;
 
     // Will moving this address into tried evict another entry?
     if (test_before_evict && (vvTried[tried_bucket][tried_bucket_pos] != -1)) {
         // Output the entry we'd be colliding with, for debugging purposes
-        auto colliding_entry = mapInfo.find(vvTried[tried_bucket][tried_bucket_pos]);
-        LogPrint(BCLog::ADDRMAN, "Collision inserting element into tried table (%s), moving %s to m_tried_collisions=%d\n", colliding_entry != mapInfo.end() ? colliding_entry->second.ToString() : "", addr.ToString(), m_tried_collisions.size());
+        const CAddrInfo& colliding_entry = vInfo[vvTried[tried_bucket][tried_bucket_pos]];
+        LogPrint(BCLog::ADDRMAN, "Collision inserting element into tried table (%s), moving %s to m_tried_collisions=%d\n", colliding_entry.ToString(), addr.ToString(), m_tried_collisions.size());
         if (m_tried_collisions.size() < ADDRMAN_SET_TRIED_COLLISION_SIZE) {
             m_tried_collisions.insert(nId);
         }
@@ -255,11 +335,11 @@ void CAddrMan::Good_(const CService& addr, bool test_before_evict, int64_t nTime
         LogPrint(BCLog::ADDRMAN, "Moving %s to tried\n", addr.ToString());
 
         // move nId to the tried tables
-        MakeTried(info, nId);
+        MakeTried(info, nId, pos);
     }
 }
 
-bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimePenalty)
+bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimePenalty, const BucketPosition& new_pos)
 {
     if (!addr.IsRoutable())
         return false;
@@ -308,12 +388,15 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
         fNew = true;
     }
 
-    int nUBucket = pinfo->GetNewBucket(nKey, source, m_asmap);
-    int nUBucketPos = pinfo->GetBucketPosition(nKey, true, nUBucket);
+    // The position is computed from the stored entry, whose port may differ from addr's.
+    const bool fPosValid = new_pos.bucket != -1 && new_pos.key == nKey && static_cast<const CService&>(*pinfo) == addr;
+    const BucketPosition pos = fPosValid ? new_pos : GetNewPosition(nKey, *pinfo, source);
+    int nUBucket = pos.bucket;
+    int nUBucketPos = pos.pos;
     if (vvNew[nUBucket][nUBucketPos] != nId) {
         bool fInsert = vvNew[nUBucket][nUBucketPos] == -1;
         if (!fInsert) {
-            CAddrInfo& infoExisting = mapInfo[vvNew[nUBucket][nUBucketPos]];
+            CAddrInfo& infoExisting = vInfo[vvNew[nUBucket][nUBucketPos]];
             if (infoExisting.IsTerrible() || (infoExisting.nRefCount > 1 && pinfo->nRefCount == 0)) {
                 // Overwrite the existing new table entry.
                 fInsert = true;
@@ -321,8 +404,7 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
         }
         if (fInsert) {
             ClearNew(nUBucket, nUBucketPos);
-            pinfo->nRefCount++;
-            vvNew[nUBucket][nUBucketPos] = nId;
+            SetNew(nUBucket, nUBucketPos, nId);
         } else {
             if (pinfo->nRefCount == 0) {
                 Delete(nId);
@@ -368,15 +450,10 @@ CAddrInfo CAddrMan::Select_(bool newOnly)
         // use a tried node
         double fChanceFactor = 1.0;
         while (1) {
-            int nKBucket = insecure_rand.randrange(ADDRMAN_TRIED_BUCKET_COUNT);
-            int nKBucketPos = insecure_rand.randrange(ADDRMAN_BUCKET_SIZE);
-            while (vvTried[nKBucket][nKBucketPos] == -1) {
-                nKBucket = (nKBucket + insecure_rand.randbits(ADDRMAN_TRIED_BUCKET_COUNT_LOG2)) % ADDRMAN_TRIED_BUCKET_COUNT;
-                nKBucketPos = (nKBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
-            int nId = vvTried[nKBucket][nKBucketPos];
-            assert(mapInfo.count(nId) == 1);
-            CAddrInfo& info = mapInfo[nId];
+            // pick a random occupied position in the tried table
+            int nId = vvTried.GetOccupied(insecure_rand.randrange(vvTried.CountOccupied()));
+            assert(Exists(nId));
+            CAddrInfo& info = vInfo[nId];
             if (insecure_rand.randbits(30) < fChanceFactor * info.GetChance() * (1 << 30))
                 return info;
             fChanceFactor *= 1.2;
@@ -385,15 +462,10 @@ CAddrInfo CAddrMan::Select_(bool newOnly)
         // use a new node
         double fChanceFactor = 1.0;
         while (1) {
-            int nUBucket = insecure_rand.randrange(ADDRMAN_NEW_BUCKET_COUNT);
-            int nUBucketPos = insecure_rand.randrange(ADDRMAN_BUCKET_SIZE);
-            while (vvNew[nUBucket][nUBucketPos] == -1) {
-                nUBucket = (nUBucket + insecure_rand.randbits(ADDRMAN_NEW_BUCKET_COUNT_LOG2)) % ADDRMAN_NEW_BUCKET_COUNT;
-                nUBucketPos = (nUBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
-            int nId = vvNew[nUBucket][nUBucketPos];
-            assert(mapInfo.count(nId) == 1);
-            CAddrInfo& info = mapInfo[nId];
+            // pick a random occupied position in the new table
+            int nId = vvNew.GetOccupied(insecure_rand.randrange(vvNew.CountOccupied()));
+            assert(Exists(nId));
+            CAddrInfo& info = vInfo[nId];
             if (insecure_rand.randbits(30) < fChanceFactor * info.GetChance() * (1 << 30))
                 return info;
             fChanceFactor *= 1.2;
@@ -410,9 +482,10 @@ int CAddrMan::Check_()
     if (vRandom.size() != (size_t)(nTried + nNew))
         return -7;
 
-    for (const auto& entry : mapInfo) {
-        int n = entry.first;
-        const CAddrInfo& info = entry.second;
+    for (int n = 0; n < (int)vInfo.size(); n++) {
+        const CAddrInfo& info = vInfo[n];
+        if (info.nRandomPos == -1)
+            continue; // unused nId
         if (info.fInTried) {
             if (!info.nLastSuccess)
                 return -1;
@@ -425,8 +498,14 @@ int CAddrMan::Check_()
             if (!info.nRefCount)
                 return -4;
             mapNew[n] = info.nRefCount;
+            for (int i = 0; i < info.nRefCount; i++) {
+                const int position = vNewPositions[n][i];
+                if (vvNew[position / ADDRMAN_BUCKET_SIZE][position % ADDRMAN_BUCKET_SIZE] != n)
+                    return -20;
+            }
         }
-        if (mapAddr[info] != n)
+        const auto it = mapAddr.find(info);
+        if (it == mapAddr.end() || it->second != n)
             return -5;
         if (info.nRandomPos < 0 || (size_t)info.nRandomPos >= vRandom.size() || vRandom[info.nRandomPos] != n)
             return -14;
@@ -446,9 +525,9 @@ int CAddrMan::Check_()
              if (vvTried[n][i] != -1) {
                  if (!setTried.count(vvTried[n][i]))
                      return -11;
-                 if (mapInfo[vvTried[n][i]].GetTriedBucket(nKey, m_asmap) != n)
+                 if (vInfo[vvTried[n][i]].GetTriedBucket(nKey, m_asmap) != n)
                      return -17;
-                 if (mapInfo[vvTried[n][i]].GetBucketPosition(nKey, false, n) != i)
+                 if (vInfo[vvTried[n][i]].GetBucketPosition(nKey, false, n) != i)
                      return -18;
                  setTried.erase(vvTried[n][i]);
              }
@@ -460,7 +539,7 @@ int CAddrMan::Check_()
             if (vvNew[n][i] != -1) {
                 if (!mapNew.count(vvNew[n][i]))
                     return -12;
-                if (mapInfo[vvNew[n][i]].GetBucketPosition(nKey, true, n) != i)
+                if (vInfo[vvNew[n][i]].GetBucketPosition(nKey, true, n) != i)
                     return -19;
                 if (--mapNew[vvNew[n][i]] == 0)
                     mapNew.erase(vvNew[n][i]);
@@ -468,6 +547,9 @@ int CAddrMan::Check_()
         }
     }
 
+    if (vvTried.CountOccupied() != (size_t)nTried)
+        return -21;
+
     if (setTried.size())
         return -13;
     if (mapNew.size())
@@ -496,9 +578,9 @@ void CAddrMan::GetAddr_(std::vector<CAddress>& vAddr, size_t max_addresses, size
 
         int nRndPos = insecure_rand.randrange(vRandom.size() - n) + n;
         SwapRandom(n, nRndPos);
-        assert(mapInfo.count(vRandom[n]) == 1);
+        assert(Exists(vRandom[n]));
 
-        const CAddrInfo& ai = mapInfo[vRandom[n]];
+        const CAddrInfo& ai = vInfo[vRandom[n]];
         if (!ai.IsTerrible())
             vAddr.push_back(ai);
     }
@@ -549,22 +631,23 @@ void CAddrMan::ResolveCollisions_()
 
         bool erase_collision = false;
 
-        // If id_new not found in mapInfo remove it from m_tried_collisions
-        if (mapInfo.count(id_new) != 1) {
+        // If id_new not found in vInfo remove it from m_tried_collisions
+        if (!Exists(id_new)) {
             erase_collision = true;
         } else {
-            CAddrInfo& info_new = mapInfo[id_new];
+            CAddrInfo& info_new = vInfo[id_new];
 
             // Which tried bucket to move the entry to.
-            int tried_bucket = info_new.GetTriedBucket(nKey, m_asmap);
-            int tried_bucket_pos = info_new.GetBucketPosition(nKey, false, tried_bucket);
+            const BucketPosition tried_pos = GetTriedPosition(nKey, info_new);
+            int tried_bucket = tried_pos.bucket;
+            int tried_bucket_pos = tried_pos.pos;
             if (!info_new.IsValid()) { // id_new may no longer map to a valid address
                 erase_collision = true;
             } else if (vvTried[tried_bucket][tried_bucket_pos] != -1) { // The position in the tried bucket is not empty
 
                 // Get the to-be-evicted address that is being tested
                 int id_old = vvTried[tried_bucket][tried_bucket_pos];
-                CAddrInfo& info_old = mapInfo[id_old];
+                CAddrInfo& info_old = vInfo[id_old];
 
                 // Has successfully connected in last X hours
                 if (GetAdjustedTime() - info_old.nLastSuccess < ADDRMAN_REPLACEMENT_HOURS*(60*60)) {
@@ -576,7 +659,7 @@ void CAddrMan::ResolveCollisions_()
                         LogPrint(BCLog::ADDRMAN, "Replacing %s with %s in tried table\n", info_old.ToString(), info_new.ToString());
 
                         // Replaces an existing address already in the tried table with the new address
-                        Good_(info_new, false, GetAdjustedTime());
+                        Good_(info_new, false, GetAdjustedTime(), tried_pos);
                         erase_collision = true;
                     }
                 } else if (GetAdjustedTime() - info_new.nLastSuccess > ADDRMAN_TEST_WINDOW) {
@@ -584,11 +667,11 @@ void CAddrMan::ResolveCollisions_()
                     // just evict the old entry -- we must not be able to
                     // connect to it for some reason.
                     LogPrint(BCLog::ADDRMAN, "Unable to test; replacing %s with %s in tried table anyway\n", info_old.ToString(), info_new.ToString());
-                    Good_(info_new, false, GetAdjustedTime());
+                    Good_(info_new, false, GetAdjustedTime(), tried_pos);
                     erase_collision = true;
                 }
             } else { // Collision is not actually a collision anymore
-                Good_(info_new, false, GetAdjustedTime());
+                Good_(info_new, false, GetAdjustedTime(), tried_pos);
                 erase_collision = true;
             }
         }
@@ -611,21 +694,23 @@ CAddrInfo CAddrMan::SelectTriedCollision_()
     std::advance(it, insecure_rand.randrange(m_tried_collisions.size()));
     int id_new = *it;
 
-    // If id_new not found in mapInfo remove it from m_tried_collisions
-    if (mapInfo.count(id_new) != 1) {
+    // If id_new not found in vInfo remove it from m_tried_collisions
+    if (!Exists(id_new)) {
         m_tried_collisions.erase(it);
         return CAddrInfo();
     }
 
-    CAddrInfo& newInfo = mapInfo[id_new];
+    CAddrInfo& newInfo = vInfo[id_new];
 
     // which tried bucket to move the entry to
-    int tried_bucket = newInfo.GetTriedBucket(nKey, m_asmap);
-    int tried_bucket_pos = newInfo.GetBucketPosition(nKey, false, tried_bucket);
+    const BucketPosition tried_pos = GetTriedPosition(nKey, newInfo);
 
-    int id_old = vvTried[tried_bucket][tried_bucket_pos];
+    int id_old = vvTried[tried_pos.bucket][tried_pos.pos];
+    if (id_old == -1) {
+        return CAddrInfo();
+    }
 
-    return mapInfo[id_old];
+    return vInfo[id_old];
 }
 
 std::vector<bool> CAddrMan::DecodeAsmap(fs::path path)
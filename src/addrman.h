@@ -18,11 +18,15 @@
 
 #include <fs.h>
 #include <hash.h>
+#include <algorithm>
+#include <array>
 #include <iostream>
+#include <iterator>
 #include <map>
 #include <set>
 #include <stdint.h>
 #include <streams.h>
+#include <unordered_map>
 #include <vector>
 
 /**
@@ -96,6 +100,20 @@ public:
     double GetChance(int64_t nNow = GetAdjustedTime()) const;
 };
 
+/** Salted hasher for network addresses, so that lookups in the address index
+ *  cannot be slowed down by crafted addresses. */
+class SaltedNetAddrHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedNetAddrHasher();
+
+    size_t operator()(const CNetAddr& addr) const;
+};
+
 /** Stochastic address manager
  *
  * Design goals:
@@ -120,6 +138,8 @@ public:
  *      be observable by adversaries.
  *    * Several indexes are kept for high performance. Defining DEBUG_ADDRMAN will introduce frequent (and expensive)
  *      consistency checks for the entire data structure.
+ *  * All entries are stored in one flat table indexed by their nId, and each table keeps a dense list of its
+ *    occupied positions, so that selecting an address takes constant time however sparse the tables are.
  */
 
 //! total number of buckets for tried addresses
@@ -166,6 +186,71 @@ public:
 //! the maximum time we'll spend trying to resolve a tried table collision, in seconds
 static const int64_t ADDRMAN_TEST_WINDOW = 40*60; // 40 minutes
 
+/**
+ * Table of BUCKET_COUNT buckets of ADDRMAN_BUCKET_SIZE positions, each holding
+ * an nId or -1 if empty. Besides the positions it keeps a dense list of the
+ * occupied ones, so that a random entry can be picked in constant time.
+ */
+template <int BUCKET_COUNT>
+class CAddrManBucketTable
+{
+private:
+    //! nId at every position (bucket * ADDRMAN_BUCKET_SIZE + position in bucket), -1 if empty
+    int m_ids[BUCKET_COUNT * ADDRMAN_BUCKET_SIZE];
+
+    //! index in m_occupied of every occupied position
+    int m_occupied_index[BUCKET_COUNT * ADDRMAN_BUCKET_SIZE];
+
+    //! all occupied positions, in no particular order
+    std::vector<int> m_occupied;
+
+public:
+    CAddrManBucketTable()
+    {
+        Clear();
+    }
+
+    //! Read access to a bucket. Positions are only changed through Set().
+    const int* operator[](int bucket) const
+    {
+        return m_ids + bucket * ADDRMAN_BUCKET_SIZE;
+    }
+
+    //! Store an nId at a position, or empty it if nId is -1.
+    void Set(int bucket, int pos, int nId)
+    {
+        const int n = bucket * ADDRMAN_BUCKET_SIZE + pos;
+        if (m_ids[n] == -1 && nId != -1) {
+            m_occupied_index[n] = m_occupied.size();
+            m_occupied.push_back(n);
+        } else if (m_ids[n] != -1 && nId == -1) {
+            const int last = m_occupied.back();
+            m_occupied[m_occupied_index[n]] = last;
+            m_occupied_index[last] = m_occupied_index[n];
+            m_occupied.pop_back();
+        }
+        m_ids[n] = nId;
+    }
+
+    void Clear()
+    {
+        std::fill(std::begin(m_ids), std::end(m_ids), -1);
+        m_occupied.clear();
+    }
+
+    //! Number of occupied positions.
+    size_t CountOccupied() const
+    {
+        return m_occupied.size();
+    }
+
+    //! nId at the n-th occupied position, for n < CountOccupied().
+    int GetOccupied(size_t n) const
+    {
+        return m_ids[m_occupied[n]];
+    }
+};
+
 /**
  * Stochastical (IP) address manager
  */
@@ -199,14 +284,17 @@ private:
     //! @note Don't increment this. Increment `lowest_compatible` in `Serialize()` instead.
     static constexpr uint8_t INCOMPATIBILITY_BASE = 32;
 
-    //! last used nId
-    int nIdCount GUARDED_BY(cs);
+    //! table with information about all nIds, indexed by nId. Unused nIds have nRandomPos -1.
+    std::vector<CAddrInfo> vInfo GUARDED_BY(cs);
+
+    //! unused nIds below vInfo.size(), handed out again before vInfo grows
+    std::vector<int> vFreeIds GUARDED_BY(cs);
 
-    //! table with information about all nIds
-    std::map<int, CAddrInfo> mapInfo GUARDED_BY(cs);
+    //! positions (bucket * ADDRMAN_BUCKET_SIZE + position in bucket) in vvNew of every nId, the first nRefCount are valid
+    std::vector<std::array<int, ADDRMAN_NEW_BUCKETS_PER_ADDRESS>> vNewPositions GUARDED_BY(cs);
 
     //! find an nId based on its network address
-    std::map<CNetAddr, int> mapAddr GUARDED_BY(cs);
+    std::unordered_map<CNetAddr, int, SaltedNetAddrHasher> mapAddr GUARDED_BY(cs);
 
     //! randomly-ordered vector of all nIds
     std::vector<int> vRandom GUARDED_BY(cs);
@@ -215,13 +303,13 @@ private:
     int nTried GUARDED_BY(cs);
 
     //! list of "tried" buckets
-    int vvTried[ADDRMAN_TRIED_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE] GUARDED_BY(cs);
+    CAddrManBucketTable<ADDRMAN_TRIED_BUCKET_COUNT> vvTried GUARDED_BY(cs);
 
     //! number of (unique) "new" entries
     int nNew GUARDED_BY(cs);
 
     //! list of "new" buckets
-    int vvNew[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE] GUARDED_BY(cs);
+    CAddrManBucketTable<ADDRMAN_NEW_BUCKET_COUNT> vvNew GUARDED_BY(cs);
 
     //! last time Good was called (memory only)
     int64_t nLastGood GUARDED_BY(cs);
@@ -236,6 +324,28 @@ protected:
     //! Source of random numbers for randomization in inner loops
     FastRandomContext insecure_rand;
 
+    //! A bucket and position in a table, which can be computed for an address before taking cs.
+    struct BucketPosition {
+        //! nKey the position was computed with
+        uint256 key;
+        int bucket;
+        int pos;
+
+        BucketPosition() : bucket(-1), pos(-1) {}
+    };
+
+    //! Compute the position of an entry in the "new" table, given the source it was learnt from.
+    BucketPosition GetNewPosition(const uint256& key, const CAddrInfo& info, const CNetAddr& source) const;
+
+    //! Compute the position of an entry in the "tried" table.
+    BucketPosition GetTriedPosition(const uint256& key, const CAddrInfo& info) const;
+
+    //! Whether nId refers to an entry.
+    bool Exists(int nId) const EXCLUSIVE_LOCKS_REQUIRED(cs)
+    {
+        return nId >= 0 && (size_t)nId < vInfo.size() && vInfo[nId].nRandomPos != -1;
+    }
+
     //! Find an entry.
     CAddrInfo* Find(const CNetAddr& addr, int *pnId = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
@@ -246,20 +356,26 @@ protected:
     //! Swap two elements in vRandom.
     void SwapRandom(unsigned int nRandomPos1, unsigned int nRandomPos2) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
-    //! Move an entry from the "new" table(s) to the "tried" table
-    void MakeTried(CAddrInfo& info, int nId) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    //! Move an entry from the "new" table(s) to the "tried" table, at the given position.
+    void MakeTried(CAddrInfo& info, int nId, const BucketPosition& tried_pos) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
     //! Delete an entry. It must not be in tried, and have refcount 0.
     void Delete(int nId) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    //! Put an entry at an empty position in the "new" table, increasing its refcount.
+    void SetNew(int nUBucket, int nUBucketPos, int nId) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    //! Empty an occupied position in the "new" table, decreasing the refcount of the entry there without deleting it.
+    void UnsetNew(int nUBucket, int nUBucketPos) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     //! Clear a position in a "new" table. This is the only place where entries are actually deleted.
     void ClearNew(int nUBucket, int nUBucketPos) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
-    //! Mark an entry "good", possibly moving it from "new" to "tried".
-    void Good_(const CService &addr, bool test_before_evict, int64_t time) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    //! Mark an entry "good", possibly moving it from "new" to "tried". tried_pos is used if it was computed with the current nKey.
+    void Good_(const CService &addr, bool test_before_evict, int64_t time, const BucketPosition& tried_pos = BucketPosition()) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
-    //! Add an entry to the "new" table.
-    bool Add_(const CAddress &addr, const CNetAddr& source, int64_t nTimePenalty) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    //! Add an entry to the "new" table. new_pos is used if it was computed with the current nKey for the entry's address.
+    bool Add_(const CAddress &addr, const CNetAddr& source, int64_t nTimePenalty, const BucketPosition& new_pos) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
     //! Mark an entry as attempted to connect.
     void Attempt_(const CService &addr, bool fCountFailure, int64_t nTime) EXCLUSIVE_LOCKS_REQUIRED(cs);
@@ -369,11 +485,11 @@ public:
 
         int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT ^ (1 << 30);
         s << nUBuckets;
-        std::map<int, int> mapUnkIds;
+        std::vector<int> vUnkIds(vInfo.size());
         int nIds = 0;
-        for (const auto& entry : mapInfo) {
-            mapUnkIds[entry.first] = nIds;
-            const CAddrInfo &info = entry.second;
+        for (size_t n = 0; n < vInfo.size(); n++) {
+            vUnkIds[n] = nIds;
+            const CAddrInfo &info = vInfo[n];
             if (info.nRefCount) {
                 assert(nIds != nNew); // this means nNew was wrong, oh ow
                 s << info;
@@ -381,8 +497,7 @@ public:
             }
         }
         nIds = 0;
-        for (const auto& entry : mapInfo) {
-            const CAddrInfo &info = entry.second;
+        for (const CAddrInfo& info : vInfo) {
             if (info.fInTried) {
                 assert(nIds != nTried); // this means nTried was wrong, oh ow
                 s << info;
@@ -398,7 +513,7 @@ public:
             s << nSize;
             for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
                 if (vvNew[bucket][i] != -1) {
-                    int nIndex = mapUnkIds[vvNew[bucket][i]];
+                    int nIndex = vUnkIds[vvNew[bucket][i]];
                     s << nIndex;
                 }
             }
@@ -459,14 +574,15 @@ public:
         }
 
         // Deserialize entries from the new table.
+        vInfo.resize(nNew);
+        vNewPositions.resize(nNew);
         for (int n = 0; n < nNew; n++) {
-            CAddrInfo &info = mapInfo[n];
+            CAddrInfo &info = vInfo[n];
             s >> info;
             mapAddr[info] = n;
             info.nRandomPos = vRandom.size();
             vRandom.push_back(n);
         }
-        nIdCount = nNew;
 
         // Deserialize entries from the tried table.
         int nLost = 0;
@@ -476,13 +592,14 @@ public:
             int nKBucket = info.GetTriedBucket(nKey, m_asmap);
             int nKBucketPos = info.GetBucketPosition(nKey, false, nKBucket);
             if (vvTried[nKBucket][nKBucketPos] == -1) {
+                const int nId = vInfo.size();
                 info.nRandomPos = vRandom.size();
                 info.fInTried = true;
-                vRandom.push_back(nIdCount);
-                mapInfo[nIdCount] = info;
-                mapAddr[info] = nIdCount;
-                vvTried[nKBucket][nKBucketPos] = nIdCount;
-                nIdCount++;
+                vRandom.push_back(nId);
+                vInfo.push_back(info);
+                vNewPositions.emplace_back();
+                mapAddr[info] = nId;
+                vvTried.Set(nKBucket, nKBucketPos, nId);
             } else {
                 nLost++;
             }
@@ -490,7 +607,7 @@ public:
         nTried -= nLost;
 
         // Store positions in the new table buckets to apply later (if possible).
-        std::map<int, int> entryToBucket; // Represents which entry belonged to which bucket when serializing
+        std::vector<int> entryToBucket(nNew); // Represents which entry belonged to which bucket when serializing
 
         for (int bucket = 0; bucket < nUBuckets; bucket++) {
             int nSize = 0;
@@ -514,14 +631,13 @@ public:
         }
 
         for (int n = 0; n < nNew; n++) {
-            CAddrInfo &info = mapInfo[n];
+            CAddrInfo &info = vInfo[n];
             int bucket = entryToBucket[n];
             int nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
             if (format >= Format::V2_ASMAP && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT && vvNew[bucket][nUBucketPos] == -1 &&
                 info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS && serialized_asmap_version == supplied_asmap_version) {
                 // Bucketing has not changed, using existing bucket positions for the new table
-                vvNew[bucket][nUBucketPos] = n;
-                info.nRefCount++;
+                SetNew(bucket, nUBucketPos, n);
             } else {
                 // In case the new table data cannot be used (format unknown, bucket count wrong or new asmap),
                 // try to give them a reference based on their primary source address.
@@ -529,21 +645,17 @@ public:
                 bucket = info.GetNewBucket(nKey, m_asmap);
                 nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
                 if (vvNew[bucket][nUBucketPos] == -1) {
-                    vvNew[bucket][nUBucketPos] = n;
-                    info.nRefCount++;
+                    SetNew(bucket, nUBucketPos, n);
                 }
             }
         }
 
         // Prune new entries with refcount 0 (as a result of collisions).
         int nLostUnk = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); ) {
-            if (it->second.fInTried == false && it->second.nRefCount == 0) {
-                std::map<int, CAddrInfo>::const_iterator itCopy = it++;
-                Delete(itCopy->first);
+        for (size_t n = 0; n < vInfo.size(); n++) {
+            if (vInfo[n].fInTried == false && vInfo[n].nRefCount == 0) {
+                Delete(n);
                 nLostUnk++;
-            } else {
-                it++;
             }
         }
         if (nLost + nLostUnk > 0) {
@@ -558,23 +670,17 @@ public:
         LOCK(cs);
         std::vector<int>().swap(vRandom);
         nKey = insecure_rand.rand256();
-        for (size_t bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
-            for (size_t entry = 0; entry < ADDRMAN_BUCKET_SIZE; entry++) {
-                vvNew[bucket][entry] = -1;
-            }
-        }
-        for (size_t bucket = 0; bucket < ADDRMAN_TRIED_BUCKET_COUNT; bucket++) {
-            for (size_t entry = 0; entry < ADDRMAN_BUCKET_SIZE; entry++) {
-                vvTried[bucket][entry] = -1;
-            }
-        }
+        vvNew.Clear();
+        vvTried.Clear();
 
-        nIdCount = 0;
         nTried = 0;
         nNew = 0;
         nLastGood = 1; //Initially at 1 so that "never" is strictly worse.
-        mapInfo.clear();
+        std::vector<CAddrInfo>().swap(vInfo);
+        std::vector<int>().swap(vFreeIds);
+        std::vector<std::array<int, ADDRMAN_NEW_BUCKETS_PER_ADDRESS>>().swap(vNewPositions);
         mapAddr.clear();
+        m_tried_collisions.clear();
     }
 
     CAddrMan()
@@ -610,10 +716,12 @@ public:
     //! Add a single address.
     bool Add(const CAddress &addr, const CNetAddr& source, int64_t nTimePenalty = 0)
     {
+        // Hash the address into its bucket before taking cs, to keep the critical section short.
+        const BucketPosition new_pos = GetNewPosition(WITH_LOCK(cs, return nKey), CAddrInfo(addr, source), source);
         LOCK(cs);
         bool fRet = false;
         Check();
-        fRet |= Add_(addr, source, nTimePenalty);
+        fRet |= Add_(addr, source, nTimePenalty, new_pos);
         Check();
         if (fRet) {
             LogPrint(BCLog::ADDRMAN, "Added %s from %s: %i tried, %i new\n", addr.ToStringIPPort(), source.ToString(), nTried, nNew);
@@ -624,11 +732,18 @@ public:
     //! Add multiple addresses.
     bool Add(const std::vector<CAddress> &vAddr, const CNetAddr& source, int64_t nTimePenalty = 0)
     {
+        // Hash the addresses into their buckets before taking cs, to keep the critical section short.
+        const uint256 key = WITH_LOCK(cs, return nKey);
+        std::vector<BucketPosition> vNewPos;
+        vNewPos.reserve(vAddr.size());
+        for (const CAddress& addr : vAddr) {
+            vNewPos.push_back(GetNewPosition(key, CAddrInfo(addr, source), source));
+        }
         LOCK(cs);
         int nAdd = 0;
         Check();
-        for (std::vector<CAddress>::const_iterator it = vAddr.begin(); it != vAddr.end(); it++)
-            nAdd += Add_(*it, source, nTimePenalty) ? 1 : 0;
+        for (size_t i = 0; i < vAddr.size(); i++)
+            nAdd += Add_(vAddr[i], source, nTimePenalty, vNewPos[i]) ? 1 : 0;
         Check();
         if (nAdd) {
             LogPrint(BCLog::ADDRMAN, "Added %i addresses from %s: %i tried, %i new\n", nAdd, source.ToString(), nTried, nNew);
@@ -639,9 +754,11 @@ public:
     //! Mark an entry as accessible.
     void Good(const CService &addr, bool test_before_evict = true, int64_t nTime = GetAdjustedTime())
     {
+        // Hash the address into its bucket before taking cs, to keep the critical section short.
+        const BucketPosition tried_pos = GetTriedPosition(WITH_LOCK(cs, return nKey), CAddrInfo(CAddress(addr, NODE_NONE), CNetAddr()));
         LOCK(cs);
         Check();
-        Good_(addr, test_before_evict, nTime);
+        Good_(addr, test_before_evict, nTime, tried_pos);
         Check();
     }
 
@@ -7,6 +7,8 @@
 #include <random.h>
 #include <util/time.h>
 
+#include <atomic>
+#include <thread>
 #include <vector>
 
 /* A "source" is a source address from which we have received a bunch of other addresses. */
@@ -14,6 +16,9 @@
 static constexpr size_t NUM_SOURCES = 64;
 static constexpr size_t NUM_ADDRESSES_PER_SOURCE = 256;
 
+/* Number of sources for a large table of about 100k addresses, as kept by long-running nodes. */
+static constexpr size_t NUM_SOURCES_LARGE = 400;
+
 static std::vector<CAddress> g_sources;
 static std::vector<std::vector<CAddress>> g_addresses;
 
@@ -23,6 +28,8 @@ static void CreateAddresses()
         return;
     }
 
+    // Sources beyond NUM_SOURCES are only used by the benchmarks on large tables.
+
     FastRandomContext rng(uint256(std::vector<unsigned char>(32, 123)));
 
     auto randAddr = [&rng]() {
@@ -42,7 +49,7 @@ static void CreateAddresses()
         return ret;
     };
 
-    for (size_t source_i = 0; source_i < NUM_SOURCES; ++source_i) {
+    for (size_t source_i = 0; source_i < NUM_SOURCES_LARGE; ++source_i) {
         g_sources.emplace_back(randAddr());
         g_addresses.emplace_back();
         for (size_t addr_i = 0; addr_i < NUM_ADDRESSES_PER_SOURCE; ++addr_i) {
@@ -51,18 +58,29 @@ static void CreateAddresses()
     }
 }
 
-static void AddAddressesToAddrMan(CAddrMan& addrman)
+static void AddAddressesToAddrMan(CAddrMan& addrman, size_t num_sources = NUM_SOURCES)
 {
-    for (size_t source_i = 0; source_i < NUM_SOURCES; ++source_i) {
+    for (size_t source_i = 0; source_i < num_sources; ++source_i) {
         addrman.Add(g_addresses[source_i], g_sources[source_i]);
     }
 }
 
-static void FillAddrMan(CAddrMan& addrman)
+static void FillAddrMan(CAddrMan& addrman, size_t num_sources = NUM_SOURCES)
 {
     CreateAddresses();
 
-    AddAddressesToAddrMan(addrman);
+    AddAddressesToAddrMan(addrman, num_sources);
+}
+
+static void MarkSomeAsGood(CAddrMan& addrman, size_t num_sources = NUM_SOURCES)
+{
+    for (size_t source_i = 0; source_i < num_sources; ++source_i) {
+        for (size_t addr_i = 0; addr_i < NUM_ADDRESSES_PER_SOURCE; ++addr_i) {
+            if (addr_i % 32 == 0) {
+                addrman.Good(g_addresses[source_i][addr_i]);
+            }
+        }
+    }
 }
 
 /* Benchmarks */
@@ -117,24 +135,88 @@ static void AddrManGood(benchmark::Bench& bench)
         FillAddrMan(addrman);
     }
 
-    auto markSomeAsGood = [](CAddrMan& addrman) {
-        for (size_t source_i = 0; source_i < NUM_SOURCES; ++source_i) {
-            for (size_t addr_i = 0; addr_i < NUM_ADDRESSES_PER_SOURCE; ++addr_i) {
-                if (addr_i % 32 == 0) {
-                    addrman.Good(g_addresses[source_i][addr_i]);
-                }
-            }
-        }
-    };
+    uint64_t i = 0;
+    bench.run([&] {
+        MarkSomeAsGood(addrmans.at(i));
+        ++i;
+    });
+}
+
+/* Benchmarks on tables of about 100k addresses */
+
+static void AddrManAddLarge(benchmark::Bench& bench)
+{
+    CreateAddresses();
+
+    CAddrMan addrman;
+
+    bench.epochs(3).epochIterations(1).run([&] {
+        AddAddressesToAddrMan(addrman, NUM_SOURCES_LARGE);
+        addrman.Clear();
+    });
+}
+
+static void AddrManSelectLarge(benchmark::Bench& bench)
+{
+    CAddrMan addrman;
+
+    FillAddrMan(addrman, NUM_SOURCES_LARGE);
+    MarkSomeAsGood(addrman, NUM_SOURCES_LARGE);
+
+    bench.run([&] {
+        const auto& address = addrman.Select();
+        assert(address.GetPort() > 0);
+    });
+}
+
+static void AddrManGoodLarge(benchmark::Bench& bench)
+{
+    bench.epochs(3).epochIterations(1);
+
+    std::vector<CAddrMan> addrmans(bench.epochs() * bench.epochIterations());
+    for (auto& addrman : addrmans) {
+        FillAddrMan(addrman, NUM_SOURCES_LARGE);
+    }
 
     uint64_t i = 0;
     bench.run([&] {
-        markSomeAsGood(addrmans.at(i));
+        MarkSomeAsGood(addrmans.at(i), NUM_SOURCES_LARGE);
         ++i;
     });
 }
 
+/* Select while another thread keeps adding addresses and marking them good,
+ * which measures how long Select has to wait for the addrman lock. */
+static void AddrManSelectContended(benchmark::Bench& bench)
+{
+    CAddrMan addrman;
+
+    FillAddrMan(addrman, NUM_SOURCES_LARGE);
+
+    std::atomic<bool> stop{false};
+    std::thread writer([&] {
+        size_t source_i = 0;
+        while (!stop) {
+            addrman.Add(g_addresses[source_i], g_sources[source_i]);
+            addrman.Good(g_addresses[source_i][source_i % NUM_ADDRESSES_PER_SOURCE]);
+            source_i = (source_i + 1) % NUM_SOURCES_LARGE;
+        }
+    });
+
+    bench.run([&] {
+        const auto& address = addrman.Select();
+        assert(address.GetPort() > 0);
+    });
+
+    stop = true;
+    writer.join();
+}
+
 BENCHMARK(AddrManAdd);
 BENCHMARK(AddrManSelect);
 BENCHMARK(AddrManGetAddr);
 BENCHMARK(AddrManGood);
+BENCHMARK(AddrManAddLarge);
+BENCHMARK(AddrManSelectLarge);
+BENCHMARK(AddrManGoodLarge);
+BENCHMARK(AddrManSelectContended);
@@ -0,0 +1,60 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <blockencodings.h>
+#include <random.h>
+#include <test/util/setup_common.h>
+#include <txmempool.h>
+
+#include <vector>
+
+//! Number of transactions in the block, besides the coinbase
+static constexpr size_t BLOCK_TXS{2000};
+//! Number of transactions of the block which are missing from the mempool
+static constexpr size_t MISSING_TXS{20};
+
+/** Reconstruct a compact block from a mempool of the given size, which has most of the block's transactions */
+static void CompactBlockReconstruct(benchmark::Bench& bench, size_t mempool_txs)
+{
+    assert(mempool_txs >= BLOCK_TXS);
+    FastRandomContext det_rand{true};
+
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    CBlock block;
+    block.nBits = 0x207fffff;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    for (size_t i = 0; i < mempool_txs + MISSING_TXS; ++i) {
+        CMutableTransaction tx;
+        tx.vin.emplace_back(COutPoint(det_rand.rand256(), 0));
+        tx.vout.emplace_back(det_rand.randrange(COIN), CScript() << OP_TRUE);
+        const CTransactionRef ref = MakeTransactionRef(tx);
+        if (i < mempool_txs) {
+            LOCK2(cs_main, pool.cs);
+            pool.addUnchecked(entry.FromTx(ref));
+        }
+        const size_t stride = mempool_txs / BLOCK_TXS;
+        if ((i % stride == 0 && i / stride < BLOCK_TXS) || i >= mempool_txs) {
+            block.vtx.push_back(ref);
+        }
+    }
+    const CBlockHeaderAndShortTxIDs cmpctblock(block, true);
+    const std::vector<std::pair<uint256, CTransactionRef>> extra_txn;
+
+    bench.run([&] {
+        PartiallyDownloadedBlock partial_block(&pool);
+        const ReadStatus status = partial_block.InitData(cmpctblock, extra_txn);
+        assert(status == READ_STATUS_OK);
+    });
+}
+
+static void CompactBlockReconstructSmallMempool(benchmark::Bench& bench) { CompactBlockReconstruct(bench, 5000); }
+static void CompactBlockReconstructLargeMempool(benchmark::Bench& bench) { CompactBlockReconstruct(bench, 100000); }
+
+BENCHMARK(CompactBlockReconstructSmallMempool);
+BENCHMARK(CompactBlockReconstructLargeMempool);
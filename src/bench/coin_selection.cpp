@@ -5,6 +5,12 @@
 #include <bench/bench.h>
 #include <interfaces/chain.h>
 #include <node/context.h>
+#include <policy/feerate.h>
+#include <random.h>
+#include <test/util/mining.h>
+#include <test/util/setup_common.h>
+#include <test/util/wallet.h>
+#include <validationinterface.h>
 #include <wallet/coinselection.h>
 #include <wallet/wallet.h>
 
@@ -62,6 +68,103 @@ static void CoinSelection(benchmark::Bench& bench)
     });
 }
 
+// Coin selection in a wallet with a long transaction history, where most of
+// the transactions no longer hold any unspent outputs.
+static void CoinSelectionLargeHistory(benchmark::Bench& bench)
+{
+    TestingSetup test_setup{
+        CBaseChainParams::REGTEST,
+        /* extra_args */ {
+            "-nodebuglogfile",
+            "-nodebug",
+        },
+    };
+
+    NodeContext node;
+    auto chain = interfaces::MakeChain(node);
+    CWallet wallet(chain.get(), "", CreateMockWalletDatabase());
+    {
+        wallet.SetupLegacyScriptPubKeyMan();
+        bool first_run;
+        if (wallet.LoadWallet(first_run) != DBErrors::LOAD_OK) assert(false);
+    }
+    auto handler = chain->handleNotifications({&wallet, [](CWallet*) {}});
+
+    generatetoaddress(test_setup.m_node, ADDRESS_BCRT1_UNSPENDABLE);
+    SyncWithValidationInterfaceQueue();
+    AddTxHistory(wallet, /* num_txs */ 500000, /* unspent_interval */ 100);
+
+    LOCK(wallet.cs_wallet);
+    const CoinEligibilityFilter filter_standard(1, 6, 0);
+    const CoinSelectionParams coin_selection_params(true, 34, 148, CFeeRate(0), 0);
+    bench.run([&] {
+        std::vector<COutput> coins;
+        wallet.AvailableCoins(coins);
+        assert(coins.size() == 500000 / 100 + 1);
+
+        std::vector<OutputGroup> groups;
+        for (const COutput& output : coins) {
+            groups.emplace_back(output.GetInputCoin(), 6, false, 0, 0);
+        }
+        std::set<CInputCoin> setCoinsRet;
+        CAmount nValueRet;
+        bool bnb_used;
+        bool success = wallet.SelectCoinsMinConf(COIN, filter_standard, groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used);
+        assert(success);
+    });
+}
+
+// Coin selection from synthetic pools of single coin groups, as in a wallet
+// that collected many deposits. The groups are set up as SelectCoins passes
+// them on, with the fees for the feerates computed once for all attempts.
+static void CoinSelectionPool(benchmark::Bench& bench, size_t num_utxos, bool use_bnb)
+{
+    FastRandomContext det_rand{true};
+    CMutableTransaction tx;
+    tx.vout.resize(num_utxos);
+    for (CTxOut& txout : tx.vout) {
+        txout.nValue = 10000 + det_rand.randrange(COIN);
+    }
+    const CTransactionRef ptx = MakeTransactionRef(std::move(tx));
+    std::vector<OutputGroup> groups;
+    groups.reserve(num_utxos);
+    for (size_t i = 0; i < num_utxos; ++i) {
+        groups.emplace_back(CInputCoin(ptx, i, /* input_bytes */ 68), 6, false, 0, 0);
+    }
+    OutputGroupPool group_pool(std::move(groups));
+
+    const CoinEligibilityFilter filter_standard(1, 6, 0);
+    const CFeeRate effective_feerate(10000);
+    const CFeeRate long_term_feerate(1000);
+    const CAmount target = 10 * COIN + 12345;
+    const CAmount cost_of_change = effective_feerate.GetFee(68 + 31);
+    const CAmount not_input_fees = effective_feerate.GetFee(11 + 31);
+    // Prepare the pool for the feerates outside the measurement, as earlier attempts would
+    group_pool.GetEligibleWithFees(filter_standard, effective_feerate, long_term_feerate);
+
+    bench.unit("selection").run([&] {
+        std::set<CInputCoin> selection;
+        CAmount value_ret;
+        if (use_bnb) {
+            std::vector<OutputGroup>& utxo_pool = group_pool.GetEligibleWithFees(filter_standard, effective_feerate, long_term_feerate);
+            BnBStats stats;
+            SelectCoinsBnB(utxo_pool, target, cost_of_change, selection, value_ret, not_input_fees, &stats);
+            assert(stats.tries > 0);
+        } else {
+            const std::vector<OutputGroup>& utxo_pool = group_pool.GetEligible(filter_standard);
+            bool success = KnapsackSolver(target, utxo_pool, selection, value_ret);
+            assert(success);
+        }
+    });
+}
+
+static void CoinSelectionBnB10k(benchmark::Bench& bench) { CoinSelectionPool(bench, 10000, /* use_bnb */ true); }
+static void CoinSelectionBnB100k(benchmark::Bench& bench) { CoinSelectionPool(bench, 100000, /* use_bnb */ true); }
+static void CoinSelectionBnB1M(benchmark::Bench& bench) { CoinSelectionPool(bench, 1000000, /* use_bnb */ true); }
+static void CoinSelectionKnapsack10k(benchmark::Bench& bench) { CoinSelectionPool(bench, 10000, /* use_bnb */ false); }
+static void CoinSelectionKnapsack100k(benchmark::Bench& bench) { CoinSelectionPool(bench, 100000, /* use_bnb */ false); }
+static void CoinSelectionKnapsack1M(benchmark::Bench& bench) { CoinSelectionPool(bench, 1000000, /* use_bnb */ false); }
+
 typedef std::set<CInputCoin> CoinSet;
 static NodeContext testNode;
 static auto testChain = interfaces::MakeChain(testNode);
@@ -112,4 +215,11 @@ static void BnBExhaustion(benchmark::Bench& bench)
 }
 
 BENCHMARK(CoinSelection);
+BENCHMARK(CoinSelectionLargeHistory);
 BENCHMARK(BnBExhaustion);
+BENCHMARK(CoinSelectionBnB10k);
+BENCHMARK(CoinSelectionBnB100k);
+BENCHMARK(CoinSelectionBnB1M);
+BENCHMARK(CoinSelectionKnapsack10k);
+BENCHMARK(CoinSelectionKnapsack100k);
+BENCHMARK(CoinSelectionKnapsack1M);
@@ -89,6 +89,25 @@ static void SipHash_32b(benchmark::Bench& bench)
     });
 }
 
+static void SipHash_32b_Batch(benchmark::Bench& bench)
+{
+    constexpr size_t BATCH = 16;
+    uint256 vals[BATCH];
+    const uint256* ptrs[BATCH];
+    for (size_t i = 0; i < BATCH; ++i) {
+        ptrs[i] = &vals[i];
+        *vals[i].begin() = i;
+    }
+    uint64_t out[BATCH];
+    uint64_t k1 = 0;
+    bench.batch(BATCH).unit("hash").run([&] {
+        SipHashUint256Batch(0, ++k1, ptrs, out, BATCH);
+        for (size_t i = 0; i < BATCH; ++i) {
+            *((uint64_t*)vals[i].begin()) = out[i];
+        }
+    });
+}
+
 static void FastRandom_32bit(benchmark::Bench& bench)
 {
     FastRandomContext rng(true);
@@ -113,6 +132,7 @@ BENCHMARK(SHA3_256_1M);
 
 BENCHMARK(SHA256_32b);
 BENCHMARK(SipHash_32b);
+BENCHMARK(SipHash_32b_Batch);
 BENCHMARK(SHA256D64_1024);
 BENCHMARK(FastRandom_32bit);
 BENCHMARK(FastRandom_1bit);
@@ -0,0 +1,99 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <consensus/validation.h>
+#include <key.h>
+#include <script/interpreter.h>
+#include <script/sigcache.h>
+#include <test/util/mining.h>
+#include <test/util/setup_common.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <vector>
+
+static constexpr size_t NUM_TXS{1000};
+//! Fee paid per output, enough for the minimum relay feerate
+static constexpr CAmount FEE_PER_OUTPUT{1000};
+
+static CMutableTransaction SignedSpend(const std::vector<COutPoint>& prevouts, CAmount value_in, size_t num_outputs, const CKey& key, const CScript& script)
+{
+    CMutableTransaction tx;
+    for (const COutPoint& prevout : prevouts) {
+        tx.vin.emplace_back(prevout);
+    }
+    for (size_t i = 0; i < num_outputs; ++i) {
+        tx.vout.emplace_back(value_in / num_outputs - FEE_PER_OUTPUT, script);
+    }
+    for (size_t i = 0; i < tx.vin.size(); ++i) {
+        std::vector<unsigned char> sig;
+        const uint256 sighash = SignatureHash(script, tx, i, SIGHASH_ALL, 0, SigVersion::BASE);
+        assert(key.Sign(sighash, sig));
+        sig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[i].scriptSig = CScript() << sig;
+    }
+    return tx;
+}
+
+/** Accept NUM_TXS independent transactions with one signature each into an empty mempool */
+static void MempoolAccept(benchmark::Bench& bench, bool batch)
+{
+    TestingSetup test_setup{
+        CBaseChainParams::REGTEST,
+        /* extra_args */ {
+            "-nodebuglogfile",
+            "-nodebug",
+            "-maxsigcachesize=1",
+        },
+    };
+    CTxMemPool& pool = *test_setup.m_node.mempool;
+
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript script = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+
+    // Split a mature coinbase into one confirmed output per transaction
+    const CTxIn coinbase_in = MineBlock(test_setup.m_node, script);
+    for (int i = 0; i < COINBASE_MATURITY; ++i) {
+        MineBlock(test_setup.m_node, CScript() << OP_TRUE);
+    }
+    const CAmount coinbase_value = WITH_LOCK(cs_main, return ::ChainstateActive().CoinsTip().AccessCoin(coinbase_in.prevout).out.nValue);
+    const CTransactionRef split = MakeTransactionRef(SignedSpend({coinbase_in.prevout}, coinbase_value, NUM_TXS, key, script));
+    {
+        LOCK(cs_main);
+        TxValidationState state;
+        assert(AcceptToMemoryPool(pool, state, split, nullptr /* plTxnReplaced */, false /* bypass_limits */));
+    }
+    MineBlock(test_setup.m_node, CScript() << OP_TRUE);
+
+    std::vector<CTransactionRef> txs;
+    for (size_t i = 0; i < NUM_TXS; ++i) {
+        txs.push_back(MakeTransactionRef(SignedSpend({COutPoint(split->GetHash(), i)}, split->vout[i].nValue, 1, key, script)));
+    }
+
+    bench.run([&] {
+        // Start from cold caches, so that every signature is verified once per run.
+        InitSignatureCache();
+        InitScriptExecutionCache();
+        pool.clear();
+
+        if (batch) {
+            AcceptToMemoryPoolBatch(pool, txs, nullptr /* plTxnReplaced */);
+        } else {
+            for (const CTransactionRef& tx : txs) {
+                LOCK(cs_main);
+                TxValidationState state;
+                AcceptToMemoryPool(pool, state, tx, nullptr /* plTxnReplaced */, false /* bypass_limits */);
+            }
+        }
+        assert(pool.size() == NUM_TXS);
+    });
+}
+
+static void MempoolAcceptSerial(benchmark::Bench& bench) { MempoolAccept(bench, false); }
+static void MempoolAcceptBatch(benchmark::Bench& bench) { MempoolAccept(bench, true); }
+
+BENCHMARK(MempoolAcceptSerial);
+BENCHMARK(MempoolAcceptBatch);
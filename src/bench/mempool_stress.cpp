@@ -91,4 +91,79 @@ static void ComplexMemPool(benchmark::Bench& bench)
     });
 }
 
+/** Create chain_count chains of chain_length transactions each spending the previous one. */
+static std::vector<std::vector<CTransactionRef>> CreateChains(size_t chain_count, size_t chain_length)
+{
+    std::vector<std::vector<CTransactionRef>> chains(chain_count);
+    for (size_t c = 0; c < chain_count; ++c) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << CScriptNum(c);
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        tx.vout[0].nValue = 10 * COIN;
+        for (size_t i = 0; i < chain_length; ++i) {
+            chains[c].emplace_back(MakeTransactionRef(tx));
+            tx.vin[0] = CTxIn(COutPoint(chains[c].back()->GetHash(), 0));
+        }
+    }
+    return chains;
+}
+
+/** A long chain of CPFP-like transactions arriving one at a time. */
+static void MempoolLongChain(benchmark::Bench& bench)
+{
+    const auto chains = CreateChains(/* chain_count */ 4, /* chain_length */ 200);
+
+    TestingSetup test_setup;
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    bench.run([&]() NO_THREAD_SAFETY_ANALYSIS {
+        for (const auto& chain : chains) {
+            for (const auto& tx : chain) {
+                AddTx(tx, pool);
+            }
+        }
+        for (const auto& chain : chains) {
+            pool.removeRecursive(*chain.front(), MemPoolRemovalReason::REPLACED);
+        }
+    });
+}
+
+/**
+ * Confirm the first half of a set of chains in a block, then disconnect the block again and add
+ * its transactions back to the mempool, as done by UpdateMempoolForReorg.
+ */
+static void MempoolReorg(benchmark::Bench& bench)
+{
+    const auto chains = CreateChains(/* chain_count */ 20, /* chain_length */ 50);
+
+    std::vector<CTransactionRef> block_txs;
+    std::vector<uint256> block_hashes;
+    for (const auto& chain : chains) {
+        for (size_t i = 0; i < chain.size() / 2; ++i) {
+            block_txs.push_back(chain[i]);
+            block_hashes.push_back(chain[i]->GetHash());
+        }
+    }
+
+    TestingSetup test_setup;
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    for (const auto& chain : chains) {
+        for (const auto& tx : chain) {
+            AddTx(tx, pool);
+        }
+    }
+    bench.run([&]() NO_THREAD_SAFETY_ANALYSIS {
+        pool.removeForBlock(block_txs, 2);
+        for (const auto& tx : block_txs) {
+            AddTx(tx, pool);
+        }
+        pool.UpdateTransactionsFromBlock(block_hashes);
+    });
+}
+
 BENCHMARK(ComplexMemPool);
+BENCHMARK(MempoolLongChain);
+BENCHMARK(MempoolReorg);
@@ -0,0 +1,52 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bench/data.h>
+
+#include <chainparams.h>
+#include <net.h>
+#include <primitives/block.h>
+#include <protocol.h>
+
+#include <string.h>
+
+/** Receive a block message off the wire, in socket-sized reads, and deserialize the block */
+static void ReceiveBlockMessage(benchmark::Bench& bench)
+{
+    SelectParams(CBaseChainParams::MAIN);
+
+    CSerializedNetMsg msg;
+    msg.m_type = NetMsgType::BLOCK;
+    msg.data = benchmark::data::block413567;
+    std::vector<unsigned char> wire;
+    V1TransportSerializer().prepareForTransport(msg, wire);
+    wire.insert(wire.end(), msg.data.begin(), msg.data.end());
+
+    V1TransportDeserializer deserializer(Params(), 0, SER_NETWORK, PROTOCOL_VERSION);
+    bench.unit("block").run([&] {
+        size_t pos = 0;
+        while (pos < wire.size()) {
+            const Span<char> buf = deserializer.GetReadBuffer();
+            const size_t n = std::min(buf.size(), wire.size() - pos);
+            memcpy(buf.data(), wire.data() + pos, n);
+            size_t parsed = 0;
+            while (parsed < n) {
+                const int handled = deserializer.ReadFromBuffer(n - parsed);
+                assert(handled >= 0);
+                parsed += handled;
+            }
+            pos += n;
+        }
+        assert(deserializer.Complete());
+        uint32_t out_err_raw_size{0};
+        Optional<CNetMessage> received{deserializer.GetMessage(std::chrono::microseconds{0}, out_err_raw_size)};
+        assert(received);
+        CBlock block;
+        received->m_recv >> block;
+        assert(received->m_recv.empty());
+    });
+}
+
+BENCHMARK(ReceiveBlockMessage);
@@ -0,0 +1,59 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <random.h>
+#include <txannounce.h>
+#include <txmempool.h>
+
+#include <vector>
+
+static constexpr int NUM_PEERS = 1000;
+static constexpr int NUM_MEMPOOL_TXS = 5000;
+static constexpr int TXS_PER_TRICKLE = 35;
+static constexpr size_t ANNOUNCE_MAX = 35;
+
+/** Announce a batch of new transactions to many peers, as done once per trickle interval */
+static void TxAnnounceManyPeers(benchmark::Bench& bench)
+{
+    FastRandomContext det_rand{true};
+    CTxMemPool pool;
+    std::vector<uint256> txids;
+    {
+        LOCK2(cs_main, pool.cs);
+        for (int i = 0; i < NUM_MEMPOOL_TXS; ++i) {
+            CMutableTransaction tx;
+            tx.vin.emplace_back(COutPoint(det_rand.rand256(), 0));
+            tx.vout.emplace_back(i, CScript() << OP_TRUE);
+            const CTransactionRef ref = MakeTransactionRef(tx);
+            LockPoints lp;
+            pool.addUnchecked(CTxMemPoolEntry(ref, det_rand.randrange(100000), 0, 1, false, 4, lp));
+            txids.push_back(ref->GetHash());
+        }
+    }
+
+    TxAnnouncementQueue queue;
+    for (NodeId peer = 0; peer < NUM_PEERS; ++peer) {
+        queue.AddPeer(peer);
+    }
+
+    size_t next_tx = 0;
+    uint64_t announced = 0;
+    bench.unit("trickle").run([&] {
+        for (int i = 0; i < TXS_PER_TRICKLE; ++i) {
+            queue.Push(txids[next_tx]);
+            next_tx = (next_tx + 1) % txids.size();
+        }
+        queue.Seal(pool);
+        for (NodeId peer = 0; peer < NUM_PEERS; ++peer) {
+            queue.Announce(peer, pool, ANNOUNCE_MAX, [&](const TxMempoolInfo& info) {
+                ++announced;
+                return true;
+            });
+        }
+    });
+    assert(announced > 0);
+}
+
+BENCHMARK(TxAnnounceManyPeers);
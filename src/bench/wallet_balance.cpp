@@ -53,12 +53,50 @@ static void WalletBalance(benchmark::Bench& bench, const bool set_dirty, const b
     });
 }
 
+/** Balance of a wallet with a long transaction history, most of it spent */
+static void WalletBalanceLargeHistory(benchmark::Bench& bench, const bool set_dirty)
+{
+    TestingSetup test_setup{
+        CBaseChainParams::REGTEST,
+        /* extra_args */ {
+            "-nodebuglogfile",
+            "-nodebug",
+        },
+    };
+
+    NodeContext node;
+    std::unique_ptr<interfaces::Chain> chain = interfaces::MakeChain(node);
+    CWallet wallet{chain.get(), "", CreateMockWalletDatabase()};
+    {
+        wallet.SetupLegacyScriptPubKeyMan();
+        bool first_run;
+        if (wallet.LoadWallet(first_run) != DBErrors::LOAD_OK) assert(false);
+    }
+    auto handler = chain->handleNotifications({&wallet, [](CWallet*) {}});
+
+    generatetoaddress(test_setup.m_node, ADDRESS_BCRT1_UNSPENDABLE);
+    SyncWithValidationInterfaceQueue();
+    const CAmount expected = AddTxHistory(wallet, /* num_txs */ 500000, /* unspent_interval */ 100);
+
+    auto bal = wallet.GetBalance(); // Cache
+
+    bench.run([&] {
+        if (set_dirty) wallet.MarkDirty();
+        bal = wallet.GetBalance();
+        assert(bal.m_mine_trusted == expected);
+    });
+}
+
 static void WalletBalanceDirty(benchmark::Bench& bench) { WalletBalance(bench, /* set_dirty */ true, /* add_watchonly */ true, /* add_mine */ true); }
 static void WalletBalanceClean(benchmark::Bench& bench) { WalletBalance(bench, /* set_dirty */ false, /* add_watchonly */ true, /* add_mine */ true); }
 static void WalletBalanceMine(benchmark::Bench& bench) { WalletBalance(bench, /* set_dirty */ false, /* add_watchonly */ false, /* add_mine */ true); }
 static void WalletBalanceWatch(benchmark::Bench& bench) { WalletBalance(bench, /* set_dirty */ false, /* add_watchonly */ true, /* add_mine */ false); }
+static void WalletBalanceLargeDirty(benchmark::Bench& bench) { WalletBalanceLargeHistory(bench, /* set_dirty */ true); }
+static void WalletBalanceLargeClean(benchmark::Bench& bench) { WalletBalanceLargeHistory(bench, /* set_dirty */ false); }
 
 BENCHMARK(WalletBalanceDirty);
 BENCHMARK(WalletBalanceClean);
 BENCHMARK(WalletBalanceMine);
 BENCHMARK(WalletBalanceWatch);
+BENCHMARK(WalletBalanceLargeDirty);
+BENCHMARK(WalletBalanceLargeClean);
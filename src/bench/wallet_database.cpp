@@ -0,0 +1,61 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
+#include <bench/bench.h>
+#include <optional.h>
+#include <test/util/setup_common.h>
+#include <util/system.h>
+#include <util/translation.h>
+#include <wallet/db.h>
+#include <wallet/walletdb.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+static constexpr int NUM_RECORDS = 100;
+
+/** Write records to a wallet database on disk, as a bulk operation such as a rescan or import would */
+static void WalletDatabaseWrite(benchmark::Bench& bench, DatabaseFormat format, bool write_group)
+{
+    TestingSetup test_setup{
+        CBaseChainParams::REGTEST,
+        /* extra_args */ {
+            "-nodebuglogfile",
+            "-nodebug",
+        },
+    };
+
+    DatabaseOptions options;
+    options.require_create = true;
+    options.require_format = format;
+    DatabaseStatus status;
+    bilingual_str error;
+    std::unique_ptr<WalletDatabase> database = MakeDatabase(GetDataDir() / "bench_wallet", options, status, error);
+    assert(database);
+
+    const std::vector<unsigned char> value(200, 0x42);
+    int key = 0;
+    bench.batch(NUM_RECORDS).unit("record").run([&] {
+        Optional<WalletWriteGroup> group;
+        if (write_group) group.emplace(*database);
+        std::unique_ptr<DatabaseBatch> batch = database->MakeBatch();
+        for (int i = 0; i < NUM_RECORDS; ++i) {
+            if (!batch->Write(std::make_pair(std::string("bench"), key++), value)) assert(false);
+        }
+    });
+}
+
+static void WalletDatabaseWriteBDB(benchmark::Bench& bench) { WalletDatabaseWrite(bench, DatabaseFormat::BERKELEY, /* write_group */ false); }
+BENCHMARK(WalletDatabaseWriteBDB);
+#ifdef USE_SQLITE
+static void WalletDatabaseWriteSQLite(benchmark::Bench& bench) { WalletDatabaseWrite(bench, DatabaseFormat::SQLITE, /* write_group */ false); }
+static void WalletDatabaseWriteSQLiteWriteGroup(benchmark::Bench& bench) { WalletDatabaseWrite(bench, DatabaseFormat::SQLITE, /* write_group */ true); }
+BENCHMARK(WalletDatabaseWriteSQLite);
+BENCHMARK(WalletDatabaseWriteSQLiteWriteGroup);
+#endif
@@ -0,0 +1,62 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <interfaces/chain.h>
+#include <node/context.h>
+#include <random.h>
+#include <script/standard.h>
+#include <test/util/setup_common.h>
+#include <wallet/wallet.h>
+
+#include <vector>
+
+static constexpr int NUM_SCRIPTS = 1000;
+
+/** IsMine for outputs paying to others, as seen for nearly every output in a block */
+static void WalletIsMine(benchmark::Bench& bench, const bool descriptors)
+{
+    TestingSetup test_setup{
+        CBaseChainParams::REGTEST,
+        /* extra_args */ {
+            "-nodebuglogfile",
+            "-nodebug",
+        },
+    };
+
+    NodeContext node;
+    std::unique_ptr<interfaces::Chain> chain = interfaces::MakeChain(node);
+    CWallet wallet{chain.get(), "", CreateMockWalletDatabase()};
+    {
+        if (!descriptors) wallet.SetupLegacyScriptPubKeyMan();
+        bool first_run;
+        if (wallet.LoadWallet(first_run) != DBErrors::LOAD_OK) assert(false);
+        LOCK(wallet.cs_wallet);
+        if (descriptors) {
+            wallet.SetWalletFlag(WALLET_FLAG_DESCRIPTORS);
+            wallet.SetupDescriptorScriptPubKeyMans();
+        } else {
+            if (!wallet.GetLegacyScriptPubKeyMan()->SetupGeneration()) assert(false);
+        }
+    }
+
+    FastRandomContext det_rand{true};
+    std::vector<CScript> scripts;
+    for (int i = 0; i < NUM_SCRIPTS; ++i) {
+        scripts.push_back(GetScriptForDestination(WitnessV0KeyHash(uint160{det_rand.randbytes(20)})));
+    }
+
+    LOCK(wallet.cs_wallet);
+    bench.batch(NUM_SCRIPTS).unit("script").run([&] {
+        for (const CScript& script : scripts) {
+            assert(wallet.IsMine(script) == ISMINE_NO);
+        }
+    });
+}
+
+static void WalletIsMineDescriptors(benchmark::Bench& bench) { WalletIsMine(bench, /* descriptors */ true); }
+static void WalletIsMineLegacy(benchmark::Bench& bench) { WalletIsMine(bench, /* descriptors */ false); }
+
+BENCHMARK(WalletIsMineDescriptors);
+BENCHMARK(WalletIsMineLegacy);
@@ -0,0 +1,96 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <interfaces/chain.h>
+#include <node/context.h>
+#include <optional.h>
+#include <rpc/request.h>
+#include <rpc/server.h>
+#include <test/util/mining.h>
+#include <test/util/setup_common.h>
+#include <test/util/wallet.h>
+#include <univalue.h>
+#include <util/ref.h>
+#include <validationinterface.h>
+#include <wallet/rpcwallet.h>
+#include <wallet/wallet.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+static constexpr int NUM_TXS = 100000;
+
+static const CRPCCommand& FindWalletCommand(const std::string& name)
+{
+    for (const CRPCCommand& command : GetWalletRPCCommands()) {
+        if (command.name == name) return command;
+    }
+    assert(false);
+}
+
+/** Call a wallet RPC on a wallet with a long transaction history, all of it confirmed in the tip */
+static void WalletListCommand(benchmark::Bench& bench, const std::string& name, const std::function<UniValue(const CWallet&)>& params, size_t num_txs)
+{
+    TestingSetup test_setup{
+        CBaseChainParams::REGTEST,
+        /* extra_args */ {
+            "-nodebuglogfile",
+            "-nodebug",
+        },
+    };
+
+    NodeContext node;
+    std::unique_ptr<interfaces::Chain> chain = interfaces::MakeChain(node);
+    const std::shared_ptr<CWallet> wallet = std::make_shared<CWallet>(chain.get(), "", CreateMockWalletDatabase());
+    {
+        wallet->SetupLegacyScriptPubKeyMan();
+        bool first_run;
+        if (wallet->LoadWallet(first_run) != DBErrors::LOAD_OK) assert(false);
+    }
+    auto handler = chain->handleNotifications({wallet.get(), [](CWallet*) {}});
+
+    generatetoaddress(test_setup.m_node, ADDRESS_BCRT1_UNSPENDABLE);
+    SyncWithValidationInterfaceQueue();
+    AddTxHistory(*wallet, NUM_TXS, /* unspent_interval */ 100);
+    AddWallet(wallet);
+
+    const CRPCCommand& command = FindWalletCommand(name);
+    util::Ref context;
+    JSONRPCRequest request(context);
+    request.params = params(*wallet);
+    bench.run([&] {
+        UniValue result;
+        if (!command.actor(request, result, /* last_handler */ true)) assert(false);
+        assert((result.isArray() ? result : result["transactions"]).size() == num_txs);
+    });
+
+    RemoveWallet(wallet, nullopt);
+}
+
+// A page of ten entries far back in the history, as when paging through it
+static void WalletListTransactionsDeepPage(benchmark::Bench& bench)
+{
+    WalletListCommand(bench, "listtransactions", [](const CWallet&) {
+        UniValue params(UniValue::VARR);
+        params.push_back("*");
+        params.push_back(10);
+        params.push_back(2 * NUM_TXS);
+        return params;
+    }, /* num_txs */ 10);
+}
+
+// The transactions since the tip, as when polling for new ones
+static void WalletListSinceBlockTip(benchmark::Bench& bench)
+{
+    WalletListCommand(bench, "listsinceblock", [](const CWallet& wallet) {
+        UniValue params(UniValue::VARR);
+        params.push_back(WITH_LOCK(wallet.cs_wallet, return wallet.GetLastBlockHash().GetHex()));
+        return params;
+    }, /* num_txs */ 0);
+}
+
+BENCHMARK(WalletListTransactionsDeepPage);
+BENCHMARK(WalletListSinceBlockTip);
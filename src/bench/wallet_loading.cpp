@@ -0,0 +1,89 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
+#include <bench/bench.h>
+#include <core_memusage.h>
+#include <interfaces/chain.h>
+#include <memusage.h>
+#include <node/context.h>
+#include <test/util/setup_common.h>
+#include <util/system.h>
+#include <util/translation.h>
+#include <wallet/db.h>
+#include <wallet/wallet.h>
+#include <wallet/walletdb.h>
+
+#include <iostream>
+#include <memory>
+
+static constexpr int NUM_TXS = 1000000;
+//! Number of transactions written in each database transaction while setting up
+static constexpr int WRITE_BATCH_SIZE = 10000;
+
+/** Load a wallet with a long transaction history from disk, as at startup */
+static void WalletLoadTransactions(benchmark::Bench& bench, DatabaseFormat format)
+{
+    TestingSetup test_setup{
+        CBaseChainParams::REGTEST,
+        /* extra_args */ {
+            "-nodebuglogfile",
+            "-nodebug",
+        },
+    };
+
+    NodeContext node;
+    std::unique_ptr<interfaces::Chain> chain = interfaces::MakeChain(node);
+    const fs::path path = GetDataDir() / "bench_wallet";
+    DatabaseOptions options;
+    options.require_create = true;
+    options.require_format = format;
+    DatabaseStatus status;
+    bilingual_str error;
+    {
+        CWallet wallet{chain.get(), "", MakeDatabase(path, options, status, error)};
+        WalletBatch batch(wallet.GetDatabase());
+        const CScript script = CScript() << OP_TRUE;
+        COutPoint prevout{uint256S("01"), 0};
+        for (int i = 0; i < NUM_TXS; ++i) {
+            if (i % WRITE_BATCH_SIZE == 0 && !batch.TxnBegin()) assert(false);
+            CMutableTransaction mtx;
+            mtx.vin.emplace_back(prevout);
+            mtx.vout.emplace_back(COIN, script);
+            mtx.vout.emplace_back(COIN / 100, script);
+            CWalletTx wtx(&wallet, MakeTransactionRef(std::move(mtx)));
+            wtx.nOrderPos = i;
+            if (!batch.WriteTx(wtx)) assert(false);
+            prevout = COutPoint(wtx.GetHash(), 0);
+            if ((i + 1) % WRITE_BATCH_SIZE == 0 && !batch.TxnCommit()) assert(false);
+        }
+    }
+
+    options.require_create = false;
+    options.require_existing = true;
+    size_t wallet_usage = 0;
+    bench.epochs(3).epochIterations(1).batch(NUM_TXS).unit("tx").run([&] {
+        CWallet wallet{chain.get(), "", MakeDatabase(path, options, status, error)};
+        bool first_run;
+        if (wallet.LoadWallet(first_run) != DBErrors::LOAD_OK) assert(false);
+        LOCK(wallet.cs_wallet);
+        assert(wallet.mapWallet.size() == NUM_TXS);
+        wallet_usage = memusage::DynamicUsage(wallet.mapWallet);
+        for (const auto& entry : wallet.mapWallet) {
+            wallet_usage += RecursiveDynamicUsage(entry.second.tx);
+        }
+    });
+    // Report the memory held by the loaded transactions next to the timings.
+    std::cout << bench.name() << ": mapWallet uses " << wallet_usage / (1024 * 1024) << " MiB for " << NUM_TXS << " transactions" << std::endl;
+}
+
+static void WalletLoadTransactionsBDB(benchmark::Bench& bench) { WalletLoadTransactions(bench, DatabaseFormat::BERKELEY); }
+BENCHMARK(WalletLoadTransactionsBDB);
+#ifdef USE_SQLITE
+static void WalletLoadTransactionsSQLite(benchmark::Bench& bench) { WalletLoadTransactions(bench, DatabaseFormat::SQLITE); }
+BENCHMARK(WalletLoadTransactionsSQLite);
+#endif
@@ -0,0 +1,77 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <blockfilter.h>
+#include <index/blockfilterindex.h>
+#include <interfaces/chain.h>
+#include <node/context.h>
+#include <test/util/mining.h>
+#include <test/util/setup_common.h>
+#include <test/util/wallet.h>
+#include <util/time.h>
+#include <validationinterface.h>
+#include <wallet/wallet.h>
+
+#include <chrono>
+
+static constexpr int NUM_BLOCKS = 1000;
+static constexpr int BLOCKS_PER_WALLET_BLOCK = 50;
+
+static void WalletRescan(benchmark::Bench& bench, const bool use_filter_index)
+{
+    TestingSetup test_setup{
+        CBaseChainParams::REGTEST,
+        /* extra_args */ {
+            "-nodebuglogfile",
+            "-nodebug",
+        },
+    };
+
+    NodeContext node;
+    std::unique_ptr<interfaces::Chain> chain = interfaces::MakeChain(node);
+    CWallet wallet{chain.get(), "", CreateMockWalletDatabase()};
+    {
+        bool first_run;
+        if (wallet.LoadWallet(first_run) != DBErrors::LOAD_OK) assert(false);
+        LOCK(wallet.cs_wallet);
+        wallet.SetWalletFlag(WALLET_FLAG_DESCRIPTORS);
+        wallet.SetupDescriptorScriptPubKeyMans();
+    }
+    auto handler = chain->handleNotifications({&wallet, [](CWallet*) {}});
+
+    // Only a few blocks pay to the wallet, as when restoring a wallet that was used occasionally.
+    const std::string address_mine = getnewaddress(wallet);
+    for (int i = 1; i <= NUM_BLOCKS; ++i) {
+        generatetoaddress(test_setup.m_node, i % BLOCKS_PER_WALLET_BLOCK == 0 ? address_mine : ADDRESS_BCRT1_UNSPENDABLE);
+    }
+    SyncWithValidationInterfaceQueue();
+
+    if (use_filter_index) {
+        InitBlockFilterIndex(BlockFilterType::BASIC, /* n_cache_size */ 1 << 20, /* f_memory */ true);
+        BlockFilterIndex& filter_index = *GetBlockFilterIndex(BlockFilterType::BASIC);
+        filter_index.Start();
+        while (!filter_index.BlockUntilSyncedToCurrentChain()) {
+            UninterruptibleSleep(std::chrono::milliseconds{10});
+        }
+    }
+
+    const uint256 genesis_hash = chain->getBlockHash(0);
+    bench.run([&] {
+        WalletRescanReserver reserver(wallet);
+        assert(reserver.reserve());
+        const CWallet::ScanResult result = wallet.ScanForWalletTransactions(genesis_hash, 0, /* max_height */ {}, reserver, /* fUpdate */ true);
+        assert(result.status == CWallet::ScanResult::SUCCESS);
+        assert(result.last_scanned_height == NUM_BLOCKS);
+    });
+    assert(WITH_LOCK(wallet.cs_wallet, return wallet.mapWallet.size()) == NUM_BLOCKS / BLOCKS_PER_WALLET_BLOCK);
+
+    DestroyAllBlockFilterIndexes();
+}
+
+static void WalletRescanBlocks(benchmark::Bench& bench) { WalletRescan(bench, /* use_filter_index */ false); }
+static void WalletRescanFilterIndex(benchmark::Bench& bench) { WalletRescan(bench, /* use_filter_index */ true); }
+
+BENCHMARK(WalletRescanBlocks);
+BENCHMARK(WalletRescanFilterIndex);
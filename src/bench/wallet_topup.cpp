@@ -0,0 +1,58 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <interfaces/chain.h>
+#include <key.h>
+#include <key_io.h>
+#include <node/context.h>
+#include <script/descriptor.h>
+#include <test/util/setup_common.h>
+#include <wallet/scriptpubkeyman.h>
+#include <wallet/wallet.h>
+
+#include <string>
+#include <vector>
+
+static constexpr unsigned int NUM_KEYS = 10000;
+
+/** Top up a fresh ranged wpkh() xpub descriptor, as when importing it with a large keypool */
+static void WalletTopUpDescriptor(benchmark::Bench& bench)
+{
+    TestingSetup test_setup{
+        CBaseChainParams::REGTEST,
+        /* extra_args */ {
+            "-nodebuglogfile",
+            "-nodebug",
+        },
+    };
+
+    NodeContext node;
+    std::unique_ptr<interfaces::Chain> chain = interfaces::MakeChain(node);
+    CWallet wallet{chain.get(), "", CreateMockWalletDatabase()};
+    {
+        bool first_run;
+        if (wallet.LoadWallet(first_run) != DBErrors::LOAD_OK) assert(false);
+        LOCK(wallet.cs_wallet);
+        wallet.SetWalletFlag(WALLET_FLAG_DESCRIPTORS);
+        wallet.SetWalletFlag(WALLET_FLAG_DISABLE_PRIVATE_KEYS);
+    }
+
+    CExtKey master_key;
+    const std::vector<unsigned char> seed(32, 0x42);
+    master_key.SetSeed(seed.data(), seed.size());
+    const std::string desc_str = "wpkh(" + EncodeExtPubKey(master_key.Neuter()) + "/0/*)";
+
+    bench.batch(NUM_KEYS).unit("key").run([&] {
+        FlatSigningProvider keys;
+        std::string error;
+        std::shared_ptr<Descriptor> desc = Parse(desc_str, keys, error);
+        assert(desc);
+        WalletDescriptor w_desc(desc, 0, 0, 0, 0);
+        DescriptorScriptPubKeyMan spk_man(wallet, w_desc);
+        if (!spk_man.TopUp(NUM_KEYS)) assert(false);
+    });
+}
+
+BENCHMARK(WalletTopUpDescriptor);
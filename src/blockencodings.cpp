@@ -14,7 +14,8 @@
 #include <validation.h>
 #include <util/system.h>
 
-#include <unordered_map>
+#include <algorithm>
+#include <limits>
 
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())),
@@ -44,6 +45,92 @@ uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const {
     return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
 }
 
+void CBlockHeaderAndShortTxIDs::GetShortIDs(const uint256* const* txhashes, uint64_t* out, size_t n) const {
+    static_assert(SHORTTXIDS_LENGTH == 6, "shorttxids calculation assumes 6-byte shorttxids");
+    SipHashUint256Batch(shorttxidk0, shorttxidk1, txhashes, out, n);
+    for (size_t i = 0; i < n; i++) {
+        out[i] &= 0xffffffffffffL;
+    }
+}
+
+namespace {
+
+//! Marks an empty slot of the short ID index (short IDs only have 48 bits).
+static constexpr uint64_t EMPTY_SLOT = std::numeric_limits<uint64_t>::max();
+//! Maximum distance of a short ID from its home slot. With the table at most a quarter full,
+//! well-formed compact blocks essentially never exceed it, while short IDs chosen to collide
+//! cannot make lookups slow.
+static constexpr size_t MAX_PROBES = 64;
+
+/**
+ * Map from the short IDs of a compact block to the positions of the transactions in the block,
+ * which every mempool transaction is looked up in. As most mempool transactions are not in the
+ * block, a bit filter small enough to stay in L1 cache rejects most lookups before the table is
+ * touched. The table itself is a flat array with linear probing. Short IDs are SipHash outputs,
+ * so their bits are used as the hash directly.
+ */
+class ShortIDIndex
+{
+private:
+    std::vector<uint64_t> m_shortids;
+    std::vector<uint16_t> m_positions;
+    size_t m_slot_mask;
+    std::vector<uint64_t> m_filter;
+    size_t m_filter_mask;
+
+    size_t FilterBit(uint64_t shortid) const { return (shortid >> 24) & m_filter_mask; }
+
+public:
+    explicit ShortIDIndex(size_t count)
+    {
+        size_t slots = 1;
+        while (slots < count * 4) slots <<= 1;
+        m_shortids.assign(slots, EMPTY_SLOT);
+        m_positions.resize(slots);
+        m_slot_mask = slots - 1;
+
+        // At least 8 filter bits per short ID
+        size_t filter_bits = 64;
+        while (filter_bits < count * 8) filter_bits <<= 1;
+        m_filter.assign(filter_bits / 64, 0);
+        m_filter_mask = filter_bits - 1;
+    }
+
+    //! Returns false for a duplicate short ID, or one too far from its home slot.
+    bool Insert(uint64_t shortid, uint16_t position)
+    {
+        for (size_t probe = 0; probe < MAX_PROBES; probe++) {
+            const size_t slot = (shortid + probe) & m_slot_mask;
+            if (m_shortids[slot] == shortid) return false;
+            if (m_shortids[slot] == EMPTY_SLOT) {
+                m_shortids[slot] = shortid;
+                m_positions[slot] = position;
+                const size_t bit = FilterBit(shortid);
+                m_filter[bit / 64] |= uint64_t{1} << (bit % 64);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Find(uint64_t shortid, uint16_t& position) const
+    {
+        const size_t bit = FilterBit(shortid);
+        if (!((m_filter[bit / 64] >> (bit % 64)) & 1)) return false;
+        for (size_t probe = 0; probe < MAX_PROBES; probe++) {
+            const size_t slot = (shortid + probe) & m_slot_mask;
+            if (m_shortids[slot] == shortid) {
+                position = m_positions[slot];
+                return true;
+            }
+            if (m_shortids[slot] == EMPTY_SLOT) break;
+        }
+        return false;
+    }
+};
+
+} // namespace
+
 
 
 ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn) {
@@ -78,47 +165,45 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     // Because well-formed cmpctblock messages will have a (relatively) uniform distribution
     // of short IDs, any highly-uneven distribution of elements can be safely treated as a
     // READ_STATUS_FAILED.
-    std::unordered_map<uint64_t, uint16_t> shorttxids(cmpctblock.shorttxids.size());
+    ShortIDIndex shorttxids(cmpctblock.shorttxids.size());
     uint16_t index_offset = 0;
     for (size_t i = 0; i < cmpctblock.shorttxids.size(); i++) {
         while (txn_available[i + index_offset])
             index_offset++;
-        shorttxids[cmpctblock.shorttxids[i]] = i + index_offset;
-        // To determine the chance that the number of entries in a bucket exceeds N,
-        // we use the fact that the number of elements in a single bucket is
-        // binomially distributed (with n = the number of shorttxids S, and p =
-        // 1 / the number of buckets), that in the worst case the number of buckets is
-        // equal to S (due to std::unordered_map having a default load factor of 1.0),
-        // and that the chance for any bucket to exceed N elements is at most
-        // buckets * (the chance that any given bucket is above N elements).
-        // Thus: P(max_elements_per_bucket > N) <= S * (1 - cdf(binomial(n=S,p=1/S), N)).
-        // If we assume blocks of up to 16000, allowing 12 elements per bucket should
-        // only fail once per ~1 million block transfers (per peer and connection).
-        if (shorttxids.bucket_size(shorttxids.bucket(cmpctblock.shorttxids[i])) > 12)
-            return READ_STATUS_FAILED;
+        // TODO: in the shortid-collision case, we should instead request both transactions
+        // which collided. Falling back to full-block-request here is overkill.
+        if (!shorttxids.Insert(cmpctblock.shorttxids[i], i + index_offset))
+            return READ_STATUS_FAILED; // Short ID collision or uneven distribution
     }
-    // TODO: in the shortid-collision case, we should instead request both transactions
-    // which collided. Falling back to full-block-request here is overkill.
-    if (shorttxids.size() != cmpctblock.shorttxids.size())
-        return READ_STATUS_FAILED; // Short ID collision
 
     std::vector<bool> have_txn(txn_available.size());
+    uint16_t idx;
     {
     LOCK(pool->cs);
+    static constexpr size_t SHORTID_BATCH = 16;
+    const uint256* batch_hashes[SHORTID_BATCH];
+    uint64_t batch_shortids[SHORTID_BATCH];
     for (size_t i = 0; i < pool->vTxHashes.size(); i++) {
-        uint64_t shortid = cmpctblock.GetShortID(pool->vTxHashes[i].first);
-        std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
-        if (idit != shorttxids.end()) {
-            if (!have_txn[idit->second]) {
-                txn_available[idit->second] = pool->vTxHashes[i].second->GetSharedTx();
-                have_txn[idit->second]  = true;
+        if (i % SHORTID_BATCH == 0) {
+            // Compute the short IDs of the next transactions at once
+            const size_t count = std::min(SHORTID_BATCH, pool->vTxHashes.size() - i);
+            for (size_t j = 0; j < count; j++) {
+                batch_hashes[j] = &pool->vTxHashes[i + j].first;
+            }
+            cmpctblock.GetShortIDs(batch_hashes, batch_shortids, count);
+        }
+        uint64_t shortid = batch_shortids[i % SHORTID_BATCH];
+        if (shorttxids.Find(shortid, idx)) {
+            if (!have_txn[idx]) {
+                txn_available[idx] = pool->vTxHashes[i].second->GetSharedTx();
+                have_txn[idx]  = true;
                 mempool_count++;
             } else {
                 // If we find two mempool txn that match the short id, just request it.
                 // This should be rare enough that the extra bandwidth doesn't matter,
                 // but eating a round-trip due to FillBlock failure would be annoying
-                if (txn_available[idit->second]) {
-                    txn_available[idit->second].reset();
+                if (txn_available[idx]) {
+                    txn_available[idx].reset();
                     mempool_count--;
                 }
             }
@@ -126,18 +211,17 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
         // Though ideally we'd continue scanning for the two-txn-match-shortid case,
         // the performance win of an early exit here is too good to pass up and worth
         // the extra risk.
-        if (mempool_count == shorttxids.size())
+        if (mempool_count == cmpctblock.shorttxids.size())
             break;
     }
     }
 
     for (size_t i = 0; i < extra_txn.size(); i++) {
         uint64_t shortid = cmpctblock.GetShortID(extra_txn[i].first);
-        std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
-        if (idit != shorttxids.end()) {
-            if (!have_txn[idit->second]) {
-                txn_available[idit->second] = extra_txn[i].second;
-                have_txn[idit->second]  = true;
+        if (shorttxids.Find(shortid, idx)) {
+            if (!have_txn[idx]) {
+                txn_available[idx] = extra_txn[i].second;
+                have_txn[idx]  = true;
                 mempool_count++;
                 extra_count++;
             } else {
@@ -147,9 +231,9 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
                 // but eating a round-trip due to FillBlock failure would be annoying
                 // Note that we don't want duplication between extra_txn and mempool to
                 // trigger this case, so we compare witness hashes first
-                if (txn_available[idit->second] &&
-                        txn_available[idit->second]->GetWitnessHash() != extra_txn[i].second->GetWitnessHash()) {
-                    txn_available[idit->second].reset();
+                if (txn_available[idx] &&
+                        txn_available[idx]->GetWitnessHash() != extra_txn[i].second->GetWitnessHash()) {
+                    txn_available[idx].reset();
                     mempool_count--;
                     extra_count--;
                 }
@@ -158,7 +242,7 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
         // Though ideally we'd continue scanning for the two-txn-match-shortid case,
         // the performance win of an early exit here is too good to pass up and worth
         // the extra risk.
-        if (mempool_count == shorttxids.size())
+        if (mempool_count == cmpctblock.shorttxids.size())
             break;
     }
 
@@ -107,6 +107,8 @@ public:
     CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID);
 
     uint64_t GetShortID(const uint256& txhash) const;
+    //! Compute the short IDs of n transaction hashes at once
+    void GetShortIDs(const uint256* const* txhashes, uint64_t* out, size_t n) const;
 
     size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
 
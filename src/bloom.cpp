@@ -5,6 +5,7 @@
 #include <bloom.h>
 
 #include <primitives/transaction.h>
+#include <crypto/siphash.h>
 #include <hash.h>
 #include <script/script.h>
 #include <script/standard.h>
@@ -15,6 +16,7 @@
 #include <stdlib.h>
 
 #include <algorithm>
+#include <limits>
 
 #define LN2SQUARED 0.4804530139182014246671025263266649717305529515945455
 #define LN2 0.6931471805599453094172321214581765680755001343602552
@@ -274,3 +276,49 @@ void CRollingBloomFilter::reset()
     nGeneration = 1;
     std::fill(data.begin(), data.end(), 0);
 }
+
+CSaltedBloomFilter::CSaltedBloomFilter(const unsigned int nElements, const double nFPRate)
+{
+    const double logFpRate = log(nFPRate);
+    /* The usual sizing for a bloom filter, with between 1 and 16 hash functions. */
+    m_hash_funcs = std::max(1, std::min((int)round(logFpRate / log(0.5)), 16));
+    const double nFilterBits = ceil(-1.0 / LN2SQUARED * std::max(nElements, 1U) * logFpRate);
+    m_blocks = std::max<uint32_t>(1, (uint32_t)std::min(ceil(nFilterBits / 512), (double)std::numeric_limits<uint32_t>::max()));
+    m_data.resize(size_t{m_blocks} * 8);
+    reset();
+}
+
+/* The low 32 bits of the hash pick the block, the high 32 bits the positions in it. */
+void CSaltedBloomFilter::insert(Span<const unsigned char> vKey)
+{
+    const uint64_t hash = CSipHasher(m_k0, m_k1).Write(vKey.data(), vKey.size()).Finalize();
+    uint64_t* const block = &m_data[size_t{FastMod((uint32_t)hash, m_blocks)} * 8];
+    const uint32_t h1 = (hash >> 32) & 0xFFFF;
+    const uint32_t h2 = (hash >> 48) | 1;
+    for (int n = 0; n < m_hash_funcs; n++) {
+        const uint32_t pos = (h1 + n * h2) & 0x1FF;
+        block[pos >> 6] |= ((uint64_t)1) << (pos & 0x3F);
+    }
+}
+
+bool CSaltedBloomFilter::contains(Span<const unsigned char> vKey) const
+{
+    const uint64_t hash = CSipHasher(m_k0, m_k1).Write(vKey.data(), vKey.size()).Finalize();
+    const uint64_t* const block = &m_data[size_t{FastMod((uint32_t)hash, m_blocks)} * 8];
+    const uint32_t h1 = (hash >> 32) & 0xFFFF;
+    const uint32_t h2 = (hash >> 48) | 1;
+    for (int n = 0; n < m_hash_funcs; n++) {
+        const uint32_t pos = (h1 + n * h2) & 0x1FF;
+        if (!((block[pos >> 6] >> (pos & 0x3F)) & 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void CSaltedBloomFilter::reset()
+{
+    m_k0 = GetRand(std::numeric_limits<uint64_t>::max());
+    m_k1 = GetRand(std::numeric_limits<uint64_t>::max());
+    std::fill(m_data.begin(), m_data.end(), 0);
+}
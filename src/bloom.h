@@ -6,7 +6,9 @@
 #define BITCOIN_BLOOM_H
 
 #include <serialize.h>
+#include <span.h>
 
+#include <stdint.h>
 #include <vector>
 
 class COutPoint;
@@ -117,4 +119,34 @@ private:
     int nHashFuncs;
 };
 
+/**
+ * SaltedBloomFilter is a bloom filter for fast local membership tests, such as
+ * ruling out that a script belongs to a wallet before looking it up elsewhere.
+ *
+ * It is never serialized or relayed, so unlike CBloomFilter it hashes with
+ * SipHash under a random salt, and it places all probes for an element in the
+ * same 512-bit block, so a lookup touches a single cache line. This costs a
+ * slightly higher false positive rate than requested for a given size.
+ * Elements cannot be removed; use reset() to start over.
+ */
+class CSaltedBloomFilter
+{
+public:
+    CSaltedBloomFilter(const unsigned int nElements, const double nFPRate);
+
+    void insert(Span<const unsigned char> vKey);
+    bool contains(Span<const unsigned char> vKey) const;
+
+    //! Clear the filter and choose a new salt
+    void reset();
+
+private:
+    uint64_t m_k0;
+    uint64_t m_k1;
+    int m_hash_funcs;
+    //! Number of 512-bit blocks, each stored as 8 consecutive entries in m_data
+    uint32_t m_blocks;
+    std::vector<uint64_t> m_data;
+};
+
 #endif // BITCOIN_BLOOM_H
@@ -15,10 +15,18 @@ class CBlock;
 class CBlockHeader;
 class CScript;
 class CTransaction;
+class CTxUndo;
 struct CMutableTransaction;
 class uint256;
 class UniValue;
 
+/** Level of detail with which the transactions of a block are converted to JSON. */
+enum class TxVerbosity {
+    SHOW_TXID,                //!< Only the txid of each transaction
+    SHOW_DETAILS,             //!< Transactions in the format of the getrawtransaction RPC
+    SHOW_DETAILS_AND_PREVOUT, //!< As SHOW_DETAILS, plus the outputs spent by each input and the fee, if undo data is available
+};
+
 // core_read.cpp
 CScript ParseScript(const std::string& s);
 std::string ScriptToAsmStr(const CScript& script, const bool fAttemptSighashDecode = false);
@@ -45,6 +53,6 @@ std::string EncodeHexTx(const CTransaction& tx, const int serializeFlags = 0);
 std::string SighashToStr(unsigned char sighash_type);
 void ScriptPubKeyToUniv(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 void ScriptToUniv(const CScript& script, UniValue& out, bool include_address);
-void TxToUniv(const CTransaction& tx, const uint256& hashBlock, UniValue& entry, bool include_hex = true, int serialize_flags = 0);
+void TxToUniv(const CTransaction& tx, const uint256& hashBlock, UniValue& entry, bool include_hex = true, int serialize_flags = 0, const CTxUndo* txundo = nullptr);
 
 #endif // BITCOIN_CORE_IO_H
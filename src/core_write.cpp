@@ -11,6 +11,7 @@
 #include <script/standard.h>
 #include <serialize.h>
 #include <streams.h>
+#include <undo.h>
 #include <univalue.h>
 #include <util/system.h>
 #include <util/strencodings.h>
@@ -177,7 +178,7 @@ void ScriptPubKeyToUniv(const CScript& scriptPubKey,
     out.pushKV("addresses", a);
 }
 
-void TxToUniv(const CTransaction& tx, const uint256& hashBlock, UniValue& entry, bool include_hex, int serialize_flags)
+void TxToUniv(const CTransaction& tx, const uint256& hashBlock, UniValue& entry, bool include_hex, int serialize_flags, const CTxUndo* txundo)
 {
     entry.pushKV("txid", tx.GetHash().GetHex());
     entry.pushKV("hash", tx.GetWitnessHash().GetHex());
@@ -189,6 +190,11 @@ void TxToUniv(const CTransaction& tx, const uint256& hashBlock, UniValue& entry,
     entry.pushKV("weight", GetTransactionWeight(tx));
     entry.pushKV("locktime", (int64_t)tx.nLockTime);
 
+    // Undo data is only attached if it matches the inputs of the transaction.
+    const bool have_undo = txundo != nullptr && !tx.IsCoinBase() && txundo->vprevout.size() == tx.vin.size();
+    CAmount amt_total_in = 0;
+    CAmount amt_total_out = 0;
+
     UniValue vin(UniValue::VARR);
     for (unsigned int i = 0; i < tx.vin.size(); i++) {
         const CTxIn& txin = tx.vin[i];
@@ -210,6 +216,21 @@ void TxToUniv(const CTransaction& tx, const uint256& hashBlock, UniValue& entry,
             }
             in.pushKV("txinwitness", txinwitness);
         }
+        if (have_undo) {
+            const Coin& prev_coin = txundo->vprevout[i];
+            const CTxOut& prev_txout = prev_coin.out;
+            amt_total_in += prev_txout.nValue;
+
+            UniValue o_script_pub_key(UniValue::VOBJ);
+            ScriptPubKeyToUniv(prev_txout.scriptPubKey, o_script_pub_key, true);
+
+            UniValue p(UniValue::VOBJ);
+            p.pushKV("generated", bool(prev_coin.fCoinBase));
+            p.pushKV("height", uint64_t(prev_coin.nHeight));
+            p.pushKV("value", ValueFromAmount(prev_txout.nValue));
+            p.pushKV("scriptPubKey", o_script_pub_key);
+            in.pushKV("prevout", p);
+        }
         in.pushKV("sequence", (int64_t)txin.nSequence);
         vin.push_back(in);
     }
@@ -228,9 +249,17 @@ void TxToUniv(const CTransaction& tx, const uint256& hashBlock, UniValue& entry,
         ScriptPubKeyToUniv(txout.scriptPubKey, o, true);
         out.pushKV("scriptPubKey", o);
         vout.push_back(out);
+
+        if (have_undo) {
+            amt_total_out += txout.nValue;
+        }
     }
     entry.pushKV("vout", vout);
 
+    if (have_undo) {
+        entry.pushKV("fee", ValueFromAmount(amt_total_in - amt_total_out));
+    }
+
     if (!hashBlock.IsNull())
         entry.pushKV("blockhash", hashBlock.GetHex());
 
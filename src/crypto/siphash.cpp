@@ -4,6 +4,25 @@
 
 #include <crypto/siphash.h>
 
+#include <assert.h>
+
+#include <compat/cpuid.h>
+#include <crypto/common.h>
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace siphash_avx2
+{
+void SipHashUint256_4way(uint64_t k0, uint64_t k1, const uint256* const* vals, uint64_t* out);
+}
+#endif
+
+#if defined(ENABLE_AVX512) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace siphash_avx512
+{
+void SipHashUint256_8way(uint64_t k0, uint64_t k1, const uint256* const* vals, uint64_t* out);
+}
+#endif
+
 #define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
 
 #define SIPROUND do { \
@@ -171,3 +190,97 @@ uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint3
     SIPROUND;
     return v0 ^ v1 ^ v2 ^ v3;
 }
+
+namespace {
+
+typedef void (*SipHashUint256MultiType)(uint64_t, uint64_t, const uint256* const*, uint64_t*);
+
+//! Number of values hashed at once by the multi-lane implementation, or 0 if there is none.
+size_t g_lanes = 0;
+SipHashUint256MultiType SipHashUint256Multi = nullptr;
+
+bool SelfTest()
+{
+    uint256 vals[16];
+    const uint256* ptrs[16];
+    for (int i = 0; i < 16; ++i) {
+        for (int j = 0; j < 32; ++j) *(vals[i].begin() + j) = i * 32 + j;
+        ptrs[i] = &vals[i];
+    }
+    uint64_t out[16];
+    SipHashUint256Batch(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, ptrs, out, 16);
+    for (int i = 0; i < 16; ++i) {
+        if (out[i] != SipHashUint256(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, vals[i])) return false;
+    }
+    return true;
+}
+
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+/** Return the register state components enabled by the OS (XCR0). */
+uint32_t GetXCR0()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return a;
+}
+#endif
+
+} // namespace
+
+void SipHashUint256Batch(uint64_t k0, uint64_t k1, const uint256* const* vals, uint64_t* out, size_t n)
+{
+    size_t i = 0;
+    if (g_lanes) {
+        for (; i + g_lanes <= n; i += g_lanes) {
+            SipHashUint256Multi(k0, k1, vals + i, out + i);
+        }
+    }
+    for (; i < n; ++i) {
+        out[i] = SipHashUint256(k0, k1, *vals[i]);
+    }
+}
+
+std::string SipHashAutoDetect()
+{
+    std::string ret = "standard";
+#if defined(USE_ASM) && defined(HAVE_GETCPUID)
+    bool have_avx2 = false;
+    bool have_avx512 = false;
+    uint32_t xcr0 = 0;
+
+    (void)have_avx2;
+    (void)have_avx512;
+    (void)xcr0;
+
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    const bool have_xsave = (ecx >> 27) & 1;
+    const bool have_avx = (ecx >> 28) & 1;
+    if (have_xsave && have_avx) {
+        xcr0 = GetXCR0();
+        GetCPUID(7, 0, eax, ebx, ecx, edx);
+        // AVX2 needs the XMM and YMM state, AVX-512 additionally the opmask and ZMM state.
+        have_avx2 = ((ebx >> 5) & 1) && (xcr0 & 0x6) == 0x6;
+        have_avx512 = ((ebx >> 16) & 1) && (xcr0 & 0xe6) == 0xe6;
+    }
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_avx2) {
+        SipHashUint256Multi = siphash_avx2::SipHashUint256_4way;
+        g_lanes = 4;
+        ret = "avx2(4way)";
+    }
+#endif
+
+#if defined(ENABLE_AVX512) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_avx512) {
+        SipHashUint256Multi = siphash_avx512::SipHashUint256_8way;
+        g_lanes = 8;
+        ret = "avx512(8way)";
+    }
+#endif
+#endif
+
+    assert(SelfTest());
+    return ret;
+}
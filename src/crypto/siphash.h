@@ -6,6 +6,7 @@
 #define BITCOIN_CRYPTO_SIPHASH_H
 
 #include <stdint.h>
+#include <string>
 
 #include <uint256.h>
 
@@ -44,4 +45,12 @@ public:
 uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
 uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra);
 
+/** Compute out[i] = SipHashUint256(k0, k1, *vals[i]) for n values at once, hashing several
+ *  values in parallel on CPUs with AVX2 or AVX-512 support. */
+void SipHashUint256Batch(uint64_t k0, uint64_t k1, const uint256* const* vals, uint64_t* out, size_t n);
+
+/** Autodetect the best available multi-lane SipHash implementation for the batch functions.
+ *  Returns the name of the implementation. */
+std::string SipHashAutoDetect();
+
 #endif // BITCOIN_CRYPTO_SIPHASH_H
@@ -0,0 +1,87 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX512
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include <uint256.h>
+
+namespace siphash_avx512 {
+namespace {
+
+__m512i inline K(uint64_t x) { return _mm512_set1_epi64(x); }
+__m512i inline Add(__m512i x, __m512i y) { return _mm512_add_epi64(x, y); }
+__m512i inline Xor(__m512i x, __m512i y) { return _mm512_xor_si512(x, y); }
+template<int b> __m512i inline RotL(__m512i x) { return _mm512_rol_epi64(x, b); }
+
+void inline __attribute__((always_inline)) SipRound(__m512i& v0, __m512i& v1, __m512i& v2, __m512i& v3)
+{
+    v0 = Add(v0, v1); v1 = RotL<13>(v1); v1 = Xor(v1, v0);
+    v0 = RotL<32>(v0);
+    v2 = Add(v2, v3); v3 = RotL<16>(v3); v3 = Xor(v3, v2);
+    v0 = Add(v0, v3); v3 = RotL<21>(v3); v3 = Xor(v3, v0);
+    v2 = Add(v2, v1); v1 = RotL<17>(v1); v1 = Xor(v1, v2);
+    v2 = RotL<32>(v2);
+}
+
+void inline __attribute__((always_inline)) Compress(__m512i& v0, __m512i& v1, __m512i& v2, __m512i& v3, __m512i d)
+{
+    v3 = Xor(v3, d);
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    v0 = Xor(v0, d);
+}
+
+/** Load 4 values and transpose them, so that w[j] holds 64-bit word j of every value. */
+void inline Load4(const uint256* const* vals, __m256i w[4])
+{
+    __m256i r0 = _mm256_loadu_si256((const __m256i*)vals[0]->begin());
+    __m256i r1 = _mm256_loadu_si256((const __m256i*)vals[1]->begin());
+    __m256i r2 = _mm256_loadu_si256((const __m256i*)vals[2]->begin());
+    __m256i r3 = _mm256_loadu_si256((const __m256i*)vals[3]->begin());
+    __m256i t0 = _mm256_unpacklo_epi64(r0, r1);
+    __m256i t1 = _mm256_unpackhi_epi64(r0, r1);
+    __m256i t2 = _mm256_unpacklo_epi64(r2, r3);
+    __m256i t3 = _mm256_unpackhi_epi64(r2, r3);
+    w[0] = _mm256_permute2x128_si256(t0, t2, 0x20);
+    w[1] = _mm256_permute2x128_si256(t1, t3, 0x20);
+    w[2] = _mm256_permute2x128_si256(t0, t2, 0x31);
+    w[3] = _mm256_permute2x128_si256(t1, t3, 0x31);
+}
+
+void inline __attribute__((always_inline)) Hash8(uint64_t k0, uint64_t k1, const uint256* const* vals, __m512i last, uint64_t* out)
+{
+    __m256i lo[4], hi[4];
+    Load4(vals, lo);
+    Load4(vals + 4, hi);
+
+    __m512i v0 = K(0x736f6d6570736575ULL ^ k0);
+    __m512i v1 = K(0x646f72616e646f6dULL ^ k1);
+    __m512i v2 = K(0x6c7967656e657261ULL ^ k0);
+    __m512i v3 = K(0x7465646279746573ULL ^ k1);
+
+    for (int j = 0; j < 4; ++j) {
+        Compress(v0, v1, v2, v3, _mm512_inserti64x4(_mm512_castsi256_si512(lo[j]), hi[j], 1));
+    }
+    Compress(v0, v1, v2, v3, last);
+    v2 = Xor(v2, K(0xFF));
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    _mm512_storeu_si512((void*)out, Xor(Xor(v0, v1), Xor(v2, v3)));
+}
+
+}
+
+void SipHashUint256_8way(uint64_t k0, uint64_t k1, const uint256* const* vals, uint64_t* out)
+{
+    Hash8(k0, k1, vals, K(((uint64_t)4) << 59), out);
+}
+
+}
+
+#endif
@@ -12,10 +12,15 @@
 #include <validation.h>
 #include <warnings.h>
 
+#include <condition_variable>
+#include <deque>
+
 constexpr char DB_BEST_BLOCK = 'B';
 
 constexpr int64_t SYNC_LOG_INTERVAL = 30; // seconds
 constexpr int64_t SYNC_LOCATOR_WRITE_INTERVAL = 30; // seconds
+/** Number of blocks each sync worker may have read or prepared ahead of the sync thread. */
+constexpr size_t SYNC_BLOCKS_PER_THREAD = 2;
 
 template <typename... Args>
 static void FatalError(const char* fmt, const Args&... args)
@@ -84,11 +89,118 @@ static const CBlockIndex* NextSyncBlock(const CBlockIndex* pindex_prev) EXCLUSIV
     return ::ChainActive().Next(::ChainActive().FindFork(pindex_prev));
 }
 
+/**
+ * Reads blocks from disk and prepares them for an index on a pool of worker threads, while the sync
+ * thread consumes the results in the order the blocks were pushed.
+ */
+class BaseIndex::SyncPipeline
+{
+private:
+    struct Item {
+        const CBlockIndex* pindex;
+        CBlock block;
+        std::unique_ptr<PreparedBlock> prepared;
+        bool done{false};
+    };
+
+    BaseIndex& m_index;
+    const Consensus::Params& m_consensus_params;
+
+    Mutex m_mutex;
+    std::condition_variable m_work_cv;
+    std::condition_variable m_done_cv;
+    /** Items not yet picked up by a worker. */
+    std::deque<std::shared_ptr<Item>> m_pending GUARDED_BY(m_mutex);
+    /** All items that have not been popped yet, in chain order. */
+    std::deque<std::shared_ptr<Item>> m_in_flight GUARDED_BY(m_mutex);
+    bool m_stop GUARDED_BY(m_mutex){false};
+
+    std::vector<std::thread> m_workers;
+
+    void ThreadWorker()
+    {
+        WAIT_LOCK(m_mutex, lock);
+        while (true) {
+            m_work_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_stop || !m_pending.empty(); });
+            if (m_stop) return;
+
+            std::shared_ptr<Item> item = std::move(m_pending.front());
+            m_pending.pop_front();
+            {
+                REVERSE_LOCK(lock);
+                if (ReadBlockFromDisk(item->block, item->pindex, m_consensus_params)) {
+                    item->prepared = m_index.PrepareBlock(item->block, item->pindex);
+                } else {
+                    LogPrintf("%s: Failed to read block %s from disk\n",
+                              __func__, item->pindex->GetBlockHash().ToString());
+                }
+            }
+            item->done = true;
+            m_done_cv.notify_all();
+        }
+    }
+
+public:
+    SyncPipeline(BaseIndex& index, int n_threads)
+        : m_index(index), m_consensus_params(Params().GetConsensus())
+    {
+        for (int i = 0; i < n_threads; ++i) {
+            m_workers.emplace_back([this, i] {
+                TraceThread(strprintf("indexsync.%i", i).c_str(), [this] { ThreadWorker(); });
+            });
+        }
+    }
+
+    ~SyncPipeline()
+    {
+        WITH_LOCK(m_mutex, m_stop = true);
+        m_work_cv.notify_all();
+        for (std::thread& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    size_t Capacity() const { return m_workers.size() * SYNC_BLOCKS_PER_THREAD; }
+
+    size_t Size() { return WITH_LOCK(m_mutex, return m_in_flight.size()); }
+
+    /** Return the last block pushed that has not been popped yet, or null if there is none. */
+    const CBlockIndex* Back() { return WITH_LOCK(m_mutex, return m_in_flight.empty() ? nullptr : m_in_flight.back()->pindex); }
+
+    void Push(const CBlockIndex* pindex)
+    {
+        auto item = std::make_shared<Item>();
+        item->pindex = pindex;
+        {
+            LOCK(m_mutex);
+            m_pending.push_back(item);
+            m_in_flight.push_back(std::move(item));
+        }
+        m_work_cv.notify_one();
+    }
+
+    /**
+     * Wait for the oldest block pushed to be prepared and remove it from the pipeline. The prepared
+     * data is null if the block could not be read or prepared.
+     */
+    void Pop(const CBlockIndex*& pindex, CBlock& block, std::unique_ptr<PreparedBlock>& prepared)
+    {
+        WAIT_LOCK(m_mutex, lock);
+        assert(!m_in_flight.empty());
+        const std::shared_ptr<Item> item = m_in_flight.front();
+        m_done_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return item->done; });
+        m_in_flight.pop_front();
+        pindex = item->pindex;
+        block = std::move(item->block);
+        prepared = std::move(item->prepared);
+    }
+};
+
 void BaseIndex::ThreadSync()
 {
     const CBlockIndex* pindex = m_best_block_index.load();
     if (!m_synced) {
-        auto& consensus_params = Params().GetConsensus();
+        SyncPipeline pipeline(*this, m_sync_threads);
 
         int64_t last_log_time = 0;
         int64_t last_locator_write_time = 0;
@@ -104,22 +216,39 @@ void BaseIndex::ThreadSync()
 
             {
                 LOCK(cs_main);
-                const CBlockIndex* pindex_next = NextSyncBlock(pindex);
-                if (!pindex_next) {
+                // Queue up the blocks following the last one pushed. On a reorg, stop queueing
+                // until all blocks of the old branch have been written, so the index can be
+                // rewound from its own best block.
+                while (pipeline.Size() < pipeline.Capacity()) {
+                    const CBlockIndex* pindex_last = pipeline.Back();
+                    if (!pindex_last) pindex_last = pindex;
+                    const CBlockIndex* pindex_next = NextSyncBlock(pindex_last);
+                    if (!pindex_next) break;
+                    if (pindex_next->pprev != pindex_last) {
+                        if (pindex_last != pindex) break;
+                        m_best_block_index = pindex;
+                        if (!Rewind(pindex, pindex_next->pprev)) {
+                            FatalError("%s: Failed to rewind index %s to a previous chain tip",
+                                       __func__, GetName());
+                            return;
+                        }
+                        pindex = pindex_next->pprev;
+                    }
+                    pipeline.Push(pindex_next);
+                }
+                if (pipeline.Size() == 0) {
                     m_best_block_index = pindex;
                     m_synced = true;
                     // No need to handle errors in Commit. See rationale above.
                     Commit();
                     break;
                 }
-                if (pindex_next->pprev != pindex && !Rewind(pindex, pindex_next->pprev)) {
-                    FatalError("%s: Failed to rewind index %s to a previous chain tip",
-                               __func__, GetName());
-                    return;
-                }
-                pindex = pindex_next;
             }
 
+            CBlock block;
+            std::unique_ptr<PreparedBlock> prepared;
+            pipeline.Pop(pindex, block, prepared);
+
             int64_t current_time = GetTime();
             if (last_log_time + SYNC_LOG_INTERVAL < current_time) {
                 LogPrintf("Syncing %s with block chain from height %d\n",
@@ -127,24 +256,23 @@ void BaseIndex::ThreadSync()
                 last_log_time = current_time;
             }
 
-            if (last_locator_write_time + SYNC_LOCATOR_WRITE_INTERVAL < current_time) {
-                m_best_block_index = pindex;
-                last_locator_write_time = current_time;
-                // No need to handle errors in Commit. See rationale above.
-                Commit();
-            }
-
-            CBlock block;
-            if (!ReadBlockFromDisk(block, pindex, consensus_params)) {
-                FatalError("%s: Failed to read block %s from disk",
-                           __func__, pindex->GetBlockHash().ToString());
+            if (!prepared) {
+                FatalError("%s: Failed to read or prepare block %s for index %s",
+                           __func__, pindex->GetBlockHash().ToString(), GetName());
                 return;
             }
-            if (!WriteBlock(block, pindex)) {
+            if (!WritePreparedBlock(block, pindex, *prepared)) {
                 FatalError("%s: Failed to write block %s to index database",
                            __func__, pindex->GetBlockHash().ToString());
                 return;
             }
+
+            if (last_locator_write_time + SYNC_LOCATOR_WRITE_INTERVAL < current_time) {
+                m_best_block_index = pindex;
+                last_locator_write_time = current_time;
+                // No need to handle errors in Commit. See rationale above.
+                Commit();
+            }
         }
     }
 
@@ -171,6 +299,16 @@ bool BaseIndex::CommitInternal(CDBBatch& batch)
     return true;
 }
 
+std::unique_ptr<BaseIndex::PreparedBlock> BaseIndex::PrepareBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    return MakeUnique<PreparedBlock>();
+}
+
+bool BaseIndex::WritePreparedBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared)
+{
+    return WriteBlock(block, pindex);
+}
+
 bool BaseIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
 {
     assert(current_tip == m_best_block_index);
@@ -220,7 +358,8 @@ void BaseIndex::BlockConnected(const std::shared_ptr<const CBlock>& block, const
         }
     }
 
-    if (WriteBlock(*block, pindex)) {
+    std::unique_ptr<PreparedBlock> prepared = PrepareBlock(*block, pindex);
+    if (prepared && WritePreparedBlock(*block, pindex, *prepared)) {
         m_best_block_index = pindex;
     } else {
         FatalError("%s: Failed to write block %s to index",
@@ -297,8 +436,10 @@ void BaseIndex::Interrupt()
     m_interrupt();
 }
 
-void BaseIndex::Start()
+void BaseIndex::Start(int sync_threads)
 {
+    m_sync_threads = std::max(1, sync_threads);
+
     // Need to register this ValidationInterface before running Init(), so that
     // callbacks are not missed if Init sets m_synced to true.
     RegisterValidationInterface(this);
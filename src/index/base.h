@@ -13,6 +13,11 @@
 
 class CBlockIndex;
 
+/** -indexthreads default (number of threads preparing blocks during index sync, 0 = auto) */
+static constexpr int DEFAULT_INDEX_SYNC_THREADS = 0;
+/** Maximum number of threads preparing blocks during index sync */
+static constexpr int MAX_INDEX_SYNC_THREADS = 16;
+
 struct IndexSummary {
     std::string name;
     bool synced{false};
@@ -26,6 +31,16 @@ struct IndexSummary {
  */
 class BaseIndex : public CValidationInterface
 {
+public:
+    /**
+     * Index data computed for a single block by PrepareBlock and consumed by WritePreparedBlock.
+     * Indexes that split the processing of a block into an independent and a sequential part
+     * extend this with their own data.
+     */
+    struct PreparedBlock {
+        virtual ~PreparedBlock() {}
+    };
+
 protected:
     /**
      * The database stores a block locator of the chain the database is synced to
@@ -48,6 +63,11 @@ protected:
     };
 
 private:
+    class SyncPipeline;
+
+    /// Number of worker threads that read and prepare blocks ahead of the sync thread.
+    int m_sync_threads{1};
+
     /// Whether the index is in sync with the main chain. The flag is flipped
     /// from false to true once, after which point this starts processing
     /// ValidationInterface notifications to stay in sync.
@@ -64,6 +84,10 @@ private:
     /// interrupted with m_interrupt. Once the index gets in sync, the m_synced
     /// flag is set and the BlockConnected ValidationInterface callback takes
     /// over and the sync thread exits.
+    ///
+    /// Blocks are read from disk and passed through PrepareBlock by a pool of
+    /// m_sync_threads workers, ahead of and in parallel with the sync thread,
+    /// which passes them to WritePreparedBlock in chain order.
     void ThreadSync();
 
     /// Write the current index state (eg. chain block locator and subclass-specific items) to disk.
@@ -87,6 +111,16 @@ protected:
     /// Write update index entries for a newly connected block.
     virtual bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) { return true; }
 
+    /// Compute the part of the index data for a block that does not depend on previously indexed
+    /// blocks. During initial sync this is called from multiple threads concurrently and ahead of
+    /// the sync thread, so it must not access mutable index state. Returns null on failure.
+    virtual std::unique_ptr<PreparedBlock> PrepareBlock(const CBlock& block, const CBlockIndex* pindex);
+
+    /// Write update index entries for a newly connected block, given the data computed for it by
+    /// PrepareBlock. Always called sequentially in chain order. The default implementation
+    /// ignores the prepared data and calls WriteBlock.
+    virtual bool WritePreparedBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared);
+
     /// Virtual method called internally by Commit that can be overridden to atomically
     /// commit more index state.
     virtual bool CommitInternal(CDBBatch& batch);
@@ -115,7 +149,9 @@ public:
 
     /// Start initializes the sync state and registers the instance as a
     /// ValidationInterface so that it stays in sync with blockchain updates.
-    void Start();
+    /// sync_threads is the number of threads preparing blocks while the index
+    /// catches up with the chain.
+    void Start(int sync_threads = 1);
 
     /// Stops the instance from staying in sync with blockchain updates.
     void Stop();
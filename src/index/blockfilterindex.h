@@ -47,7 +47,11 @@ protected:
 
     bool CommitInternal(CDBBatch& batch) override;
 
-    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+    /// Construct the filter for a block. This only depends on the block and its undo data.
+    std::unique_ptr<PreparedBlock> PrepareBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    /// Chain the filter header to the previous one and write the filter to disk.
+    bool WritePreparedBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared) override;
 
     bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
 
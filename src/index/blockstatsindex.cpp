@@ -0,0 +1,203 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <dbwrapper.h>
+#include <index/blockstatsindex.h>
+#include <undo.h>
+#include <util/system.h>
+#include <validation.h>
+
+/* The index database stores the statistics of each block. Like the block filter index, entries
+ * belonging to blocks on the active chain are indexed by height, and those belonging to blocks that
+ * have been reorganized out of the active chain are indexed by block hash, so that the statistics of
+ * any block can be retrieved regardless of reorgs racing with the lookup.
+ *
+ * Keys for the height index have the type [DB_BLOCK_HEIGHT, uint32 (BE)]. The height is represented
+ * as big-endian so that sequential reads of ranges of heights are fast.
+ * Keys for the hash index have the type [DB_BLOCK_HASH, uint256].
+ */
+constexpr char DB_BLOCK_HASH = 's';
+constexpr char DB_BLOCK_HEIGHT = 't';
+
+std::unique_ptr<BlockStatsIndex> g_blockstatsindex;
+
+namespace {
+
+struct DBHeightKey {
+    int height;
+
+    DBHeightKey() : height(0) {}
+    explicit DBHeightKey(int height_in) : height(height_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_BLOCK_HEIGHT);
+        ser_writedata32be(s, height);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_BLOCK_HEIGHT) {
+            throw std::ios_base::failure("Invalid format for block stats index DB height key");
+        }
+        height = ser_readdata32be(s);
+    }
+};
+
+struct DBHashKey {
+    uint256 hash;
+
+    explicit DBHashKey(const uint256& hash_in) : hash(hash_in) {}
+
+    SERIALIZE_METHODS(DBHashKey, obj) {
+        char prefix = DB_BLOCK_HASH;
+        READWRITE(prefix);
+        if (prefix != DB_BLOCK_HASH) {
+            throw std::ios_base::failure("Invalid format for block stats index DB hash key");
+        }
+
+        READWRITE(obj.hash);
+    }
+};
+
+struct PreparedStats : public BaseIndex::PreparedBlock {
+    CBlockStats stats;
+};
+
+} // namespace
+
+BlockStatsIndex::BlockStatsIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<BaseIndex::DB>(GetDataDir() / "indexes" / "blockstats", n_cache_size, f_memory, f_wipe))
+{}
+
+std::unique_ptr<BaseIndex::PreparedBlock> BlockStatsIndex::PrepareBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CBlockUndo block_undo;
+    if (pindex->nHeight > 0 && !UndoReadFromDisk(block_undo, pindex)) {
+        return nullptr;
+    }
+
+    auto prepared = MakeUnique<PreparedStats>();
+    if (!ComputeBlockStats(block, block_undo, prepared->stats)) {
+        return nullptr;
+    }
+    return prepared;
+}
+
+bool BlockStatsIndex::WritePreparedBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared)
+{
+    std::pair<uint256, CBlockStats> value;
+    value.first = pindex->GetBlockHash();
+    value.second = static_cast<PreparedStats&>(prepared).stats;
+    return m_db->Write(DBHeightKey(pindex->nHeight), value);
+}
+
+bool BlockStatsIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    CDBBatch batch(*m_db);
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+
+    // During a reorg, copy the statistics of the blocks getting disconnected from the height index
+    // to the hash index so they can still be found once the height index entries are overwritten.
+    DBHeightKey key(new_tip->nHeight);
+    db_it->Seek(key);
+    for (int height = new_tip->nHeight; height <= current_tip->nHeight; ++height) {
+        if (!db_it->GetKey(key) || key.height != height) {
+            return error("%s: unexpected key in %s: expected (%c, %d)",
+                         __func__, GetName(), DB_BLOCK_HEIGHT, height);
+        }
+
+        std::pair<uint256, CBlockStats> value;
+        if (!db_it->GetValue(value)) {
+            return error("%s: unable to read value in %s at key (%c, %d)",
+                         __func__, GetName(), DB_BLOCK_HEIGHT, height);
+        }
+
+        batch.Write(DBHashKey(value.first), value.second);
+        db_it->Next();
+    }
+    if (!m_db->WriteBatch(batch)) return false;
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+bool BlockStatsIndex::LookupStats(const CBlockIndex* block_index, CBlockStats& stats_out) const
+{
+    // First check if the result is stored under the height index and the value there matches the
+    // block hash. This should be the case if the block is on the active chain.
+    std::pair<uint256, CBlockStats> read_out;
+    if (!m_db->Read(DBHeightKey(block_index->nHeight), read_out)) {
+        return false;
+    }
+    if (read_out.first == block_index->GetBlockHash()) {
+        stats_out = read_out.second;
+        return true;
+    }
+
+    // If value at the height index corresponds to an different block, the result will be stored in
+    // the hash index.
+    return m_db->Read(DBHashKey(block_index->GetBlockHash()), stats_out);
+}
+
+bool BlockStatsIndex::LookupStatsRange(int start_height, const CBlockIndex* stop_index,
+                                       std::vector<CBlockStats>& stats_out) const
+{
+    if (start_height < 0) {
+        return error("%s: start height (%d) is negative", __func__, start_height);
+    }
+    if (start_height > stop_index->nHeight) {
+        return error("%s: start height (%d) is greater than stop height (%d)",
+                     __func__, start_height, stop_index->nHeight);
+    }
+
+    // Read the height index up to the first height that has not been indexed yet.
+    std::vector<std::pair<uint256, CBlockStats>> values;
+    values.reserve(static_cast<size_t>(stop_index->nHeight - start_height + 1));
+
+    DBHeightKey key(start_height);
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+    db_it->Seek(DBHeightKey(start_height));
+    for (int height = start_height; height <= stop_index->nHeight; ++height) {
+        if (!db_it->Valid() || !db_it->GetKey(key) || key.height != height) break;
+
+        values.emplace_back();
+        if (!db_it->GetValue(values.back())) {
+            LogPrintf("%s: unable to read value in %s at key (%c, %d)\n",
+                      __func__, GetName(), DB_BLOCK_HEIGHT, height);
+            values.pop_back();
+            break;
+        }
+
+        db_it->Next();
+    }
+
+    stats_out.resize(values.size());
+    if (values.empty()) return true;
+
+    // Iterate backwards through block indexes collecting results in order to access the block hash
+    // of each entry in case we need to look it up in the hash index. A block found in neither ends
+    // the indexed part of the range.
+    for (const CBlockIndex* block_index = stop_index->GetAncestor(start_height + static_cast<int>(values.size()) - 1);
+         block_index && block_index->nHeight >= start_height;
+         block_index = block_index->pprev) {
+        uint256 block_hash = block_index->GetBlockHash();
+
+        size_t i = static_cast<size_t>(block_index->nHeight - start_height);
+        if (block_hash == values[i].first) {
+            stats_out[i] = std::move(values[i].second);
+            continue;
+        }
+
+        if (!m_db->Read(DBHashKey(block_hash), stats_out[i])) {
+            stats_out.resize(i);
+        }
+    }
+
+    return true;
+}
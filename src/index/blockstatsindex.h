@@ -0,0 +1,53 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_BLOCKSTATSINDEX_H
+#define BITCOIN_INDEX_BLOCKSTATSINDEX_H
+
+#include <chain.h>
+#include <index/base.h>
+#include <node/blockstats.h>
+
+#include <vector>
+
+/**
+ * BlockStatsIndex stores the getblockstats statistics of every block, computed once when the block
+ * is connected, so that statistics for single blocks or ranges of heights can be served without
+ * reading blocks and undo data from disk.
+ */
+class BlockStatsIndex final : public BaseIndex
+{
+private:
+    std::unique_ptr<BaseIndex::DB> m_db;
+
+protected:
+    /// Compute the statistics of a block. This only depends on the block and its undo data.
+    std::unique_ptr<PreparedBlock> PrepareBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool WritePreparedBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override { return *m_db; }
+
+    const char* GetName() const override { return "blockstatsindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit BlockStatsIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /// Get the statistics of a single block.
+    bool LookupStats(const CBlockIndex* block_index, CBlockStats& stats_out) const;
+
+    /// Get the statistics of a range of blocks between two heights on a chain. Only the leading
+    /// blocks of the range that have been indexed are returned, so stats_out may be shorter than
+    /// the range. Returns false if the arguments are invalid.
+    bool LookupStatsRange(int start_height, const CBlockIndex* stop_index,
+                          std::vector<CBlockStats>& stats_out) const;
+};
+
+/// The global block statistics index. May be null.
+extern std::unique_ptr<BlockStatsIndex> g_blockstatsindex;
+
+#endif // BITCOIN_INDEX_BLOCKSTATSINDEX_H
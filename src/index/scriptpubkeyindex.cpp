@@ -0,0 +1,322 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <compressor.h>
+#include <crypto/sha256.h>
+#include <index/scriptpubkeyindex.h>
+#include <undo.h>
+#include <util/system.h>
+#include <validation.h>
+
+/* The index database stores one entry for each output created and each output spent in the active
+ * chain, except for unspendable outputs and the outputs of the genesis block.
+ *
+ * Keys have the type [DB_SCRIPT, uint256 (SHA256 of scriptPubKey), uint32 (BE) height, uint256
+ * txid, VARINT((n << 1) | spending)]. The height is represented as big-endian so that the history of
+ * a script is iterated in chain order, and the output/input index is merged with the entry kind into
+ * a single VARINT to keep keys short.
+ *
+ * Values hold the compressed amount of the output and, for spending entries only, the outpoint that
+ * was spent. The entry kind is known from the key when reading the value back.
+ *
+ * The hash of each indexed block is stored under [DB_BLOCK_HEIGHT, uint32 (BE) height], written in
+ * the same batch as the block's entries, so that a lookup reads entries and block hashes from the
+ * same database snapshot.
+ */
+constexpr char DB_SCRIPT = 's';
+constexpr char DB_BLOCK_HEIGHT = 't';
+
+std::unique_ptr<ScriptPubKeyIndex> g_scriptpubkeyindex;
+
+namespace {
+
+struct DBKey {
+    uint256 script_hash;
+    int height{0};
+    uint256 txid;
+    uint32_t n{0};
+    bool spending{false};
+
+    DBKey() {}
+    DBKey(const uint256& script_hash_in, int height_in, const uint256& txid_in, uint32_t n_in, bool spending_in)
+        : script_hash(script_hash_in), height(height_in), txid(txid_in), n(n_in), spending(spending_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_SCRIPT);
+        s << script_hash;
+        ser_writedata32be(s, height);
+        s << txid;
+        uint64_t code = (uint64_t{n} << 1) | (spending ? 1 : 0);
+        s << VARINT(code);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_SCRIPT) {
+            throw std::ios_base::failure("Invalid format for scriptpubkey index DB key");
+        }
+        s >> script_hash;
+        height = ser_readdata32be(s);
+        s >> txid;
+        uint64_t code = 0;
+        s >> VARINT(code);
+        n = static_cast<uint32_t>(code >> 1);
+        spending = code & 1;
+    }
+};
+
+/** Key prefix used to seek to the start of a script's history. */
+struct DBScriptPrefix {
+    uint256 script_hash;
+
+    explicit DBScriptPrefix(const uint256& script_hash_in) : script_hash(script_hash_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_SCRIPT);
+        s << script_hash;
+    }
+};
+
+struct DBHeightKey {
+    int height{0};
+
+    DBHeightKey() {}
+    explicit DBHeightKey(int height_in) : height(height_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_BLOCK_HEIGHT);
+        ser_writedata32be(s, height);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_BLOCK_HEIGHT) {
+            throw std::ios_base::failure("Invalid format for scriptpubkey index DB height key");
+        }
+        height = ser_readdata32be(s);
+    }
+};
+
+struct DBVal {
+    CAmount value{0};
+    COutPoint prevout;
+    bool spending{false};
+
+    DBVal() {}
+    explicit DBVal(bool spending_in) : spending(spending_in) {}
+    DBVal(CAmount value_in, const COutPoint& prevout_in, bool spending_in)
+        : value(value_in), prevout(prevout_in), spending(spending_in) {}
+
+    SERIALIZE_METHODS(DBVal, obj)
+    {
+        READWRITE(Using<AmountCompression>(obj.value));
+        if (obj.spending) READWRITE(obj.prevout);
+    }
+};
+
+using DBEntries = std::vector<std::pair<DBKey, DBVal>>;
+
+struct PreparedEntries : public BaseIndex::PreparedBlock {
+    DBEntries entries;
+};
+
+/** Collect the index entries for all outputs created and spent by a block. */
+bool BuildBlockEntries(const CBlock& block, const CBlockUndo& block_undo, int height, DBEntries& entries)
+{
+    if (block_undo.vtxundo.size() + 1 != block.vtx.size()) {
+        return error("%s: undo data does not match block at height %d", __func__, height);
+    }
+
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+
+        for (uint32_t n = 0; n < tx.vout.size(); ++n) {
+            const CTxOut& out = tx.vout[n];
+            if (out.scriptPubKey.IsUnspendable()) continue;
+            entries.emplace_back(DBKey(ScriptPubKeyIndex::HashScript(out.scriptPubKey), height, txid, n, false),
+                                 DBVal(out.nValue, COutPoint(), false));
+        }
+
+        if (tx.IsCoinBase()) continue;
+
+        const CTxUndo& tx_undo = block_undo.vtxundo[i - 1];
+        if (tx_undo.vprevout.size() != tx.vin.size()) {
+            return error("%s: undo data does not match transaction %s", __func__, txid.ToString());
+        }
+        for (uint32_t n = 0; n < tx.vin.size(); ++n) {
+            const CTxOut& prev = tx_undo.vprevout[n].out;
+            entries.emplace_back(DBKey(ScriptPubKeyIndex::HashScript(prev.scriptPubKey), height, txid, n, true),
+                                 DBVal(prev.nValue, tx.vin[n].prevout, true));
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+/** Access to the scriptpubkeyindex database (indexes/scriptpubkeyindex/) */
+class ScriptPubKeyIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /// Write the entries and the hash of a block to the DB in a single batch.
+    bool WriteEntries(const DBEntries& entries, const CBlockIndex* pindex);
+
+    /// Erase the entries and the hash of a block from the DB in a single batch.
+    bool EraseEntries(const DBEntries& entries, const CBlockIndex* pindex);
+};
+
+ScriptPubKeyIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "scriptpubkeyindex", n_cache_size, f_memory, f_wipe)
+{}
+
+bool ScriptPubKeyIndex::DB::WriteEntries(const DBEntries& entries, const CBlockIndex* pindex)
+{
+    CDBBatch batch(*this);
+    for (const auto& entry : entries) {
+        batch.Write(entry.first, entry.second);
+    }
+    batch.Write(DBHeightKey(pindex->nHeight), pindex->GetBlockHash());
+    return WriteBatch(batch);
+}
+
+bool ScriptPubKeyIndex::DB::EraseEntries(const DBEntries& entries, const CBlockIndex* pindex)
+{
+    CDBBatch batch(*this);
+    for (const auto& entry : entries) {
+        batch.Erase(entry.first);
+    }
+    batch.Erase(DBHeightKey(pindex->nHeight));
+    return WriteBatch(batch);
+}
+
+ScriptPubKeyIndex::ScriptPubKeyIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<ScriptPubKeyIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+ScriptPubKeyIndex::~ScriptPubKeyIndex() {}
+
+uint256 ScriptPubKeyIndex::HashScript(const CScript& script)
+{
+    uint256 hash;
+    CSHA256().Write(script.data(), script.size()).Finalize(hash.begin());
+    return hash;
+}
+
+std::unique_ptr<BaseIndex::PreparedBlock> ScriptPubKeyIndex::PrepareBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    auto prepared = MakeUnique<PreparedEntries>();
+
+    // Exclude genesis block transaction because outputs are not spendable.
+    if (pindex->nHeight == 0) return prepared;
+
+    CBlockUndo block_undo;
+    if (!UndoReadFromDisk(block_undo, pindex) ||
+        !BuildBlockEntries(block, block_undo, pindex->nHeight, prepared->entries)) {
+        return nullptr;
+    }
+    return prepared;
+}
+
+bool ScriptPubKeyIndex::WritePreparedBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared)
+{
+    return m_db->WriteEntries(static_cast<PreparedEntries&>(prepared).entries, pindex);
+}
+
+bool ScriptPubKeyIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    // Entries are keyed by height, so those of disconnected blocks must be erased explicitly before
+    // blocks of the new branch are written at the same heights.
+    const Consensus::Params& consensus_params = Params().GetConsensus();
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        if (pindex->nHeight == 0) {
+            if (!m_db->EraseEntries({}, pindex)) return false;
+            continue;
+        }
+
+        CBlock block;
+        CBlockUndo block_undo;
+        if (!ReadBlockFromDisk(block, pindex, consensus_params) || !UndoReadFromDisk(block_undo, pindex)) {
+            return error("%s: Failed to read block %s from disk", __func__, pindex->GetBlockHash().ToString());
+        }
+
+        DBEntries entries;
+        if (!BuildBlockEntries(block, block_undo, pindex->nHeight, entries) || !m_db->EraseEntries(entries, pindex)) {
+            return false;
+        }
+    }
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+BaseIndex::DB& ScriptPubKeyIndex::GetDB() const { return *m_db; }
+
+bool ScriptPubKeyIndex::FindScriptHistory(const uint256& script_hash, const ScriptPubKeyHistoryEntry* after, size_t count,
+                                          std::vector<ScriptPubKeyHistoryEntry>& entries) const
+{
+    entries.clear();
+
+    // The iterator reads from a snapshot of the database, so the block hashes read below belong
+    // to the same chain as the entries even if the index is rewound in the meantime.
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+    DBKey key;
+    if (after) {
+        const DBKey after_key(script_hash, after->height, after->txid, after->n, after->spending);
+        db_it->Seek(after_key);
+        if (db_it->Valid() && db_it->GetKey(key) && key.script_hash == after_key.script_hash &&
+            key.height == after_key.height && key.txid == after_key.txid && key.n == after_key.n &&
+            key.spending == after_key.spending) {
+            db_it->Next();
+        }
+    } else {
+        db_it->Seek(DBScriptPrefix(script_hash));
+    }
+    for (; db_it->Valid() && entries.size() < count; db_it->Next()) {
+        if (!db_it->GetKey(key) || key.script_hash != script_hash) break;
+
+        DBVal value(key.spending);
+        if (!db_it->GetValue(value)) {
+            return error("%s: unable to read value in %s for script %s",
+                         __func__, GetName(), script_hash.ToString());
+        }
+
+        ScriptPubKeyHistoryEntry entry;
+        entry.height = key.height;
+        entry.txid = key.txid;
+        entry.n = key.n;
+        entry.spending = key.spending;
+        entry.prevout = value.prevout;
+        entry.value = value.value;
+        entries.push_back(std::move(entry));
+    }
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (i > 0 && entries[i].height == entries[i - 1].height) {
+            entries[i].block_hash = entries[i - 1].block_hash;
+            continue;
+        }
+        DBHeightKey height_key;
+        db_it->Seek(DBHeightKey(entries[i].height));
+        if (!db_it->Valid() || !db_it->GetKey(height_key) || height_key.height != entries[i].height ||
+            !db_it->GetValue(entries[i].block_hash)) {
+            return error("%s: unable to read hash of block %d in %s", __func__, entries[i].height, GetName());
+        }
+    }
+    return true;
+}
@@ -0,0 +1,87 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_SCRIPTPUBKEYINDEX_H
+#define BITCOIN_INDEX_SCRIPTPUBKEYINDEX_H
+
+#include <amount.h>
+#include <chain.h>
+#include <index/base.h>
+#include <script/script.h>
+
+#include <vector>
+
+/** A single funding or spending event in the history of a scriptPubKey. */
+struct ScriptPubKeyHistoryEntry
+{
+    /** Height of the block containing the transaction. */
+    int height{0};
+    /** Hash of the block containing the transaction. */
+    uint256 block_hash;
+    /** The transaction creating (funding) or spending the output. */
+    uint256 txid;
+    /** Output index for funding entries, input index for spending entries. */
+    uint32_t n{0};
+    /** Whether this entry records a spend rather than a newly created output. */
+    bool spending{false};
+    /** For spending entries, the outpoint that was spent. Null for funding entries. */
+    COutPoint prevout;
+    /** Value of the created or spent output. */
+    CAmount value{0};
+};
+
+/**
+ * ScriptPubKeyIndex is used to look up the history of a scriptPubKey. For every output created and
+ * every output spent in the active chain, an entry is written to a LevelDB database, keyed by the
+ * SHA256 of the scriptPubKey followed by the block height, so that the history of a script can be
+ * read in chain order with a single database iteration.
+ */
+class ScriptPubKeyIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    /// Collect the entries of a block from the block and its undo data.
+    std::unique_ptr<PreparedBlock> PrepareBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    /// Write the collected entries of a block in a single batch.
+    bool WritePreparedBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "scriptpubkeyindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit ScriptPubKeyIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~ScriptPubKeyIndex() override;
+
+    /// Compute the key under which the history of a scriptPubKey is stored.
+    static uint256 HashScript(const CScript& script);
+
+    /// Look up a page of the history of a scriptPubKey, in chain order.
+    ///
+    /// @param[in]   script_hash  SHA256 of the scriptPubKey, see HashScript.
+    /// @param[in]   after  If not null, start after this entry, of which only height, txid, n and
+    ///                     spending are used. The lookup seeks to it rather than walking the entries
+    ///                     before it.
+    /// @param[in]   count  Maximum number of entries to return.
+    /// @param[out]  entries  The history entries found.
+    /// @return  false if the database could not be read, true otherwise
+    bool FindScriptHistory(const uint256& script_hash, const ScriptPubKeyHistoryEntry* after, size_t count,
+                           std::vector<ScriptPubKeyHistoryEntry>& entries) const;
+};
+
+/// The global scriptPubKey index. May be null.
+extern std::unique_ptr<ScriptPubKeyIndex> g_scriptpubkeyindex;
+
+#endif // BITCOIN_INDEX_SCRIPTPUBKEYINDEX_H
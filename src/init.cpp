@@ -17,11 +17,14 @@
 #include <chainparams.h>
 #include <compat/sanity.h>
 #include <consensus/validation.h>
+#include <crypto/siphash.h>
 #include <fs.h>
 #include <hash.h>
 #include <httprpc.h>
 #include <httpserver.h>
 #include <index/blockfilterindex.h>
+#include <index/blockstatsindex.h>
+#include <index/scriptpubkeyindex.h>
 #include <index/txindex.h>
 #include <interfaces/chain.h>
 #include <interfaces/node.h>
@@ -31,6 +34,7 @@
 #include <net_permissions.h>
 #include <net_processing.h>
 #include <netbase.h>
+#include <node/blockcache.h>
 #include <node/context.h>
 #include <node/ui_interface.h>
 #include <policy/feerate.h>
@@ -172,6 +176,12 @@ void Interrupt(NodeContext& node)
     if (g_txindex) {
         g_txindex->Interrupt();
     }
+    if (g_scriptpubkeyindex) {
+        g_scriptpubkeyindex->Interrupt();
+    }
+    if (g_blockstatsindex) {
+        g_blockstatsindex->Interrupt();
+    }
     ForEachBlockFilterIndex([](BlockFilterIndex& index) { index.Interrupt(); });
 }
 
@@ -222,6 +232,7 @@ void Shutdown(NodeContext& node)
     // After everything has been shut down, but before things get flushed, stop the
     // CScheduler/checkqueue, threadGroup and load block thread.
     if (node.scheduler) node.scheduler->stop();
+    GetMainSignals().StopBackgroundThreads();
     if (g_load_block.joinable()) g_load_block.join();
     threadGroup.interrupt_all();
     threadGroup.join_all();
@@ -229,6 +240,7 @@ void Shutdown(NodeContext& node)
     // After the threads that potentially access these pointers have been stopped,
     // destruct and reset all to nullptr.
     node.peerman.reset();
+    node.block_cache.reset();
     node.connman.reset();
     node.banman.reset();
 
@@ -267,6 +279,14 @@ void Shutdown(NodeContext& node)
         g_txindex->Stop();
         g_txindex.reset();
     }
+    if (g_scriptpubkeyindex) {
+        g_scriptpubkeyindex->Stop();
+        g_scriptpubkeyindex.reset();
+    }
+    if (g_blockstatsindex) {
+        g_blockstatsindex->Stop();
+        g_blockstatsindex.reset();
+    }
     ForEachBlockFilterIndex([](BlockFilterIndex& index) { index.Stop(); });
     DestroyAllBlockFilterIndexes();
 
@@ -397,6 +417,7 @@ void SetupServerArgs(NodeContext& node)
     argsman.AddArg("-alertnotify=<cmd>", "Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #endif
     argsman.AddArg("-assumevalid=<hex>", strprintf("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all, default: %s, testnet: %s, signet: %s)", defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex(), signetChainParams->GetConsensus().defaultAssumeValid.GetHex()), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-blockcachesize=<n>", strprintf("Maximum size of the cache of serialized blocks served to peers and over RPC/REST, in MiB (0 to %d, default: %u)", MAX_BLOCK_CACHE_SIZE, DEFAULT_BLOCK_CACHE_SIZE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-blocksdir=<dir>", "Specify directory to hold blocks subdirectory for *.dat files (default: <datadir>)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #if HAVE_SYSTEM
     argsman.AddArg("-blocknotify=<cmd>", "Execute command when the best block changes (%s in cmd is replaced by block hash)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
@@ -418,8 +439,9 @@ void SetupServerArgs(NodeContext& node)
     argsman.AddArg("-par=<n>", strprintf("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)",
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-persistmempool", strprintf("Whether to save the mempool on shutdown and load on restart (default: %u)", DEFAULT_PERSIST_MEMPOOL), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-persistmempoolv2", strprintf("Save the mempool in a format that records the chain tip and a checksum, so that it reloads without verifying scripts again if the tip did not change. Older versions cannot load such a file (default: %u)", DEFAULT_PERSIST_MEMPOOL_V2), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-pid=<file>", strprintf("Specify pid file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)", BITCOIN_PID_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
-    argsman.AddArg("-prune=<n>", strprintf("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex and -rescan. "
+    argsman.AddArg("-prune=<n>", strprintf("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex, -scriptpubkeyindex, -blockstatsindex and -rescan. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >=%u = automatically prune block files to stay under the specified target size in MiB)", MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-reindex", "Rebuild chain state and block index from the blk*.dat files on disk", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
@@ -438,6 +460,10 @@ void SetupServerArgs(NodeContext& node)
                  strprintf("Maintain an index of compact filters by block (default: %s, values: %s).", DEFAULT_BLOCKFILTERINDEX, ListBlockFilterTypes()) +
                  " If <type> is not supplied or if <type> = 1, indexes for all known types are enabled.",
                  ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-indexthreads=<n>", strprintf("Set the number of threads reading and preparing blocks while building indexes, shared out among the enabled indexes (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)",
+        -GetNumCores(), MAX_INDEX_SYNC_THREADS, DEFAULT_INDEX_SYNC_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-scriptpubkeyindex", strprintf("Maintain an index of funding and spending transactions by scriptPubKey, used by the getscriptpubkeyhistory rpc call (default: %u)", DEFAULT_SCRIPTPUBKEYINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-blockstatsindex", strprintf("Maintain an index of per block statistics, used by the getblockstats and getblockstatsrange rpc calls (default: %u)", DEFAULT_BLOCKSTATSINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 
     argsman.AddArg("-addnode=<ip>", "Add a node to connect to and attempt to keep the connection open (see the `addnode` RPC command help for more info). This option can be specified multiple times to add multiple nodes.", ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY, OptionsCategory::CONNECTION);
     argsman.AddArg("-asmap=<file>", strprintf("Specify asn mapping used for bucketing of the peers (default: %s). Relative paths will be prefixed by the net-specific datadir location.", DEFAULT_ASMAP_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
@@ -539,6 +565,7 @@ void SetupServerArgs(NodeContext& node)
     hidden_args.emplace_back("-logthreadnames");
 #endif
     argsman.AddArg("-logtimemicros", strprintf("Add microsecond precision to debug timestamps (default: %u)", DEFAULT_LOGTIMEMICROS), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
+    argsman.AddArg("-lockstats", strprintf("Record lock contention statistics, which are returned by the getlockstats RPC (default: %u)", DEFAULT_LOCKSTATS), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     argsman.AddArg("-mocktime=<n>", "Replace actual time with " + UNIX_EPOCH_TIME + " (default: 0)", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     argsman.AddArg("-maxsigcachesize=<n>", strprintf("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     argsman.AddArg("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
@@ -880,6 +907,7 @@ void InitLogging(const ArgsManager& args)
 #endif
 
     fLogIPs = args.GetBoolArg("-logips", DEFAULT_LOGIPS);
+    SetLockStatsEnabled(args.GetBoolArg("-lockstats", DEFAULT_LOCKSTATS));
 
     std::string version_string = FormatFullVersion();
 #ifdef DEBUG
@@ -1021,6 +1049,10 @@ bool AppInitParameterInteraction(const ArgsManager& args)
     if (args.GetArg("-prune", 0)) {
         if (args.GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(_("Prune mode is incompatible with -txindex."));
+        if (args.GetBoolArg("-scriptpubkeyindex", DEFAULT_SCRIPTPUBKEYINDEX))
+            return InitError(_("Prune mode is incompatible with -scriptpubkeyindex."));
+        if (args.GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX))
+            return InitError(_("Prune mode is incompatible with -blockstatsindex."));
         if (!g_enabled_filter_types.empty()) {
             return InitError(_("Prune mode is incompatible with -blockfilterindex."));
         }
@@ -1223,6 +1255,8 @@ bool AppInitSanityChecks()
     // Initialize elliptic curve code
     std::string sha256_algo = SHA256AutoDetect();
     LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    std::string siphash_algo = SipHashAutoDetect();
+    LogPrintf("Using the '%s' batch SipHash implementation\n", siphash_algo);
     RandomInit();
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1404,7 +1438,12 @@ bool AppInitMain(const util::Ref& context, NodeContext& node, interfaces::BlockA
     node.chainman = &g_chainman;
     ChainstateManager& chainman = *Assert(node.chainman);
 
-    node.peerman.reset(new PeerManager(chainparams, *node.connman, node.banman.get(), *node.scheduler, chainman, *node.mempool));
+    assert(!node.block_cache);
+    // Clamp before converting from MiB, so that large values cannot overflow
+    const int64_t block_cache_size = std::max<int64_t>(0, std::min<int64_t>(args.GetArg("-blockcachesize", DEFAULT_BLOCK_CACHE_SIZE), MAX_BLOCK_CACHE_SIZE));
+    node.block_cache = MakeUnique<BlockCache>(block_cache_size << 20);
+
+    node.peerman.reset(new PeerManager(chainparams, *node.connman, node.banman.get(), *node.scheduler, chainman, *node.mempool, node.block_cache.get()));
     RegisterValidationInterface(node.peerman.get());
 
     // sanitize comments per BIP-0014, format user agent and check total size
@@ -1545,6 +1584,10 @@ bool AppInitMain(const util::Ref& context, NodeContext& node, interfaces::BlockA
     nTotalCache -= nBlockTreeDBCache;
     int64_t nTxIndexCache = std::min(nTotalCache / 8, args.GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxTxIndexCache << 20 : 0);
     nTotalCache -= nTxIndexCache;
+    int64_t script_index_cache = std::min(nTotalCache / 8, args.GetBoolArg("-scriptpubkeyindex", DEFAULT_SCRIPTPUBKEYINDEX) ? max_script_index_cache << 20 : 0);
+    nTotalCache -= script_index_cache;
+    int64_t block_stats_index_cache = std::min(nTotalCache / 8, args.GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX) ? max_block_stats_index_cache << 20 : 0);
+    nTotalCache -= block_stats_index_cache;
     int64_t filter_index_cache = 0;
     if (!g_enabled_filter_types.empty()) {
         size_t n_indexes = g_enabled_filter_types.size();
@@ -1562,6 +1605,12 @@ bool AppInitMain(const util::Ref& context, NodeContext& node, interfaces::BlockA
     if (args.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
         LogPrintf("* Using %.1f MiB for transaction index database\n", nTxIndexCache * (1.0 / 1024 / 1024));
     }
+    if (args.GetBoolArg("-scriptpubkeyindex", DEFAULT_SCRIPTPUBKEYINDEX)) {
+        LogPrintf("* Using %.1f MiB for scriptPubKey index database\n", script_index_cache * (1.0 / 1024 / 1024));
+    }
+    if (args.GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX)) {
+        LogPrintf("* Using %.1f MiB for block statistics index database\n", block_stats_index_cache * (1.0 / 1024 / 1024));
+    }
     for (BlockFilterType filter_type : g_enabled_filter_types) {
         LogPrintf("* Using %.1f MiB for %s block filter index database\n",
                   filter_index_cache * (1.0 / 1024 / 1024), BlockFilterTypeName(filter_type));
@@ -1800,14 +1849,39 @@ bool AppInitMain(const util::Ref& context, NodeContext& node, interfaces::BlockA
     fFeeEstimatesInitialized = true;
 
     // ********************************************************* Step 8: start indexers
-    if (args.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
+    int index_threads = args.GetArg("-indexthreads", DEFAULT_INDEX_SYNC_THREADS);
+    if (index_threads <= 0) {
+        // -indexthreads=0 means autodetect (number of cores),
+        // -indexthreads=-n means "leave n cores free"
+        index_threads += GetNumCores();
+    }
+    index_threads = std::max(1, std::min(index_threads, MAX_INDEX_SYNC_THREADS));
+
+    // The indexes sync concurrently, so share the threads out among them
+    const bool txindex = args.GetBoolArg("-txindex", DEFAULT_TXINDEX);
+    const bool scriptpubkeyindex = args.GetBoolArg("-scriptpubkeyindex", DEFAULT_SCRIPTPUBKEYINDEX);
+    const bool blockstatsindex = args.GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX);
+    const int num_indexes = txindex + scriptpubkeyindex + blockstatsindex + (int)g_enabled_filter_types.size();
+    const int index_threads_each = std::max(1, index_threads / std::max(1, num_indexes));
+
+    if (txindex) {
         g_txindex = MakeUnique<TxIndex>(nTxIndexCache, false, fReindex);
-        g_txindex->Start();
+        g_txindex->Start(index_threads_each);
+    }
+
+    if (scriptpubkeyindex) {
+        g_scriptpubkeyindex = MakeUnique<ScriptPubKeyIndex>(script_index_cache, false, fReindex);
+        g_scriptpubkeyindex->Start(index_threads_each);
+    }
+
+    if (blockstatsindex) {
+        g_blockstatsindex = MakeUnique<BlockStatsIndex>(block_stats_index_cache, false, fReindex);
+        g_blockstatsindex->Start(index_threads_each);
     }
 
     for (const auto& filter_type : g_enabled_filter_types) {
         InitBlockFilterIndex(filter_type, filter_index_cache, false, fReindex);
-        GetBlockFilterIndex(filter_type)->Start();
+        GetBlockFilterIndex(filter_type)->Start(index_threads_each);
     }
 
     // ********************************************************* Step 9: load wallet
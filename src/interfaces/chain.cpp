@@ -6,6 +6,7 @@
 
 #include <chain.h>
 #include <chainparams.h>
+#include <index/blockfilterindex.h>
 #include <interfaces/handler.h>
 #include <interfaces/wallet.h>
 #include <net.h>
@@ -32,12 +33,18 @@
 #include <validation.h>
 #include <validationinterface.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <thread>
 #include <utility>
 
 namespace interfaces {
 namespace {
 
+//! Minimum number of block filters each thread matches in blockFiltersMatchAny
+static constexpr size_t MIN_FILTERS_PER_THREAD = 100;
+
 bool FillBlock(const CBlockIndex* index, const FoundBlock& block, UniqueLock<RecursiveMutex>& lock)
 {
     if (!index) return false;
@@ -274,6 +281,54 @@ public:
         }
         return false;
     }
+    bool hasBlockFilterIndex(BlockFilterType filter_type) override
+    {
+        return GetBlockFilterIndex(filter_type) != nullptr;
+    }
+    std::vector<std::pair<uint256, bool>> blockFiltersMatchAny(BlockFilterType filter_type,
+        const uint256& start_block,
+        int max_blocks,
+        const GCSFilter::ElementSet& elements) override
+    {
+        std::vector<std::pair<uint256, bool>> matches;
+        const BlockFilterIndex* index = GetBlockFilterIndex(filter_type);
+        if (!index || max_blocks <= 0) return matches;
+
+        int start_height;
+        const CBlockIndex* stop_index;
+        {
+            LOCK(::cs_main);
+            const CBlockIndex* start_index = LookupBlockIndex(start_block);
+            if (!start_index || !ChainActive().Contains(start_index)) return matches;
+            start_height = start_index->nHeight;
+            // Do not look past the index's best block, it may still be catching up.
+            const int stop_height = std::min({start_height + max_blocks - 1, ChainActive().Height(), index->GetSummary().best_block_height});
+            if (stop_height < start_height) return matches;
+            stop_index = ChainActive()[stop_height];
+        }
+        std::vector<BlockFilter> filters;
+        if (!index->LookupFilterRange(start_height, stop_index, filters)) return matches;
+
+        // Matching hashes every element with each block's own key, which dominates
+        // for large element sets, so spread the filters over several threads.
+        matches.resize(filters.size());
+        std::atomic<size_t> next_filter{0};
+        const auto match_filters = [&] {
+            for (size_t i = next_filter++; i < filters.size(); i = next_filter++) {
+                matches[i] = {filters[i].GetBlockHash(), filters[i].GetFilter().MatchAny(elements)};
+            }
+        };
+        const size_t num_threads = std::max<size_t>(1, std::min<size_t>(GetNumCores(), filters.size() / MIN_FILTERS_PER_THREAD));
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < num_threads; ++i) {
+            threads.emplace_back(match_filters);
+        }
+        match_filters();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        return matches;
+    }
     RBFTransactionState isRBFOptIn(const CTransaction& tx) override
     {
         if (!m_node.mempool) return IsRBFOptInEmptyMempool(tx);
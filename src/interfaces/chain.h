@@ -5,6 +5,7 @@
 #ifndef BITCOIN_INTERFACES_CHAIN_H
 #define BITCOIN_INTERFACES_CHAIN_H
 
+#include <blockfilter.h>            // For BlockFilterType and GCSFilter::ElementSet
 #include <optional.h>               // For Optional and nullopt
 #include <primitives/transaction.h> // For CTransactionRef
 #include <util/settings.h>          // For util::SettingsValue
@@ -14,6 +15,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <string>
+#include <utility>
 #include <vector>
 
 class ArgsManager;
@@ -167,6 +169,19 @@ public:
     //! the height range from min_height to max_height, inclusive.
     virtual bool hasBlocks(const uint256& block_hash, int min_height = 0, Optional<int> max_height = {}) = 0;
 
+    //! Return true if a block filter index of the given type is running.
+    virtual bool hasBlockFilterIndex(BlockFilterType filter_type) = 0;
+
+    //! Match the block filters of up to max_blocks active chain blocks,
+    //! starting at start_block, against a set of elements. Filters are
+    //! matched on multiple threads. Returns the hash of each block paired
+    //! with whether its filter matched any element, or an empty vector if
+    //! start_block is not in the active chain or its filter is not indexed.
+    virtual std::vector<std::pair<uint256, bool>> blockFiltersMatchAny(BlockFilterType filter_type,
+        const uint256& start_block,
+        int max_blocks,
+        const GCSFilter::ElementSet& elements) = 0;
+
     //! Check if transaction is RBF opt in.
     virtual RBFTransactionState isRBFOptIn(const CTransaction& tx) = 0;
 
@@ -26,6 +26,7 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_POLL
@@ -47,6 +48,11 @@ static_assert(MINIUPNPC_API_VERSION >= 10, "miniUPnPc API version >= 10 assumed"
 
 #include <math.h>
 
+/** Maximum number of send queue entries passed to a single sendmsg() call */
+static constexpr size_t MAX_SEND_IOVECS = 64;
+/** Bytes to send per call when the size of the socket's send buffer cannot be determined */
+static constexpr size_t DEFAULT_SOCKET_SEND_BUFFER_SIZE = 64 * 1024;
+
 /** Maximum number of block-relay-only anchor connections */
 static constexpr size_t MAX_BLOCK_RELAY_ONLY_ANCHORS = 2;
 static_assert (MAX_BLOCK_RELAY_ONLY_ANCHORS <= static_cast<size_t>(MAX_BLOCK_RELAY_ONLY_CONNECTIONS), "MAX_BLOCK_RELAY_ONLY_ANCHORS must not exceed MAX_BLOCK_RELAY_ONLY_CONNECTIONS.");
@@ -640,6 +646,28 @@ void CNode::copyStats(CNodeStats &stats, const std::vector<bool> &m_asmap)
  *          False if the peer should be disconnected from.
  */
 bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete)
+{
+    complete = false;
+    while (nBytes > 0) {
+        const Span<char> buf = GetRecvBuffer();
+        const unsigned int nCopy = std::min<size_t>(nBytes, buf.size());
+        memcpy(buf.data(), pch, nCopy);
+        bool copy_complete;
+        if (!ReceiveMsgBytes(nCopy, copy_complete)) return false;
+        complete |= copy_complete;
+        pch += nCopy;
+        nBytes -= nCopy;
+    }
+    return true;
+}
+
+Span<char> CNode::GetRecvBuffer()
+{
+    LOCK(cs_vRecv);
+    return m_deserializer->GetReadBuffer();
+}
+
+bool CNode::ReceiveMsgBytes(unsigned int nBytes, bool& complete)
 {
     complete = false;
     const auto time = GetTime<std::chrono::microseconds>();
@@ -648,13 +676,12 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
     nRecvBytes += nBytes;
     while (nBytes > 0) {
         // absorb network data
-        int handled = m_deserializer->Read(pch, nBytes);
+        int handled = m_deserializer->ReadFromBuffer(nBytes);
         if (handled < 0) {
             // Serious header problem, disconnect from the peer.
             return false;
         }
 
-        pch += handled;
         nBytes -= handled;
 
         if (m_deserializer->Complete()) {
@@ -729,18 +756,45 @@ int V1TransportDeserializer::readHeader(const char *pch, unsigned int nBytes)
 int V1TransportDeserializer::readData(const char *pch, unsigned int nBytes)
 {
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
-    unsigned int nCopy = std::min(nRemaining, nBytes);
+    unsigned int nRead = std::min(nRemaining, nBytes);
+
+    // The payload stays in the chunk it was received into.
+    assert(pch == m_chunk->data + m_chunk_pos);
+    hasher.Write({(const unsigned char*)pch, nRead});
+    vRecv.Append(m_chunk, m_chunk_pos, nRead);
+    nDataPos += nRead;
 
-    if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+    return nRead;
+}
+
+Span<char> V1TransportDeserializer::GetReadBuffer()
+{
+    if (!m_chunk || m_chunk_pos == RECV_CHUNK_SIZE) {
+        m_chunk = g_recv_chunk_pool.Get();
+        m_chunk_pos = 0;
     }
+    return {m_chunk->data + m_chunk_pos, RECV_CHUNK_SIZE - m_chunk_pos};
+}
 
-    hasher.Write({(const unsigned char*)pch, nCopy});
-    memcpy(&vRecv[nDataPos], pch, nCopy);
-    nDataPos += nCopy;
+int V1TransportDeserializer::ReadFromBuffer(unsigned int nBytes)
+{
+    assert(m_chunk && m_chunk_pos + nBytes <= RECV_CHUNK_SIZE);
+    const char* pch = m_chunk->data + m_chunk_pos;
+    int ret = in_data ? readData(pch, nBytes) : readHeader(pch, nBytes);
+    if (ret < 0) {
+        Reset();
+        return ret;
+    }
+    m_chunk_pos += ret;
+    return ret;
+}
 
-    return nCopy;
+int V1TransportDeserializer::Read(const char *pch, unsigned int nBytes)
+{
+    const Span<char> buf = GetReadBuffer();
+    nBytes = std::min<size_t>(nBytes, buf.size());
+    memcpy(buf.data(), pch, nBytes);
+    return ReadFromBuffer(nBytes);
 }
 
 const uint256& V1TransportDeserializer::GetMessageHash() const
@@ -788,12 +842,20 @@ Optional<CNetMessage> V1TransportDeserializer::GetMessage(const std::chrono::mic
     return msg;
 }
 
-void V1TransportSerializer::prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) {
-    // create dbl-sha256 checksum
-    uint256 hash = Hash(msg.data);
+CSharedNetMsg::CSharedNetMsg(CSerializedNetMsg&& msg)
+    : data(std::make_shared<const std::vector<unsigned char>>(std::move(msg.data))),
+      m_type(std::move(msg.m_type)) {}
 
+const uint256& CSharedNetMsg::GetHash() const
+{
+    std::call_once(m_hash_once, [this] { m_hash = Hash(*data); });
+    return m_hash;
+}
+
+static void SerializeV1Header(const std::string& msg_type, size_t size, const uint256& hash, std::vector<unsigned char>& header)
+{
     // create header
-    CMessageHeader hdr(Params().MessageStart(), msg.m_type.c_str(), msg.data.size());
+    CMessageHeader hdr(Params().MessageStart(), msg_type.c_str(), size);
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
     // serialize header
@@ -801,33 +863,96 @@ void V1TransportSerializer::prepareForTransport(CSerializedNetMsg& msg, std::vec
     CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, header, 0, hdr};
 }
 
+void V1TransportSerializer::prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) {
+    // create dbl-sha256 checksum
+    uint256 hash = Hash(msg.data);
+
+    SerializeV1Header(msg.m_type, msg.data.size(), hash, header);
+}
+
+void V1TransportSerializer::prepareForTransport(const CSharedNetMsg& msg, std::vector<unsigned char>& header) {
+    SerializeV1Header(msg.m_type, msg.data->size(), msg.GetHash(), header);
+}
+
+/** Size of the socket's send buffer, which bounds how much a single send can hand to the kernel */
+static size_t GetSocketSendBufferSize(SOCKET hSocket)
+{
+    int size = 0;
+    socklen_t size_len = sizeof(size);
+    if (getsockopt(hSocket, SOL_SOCKET, SO_SNDBUF, (sockopt_arg_type)&size, &size_len) == SOCKET_ERROR || size <= 0) {
+        return DEFAULT_SOCKET_SEND_BUFFER_SIZE;
+    }
+    return size;
+}
+
+/**
+ * Send the send queue entries [it, end), starting at offset into the first
+ * one, with a single system call. At most max_bytes are passed to the kernel;
+ * their number is returned in requested.
+ */
+static int SendBuffers(SOCKET hSocket, std::deque<SendBufferRef>::const_iterator it, std::deque<SendBufferRef>::const_iterator end, size_t offset, size_t max_bytes, size_t& requested)
+{
+#ifdef WIN32
+    const std::vector<unsigned char>& data = **it;
+    requested = std::min(data.size() - offset, max_bytes);
+    return send(hSocket, reinterpret_cast<const char*>(data.data()) + offset, requested, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+    struct iovec iov[MAX_SEND_IOVECS];
+    size_t count = 0;
+    requested = 0;
+    for (; it != end && count < MAX_SEND_IOVECS && requested < max_bytes; ++it, ++count) {
+        const std::vector<unsigned char>& data = **it;
+        iov[count].iov_base = const_cast<unsigned char*>(data.data()) + offset;
+        iov[count].iov_len = std::min(data.size() - offset, max_bytes - requested);
+        requested += iov[count].iov_len;
+        offset = 0;
+    }
+    struct msghdr msg = {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    return sendmsg(hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
+}
+
 size_t CConnman::SocketSendData(CNode *pnode) const EXCLUSIVE_LOCKS_REQUIRED(pnode->cs_vSend)
 {
     auto it = pnode->vSendMsg.begin();
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+        assert((*it)->size() > pnode->nSendOffset);
         int nBytes = 0;
+        size_t nRequested = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (pnode->m_socket_send_buffer_size == 0) {
+                pnode->m_socket_send_buffer_size = GetSocketSendBufferSize(pnode->hSocket);
+            }
+            // Gather as much of the queue as the socket can take into one call
+            nBytes = SendBuffers(pnode->hSocket, it, pnode->vSendMsg.end(), pnode->nSendOffset, pnode->m_socket_send_buffer_size, nRequested);
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            // Drop the entries that were sent completely
+            size_t nRemaining = nBytes;
+            while (nRemaining > 0) {
+                const size_t nLeft = (*it)->size() - pnode->nSendOffset;
+                if (nRemaining < nLeft) {
+                    pnode->nSendOffset += nRemaining;
+                    break;
+                }
+                nRemaining -= nLeft;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+                pnode->nSendSize -= (*it)->size();
                 it++;
-            } else {
-                // could not send full message; stop sending more
+            }
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            if ((size_t)nBytes < nRequested) {
+                // could not send everything; stop sending more
                 break;
             }
         } else {
@@ -1475,19 +1600,20 @@ void CConnman::SocketHandler()
         }
         if (recvSet || errorSet)
         {
-            // typical socket buffer is 8K-64K
-            char pchBuf[0x10000];
+            // Receive straight into the peer's receive chunk, so that message
+            // payloads never need to be copied
+            const Span<char> buf = pnode->GetRecvBuffer();
             int nBytes = 0;
             {
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+                nBytes = recv(pnode->hSocket, buf.data(), buf.size(), MSG_DONTWAIT);
             }
             if (nBytes > 0)
             {
                 bool notify = false;
-                if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
+                if (!pnode->ReceiveMsgBytes(nBytes, notify))
                     pnode->CloseSocketDisconnect();
                 RecordBytesRecv(nBytes);
                 if (notify) {
@@ -2238,6 +2364,8 @@ void CConnman::ThreadMessageHandler()
                 return;
         }
 
+        m_msgproc->FinishMessageRound();
+
         {
             LOCK(cs_vNodes);
             for (CNode* pnode : vNodesCopy)
@@ -2996,13 +3124,27 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
 
 void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 {
-    size_t nMessageSize = msg.data.size();
-    LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.m_type), nMessageSize, pnode->GetId());
-
     // make sure we use the appropriate network transport format
     std::vector<unsigned char> serializedHeader;
     pnode->m_serializer->prepareForTransport(msg, serializedHeader);
-    size_t nTotalSize = nMessageSize + serializedHeader.size();
+
+    QueueMessage(pnode, msg.m_type, std::move(serializedHeader), std::make_shared<const std::vector<unsigned char>>(std::move(msg.data)));
+}
+
+void CConnman::PushMessage(CNode* pnode, const CSharedNetMsg& msg)
+{
+    std::vector<unsigned char> serializedHeader;
+    pnode->m_serializer->prepareForTransport(msg, serializedHeader);
+
+    QueueMessage(pnode, msg.m_type, std::move(serializedHeader), msg.data);
+}
+
+void CConnman::QueueMessage(CNode* pnode, const std::string& msg_type, std::vector<unsigned char>&& header, SendBufferRef payload)
+{
+    size_t nMessageSize = payload->size();
+    LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg_type), nMessageSize, pnode->GetId());
+
+    size_t nTotalSize = nMessageSize + header.size();
 
     size_t nBytesSent = 0;
     {
@@ -3010,14 +3152,14 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
         bool optimisticSend(pnode->vSendMsg.empty());
 
         //log total amount of bytes per message type
-        pnode->mapSendBytesPerMsgCmd[msg.m_type] += nTotalSize;
+        pnode->mapSendBytesPerMsgCmd[msg_type] += nTotalSize;
         pnode->nSendSize += nTotalSize;
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
+        pnode->vSendMsg.push_back(std::make_shared<const std::vector<unsigned char>>(std::move(header)));
         if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+            pnode->vSendMsg.push_back(std::move(payload));
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
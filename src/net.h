@@ -14,12 +14,14 @@
 #include <compat.h>
 #include <crypto/siphash.h>
 #include <hash.h>
+#include <net_buffer.h>
 #include <net_permissions.h>
 #include <netaddress.h>
 #include <optional.h>
 #include <policy/feerate.h>
 #include <protocol.h>
 #include <random.h>
+#include <span.h>
 #include <streams.h>
 #include <sync.h>
 #include <threadinterrupt.h>
@@ -29,6 +31,7 @@
 #include <cstdint>
 #include <deque>
 #include <map>
+#include <mutex>
 #include <thread>
 #include <memory>
 #include <condition_variable>
@@ -115,6 +118,29 @@ struct CSerializedNetMsg
     std::string m_type;
 };
 
+/** Immutable serialized bytes in a peer's send queue, which can be shared between peers. */
+using SendBufferRef = std::shared_ptr<const std::vector<unsigned char>>;
+
+/**
+ * A serialized message that can be queued for sending to any number of peers
+ * without copying its payload.
+ */
+struct CSharedNetMsg
+{
+    explicit CSharedNetMsg(CSerializedNetMsg&& msg);
+
+    const SendBufferRef data;
+    const std::string m_type;
+
+    //! Double-SHA256 of the payload. It is computed on first use, once for all peers, so that
+    //! messages which are never sent to a peer, such as blocks served over RPC and REST, skip it.
+    const uint256& GetHash() const;
+
+private:
+    mutable std::once_flag m_hash_once;
+    mutable uint256 m_hash;
+};
+
 /** Different types of connections to a peer. This enum encapsulates the
  * information we have available at the time of opening or accepting the
  * connection. Aside from INBOUND, all types are initiated by us.
@@ -274,6 +300,8 @@ public:
     bool ForNode(NodeId id, std::function<bool(CNode* pnode)> func);
 
     void PushMessage(CNode* pnode, CSerializedNetMsg&& msg);
+    /** Queue a message whose payload is shared with other peers' send queues. */
+    void PushMessage(CNode* pnode, const CSharedNetMsg& msg);
 
     using NodeFn = std::function<void(CNode*)>;
     void ForEachNode(const NodeFn& func)
@@ -457,6 +485,7 @@ private:
     NodeId GetNewNodeId();
 
     size_t SocketSendData(CNode *pnode) const;
+    void QueueMessage(CNode* pnode, const std::string& msg_type, std::vector<unsigned char>&& header, SendBufferRef payload);
     void DumpAddresses();
 
     // Network stats
@@ -625,6 +654,8 @@ public:
     virtual bool SendMessages(CNode* pnode) = 0;
     virtual void InitializeNode(CNode* pnode) = 0;
     virtual void FinalizeNode(const CNode& node, bool& update_connection_time) = 0;
+    /** Complete the work ProcessMessages deferred, called after ProcessMessages ran for each peer once */
+    virtual void FinishMessageRound() = 0;
 
 protected:
     /**
@@ -733,13 +764,13 @@ public:
  */
 class CNetMessage {
 public:
-    CDataStream m_recv;                  //!< received message data
+    CRecvStream m_recv;                  //!< received message data
     std::chrono::microseconds m_time{0}; //!< time of message receipt
     uint32_t m_message_size{0};          //!< size of the payload
     uint32_t m_raw_message_size{0};      //!< used wire size of the message (including header/checksum)
     std::string m_command;
 
-    CNetMessage(CDataStream&& recv_in) : m_recv(std::move(recv_in)) {}
+    CNetMessage(CRecvStream&& recv_in) : m_recv(std::move(recv_in)) {}
 
     void SetVersion(int nVersionIn)
     {
@@ -759,6 +790,10 @@ public:
     virtual void SetVersion(int version) = 0;
     // read and deserialize data
     virtual int Read(const char *data, unsigned int bytes) = 0;
+    // get the buffer that network data should be received into
+    virtual Span<char> GetReadBuffer() = 0;
+    // deserialize data that was received into the start of the buffer returned by GetReadBuffer()
+    virtual int ReadFromBuffer(unsigned int bytes) = 0;
     // decomposes a message from the context
     virtual Optional<CNetMessage> GetMessage(std::chrono::microseconds time, uint32_t& out_err) = 0;
     virtual ~TransportDeserializer() {}
@@ -774,7 +809,9 @@ private:
     bool in_data;                   // parsing header (false) or data (true)
     CDataStream hdrbuf;             // partially received header
     CMessageHeader hdr;             // complete header
-    CDataStream vRecv;              // received message data
+    CRecvStream vRecv;              // received message data, referencing the chunks it was received into
+    RecvChunkRef m_chunk;           // chunk that network data is received into
+    unsigned int m_chunk_pos{0};    // position in m_chunk up to which data has been deserialized
     unsigned int nHdrPos;
     unsigned int nDataPos;
 
@@ -814,11 +851,9 @@ public:
         hdrbuf.SetVersion(nVersionIn);
         vRecv.SetVersion(nVersionIn);
     }
-    int Read(const char *pch, unsigned int nBytes) override {
-        int ret = in_data ? readData(pch, nBytes) : readHeader(pch, nBytes);
-        if (ret < 0) Reset();
-        return ret;
-    }
+    int Read(const char *pch, unsigned int nBytes) override;
+    Span<char> GetReadBuffer() override;
+    int ReadFromBuffer(unsigned int nBytes) override;
     Optional<CNetMessage> GetMessage(std::chrono::microseconds time, uint32_t& out_err_raw_size) override;
 };
 
@@ -828,12 +863,15 @@ class TransportSerializer {
 public:
     // prepare message for transport (header construction, error-correction computation, payload encryption, etc.)
     virtual void prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) = 0;
+    // prepare the header of a shared message, whose payload cannot be modified
+    virtual void prepareForTransport(const CSharedNetMsg& msg, std::vector<unsigned char>& header) = 0;
     virtual ~TransportSerializer() {}
 };
 
 class V1TransportSerializer  : public TransportSerializer {
 public:
     void prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) override;
+    void prepareForTransport(const CSharedNetMsg& msg, std::vector<unsigned char>& header) override;
 };
 
 /** Information about a peer */
@@ -852,7 +890,8 @@ public:
     size_t nSendSize{0}; // total size of all vSendMsg entries
     size_t nSendOffset{0}; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes GUARDED_BY(cs_vSend){0};
-    std::deque<std::vector<unsigned char>> vSendMsg GUARDED_BY(cs_vSend);
+    std::deque<SendBufferRef> vSendMsg GUARDED_BY(cs_vSend);
+    size_t m_socket_send_buffer_size GUARDED_BY(cs_vSend){0}; // size of the socket's send buffer, queried on first send
     RecursiveMutex cs_vSend;
     RecursiveMutex cs_hSocket;
     RecursiveMutex cs_vRecv;
@@ -1009,9 +1048,6 @@ public:
 
         mutable RecursiveMutex cs_tx_inventory;
         CRollingBloomFilter filterInventoryKnown GUARDED_BY(cs_tx_inventory){50000, 0.000001};
-        // Set of transaction ids we still have to announce.
-        // They are sorted by the mempool before relay, so the order is not important.
-        std::set<uint256> setInventoryTxToSend;
         // Used for BIP35 mempool sending
         bool fSendMempool GUARDED_BY(cs_tx_inventory){false};
         // Last time a "MEMPOOL" request was serviced.
@@ -1119,6 +1155,10 @@ public:
     }
 
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete);
+    /** Return the buffer that the socket should receive into. */
+    Span<char> GetRecvBuffer();
+    /** Process nBytes that were received into the start of the buffer returned by GetRecvBuffer(). */
+    bool ReceiveMsgBytes(unsigned int nBytes, bool& complete);
 
     void SetCommonVersion(int greatest_common_version)
     {
@@ -1181,15 +1221,6 @@ public:
         }
     }
 
-    void PushTxInventory(const uint256& hash)
-    {
-        if (m_tx_relay == nullptr) return;
-        LOCK(m_tx_relay->cs_tx_inventory);
-        if (!m_tx_relay->filterInventoryKnown.contains(hash)) {
-            m_tx_relay->setInventoryTxToSend.insert(hash);
-        }
-    }
-
     void CloseSocketDisconnect();
 
     void copyStats(CNodeStats &stats, const std::vector<bool> &m_asmap);
@@ -0,0 +1,43 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <net_buffer.h>
+
+RecvChunkPool g_recv_chunk_pool;
+
+RecvChunkRef RecvChunkPool::Get()
+{
+    std::unique_ptr<RecvChunk> chunk;
+    {
+        LOCK(m_mutex);
+        if (!m_free.empty()) {
+            chunk = std::move(m_free.back());
+            m_free.pop_back();
+            ++m_stats.reused;
+            --m_stats.pooled;
+        } else {
+            ++m_stats.allocated;
+        }
+        ++m_stats.in_use;
+    }
+    if (!chunk) chunk.reset(new RecvChunk);
+    return RecvChunkRef(chunk.release(), [this](RecvChunk* released) { Release(released); });
+}
+
+void RecvChunkPool::Release(RecvChunk* chunk)
+{
+    std::unique_ptr<RecvChunk> owned(chunk);
+    LOCK(m_mutex);
+    --m_stats.in_use;
+    if (m_free.size() < m_max_pooled) {
+        m_free.push_back(std::move(owned));
+        ++m_stats.pooled;
+    }
+}
+
+RecvChunkPool::Stats RecvChunkPool::GetStats() const
+{
+    LOCK(m_mutex);
+    return m_stats;
+}
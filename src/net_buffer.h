@@ -0,0 +1,207 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NET_BUFFER_H
+#define BITCOIN_NET_BUFFER_H
+
+#include <serialize.h>
+#include <sync.h>
+
+#include <algorithm>
+#include <assert.h>
+#include <ios>
+#include <memory>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+/** Size of the memory chunks that network data is received into. */
+static constexpr size_t RECV_CHUNK_SIZE = 64 * 1024;
+/** Maximum number of unused chunks kept around for reuse. */
+static constexpr size_t DEFAULT_MAX_POOLED_RECV_CHUNKS = 64;
+
+/** A fixed-size block of memory that network data is received into. */
+struct RecvChunk {
+    char data[RECV_CHUNK_SIZE];
+};
+
+/**
+ * Reference to a RecvChunk. A chunk is shared by all messages whose payload
+ * it holds, and is returned to its pool once the last reference is dropped.
+ */
+using RecvChunkRef = std::shared_ptr<RecvChunk>;
+
+/**
+ * Pool of receive chunks, so that receiving a message does not require a
+ * fresh allocation sized to the message.
+ */
+class RecvChunkPool
+{
+public:
+    struct Stats {
+        //! Number of chunks that had to be allocated
+        uint64_t allocated{0};
+        //! Number of chunk requests served from the pool
+        uint64_t reused{0};
+        //! Number of chunks currently referenced
+        uint64_t in_use{0};
+        //! Number of unused chunks held by the pool
+        uint64_t pooled{0};
+    };
+
+    explicit RecvChunkPool(size_t max_pooled = DEFAULT_MAX_POOLED_RECV_CHUNKS) : m_max_pooled(max_pooled) {}
+    RecvChunkPool(const RecvChunkPool&) = delete;
+    RecvChunkPool& operator=(const RecvChunkPool&) = delete;
+
+    /** Get a chunk. Its contents are unspecified. */
+    RecvChunkRef Get() LOCKS_EXCLUDED(m_mutex);
+    Stats GetStats() const LOCKS_EXCLUDED(m_mutex);
+
+private:
+    void Release(RecvChunk* chunk) LOCKS_EXCLUDED(m_mutex);
+
+    const size_t m_max_pooled;
+    mutable Mutex m_mutex;
+    std::vector<std::unique_ptr<RecvChunk>> m_free GUARDED_BY(m_mutex);
+    Stats m_stats GUARDED_BY(m_mutex);
+};
+
+/** The pool that all peers receive into. */
+extern RecvChunkPool g_recv_chunk_pool;
+
+/**
+ * Stream over a received message payload. The payload is not
+ * copied out of the chunks it was received into; objects are deserialized
+ * from the chunk memory directly. Chunks are released as soon as they have
+ * been read past.
+ *
+ * Supports the subset of the CDataStream interface used for processing
+ * network messages.
+ */
+class CRecvStream
+{
+    struct Segment {
+        RecvChunkRef chunk;
+        uint32_t begin;
+        uint32_t size;
+    };
+
+    std::vector<Segment> m_segments;
+    //! Index of the segment the read position is in
+    size_t m_seg{0};
+    //! Read position within that segment
+    uint32_t m_seg_pos{0};
+    //! Number of bytes not read yet
+    size_t m_avail{0};
+    int nType;
+    int nVersion;
+
+    void Advance(size_t n)
+    {
+        m_seg_pos += n;
+        m_avail -= n;
+        if (m_seg_pos == m_segments[m_seg].size) {
+            m_segments[m_seg].chunk.reset();
+            ++m_seg;
+            m_seg_pos = 0;
+        }
+    }
+
+public:
+    CRecvStream(int nTypeIn, int nVersionIn) : nType(nTypeIn), nVersion(nVersionIn) {}
+
+    /** Append size bytes at offset begin of chunk to the payload. */
+    void Append(const RecvChunkRef& chunk, uint32_t begin, uint32_t size)
+    {
+        assert(begin + size <= RECV_CHUNK_SIZE);
+        if (size == 0) return;
+        if (!m_segments.empty() && m_segments.back().chunk == chunk && m_segments.back().begin + m_segments.back().size == begin) {
+            m_segments.back().size += size;
+        } else {
+            m_segments.push_back({chunk, begin, size});
+        }
+        m_avail += size;
+    }
+
+    /** Append a copy of the given data, mostly useful for constructing payloads in tests. */
+    void write(const char* pch, size_t nSize)
+    {
+        while (nSize > 0) {
+            uint32_t pos = RECV_CHUNK_SIZE;
+            if (!m_segments.empty() && m_segments.back().chunk.use_count() == 1) {
+                pos = m_segments.back().begin + m_segments.back().size;
+            }
+            RecvChunkRef chunk = pos < RECV_CHUNK_SIZE ? m_segments.back().chunk : g_recv_chunk_pool.Get();
+            if (pos == RECV_CHUNK_SIZE) pos = 0;
+            const size_t n = std::min<size_t>(nSize, RECV_CHUNK_SIZE - pos);
+            memcpy(chunk->data + pos, pch, n);
+            Append(chunk, pos, n);
+            pch += n;
+            nSize -= n;
+        }
+    }
+
+    template<typename T>
+    CRecvStream& operator<<(const T& obj)
+    {
+        // Serialize to this stream
+        ::Serialize(*this, obj);
+        return (*this);
+    }
+
+    void clear()
+    {
+        m_segments.clear();
+        m_seg = 0;
+        m_seg_pos = 0;
+        m_avail = 0;
+    }
+
+    template<typename T>
+    CRecvStream& operator>>(T&& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+
+    size_t size() const          { return m_avail; }
+    bool empty() const           { return m_avail == 0; }
+    bool eof() const             { return m_avail == 0; }
+    int in_avail() const         { return m_avail; }
+
+    void SetType(int n)          { nType = n; }
+    int GetType() const          { return nType; }
+    void SetVersion(int n)       { nVersion = n; }
+    int GetVersion() const       { return nVersion; }
+
+    void read(char* pch, size_t nSize)
+    {
+        if (nSize > m_avail) {
+            throw std::ios_base::failure("CRecvStream::read(): end of data");
+        }
+        while (nSize > 0) {
+            const Segment& seg = m_segments[m_seg];
+            const size_t n = std::min<size_t>(nSize, seg.size - m_seg_pos);
+            memcpy(pch, seg.chunk->data + seg.begin + m_seg_pos, n);
+            pch += n;
+            nSize -= n;
+            Advance(n);
+        }
+    }
+
+    void ignore(size_t nSize)
+    {
+        if (nSize > m_avail) {
+            throw std::ios_base::failure("CRecvStream::ignore(): end of data");
+        }
+        while (nSize > 0) {
+            const size_t n = std::min<size_t>(nSize, m_segments[m_seg].size - m_seg_pos);
+            nSize -= n;
+            Advance(n);
+        }
+    }
+};
+
+#endif // BITCOIN_NET_BUFFER_H
@@ -9,9 +9,11 @@
 #include <consensus/params.h>
 #include <net.h>
 #include <sync.h>
+#include <txannounce.h>
 #include <txrequest.h>
 #include <validationinterface.h>
 
+class BlockCache;
 class BlockTransactionsRequest;
 class BlockValidationState;
 class CBlockHeader;
@@ -35,13 +37,15 @@ static const int DISCOURAGEMENT_THRESHOLD{100};
 class PeerManager final : public CValidationInterface, public NetEventsInterface {
 public:
     PeerManager(const CChainParams& chainparams, CConnman& connman, BanMan* banman,
-                CScheduler& scheduler, ChainstateManager& chainman, CTxMemPool& pool);
+                CScheduler& scheduler, ChainstateManager& chainman, CTxMemPool& pool,
+                BlockCache* block_cache = nullptr);
 
     /**
      * Overridden from CValidationInterface.
      */
     void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexConnected) override;
     void BlockDisconnected(const std::shared_ptr<const CBlock> &block, const CBlockIndex* pindex) override;
+    void TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t mempool_sequence) override;
     /**
      * Overridden from CValidationInterface.
      */
@@ -73,6 +77,11 @@ public:
     * @return                      True if there is more work to be done
     */
     bool SendMessages(CNode* pto) override EXCLUSIVE_LOCKS_REQUIRED(pto->cs_sendProcessing);
+    /**
+    * Accept the transactions received from all peers in this round of the message handler together,
+    * see AcceptToMemoryPoolBatch. The peers they were received from must still be referenced.
+    */
+    void FinishMessageRound() override;
 
     /** Consider evicting an outbound peer based on the amount of time they've been behind our tip */
     void ConsiderEviction(CNode& pto, int64_t time_in_seconds) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
@@ -81,10 +90,13 @@ public:
     /** If we have extra outbound peers, try to disconnect the one with the oldest block announcement */
     void EvictExtraOutboundPeers(int64_t time_in_seconds) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     /** Retrieve unbroadcast transactions from the mempool and reattempt sending to peers */
-    void ReattemptInitialBroadcast(CScheduler& scheduler) const;
+    void ReattemptInitialBroadcast(CScheduler& scheduler);
+
+    /** Relay transaction to every node */
+    void RelayTransaction(const uint256& txid);
 
     /** Process a single message from a peer. Public for fuzz testing */
-    void ProcessMessage(CNode& pfrom, const std::string& msg_type, CDataStream& vRecv,
+    void ProcessMessage(CNode& pfrom, const std::string& msg_type, CRecvStream& vRecv,
                         const std::chrono::microseconds time_received, const std::atomic<bool>& interruptMsgProc);
 
     /**
@@ -123,6 +135,9 @@ private:
     bool MaybeDiscourageAndDisconnect(CNode& pnode);
 
     void ProcessOrphanTx(std::set<uint256>& orphan_work_set) EXCLUSIVE_LOCKS_REQUIRED(cs_main, g_cs_orphans);
+    /** Relay, orphan or reject a transaction received from a peer, depending on whether the mempool accepted it. */
+    void ProcessTxValidationResult(CNode& pfrom, const CTransactionRef& ptx, const TxValidationState& state)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main, g_cs_orphans);
     /** Process a single headers message from a peer. */
     void ProcessHeadersMessage(CNode& pfrom, const std::vector<CBlockHeader>& headers, bool via_compact_block);
 
@@ -140,7 +155,15 @@ private:
     BanMan* const m_banman;
     ChainstateManager& m_chainman;
     CTxMemPool& m_mempool;
+    //! Cache of serialized blocks served to peers, may be nullptr
+    BlockCache* const m_block_cache;
     TxRequestTracker m_txrequest GUARDED_BY(::cs_main);
+    //! Transactions to announce, shared by all tx-relay peers
+    TxAnnouncementQueue m_tx_announce;
+
+    Mutex m_tx_batch_mutex;
+    //! Transactions received in the current round of the message handler, see FinishMessageRound
+    std::vector<std::pair<CNode*, CTransactionRef>> m_tx_batch GUARDED_BY(m_tx_batch_mutex);
 
     int64_t m_stale_tip_check_time; //!< Next time to check for stale tip
 };
@@ -155,7 +178,4 @@ struct CNodeStateStats {
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 
-/** Relay transaction to every node */
-void RelayTransaction(const uint256& txid, const uint256& wtxid, const CConnman& connman) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
-
 #endif // BITCOIN_NET_PROCESSING_H
@@ -0,0 +1,102 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/blockcache.h>
+
+#include <chainparams.h>
+#include <logging.h>
+#include <net.h>
+#include <pow.h>
+#include <primitives/block.h>
+#include <protocol.h>
+#include <streams.h>
+#include <validation.h>
+#include <version.h>
+
+std::shared_ptr<const CSharedNetMsg> BlockCache::Get(const uint256& hash, bool witness)
+{
+    LOCK(m_mutex);
+    const auto it = m_index.find(Key(hash, witness));
+    if (it == m_index.end()) {
+        ++m_misses;
+        return nullptr;
+    }
+    ++m_hits;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return it->second->msg;
+}
+
+void BlockCache::Add(const uint256& hash, bool witness, std::shared_ptr<const CSharedNetMsg> msg)
+{
+    const size_t size = msg->data->size();
+    if (size > m_max_size) return;
+
+    LOCK(m_mutex);
+    const Key key(hash, witness);
+    if (m_index.count(key)) return;
+    m_entries.push_front({key, std::move(msg)});
+    m_index.emplace(key, m_entries.begin());
+    m_size += size;
+    while (m_size > m_max_size) {
+        const Entry& oldest = m_entries.back();
+        m_size -= oldest.msg->data->size();
+        m_index.erase(oldest.key);
+        m_entries.pop_back();
+    }
+}
+
+BlockCache::Stats BlockCache::GetStats() const
+{
+    LOCK(m_mutex);
+    Stats stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.entries = m_entries.size();
+    stats.size = m_size;
+    stats.max_size = m_max_size;
+    return stats;
+}
+
+std::shared_ptr<const CSharedNetMsg> GetSerializedBlock(BlockCache* cache, const CBlockIndex* pindex, bool witness, const CChainParams& chainparams, const CBlock* block)
+{
+    const uint256 hash = pindex->GetBlockHash();
+    if (cache) {
+        std::shared_ptr<const CSharedNetMsg> cached = cache->Get(hash, witness);
+        if (cached) return cached;
+    }
+
+    const int ser_version = PROTOCOL_VERSION | (witness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS);
+    CSerializedNetMsg msg;
+    msg.m_type = NetMsgType::BLOCK;
+    if (block) {
+        CVectorWriter{SER_NETWORK, ser_version, msg.data, 0, *block};
+    } else if (witness) {
+        // The network format matches the format on disk
+        if (!ReadRawBlockFromDisk(msg.data, pindex, chainparams.MessageStart())) return nullptr;
+        // The bytes are served without being parsed, so check the header as ReadBlockFromDisk would
+        CBlockHeader header;
+        try {
+            VectorReader(SER_NETWORK, ser_version, msg.data, 0) >> header;
+        } catch (const std::exception& e) {
+            LogPrintf("ERROR: %s: Deserialize of block header failed for %s: %s\n", __func__, hash.ToString(), e.what());
+            return nullptr;
+        }
+        if (header.GetHash() != hash) {
+            LogPrintf("ERROR: %s: GetHash() doesn't match index for %s\n", __func__, hash.ToString());
+            return nullptr;
+        }
+        if (!CheckProofOfWork(hash, header.nBits, chainparams.GetConsensus())) {
+            LogPrintf("ERROR: %s: Errors in block header for %s\n", __func__, hash.ToString());
+            return nullptr;
+        }
+    } else {
+        CBlock block_read;
+        if (!ReadBlockFromDisk(block_read, pindex, chainparams.GetConsensus())) return nullptr;
+        CVectorWriter{SER_NETWORK, ser_version, msg.data, 0, block_read};
+    }
+
+    std::shared_ptr<const CSharedNetMsg> shared = std::make_shared<const CSharedNetMsg>(std::move(msg));
+    if (cache) cache->Add(hash, witness, shared);
+    return shared;
+}
@@ -0,0 +1,82 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_BLOCKCACHE_H
+#define BITCOIN_NODE_BLOCKCACHE_H
+
+#include <sync.h>
+#include <uint256.h>
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <utility>
+
+class CBlock;
+class CBlockIndex;
+class CChainParams;
+struct CSharedNetMsg;
+
+//! Default for -blockcachesize, in MiB
+static constexpr int64_t DEFAULT_BLOCK_CACHE_SIZE = 32;
+//! Maximum for -blockcachesize, in MiB
+static constexpr int64_t MAX_BLOCK_CACHE_SIZE = 16384;
+
+/**
+ * Memory-bounded LRU cache of serialized blocks, keyed by block hash and by
+ * whether witness data is included.
+ *
+ * Entries are ready-to-send block messages, so a cached block can be queued
+ * for any number of peers, or returned over REST and RPC, without being read
+ * from disk and serialized again.
+ */
+class BlockCache
+{
+public:
+    struct Stats {
+        uint64_t hits{0};
+        uint64_t misses{0};
+        uint64_t entries{0};
+        uint64_t size{0};
+        uint64_t max_size{0};
+    };
+
+    explicit BlockCache(size_t max_size) : m_max_size(max_size) {}
+
+    /** Look up a serialized block, marking it as most recently used. Returns nullptr if it is not cached. */
+    std::shared_ptr<const CSharedNetMsg> Get(const uint256& hash, bool witness) LOCKS_EXCLUDED(m_mutex);
+    /** Cache a serialized block, evicting the least recently used ones to stay within the size limit. */
+    void Add(const uint256& hash, bool witness, std::shared_ptr<const CSharedNetMsg> msg) LOCKS_EXCLUDED(m_mutex);
+    Stats GetStats() const LOCKS_EXCLUDED(m_mutex);
+
+private:
+    using Key = std::pair<uint256, bool>;
+    struct Entry {
+        Key key;
+        std::shared_ptr<const CSharedNetMsg> msg;
+    };
+
+    const size_t m_max_size;
+    mutable Mutex m_mutex;
+    //! Entries, most recently used first
+    std::list<Entry> m_entries GUARDED_BY(m_mutex);
+    std::map<Key, std::list<Entry>::iterator> m_index GUARDED_BY(m_mutex);
+    size_t m_size GUARDED_BY(m_mutex){0};
+    uint64_t m_hits GUARDED_BY(m_mutex){0};
+    uint64_t m_misses GUARDED_BY(m_mutex){0};
+};
+
+/**
+ * Return the block of pindex serialized as a network block message, with or
+ * without witness data. It is taken from the cache if possible, otherwise
+ * serialized from block (if given) or read from disk, and added to the cache.
+ *
+ * @param[in] cache  The cache to use, may be nullptr
+ * @param[in] block  The block of pindex if it is at hand, may be nullptr
+ * @returns          The serialized block, or nullptr if it could not be read from disk
+ */
+std::shared_ptr<const CSharedNetMsg> GetSerializedBlock(BlockCache* cache, const CBlockIndex* pindex, bool witness, const CChainParams& chainparams, const CBlock* block = nullptr);
+
+#endif // BITCOIN_NODE_BLOCKCACHE_H
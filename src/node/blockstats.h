@@ -0,0 +1,65 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_BLOCKSTATS_H
+#define BITCOIN_NODE_BLOCKSTATS_H
+
+#include <amount.h>
+#include <serialize.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+static constexpr int NUM_GETBLOCKSTATS_PERCENTILES = 5;
+
+/**
+ * Per block statistics reported by getblockstats. Only the values which depend on the block
+ * contents are stored here; height, time and subsidy are taken from the block index.
+ */
+struct CBlockStats
+{
+    int64_t txs{0};
+    int64_t ins{0};
+    int64_t outs{0};
+    CAmount total_out{0};
+    int64_t total_size{0};
+    int64_t total_weight{0};
+    CAmount totalfee{0};
+    CAmount minfee{0};
+    CAmount maxfee{0};
+    CAmount medianfee{0};
+    CAmount minfeerate{0};
+    CAmount maxfeerate{0};
+    CAmount feerate_percentiles[NUM_GETBLOCKSTATS_PERCENTILES]{};
+    int64_t mintxsize{0};
+    int64_t maxtxsize{0};
+    int64_t mediantxsize{0};
+    int64_t swtxs{0};
+    int64_t swtotal_size{0};
+    int64_t swtotal_weight{0};
+    int64_t utxo_size_inc{0};
+
+    SERIALIZE_METHODS(CBlockStats, obj)
+    {
+        READWRITE(obj.txs, obj.ins, obj.outs, obj.total_out, obj.total_size, obj.total_weight);
+        READWRITE(obj.totalfee, obj.minfee, obj.maxfee, obj.medianfee, obj.minfeerate, obj.maxfeerate);
+        for (int i = 0; i < NUM_GETBLOCKSTATS_PERCENTILES; ++i) {
+            READWRITE(obj.feerate_percentiles[i]);
+        }
+        READWRITE(obj.mintxsize, obj.maxtxsize, obj.mediantxsize);
+        READWRITE(obj.swtxs, obj.swtotal_size, obj.swtotal_weight, obj.utxo_size_inc);
+    }
+};
+
+/** Used by getblockstats to get feerates at different percentiles by weight  */
+void CalculatePercentilesByWeight(CAmount result[NUM_GETBLOCKSTATS_PERCENTILES], std::vector<std::pair<CAmount, int64_t>>& scores, int64_t total_weight);
+
+//! Calculate the statistics of a block from the block and its undo data
+bool ComputeBlockStats(const CBlock& block, const CBlockUndo& block_undo, CBlockStats& stats);
+
+#endif // BITCOIN_NODE_BLOCKSTATS_H
@@ -8,6 +8,7 @@
 #include <interfaces/chain.h>
 #include <net.h>
 #include <net_processing.h>
+#include <node/blockcache.h>
 #include <scheduler.h>
 #include <txmempool.h>
 
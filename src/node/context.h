@@ -12,6 +12,7 @@
 
 class ArgsManager;
 class BanMan;
+class BlockCache;
 class CConnman;
 class CScheduler;
 class CTxMemPool;
@@ -37,6 +38,7 @@ struct NodeContext {
     std::unique_ptr<CConnman> connman;
     std::unique_ptr<CTxMemPool> mempool;
     std::unique_ptr<PeerManager> peerman;
+    std::unique_ptr<BlockCache> block_cache;
     ChainstateManager* chainman{nullptr}; // Currently a raw pointer because the memory is not managed by this struct
     std::unique_ptr<BanMan> banman;
     ArgsManager* args{nullptr}; // Currently a raw pointer because the memory is not managed by this struct
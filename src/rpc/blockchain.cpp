@@ -14,6 +14,11 @@
 #include <core_io.h>
 #include <hash.h>
 #include <index/blockfilterindex.h>
+#include <index/blockstatsindex.h>
+#include <index/scriptpubkeyindex.h>
+#include <key_io.h>
+#include <net.h>
+#include <node/blockcache.h>
 #include <node/coinstats.h>
 #include <node/context.h>
 #include <node/utxo_snapshot.h>
@@ -144,7 +149,7 @@ UniValue blockheaderToJSON(const CBlockIndex* tip, const CBlockIndex* blockindex
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* tip, const CBlockIndex* blockindex, bool txDetails)
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* tip, const CBlockIndex* blockindex, TxVerbosity verbosity)
 {
     // Serialize passed information without accessing chain state of the active chain!
     AssertLockNotHeld(cs_main); // For performance reasons
@@ -161,17 +166,27 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* tip, const CBlockIn
     result.pushKV("version", block.nVersion);
     result.pushKV("versionHex", strprintf("%08x", block.nVersion));
     result.pushKV("merkleroot", block.hashMerkleRoot.GetHex());
+
+    // The prevouts of all transactions are read with a single read of the block's undo data.
+    CBlockUndo blockUndo;
+    const bool have_undo = verbosity == TxVerbosity::SHOW_DETAILS_AND_PREVOUT &&
+        blockindex->nHeight > 0 &&
+        WITH_LOCK(::cs_main, return !IsBlockPruned(blockindex) && (blockindex->nStatus & BLOCK_HAVE_UNDO)) &&
+        UndoReadFromDisk(blockUndo, blockindex) &&
+        blockUndo.vtxundo.size() + 1 == block.vtx.size();
+
     UniValue txs(UniValue::VARR);
-    for(const auto& tx : block.vtx)
-    {
-        if(txDetails)
-        {
-            UniValue objTx(UniValue::VOBJ);
-            TxToUniv(*tx, uint256(), objTx, true, RPCSerializationFlags());
-            txs.push_back(objTx);
-        }
-        else
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        const CTransactionRef& tx = block.vtx[i];
+        if (verbosity == TxVerbosity::SHOW_TXID) {
             txs.push_back(tx->GetHash().GetHex());
+            continue;
+        }
+        // coinbase transaction (i == 0) doesn't have undo data
+        const CTxUndo* txundo = (have_undo && i > 0) ? &blockUndo.vtxundo[i - 1] : nullptr;
+        UniValue objTx(UniValue::VOBJ);
+        TxToUniv(*tx, uint256(), objTx, true, RPCSerializationFlags(), txundo);
+        txs.push_back(objTx);
     }
     result.pushKV("tx", txs);
     result.pushKV("time", block.GetBlockTime());
@@ -885,10 +900,11 @@ static RPCHelpMan getblock()
     return RPCHelpMan{"getblock",
                 "\nIf verbosity is 0, returns a string that is serialized, hex-encoded data for block 'hash'.\n"
                 "If verbosity is 1, returns an Object with information about block <hash>.\n"
-                "If verbosity is 2, returns an Object with information about block <hash> and information about each transaction. \n",
+                "If verbosity is 2, returns an Object with information about block <hash> and information about each transaction. \n"
+                "If verbosity is 3, returns an Object with information about block <hash> and information about each transaction, including prevout information for inputs (only for unpruned blocks in the current best chain).\n",
                 {
                     {"blockhash", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "The block hash"},
-                    {"verbosity|verbose", RPCArg::Type::NUM, /* default */ "1", "0 for hex-encoded data, 1 for a json object, and 2 for json object with transaction data"},
+                    {"verbosity|verbose", RPCArg::Type::NUM, /* default */ "1", "0 for hex-encoded data, 1 for a json object, 2 for json object with transaction data, and 3 for json object with transaction data including prevout information for inputs"},
                 },
                 {
                     RPCResult{"for verbosity = 0",
@@ -929,6 +945,37 @@ static RPCHelpMan getblock()
                         }},
                     }},
                 }},
+                    RPCResult{"for verbosity = 3",
+                RPCResult::Type::OBJ, "", "",
+                {
+                    {RPCResult::Type::ELISION, "", "Same output as verbosity = 2"},
+                    {RPCResult::Type::ARR, "tx", "",
+                    {
+                        {RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::NUM, "fee", "The transaction fee in " + CURRENCY_UNIT + ", omitted if block undo data is not available"},
+                            {RPCResult::Type::ARR, "vin", "",
+                            {
+                                {RPCResult::Type::OBJ, "", "",
+                                {
+                                    {RPCResult::Type::ELISION, "", "The same output as verbosity = 2"},
+                                    {RPCResult::Type::OBJ, "prevout", "(Only if undo information is available)",
+                                    {
+                                        {RPCResult::Type::BOOL, "generated", "Coinbase or not"},
+                                        {RPCResult::Type::NUM, "height", "The height of the prevout"},
+                                        {RPCResult::Type::STR_AMOUNT, "value", "The value in " + CURRENCY_UNIT},
+                                        {RPCResult::Type::OBJ, "scriptPubKey", "",
+                                        {
+                                            {RPCResult::Type::STR, "asm", "The asm"},
+                                            {RPCResult::Type::STR, "hex", "The hex"},
+                                            {RPCResult::Type::STR, "type", "The type, eg 'pubkeyhash'"},
+                                        }},
+                                    }},
+                                }},
+                            }},
+                        }},
+                    }},
+                }},
         },
                 RPCExamples{
                     HelpExampleCli("getblock", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
@@ -958,18 +1005,31 @@ static RPCHelpMan getblock()
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
         }
 
+        if (verbosity <= 0) {
+            if (IsBlockPruned(pblockindex)) {
+                throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+            }
+            const bool witness = !(RPCSerializationFlags() & SERIALIZE_TRANSACTION_NO_WITNESS);
+            const std::shared_ptr<const CSharedNetMsg> block_msg = GetSerializedBlock(EnsureNodeContext(request.context).block_cache.get(), pblockindex, witness, Params());
+            if (!block_msg) {
+                throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+            }
+            return HexStr(*block_msg->data);
+        }
+
         block = GetBlockChecked(pblockindex);
     }
 
-    if (verbosity <= 0)
-    {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock);
-        return strHex;
+    TxVerbosity tx_verbosity;
+    if (verbosity == 1) {
+        tx_verbosity = TxVerbosity::SHOW_TXID;
+    } else if (verbosity == 2) {
+        tx_verbosity = TxVerbosity::SHOW_DETAILS;
+    } else {
+        tx_verbosity = TxVerbosity::SHOW_DETAILS_AND_PREVOUT;
     }
 
-    return blockToJSON(block, tip, pblockindex, verbosity >= 2);
+    return blockToJSON(block, tip, pblockindex, tx_verbosity);
 },
     };
 }
@@ -1477,6 +1537,8 @@ static RPCHelpMan getchaintips()
 
 UniValue MempoolInfoToJSON(const CTxMemPool& pool)
 {
+    const size_t notifications_pending = GetMainSignals().CallbacksPending();
+    const size_t notifications_pending_total = GetMainSignals().TotalCallbacksPending();
     // Make sure this call is atomic in the pool.
     LOCK(pool.cs);
     UniValue ret(UniValue::VOBJ);
@@ -1489,6 +1551,8 @@ UniValue MempoolInfoToJSON(const CTxMemPool& pool)
     ret.pushKV("mempoolminfee", ValueFromAmount(std::max(pool.GetMinFee(maxmempool), ::minRelayTxFee).GetFeePerK()));
     ret.pushKV("minrelaytxfee", ValueFromAmount(::minRelayTxFee.GetFeePerK()));
     ret.pushKV("unbroadcastcount", uint64_t{pool.GetUnbroadcastTxs().size()});
+    ret.pushKV("notificationspending", uint64_t{notifications_pending});
+    ret.pushKV("notificationspendingtotal", uint64_t{notifications_pending_total});
     return ret;
 }
 
@@ -1507,7 +1571,9 @@ static RPCHelpMan getmempoolinfo()
                         {RPCResult::Type::NUM, "maxmempool", "Maximum memory usage for the mempool"},
                         {RPCResult::Type::STR_AMOUNT, "mempoolminfee", "Minimum fee rate in " + CURRENCY_UNIT + "/kB for tx to be accepted. Is the maximum of minrelaytxfee and minimum mempool fee"},
                         {RPCResult::Type::STR_AMOUNT, "minrelaytxfee", "Current minimum relay fee for transactions"},
-                        {RPCResult::Type::NUM, "unbroadcastcount", "Current number of transactions that haven't passed initial broadcast yet"}
+                        {RPCResult::Type::NUM, "unbroadcastcount", "Current number of transactions that haven't passed initial broadcast yet"},
+                        {RPCResult::Type::NUM, "notificationspending", "Number of validation notifications (mempool and block events) waiting in the queue of the subscriber, such as a wallet or an index, furthest behind"},
+                        {RPCResult::Type::NUM, "notificationspendingtotal", "Number of validation notifications waiting in the queues of all subscribers together"}
                     }},
                 RPCExamples{
                     HelpExampleCli("getmempoolinfo", "")
@@ -1717,67 +1783,146 @@ static RPCHelpMan getchaintxstats()
     };
 }
 
-template<typename T>
-static T CalculateTruncatedMedian(std::vector<T>& scores)
+/** The statistics reported by getblockstats and getblockstatsrange. */
+static std::vector<RPCResult> BlockStatsResultFields()
 {
-    size_t size = scores.size();
-    if (size == 0) {
-        return 0;
-    }
+    return {
+            {RPCResult::Type::NUM, "avgfee", "Average fee in the block"},
+            {RPCResult::Type::NUM, "avgfeerate", "Average feerate (in satoshis per virtual byte)"},
+            {RPCResult::Type::NUM, "avgtxsize", "Average transaction size"},
+            {RPCResult::Type::STR_HEX, "blockhash", "The block hash (to check for potential reorgs)"},
+            {RPCResult::Type::ARR_FIXED, "feerate_percentiles", "Feerates at the 10th, 25th, 50th, 75th, and 90th percentile weight unit (in satoshis per virtual byte)",
+            {
+                {RPCResult::Type::NUM, "10th_percentile_feerate", "The 10th percentile feerate"},
+                {RPCResult::Type::NUM, "25th_percentile_feerate", "The 25th percentile feerate"},
+                {RPCResult::Type::NUM, "50th_percentile_feerate", "The 50th percentile feerate"},
+                {RPCResult::Type::NUM, "75th_percentile_feerate", "The 75th percentile feerate"},
+                {RPCResult::Type::NUM, "90th_percentile_feerate", "The 90th percentile feerate"},
+            }},
+            {RPCResult::Type::NUM, "height", "The height of the block"},
+            {RPCResult::Type::NUM, "ins", "The number of inputs (excluding coinbase)"},
+            {RPCResult::Type::NUM, "maxfee", "Maximum fee in the block"},
+            {RPCResult::Type::NUM, "maxfeerate", "Maximum feerate (in satoshis per virtual byte)"},
+            {RPCResult::Type::NUM, "maxtxsize", "Maximum transaction size"},
+            {RPCResult::Type::NUM, "medianfee", "Truncated median fee in the block"},
+            {RPCResult::Type::NUM, "mediantime", "The block median time past"},
+            {RPCResult::Type::NUM, "mediantxsize", "Truncated median transaction size"},
+            {RPCResult::Type::NUM, "minfee", "Minimum fee in the block"},
+            {RPCResult::Type::NUM, "minfeerate", "Minimum feerate (in satoshis per virtual byte)"},
+            {RPCResult::Type::NUM, "mintxsize", "Minimum transaction size"},
+            {RPCResult::Type::NUM, "outs", "The number of outputs"},
+            {RPCResult::Type::NUM, "subsidy", "The block subsidy"},
+            {RPCResult::Type::NUM, "swtotal_size", "Total size of all segwit transactions"},
+            {RPCResult::Type::NUM, "swtotal_weight", "Total weight of all segwit transactions"},
+            {RPCResult::Type::NUM, "swtxs", "The number of segwit transactions"},
+            {RPCResult::Type::NUM, "time", "The block time"},
+            {RPCResult::Type::NUM, "total_out", "Total amount in all outputs (excluding coinbase and thus reward [ie subsidy + totalfee])"},
+            {RPCResult::Type::NUM, "total_size", "Total size of all non-coinbase transactions"},
+            {RPCResult::Type::NUM, "total_weight", "Total weight of all non-coinbase transactions"},
+            {RPCResult::Type::NUM, "totalfee", "The fee total"},
+            {RPCResult::Type::NUM, "txs", "The number of transactions (including coinbase)"},
+            {RPCResult::Type::NUM, "utxo_increase", "The increase/decrease in the number of unspent outputs"},
+            {RPCResult::Type::NUM, "utxo_size_inc", "The increase/decrease in size for the utxo index (not discounting op_return and similar)"},
+    };
+}
 
-    std::sort(scores.begin(), scores.end());
-    if (size % 2 == 0) {
-        return (scores[size / 2 - 1] + scores[size / 2]) / 2;
-    } else {
-        return scores[size / 2];
+static std::set<std::string> ParseSelectedStats(const UniValue& param)
+{
+    std::set<std::string> stats;
+    if (!param.isNull()) {
+        const UniValue stats_univalue = param.get_array();
+        for (unsigned int i = 0; i < stats_univalue.size(); i++) {
+            const std::string stat = stats_univalue[i].get_str();
+            stats.insert(stat);
+        }
     }
+    return stats;
 }
 
-void CalculatePercentilesByWeight(CAmount result[NUM_GETBLOCKSTATS_PERCENTILES], std::vector<std::pair<CAmount, int64_t>>& scores, int64_t total_weight)
+/**
+ * Get the statistics of a block, from the block statistics index if it has been indexed already,
+ * and otherwise by reading the block and its undo data from disk.
+ */
+static CBlockStats GetBlockStats(const CBlockIndex* pindex) LOCKS_EXCLUDED(cs_main)
 {
-    if (scores.empty()) {
-        return;
+    CBlockStats stats;
+    if (g_blockstatsindex && g_blockstatsindex->LookupStats(pindex, stats)) {
+        return stats;
     }
 
-    std::sort(scores.begin(), scores.end());
-
-    // 10th, 25th, 50th, 75th, and 90th percentile weight units.
-    const double weights[NUM_GETBLOCKSTATS_PERCENTILES] = {
-        total_weight / 10.0, total_weight / 4.0, total_weight / 2.0, (total_weight * 3.0) / 4.0, (total_weight * 9.0) / 10.0
-    };
-
-    int64_t next_percentile_index = 0;
-    int64_t cumulative_weight = 0;
-    for (const auto& element : scores) {
-        cumulative_weight += element.second;
-        while (next_percentile_index < NUM_GETBLOCKSTATS_PERCENTILES && cumulative_weight >= weights[next_percentile_index]) {
-            result[next_percentile_index] = element.first;
-            ++next_percentile_index;
+    CBlock block;
+    CBlockUndo blockUndo;
+    {
+        LOCK(cs_main);
+        block = GetBlockChecked(pindex);
+        // The genesis block has no undo data, and its coinbase has no inputs to look up.
+        if (pindex->nHeight > 0) {
+            blockUndo = GetUndoChecked(pindex);
         }
     }
-
-    // Fill any remaining percentiles with the last value.
-    for (int64_t i = next_percentile_index; i < NUM_GETBLOCKSTATS_PERCENTILES; i++) {
-        result[i] = scores.back().first;
-    }
+    CHECK_NONFATAL(ComputeBlockStats(block, blockUndo, stats));
+    return stats;
 }
 
-template<typename T>
-static inline bool SetHasKeys(const std::set<T>& set) {return false;}
-template<typename T, typename Tk, typename... Args>
-static inline bool SetHasKeys(const std::set<T>& set, const Tk& key, const Args&... args)
+static UniValue BlockStatsToJSON(const CBlockIndex* pindex, const CBlockStats& stats, const std::set<std::string>& selected)
 {
-    return (set.count(key) != 0) || SetHasKeys(set, args...);
-}
+    UniValue feerates_res(UniValue::VARR);
+    for (int64_t i = 0; i < NUM_GETBLOCKSTATS_PERCENTILES; i++) {
+        feerates_res.push_back(stats.feerate_percentiles[i]);
+    }
 
-// outpoint (needed for the utxo index) + nHeight + fCoinBase
-static constexpr size_t PER_UTXO_OVERHEAD = sizeof(COutPoint) + sizeof(uint32_t) + sizeof(bool);
+    UniValue ret_all(UniValue::VOBJ);
+    ret_all.pushKV("avgfee", (stats.txs > 1) ? stats.totalfee / (stats.txs - 1) : 0);
+    ret_all.pushKV("avgfeerate", stats.total_weight ? (stats.totalfee * WITNESS_SCALE_FACTOR) / stats.total_weight : 0); // Unit: sat/vbyte
+    ret_all.pushKV("avgtxsize", (stats.txs > 1) ? stats.total_size / (stats.txs - 1) : 0);
+    ret_all.pushKV("blockhash", pindex->GetBlockHash().GetHex());
+    ret_all.pushKV("feerate_percentiles", feerates_res);
+    ret_all.pushKV("height", (int64_t)pindex->nHeight);
+    ret_all.pushKV("ins", stats.ins);
+    ret_all.pushKV("maxfee", stats.maxfee);
+    ret_all.pushKV("maxfeerate", stats.maxfeerate);
+    ret_all.pushKV("maxtxsize", stats.maxtxsize);
+    ret_all.pushKV("medianfee", stats.medianfee);
+    ret_all.pushKV("mediantime", pindex->GetMedianTimePast());
+    ret_all.pushKV("mediantxsize", stats.mediantxsize);
+    ret_all.pushKV("minfee", stats.minfee);
+    ret_all.pushKV("minfeerate", stats.minfeerate);
+    ret_all.pushKV("mintxsize", stats.mintxsize);
+    ret_all.pushKV("outs", stats.outs);
+    ret_all.pushKV("subsidy", GetBlockSubsidy(pindex->nHeight, Params().GetConsensus()));
+    ret_all.pushKV("swtotal_size", stats.swtotal_size);
+    ret_all.pushKV("swtotal_weight", stats.swtotal_weight);
+    ret_all.pushKV("swtxs", stats.swtxs);
+    ret_all.pushKV("time", pindex->GetBlockTime());
+    ret_all.pushKV("total_out", stats.total_out);
+    ret_all.pushKV("total_size", stats.total_size);
+    ret_all.pushKV("total_weight", stats.total_weight);
+    ret_all.pushKV("totalfee", stats.totalfee);
+    ret_all.pushKV("txs", stats.txs);
+    ret_all.pushKV("utxo_increase", stats.outs - stats.ins);
+    ret_all.pushKV("utxo_size_inc", stats.utxo_size_inc);
+
+    if (selected.empty()) { // Return everything if nothing selected (default)
+        return ret_all;
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    for (const std::string& stat : selected) {
+        const UniValue& value = ret_all[stat];
+        if (value.isNull()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid selected statistic %s", stat));
+        }
+        ret.pushKV(stat, value);
+    }
+    return ret;
+}
 
 static RPCHelpMan getblockstats()
 {
     return RPCHelpMan{"getblockstats",
                 "\nCompute per block statistics for a given window. All amounts are in satoshis.\n"
-                "It won't work for some heights with pruning.\n",
+                "It won't work for some heights with pruning.\n"
+                "With -blockstatsindex, statistics are read from the index once the block has been indexed.\n",
                 {
                     {"hash_or_height", RPCArg::Type::NUM, RPCArg::Optional::NO, "The block hash or height of the target block", "", {"", "string or numeric"}},
                     {"stats", RPCArg::Type::ARR, /* default */ "all values", "Values to plot (see result below)",
@@ -1788,45 +1933,7 @@ static RPCHelpMan getblockstats()
                         "stats"},
                 },
                 RPCResult{
-            RPCResult::Type::OBJ, "", "",
-            {
-                {RPCResult::Type::NUM, "avgfee", "Average fee in the block"},
-                {RPCResult::Type::NUM, "avgfeerate", "Average feerate (in satoshis per virtual byte)"},
-                {RPCResult::Type::NUM, "avgtxsize", "Average transaction size"},
-                {RPCResult::Type::STR_HEX, "blockhash", "The block hash (to check for potential reorgs)"},
-                {RPCResult::Type::ARR_FIXED, "feerate_percentiles", "Feerates at the 10th, 25th, 50th, 75th, and 90th percentile weight unit (in satoshis per virtual byte)",
-                {
-                    {RPCResult::Type::NUM, "10th_percentile_feerate", "The 10th percentile feerate"},
-                    {RPCResult::Type::NUM, "25th_percentile_feerate", "The 25th percentile feerate"},
-                    {RPCResult::Type::NUM, "50th_percentile_feerate", "The 50th percentile feerate"},
-                    {RPCResult::Type::NUM, "75th_percentile_feerate", "The 75th percentile feerate"},
-                    {RPCResult::Type::NUM, "90th_percentile_feerate", "The 90th percentile feerate"},
-                }},
-                {RPCResult::Type::NUM, "height", "The height of the block"},
-                {RPCResult::Type::NUM, "ins", "The number of inputs (excluding coinbase)"},
-                {RPCResult::Type::NUM, "maxfee", "Maximum fee in the block"},
-                {RPCResult::Type::NUM, "maxfeerate", "Maximum feerate (in satoshis per virtual byte)"},
-                {RPCResult::Type::NUM, "maxtxsize", "Maximum transaction size"},
-                {RPCResult::Type::NUM, "medianfee", "Truncated median fee in the block"},
-                {RPCResult::Type::NUM, "mediantime", "The block median time past"},
-                {RPCResult::Type::NUM, "mediantxsize", "Truncated median transaction size"},
-                {RPCResult::Type::NUM, "minfee", "Minimum fee in the block"},
-                {RPCResult::Type::NUM, "minfeerate", "Minimum feerate (in satoshis per virtual byte)"},
-                {RPCResult::Type::NUM, "mintxsize", "Minimum transaction size"},
-                {RPCResult::Type::NUM, "outs", "The number of outputs"},
-                {RPCResult::Type::NUM, "subsidy", "The block subsidy"},
-                {RPCResult::Type::NUM, "swtotal_size", "Total size of all segwit transactions"},
-                {RPCResult::Type::NUM, "swtotal_weight", "Total weight of all segwit transactions"},
-                {RPCResult::Type::NUM, "swtxs", "The number of segwit transactions"},
-                {RPCResult::Type::NUM, "time", "The block time"},
-                {RPCResult::Type::NUM, "total_out", "Total amount in all outputs (excluding coinbase and thus reward [ie subsidy + totalfee])"},
-                {RPCResult::Type::NUM, "total_size", "Total size of all non-coinbase transactions"},
-                {RPCResult::Type::NUM, "total_weight", "Total weight of all non-coinbase transactions"},
-                {RPCResult::Type::NUM, "totalfee", "The fee total"},
-                {RPCResult::Type::NUM, "txs", "The number of transactions (including coinbase)"},
-                {RPCResult::Type::NUM, "utxo_increase", "The increase/decrease in the number of unspent outputs"},
-                {RPCResult::Type::NUM, "utxo_size_inc", "The increase/decrease in size for the utxo index (not discounting op_return and similar)"},
-            }},
+            RPCResult::Type::OBJ, "", "", BlockStatsResultFields()},
                 RPCExamples{
                     HelpExampleCli("getblockstats", R"('"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09"' '["minfeerate","avgfeerate"]')") +
                     HelpExampleCli("getblockstats", R"(1000 '["minfeerate","avgfeerate"]')") +
@@ -1835,199 +1942,111 @@ static RPCHelpMan getblockstats()
                 },
         [&](const RPCHelpMan& self, const JSONRPCRequest& request) -> UniValue
 {
-    LOCK(cs_main);
-
-    CBlockIndex* pindex;
-    if (request.params[0].isNum()) {
-        const int height = request.params[0].get_int();
-        const int current_tip = ::ChainActive().Height();
-        if (height < 0) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d is negative", height));
-        }
-        if (height > current_tip) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d after current tip %d", height, current_tip));
-        }
-
-        pindex = ::ChainActive()[height];
-    } else {
-        const uint256 hash(ParseHashV(request.params[0], "hash_or_height"));
-        pindex = LookupBlockIndex(hash);
-        if (!pindex) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-        }
-        if (!::ChainActive().Contains(pindex)) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Block is not in chain %s", Params().NetworkIDString()));
-        }
-    }
-
-    CHECK_NONFATAL(pindex != nullptr);
-
-    std::set<std::string> stats;
-    if (!request.params[1].isNull()) {
-        const UniValue stats_univalue = request.params[1].get_array();
-        for (unsigned int i = 0; i < stats_univalue.size(); i++) {
-            const std::string stat = stats_univalue[i].get_str();
-            stats.insert(stat);
-        }
-    }
-
-    const CBlock block = GetBlockChecked(pindex);
-    const CBlockUndo blockUndo = GetUndoChecked(pindex);
-
-    const bool do_all = stats.size() == 0; // Calculate everything if nothing selected (default)
-    const bool do_mediantxsize = do_all || stats.count("mediantxsize") != 0;
-    const bool do_medianfee = do_all || stats.count("medianfee") != 0;
-    const bool do_feerate_percentiles = do_all || stats.count("feerate_percentiles") != 0;
-    const bool loop_inputs = do_all || do_medianfee || do_feerate_percentiles ||
-        SetHasKeys(stats, "utxo_size_inc", "totalfee", "avgfee", "avgfeerate", "minfee", "maxfee", "minfeerate", "maxfeerate");
-    const bool loop_outputs = do_all || loop_inputs || stats.count("total_out");
-    const bool do_calculate_size = do_mediantxsize ||
-        SetHasKeys(stats, "total_size", "avgtxsize", "mintxsize", "maxtxsize", "swtotal_size");
-    const bool do_calculate_weight = do_all || SetHasKeys(stats, "total_weight", "avgfeerate", "swtotal_weight", "avgfeerate", "feerate_percentiles", "minfeerate", "maxfeerate");
-    const bool do_calculate_sw = do_all || SetHasKeys(stats, "swtxs", "swtotal_size", "swtotal_weight");
-
-    CAmount maxfee = 0;
-    CAmount maxfeerate = 0;
-    CAmount minfee = MAX_MONEY;
-    CAmount minfeerate = MAX_MONEY;
-    CAmount total_out = 0;
-    CAmount totalfee = 0;
-    int64_t inputs = 0;
-    int64_t maxtxsize = 0;
-    int64_t mintxsize = MAX_BLOCK_SERIALIZED_SIZE;
-    int64_t outputs = 0;
-    int64_t swtotal_size = 0;
-    int64_t swtotal_weight = 0;
-    int64_t swtxs = 0;
-    int64_t total_size = 0;
-    int64_t total_weight = 0;
-    int64_t utxo_size_inc = 0;
-    std::vector<CAmount> fee_array;
-    std::vector<std::pair<CAmount, int64_t>> feerate_array;
-    std::vector<int64_t> txsize_array;
-
-    for (size_t i = 0; i < block.vtx.size(); ++i) {
-        const auto& tx = block.vtx.at(i);
-        outputs += tx->vout.size();
-
-        CAmount tx_total_out = 0;
-        if (loop_outputs) {
-            for (const CTxOut& out : tx->vout) {
-                tx_total_out += out.nValue;
-                utxo_size_inc += GetSerializeSize(out, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD;
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        if (request.params[0].isNum()) {
+            const int height = request.params[0].get_int();
+            const int current_tip = ::ChainActive().Height();
+            if (height < 0) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d is negative", height));
+            }
+            if (height > current_tip) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d after current tip %d", height, current_tip));
             }
-        }
-
-        if (tx->IsCoinBase()) {
-            continue;
-        }
-
-        inputs += tx->vin.size(); // Don't count coinbase's fake input
-        total_out += tx_total_out; // Don't count coinbase reward
-
-        int64_t tx_size = 0;
-        if (do_calculate_size) {
 
-            tx_size = tx->GetTotalSize();
-            if (do_mediantxsize) {
-                txsize_array.push_back(tx_size);
+            pindex = ::ChainActive()[height];
+        } else {
+            const uint256 hash(ParseHashV(request.params[0], "hash_or_height"));
+            pindex = LookupBlockIndex(hash);
+            if (!pindex) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+            }
+            if (!::ChainActive().Contains(pindex)) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Block is not in chain %s", Params().NetworkIDString()));
             }
-            maxtxsize = std::max(maxtxsize, tx_size);
-            mintxsize = std::min(mintxsize, tx_size);
-            total_size += tx_size;
         }
+    }
 
-        int64_t weight = 0;
-        if (do_calculate_weight) {
-            weight = GetTransactionWeight(*tx);
-            total_weight += weight;
-        }
+    CHECK_NONFATAL(pindex != nullptr);
 
-        if (do_calculate_sw && tx->HasWitness()) {
-            ++swtxs;
-            swtotal_size += tx_size;
-            swtotal_weight += weight;
-        }
+    const std::set<std::string> stats = ParseSelectedStats(request.params[1]);
+    return BlockStatsToJSON(pindex, GetBlockStats(pindex), stats);
+},
+    };
+}
 
-        if (loop_inputs) {
-            CAmount tx_total_in = 0;
-            const auto& txundo = blockUndo.vtxundo.at(i - 1);
-            for (const Coin& coin: txundo.vprevout) {
-                const CTxOut& prevoutput = coin.out;
+/** Maximum number of blocks a single getblockstatsrange call may cover */
+static constexpr int MAX_BLOCK_STATS_RANGE = 10000;
 
-                tx_total_in += prevoutput.nValue;
-                utxo_size_inc -= GetSerializeSize(prevoutput, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD;
-            }
+static RPCHelpMan getblockstatsrange()
+{
+    return RPCHelpMan{"getblockstatsrange",
+                "\nCompute per block statistics for a range of blocks in the active chain. All amounts are in satoshis.\n"
+                "With -blockstatsindex, the statistics of all indexed blocks are read with a single index scan.\n"
+                + strprintf("The range may cover at most %d blocks.\n", MAX_BLOCK_STATS_RANGE) +
+                "It won't work for some heights with pruning.\n",
+                {
+                    {"start_height", RPCArg::Type::NUM, RPCArg::Optional::NO, "The height of the first block"},
+                    {"stop_height", RPCArg::Type::NUM, RPCArg::Optional::NO, "The height of the last block"},
+                    {"stats", RPCArg::Type::ARR, /* default */ "all values", "Values to plot (see getblockstats)",
+                        {
+                            {"height", RPCArg::Type::STR, RPCArg::Optional::OMITTED, "Selected statistic"},
+                            {"time", RPCArg::Type::STR, RPCArg::Optional::OMITTED, "Selected statistic"},
+                        },
+                        "stats"},
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "The statistics of each block, in order of height",
+                    {
+                        {RPCResult::Type::OBJ, "", "", BlockStatsResultFields()},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getblockstatsrange", R"(1000 1100 '["height","avgfeerate"]')") +
+                    HelpExampleRpc("getblockstatsrange", R"(1000, 1100, ["height","avgfeerate"])")
+                },
+        [&](const RPCHelpMan& self, const JSONRPCRequest& request) -> UniValue
+{
+    const int start_height = request.params[0].get_int();
+    const int stop_height = request.params[1].get_int();
+    if (start_height < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Start height %d is negative", start_height));
+    }
+    if (stop_height < start_height) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Stop height %d is less than start height %d", stop_height, start_height));
+    }
+    if (stop_height - start_height >= MAX_BLOCK_STATS_RANGE) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Range of %d blocks exceeds the maximum of %d", stop_height - start_height + 1, MAX_BLOCK_STATS_RANGE));
+    }
 
-            CAmount txfee = tx_total_in - tx_total_out;
-            CHECK_NONFATAL(MoneyRange(txfee));
-            if (do_medianfee) {
-                fee_array.push_back(txfee);
-            }
-            maxfee = std::max(maxfee, txfee);
-            minfee = std::min(minfee, txfee);
-            totalfee += txfee;
-
-            // New feerate uses satoshis per virtual byte instead of per serialized byte
-            CAmount feerate = weight ? (txfee * WITNESS_SCALE_FACTOR) / weight : 0;
-            if (do_feerate_percentiles) {
-                feerate_array.emplace_back(std::make_pair(feerate, weight));
-            }
-            maxfeerate = std::max(maxfeerate, feerate);
-            minfeerate = std::min(minfeerate, feerate);
+    const CBlockIndex* stop_index;
+    {
+        LOCK(cs_main);
+        const int current_tip = ::ChainActive().Height();
+        if (stop_height > current_tip) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Stop height %d after current tip %d", stop_height, current_tip));
         }
+        stop_index = ::ChainActive()[stop_height];
     }
 
-    CAmount feerate_percentiles[NUM_GETBLOCKSTATS_PERCENTILES] = { 0 };
-    CalculatePercentilesByWeight(feerate_percentiles, feerate_array, total_weight);
+    const std::set<std::string> selected = ParseSelectedStats(request.params[2]);
 
-    UniValue feerates_res(UniValue::VARR);
-    for (int64_t i = 0; i < NUM_GETBLOCKSTATS_PERCENTILES; i++) {
-        feerates_res.push_back(feerate_percentiles[i]);
+    // Serve the part of the range that has been indexed from the index, and compute the rest
+    // block by block.
+    std::vector<CBlockStats> stats;
+    if (!g_blockstatsindex || !g_blockstatsindex->LookupStatsRange(start_height, stop_index, stats)) {
+        stats.clear();
     }
 
-    UniValue ret_all(UniValue::VOBJ);
-    ret_all.pushKV("avgfee", (block.vtx.size() > 1) ? totalfee / (block.vtx.size() - 1) : 0);
-    ret_all.pushKV("avgfeerate", total_weight ? (totalfee * WITNESS_SCALE_FACTOR) / total_weight : 0); // Unit: sat/vbyte
-    ret_all.pushKV("avgtxsize", (block.vtx.size() > 1) ? total_size / (block.vtx.size() - 1) : 0);
-    ret_all.pushKV("blockhash", pindex->GetBlockHash().GetHex());
-    ret_all.pushKV("feerate_percentiles", feerates_res);
-    ret_all.pushKV("height", (int64_t)pindex->nHeight);
-    ret_all.pushKV("ins", inputs);
-    ret_all.pushKV("maxfee", maxfee);
-    ret_all.pushKV("maxfeerate", maxfeerate);
-    ret_all.pushKV("maxtxsize", maxtxsize);
-    ret_all.pushKV("medianfee", CalculateTruncatedMedian(fee_array));
-    ret_all.pushKV("mediantime", pindex->GetMedianTimePast());
-    ret_all.pushKV("mediantxsize", CalculateTruncatedMedian(txsize_array));
-    ret_all.pushKV("minfee", (minfee == MAX_MONEY) ? 0 : minfee);
-    ret_all.pushKV("minfeerate", (minfeerate == MAX_MONEY) ? 0 : minfeerate);
-    ret_all.pushKV("mintxsize", mintxsize == MAX_BLOCK_SERIALIZED_SIZE ? 0 : mintxsize);
-    ret_all.pushKV("outs", outputs);
-    ret_all.pushKV("subsidy", GetBlockSubsidy(pindex->nHeight, Params().GetConsensus()));
-    ret_all.pushKV("swtotal_size", swtotal_size);
-    ret_all.pushKV("swtotal_weight", swtotal_weight);
-    ret_all.pushKV("swtxs", swtxs);
-    ret_all.pushKV("time", pindex->GetBlockTime());
-    ret_all.pushKV("total_out", total_out);
-    ret_all.pushKV("total_size", total_size);
-    ret_all.pushKV("total_weight", total_weight);
-    ret_all.pushKV("totalfee", totalfee);
-    ret_all.pushKV("txs", (int64_t)block.vtx.size());
-    ret_all.pushKV("utxo_increase", outputs - inputs);
-    ret_all.pushKV("utxo_size_inc", utxo_size_inc);
-
-    if (do_all) {
-        return ret_all;
+    std::vector<const CBlockIndex*> block_indexes(stop_height - start_height + 1);
+    for (const CBlockIndex* pindex = stop_index; pindex && pindex->nHeight >= start_height; pindex = pindex->pprev) {
+        block_indexes[pindex->nHeight - start_height] = pindex;
     }
 
-    UniValue ret(UniValue::VOBJ);
-    for (const std::string& stat : stats) {
-        const UniValue& value = ret_all[stat];
-        if (value.isNull()) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid selected statistic %s", stat));
-        }
-        ret.pushKV(stat, value);
+    UniValue ret(UniValue::VARR);
+    for (size_t i = 0; i < block_indexes.size(); ++i) {
+        const CBlockIndex* pindex = block_indexes[i];
+        ret.push_back(BlockStatsToJSON(pindex, i < stats.size() ? stats[i] : GetBlockStats(pindex), selected));
     }
     return ret;
 },
@@ -2352,6 +2371,122 @@ static RPCHelpMan getblockfilter()
     };
 }
 
+static RPCHelpMan getscriptpubkeyhistory()
+{
+    return RPCHelpMan{"getscriptpubkeyhistory",
+                "\nReturns the funding and spending history of a scriptPubKey in the active chain, in chain order.\n"
+                "Requires -scriptpubkeyindex.\n",
+                {
+                    {"script", RPCArg::Type::STR, RPCArg::Optional::NO, "An address or a hex-encoded scriptPubKey"},
+                    {"count", RPCArg::Type::NUM, /* default */ "100", "The maximum number of entries to return"},
+                    {"cursor", RPCArg::Type::STR_HEX, /* default */ "start of the history", "The \"next\" value of a previous call, to continue after its last entry"},
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::STR_HEX, "scripthash", "The SHA256 of the scriptPubKey"},
+                        {RPCResult::Type::ARR, "history", "",
+                        {
+                            {RPCResult::Type::OBJ, "", "",
+                            {
+                                {RPCResult::Type::NUM, "height", "The height of the block containing the transaction"},
+                                {RPCResult::Type::STR_HEX, "blockhash", "The hash of the block containing the transaction"},
+                                {RPCResult::Type::STR_HEX, "txid", "The transaction id"},
+                                {RPCResult::Type::STR, "type", "\"funding\" if the transaction created an output, \"spending\" if it spent one"},
+                                {RPCResult::Type::NUM, "vout", /* optional */ true, "The output index (funding entries only)"},
+                                {RPCResult::Type::NUM, "vin", /* optional */ true, "The input index (spending entries only)"},
+                                {RPCResult::Type::STR_HEX, "prevout_txid", /* optional */ true, "The transaction id of the spent output (spending entries only)"},
+                                {RPCResult::Type::NUM, "prevout_vout", /* optional */ true, "The output index of the spent output (spending entries only)"},
+                                {RPCResult::Type::STR_AMOUNT, "amount", "The value of the output in " + CURRENCY_UNIT},
+                            }},
+                        }},
+                        {RPCResult::Type::STR_HEX, "next", /* optional */ true, "The cursor to pass to get the following entries (omitted at the end of the history)"},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getscriptpubkeyhistory", "\"76a91411b366edfc0a8b66feebae5c2e25a7b6a5d1cf3188ac\" 10") +
+                    HelpExampleRpc("getscriptpubkeyhistory", "\"76a91411b366edfc0a8b66feebae5c2e25a7b6a5d1cf3188ac\", 10")
+                },
+        [&](const RPCHelpMan& self, const JSONRPCRequest& request) -> UniValue
+{
+    if (!g_scriptpubkeyindex) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Requires -scriptpubkeyindex");
+    }
+
+    const std::string& script_str = request.params[0].get_str();
+    CScript script;
+    CTxDestination dest = DecodeDestination(script_str);
+    if (IsValidDestination(dest)) {
+        script = GetScriptForDestination(dest);
+    } else if (IsHex(script_str)) {
+        std::vector<unsigned char> script_bytes(ParseHex(script_str));
+        script = CScript(script_bytes.begin(), script_bytes.end());
+    } else {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address or scriptPubKey");
+    }
+
+    int count = request.params[1].isNull() ? 100 : request.params[1].get_int();
+    if (count < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
+    }
+
+    // The cursor identifies the last entry returned by the previous call
+    ScriptPubKeyHistoryEntry after;
+    if (!request.params[2].isNull()) {
+        CDataStream ssCursor(ParseHexV(request.params[2], "cursor"), SER_NETWORK, PROTOCOL_VERSION);
+        try {
+            ssCursor >> after.height >> after.txid >> after.n >> after.spending;
+        } catch (const std::exception&) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        }
+        if (!ssCursor.empty()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        }
+    }
+
+    g_scriptpubkeyindex->BlockUntilSyncedToCurrentChain();
+
+    // Look up one more entry than requested to tell whether the history continues
+    const uint256 script_hash = ScriptPubKeyIndex::HashScript(script);
+    std::vector<ScriptPubKeyHistoryEntry> entries;
+    if (!g_scriptpubkeyindex->FindScriptHistory(script_hash, request.params[2].isNull() ? nullptr : &after, count + size_t{1}, entries)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Failed to read scriptPubKey history from index");
+    }
+    const bool more = entries.size() > (size_t)count;
+    if (more) entries.pop_back();
+
+    UniValue history(UniValue::VARR);
+    for (const auto& entry : entries) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("height", entry.height);
+        obj.pushKV("blockhash", entry.block_hash.GetHex());
+        obj.pushKV("txid", entry.txid.GetHex());
+        if (entry.spending) {
+            obj.pushKV("type", "spending");
+            obj.pushKV("vin", (int64_t)entry.n);
+            obj.pushKV("prevout_txid", entry.prevout.hash.GetHex());
+            obj.pushKV("prevout_vout", (int64_t)entry.prevout.n);
+        } else {
+            obj.pushKV("type", "funding");
+            obj.pushKV("vout", (int64_t)entry.n);
+        }
+        obj.pushKV("amount", ValueFromAmount(entry.value));
+        history.push_back(obj);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("scripthash", script_hash.GetHex());
+    ret.pushKV("history", history);
+    if (more && !entries.empty()) {
+        const ScriptPubKeyHistoryEntry& last = entries.back();
+        CDataStream ssCursor(SER_NETWORK, PROTOCOL_VERSION);
+        ssCursor << last.height << last.txid << last.n << last.spending;
+        ret.pushKV("next", HexStr(ssCursor));
+    }
+    return ret;
+},
+    };
+}
+
 /**
  * Serialize the UTXO set to a file for loading elsewhere.
  *
@@ -2469,6 +2604,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      {} },
     { "blockchain",         "getchaintxstats",        &getchaintxstats,        {"nblocks", "blockhash"} },
     { "blockchain",         "getblockstats",          &getblockstats,          {"hash_or_height", "stats"} },
+    { "blockchain",         "getblockstatsrange",     &getblockstatsrange,     {"start_height", "stop_height", "stats"} },
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       {} },
     { "blockchain",         "getblockcount",          &getblockcount,          {} },
     { "blockchain",         "getblock",               &getblock,               {"blockhash","verbosity|verbose"} },
@@ -2490,6 +2626,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "preciousblock",          &preciousblock,          {"blockhash"} },
     { "blockchain",         "scantxoutset",           &scantxoutset,           {"action", "scanobjects"} },
     { "blockchain",         "getblockfilter",         &getblockfilter,         {"blockhash", "filtertype"} },
+    { "blockchain",         "getscriptpubkeyhistory", &getscriptpubkeyhistory, {"script", "count", "cursor"} },
 
     /* Not shown in help */
     { "hidden",             "invalidateblock",        &invalidateblock,        {"blockhash"} },
@@ -5,6 +5,8 @@
 
 #include <httpserver.h>
 #include <index/blockfilterindex.h>
+#include <index/blockstatsindex.h>
+#include <index/scriptpubkeyindex.h>
 #include <index/txindex.h>
 #include <interfaces/chain.h>
 #include <key_io.h>
@@ -15,12 +17,14 @@
 #include <rpc/util.h>
 #include <scheduler.h>
 #include <script/descriptor.h>
+#include <sync.h>
 #include <util/check.h>
 #include <util/message.h> // For MessageSign(), MessageVerify()
 #include <util/ref.h>
 #include <util/strencodings.h>
 #include <util/system.h>
 
+#include <algorithm>
 #include <stdint.h>
 #include <tuple>
 #ifdef HAVE_MALLOC_INFO
@@ -683,6 +687,14 @@ static RPCHelpMan getindexinfo()
         result.pushKVs(SummaryToJSON(g_txindex->GetSummary(), index_name));
     }
 
+    if (g_scriptpubkeyindex) {
+        result.pushKVs(SummaryToJSON(g_scriptpubkeyindex->GetSummary(), index_name));
+    }
+
+    if (g_blockstatsindex) {
+        result.pushKVs(SummaryToJSON(g_blockstatsindex->GetSummary(), index_name));
+    }
+
     ForEachBlockFilterIndex([&result, &index_name](const BlockFilterIndex& index) {
         result.pushKVs(SummaryToJSON(index.GetSummary(), index_name));
     });
@@ -692,6 +704,98 @@ static RPCHelpMan getindexinfo()
     };
 }
 
+static UniValue LockHistogramToUniv(const std::array<uint64_t, LOCK_STATS_BUCKETS>& histogram)
+{
+    UniValue ret(UniValue::VARR);
+    for (const uint64_t count : histogram) {
+        ret.push_back(count);
+    }
+    return ret;
+}
+
+static RPCHelpMan getlockstats()
+{
+    return RPCHelpMan{"getlockstats",
+                "Returns the lock contention statistics of every lock site (a LOCK in the source code) taken while recording was on,\n"
+                "sorted by total wait time. Recording is off by default, see -lockstats. It can be turned on and off at runtime.\n"
+                "Hold times of locks that are waited on with a condition variable include the time spent waiting.\n",
+                {
+                    {"enable", RPCArg::Type::BOOL, RPCArg::Optional::OMITTED_NAMED_ARG, "Turn recording on or off"},
+                    {"reset", RPCArg::Type::BOOL, /* default */ "false", "Clear the recorded statistics after returning them"},
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::BOOL, "enabled", "whether recording is on"},
+                        {RPCResult::Type::ARR, "locks", "",
+                        {
+                            {RPCResult::Type::OBJ, "", "",
+                            {
+                                {RPCResult::Type::STR, "name", "the locked mutex"},
+                                {RPCResult::Type::STR, "file", "source file of the lock site"},
+                                {RPCResult::Type::NUM, "line", "source line of the lock site"},
+                                {RPCResult::Type::NUM, "acquisitions", "number of times the lock was taken"},
+                                {RPCResult::Type::NUM, "contentions", "number of times the lock was held by another thread"},
+                                {RPCResult::Type::NUM, "wait_total", "total time spent waiting for the lock, in microseconds"},
+                                {RPCResult::Type::NUM, "wait_max", "longest wait for the lock, in microseconds"},
+                                {RPCResult::Type::NUM, "hold_total", "total time the lock was held, in microseconds"},
+                                {RPCResult::Type::NUM, "hold_max", "longest time the lock was held, in microseconds"},
+                                {RPCResult::Type::ARR_FIXED, "wait_histogram", "number of waits by duration. Entry 0 counts waits below 1 microsecond, entry n > 0 waits from 2^(n-1) up to 2^n microseconds. The last entry also counts all longer waits",
+                                {
+                                    {RPCResult::Type::NUM, "", ""},
+                                }},
+                                {RPCResult::Type::ARR_FIXED, "hold_histogram", "number of times the lock was held by duration, with the same buckets as wait_histogram",
+                                {
+                                    {RPCResult::Type::NUM, "", ""},
+                                }},
+                            }},
+                        }},
+                    }
+                },
+                RPCExamples{
+                    HelpExampleCli("getlockstats", "true")
+            + HelpExampleCli("getlockstats", "")
+            + HelpExampleRpc("getlockstats", "false, true")
+                },
+        [&](const RPCHelpMan& self, const JSONRPCRequest& request) -> UniValue
+{
+    if (!request.params[0].isNull()) {
+        SetLockStatsEnabled(request.params[0].get_bool());
+    }
+
+    std::vector<LockSiteInfo> sites = GetLockStats();
+    if (!request.params[1].isNull() && request.params[1].get_bool()) {
+        ResetLockStats();
+    }
+    std::sort(sites.begin(), sites.end(), [](const LockSiteInfo& a, const LockSiteInfo& b) {
+        return a.wait_total_ns > b.wait_total_ns;
+    });
+
+    UniValue locks(UniValue::VARR);
+    for (const LockSiteInfo& site : sites) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("name", site.name);
+        obj.pushKV("file", site.file);
+        obj.pushKV("line", site.line);
+        obj.pushKV("acquisitions", site.acquisitions);
+        obj.pushKV("contentions", site.contentions);
+        obj.pushKV("wait_total", site.wait_total_ns / 1000);
+        obj.pushKV("wait_max", site.wait_max_ns / 1000);
+        obj.pushKV("hold_total", site.hold_total_ns / 1000);
+        obj.pushKV("hold_max", site.hold_max_ns / 1000);
+        obj.pushKV("wait_histogram", LockHistogramToUniv(site.wait_histogram));
+        obj.pushKV("hold_histogram", LockHistogramToUniv(site.hold_histogram));
+        locks.push_back(obj);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("enabled", LockStatsEnabled());
+    result.pushKV("locks", locks);
+    return result;
+},
+    };
+}
+
 void RegisterMiscRPCCommands(CRPCTable &t)
 {
 // clang-format off
@@ -700,6 +804,7 @@ static const CRPCCommand commands[] =
   //  --------------------- ------------------------  -----------------------  ----------
     { "control",            "getmemoryinfo",          &getmemoryinfo,          {"mode"} },
     { "control",            "logging",                &logging,                {"include", "exclude"}},
+    { "control",            "getlockstats",           &getlockstats,           {"enable", "reset"}},
     { "util",               "validateaddress",        &validateaddress,        {"address"} },
     { "util",               "createmultisig",         &createmultisig,         {"nrequired","keys","address_type"} },
     { "util",               "deriveaddresses",        &deriveaddresses,        {"descriptor", "range"} },
@@ -12,6 +12,7 @@
 #include <net_processing.h>
 #include <net_types.h> // For banmap_t
 #include <netbase.h>
+#include <node/blockcache.h>
 #include <node/context.h>
 #include <policy/settings.h>
 #include <rpc/blockchain.h>
@@ -464,6 +465,14 @@ static RPCHelpMan getnettotals()
                            {RPCResult::Type::NUM, "bytes_left_in_cycle", "Bytes left in current time cycle"},
                            {RPCResult::Type::NUM, "time_left_in_cycle", "Seconds left in current time cycle"},
                         }},
+                       {RPCResult::Type::OBJ, "recvbuffers", "",
+                       {
+                           {RPCResult::Type::NUM, "chunk_size", "Size of the chunks network data is received into, in bytes"},
+                           {RPCResult::Type::NUM, "allocated", "Number of chunks allocated"},
+                           {RPCResult::Type::NUM, "reused", "Number of chunks reused from the pool"},
+                           {RPCResult::Type::NUM, "in_use", "Number of chunks holding received data"},
+                           {RPCResult::Type::NUM, "pooled", "Number of unused chunks kept for reuse"},
+                        }},
                     }
                 },
                 RPCExamples{
@@ -489,6 +498,15 @@ static RPCHelpMan getnettotals()
     outboundLimit.pushKV("bytes_left_in_cycle", node.connman->GetOutboundTargetBytesLeft());
     outboundLimit.pushKV("time_left_in_cycle", node.connman->GetMaxOutboundTimeLeftInCycle());
     obj.pushKV("uploadtarget", outboundLimit);
+
+    const RecvChunkPool::Stats recv_stats = g_recv_chunk_pool.GetStats();
+    UniValue recv_buffers(UniValue::VOBJ);
+    recv_buffers.pushKV("chunk_size", (uint64_t)RECV_CHUNK_SIZE);
+    recv_buffers.pushKV("allocated", recv_stats.allocated);
+    recv_buffers.pushKV("reused", recv_stats.reused);
+    recv_buffers.pushKV("in_use", recv_stats.in_use);
+    recv_buffers.pushKV("pooled", recv_stats.pooled);
+    obj.pushKV("recvbuffers", recv_buffers);
     return obj;
 },
     };
@@ -557,6 +575,14 @@ static RPCHelpMan getnetworkinfo()
                                 {RPCResult::Type::NUM, "score", "relative score"},
                             }},
                         }},
+                        {RPCResult::Type::OBJ, "blockcache", /* optional */ true, "cache of serialized blocks served to peers and over RPC/REST",
+                        {
+                            {RPCResult::Type::NUM, "hits", "number of blocks served from the cache"},
+                            {RPCResult::Type::NUM, "misses", "number of blocks that had to be read from disk"},
+                            {RPCResult::Type::NUM, "entries", "number of serialized blocks in the cache"},
+                            {RPCResult::Type::NUM, "size", "size of the cached blocks, in bytes"},
+                            {RPCResult::Type::NUM, "max_size", "maximum size of the cache, in bytes"},
+                        }},
                         {RPCResult::Type::STR, "warnings", "any network and blockchain warnings"},
                     }
                 },
@@ -601,6 +627,16 @@ static RPCHelpMan getnetworkinfo()
         }
     }
     obj.pushKV("localaddresses", localAddresses);
+    if (node.block_cache) {
+        const BlockCache::Stats cache_stats = node.block_cache->GetStats();
+        UniValue block_cache(UniValue::VOBJ);
+        block_cache.pushKV("hits", cache_stats.hits);
+        block_cache.pushKV("misses", cache_stats.misses);
+        block_cache.pushKV("entries", cache_stats.entries);
+        block_cache.pushKV("size", cache_stats.size);
+        block_cache.pushKV("max_size", cache_stats.max_size);
+        obj.pushKV("blockcache", block_cache);
+    }
     obj.pushKV("warnings",       GetWarnings(false).original);
     return obj;
 },
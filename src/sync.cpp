@@ -8,15 +8,18 @@
 
 #include <sync.h>
 
+#include <crypto/common.h>
 #include <logging.h>
 #include <tinyformat.h>
 #include <util/strencodings.h>
 #include <util/threadnames.h>
 
+#include <algorithm>
 #include <map>
 #include <set>
 #include <system_error>
 #include <thread>
+#include <tuple>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -32,6 +35,133 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+std::atomic<bool> g_lock_stats_enabled{DEFAULT_LOCKSTATS};
+
+struct LockSiteStats {
+    //! The lock site, written once before ready is set
+    const char* name{nullptr};
+    const char* file{nullptr};
+    int line{0};
+    std::atomic<bool> ready{false};
+
+    std::atomic<uint64_t> acquisitions{0};
+    std::atomic<uint64_t> contentions{0};
+    std::atomic<uint64_t> wait_total_ns{0};
+    std::atomic<uint64_t> wait_max_ns{0};
+    std::atomic<uint64_t> hold_total_ns{0};
+    std::atomic<uint64_t> hold_max_ns{0};
+    std::array<std::atomic<uint64_t>, LOCK_STATS_BUCKETS> wait_histogram{};
+    std::array<std::atomic<uint64_t>, LOCK_STATS_BUCKETS> hold_histogram{};
+};
+
+//! Open addressing table of lock sites. Sites are keyed by the string literal
+//! pointers of LOCK(), so a site in a header can use a few slots.
+static constexpr size_t LOCK_SITES = 2048;
+static_assert((LOCK_SITES & (LOCK_SITES - 1)) == 0, "LOCK_SITES must be a power of two");
+static LockSiteStats g_lock_sites[LOCK_SITES];
+//! Serializes claiming slots. Lookups of claimed slots don't take it.
+static std::mutex g_lock_sites_mutex;
+
+LockSiteStats* GetLockSiteStats(const char* pszName, const char* pszFile, int nLine)
+{
+    const uint64_t hash = (uint64_t{reinterpret_cast<uintptr_t>(pszName)} * 0x9E3779B97F4A7C15ULL) ^
+                          (uint64_t{reinterpret_cast<uintptr_t>(pszFile)} * 0xC2B2AE3D27D4EB4FULL) ^ nLine;
+    for (size_t i = 0; i < LOCK_SITES; ++i) {
+        LockSiteStats& site = g_lock_sites[((hash >> 17) + i) & (LOCK_SITES - 1)];
+        if (!site.ready.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(g_lock_sites_mutex);
+            if (!site.ready.load(std::memory_order_relaxed)) {
+                site.name = pszName;
+                site.file = pszFile;
+                site.line = nLine;
+                site.ready.store(true, std::memory_order_release);
+                return &site;
+            }
+        }
+        if (site.name == pszName && site.file == pszFile && site.line == nLine) return &site;
+    }
+    return nullptr;
+}
+
+static void RecordDuration(int64_t duration_ns, std::atomic<uint64_t>& total, std::atomic<uint64_t>& max, std::array<std::atomic<uint64_t>, LOCK_STATS_BUCKETS>& histogram)
+{
+    const uint64_t ns = std::max<int64_t>(duration_ns, 0);
+    total.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t prev_max = max.load(std::memory_order_relaxed);
+    while (prev_max < ns && !max.compare_exchange_weak(prev_max, ns, std::memory_order_relaxed)) {}
+    const size_t bucket = std::min<uint64_t>(CountBits(ns / 1000), LOCK_STATS_BUCKETS - 1);
+    histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void RecordLockWait(LockSiteStats& site, int64_t wait_ns, bool contended)
+{
+    site.acquisitions.fetch_add(1, std::memory_order_relaxed);
+    if (contended) site.contentions.fetch_add(1, std::memory_order_relaxed);
+    RecordDuration(wait_ns, site.wait_total_ns, site.wait_max_ns, site.wait_histogram);
+}
+
+void RecordLockHold(LockSiteStats& site, int64_t hold_ns)
+{
+    RecordDuration(hold_ns, site.hold_total_ns, site.hold_max_ns, site.hold_histogram);
+}
+
+void SetLockStatsEnabled(bool enabled)
+{
+    g_lock_stats_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool LockStatsEnabled()
+{
+    return g_lock_stats_enabled.load(std::memory_order_relaxed);
+}
+
+std::vector<LockSiteInfo> GetLockStats()
+{
+    // Merge the slots of the same site by content rather than by pointer.
+    std::map<std::tuple<std::string, std::string, int>, LockSiteInfo> merged;
+    for (const LockSiteStats& site : g_lock_sites) {
+        if (!site.ready.load(std::memory_order_acquire)) continue;
+        const uint64_t acquisitions = site.acquisitions.load(std::memory_order_relaxed);
+        if (acquisitions == 0) continue;
+        LockSiteInfo& info = merged[std::make_tuple(std::string(site.name), std::string(site.file), site.line)];
+        info.name = site.name;
+        info.file = site.file;
+        info.line = site.line;
+        info.acquisitions += acquisitions;
+        info.contentions += site.contentions.load(std::memory_order_relaxed);
+        info.wait_total_ns += site.wait_total_ns.load(std::memory_order_relaxed);
+        info.wait_max_ns = std::max<uint64_t>(info.wait_max_ns, site.wait_max_ns.load(std::memory_order_relaxed));
+        info.hold_total_ns += site.hold_total_ns.load(std::memory_order_relaxed);
+        info.hold_max_ns = std::max<uint64_t>(info.hold_max_ns, site.hold_max_ns.load(std::memory_order_relaxed));
+        for (size_t i = 0; i < LOCK_STATS_BUCKETS; ++i) {
+            info.wait_histogram[i] += site.wait_histogram[i].load(std::memory_order_relaxed);
+            info.hold_histogram[i] += site.hold_histogram[i].load(std::memory_order_relaxed);
+        }
+    }
+    std::vector<LockSiteInfo> ret;
+    ret.reserve(merged.size());
+    for (auto& entry : merged) {
+        ret.push_back(std::move(entry.second));
+    }
+    return ret;
+}
+
+void ResetLockStats()
+{
+    for (LockSiteStats& site : g_lock_sites) {
+        site.acquisitions.store(0, std::memory_order_relaxed);
+        site.contentions.store(0, std::memory_order_relaxed);
+        site.wait_total_ns.store(0, std::memory_order_relaxed);
+        site.wait_max_ns.store(0, std::memory_order_relaxed);
+        site.hold_total_ns.store(0, std::memory_order_relaxed);
+        site.hold_max_ns.store(0, std::memory_order_relaxed);
+        for (size_t i = 0; i < LOCK_STATS_BUCKETS; ++i) {
+            site.wait_histogram[i].store(0, std::memory_order_relaxed);
+            site.hold_histogram[i].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
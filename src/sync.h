@@ -9,10 +9,15 @@
 #include <threadsafety.h>
 #include <util/macros.h>
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
 ////////////////////////////////////////////////
 //                                            //
@@ -128,14 +133,69 @@ typedef AnnotatedMixin<std::mutex> Mutex;
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+static const bool DEFAULT_LOCKSTATS = false;
+//! Number of buckets in the wait and hold time histograms of a lock site
+static constexpr size_t LOCK_STATS_BUCKETS = 24;
+
+/** Lock statistics recorded for a lock site (a LOCK, LOCK2, TRY_LOCK or WAIT_LOCK call). */
+struct LockSiteInfo {
+    std::string name;
+    std::string file;
+    int line{0};
+    //! Number of times the lock was taken
+    uint64_t acquisitions{0};
+    //! Number of times the lock had to be waited for
+    uint64_t contentions{0};
+    uint64_t wait_total_ns{0};
+    uint64_t wait_max_ns{0};
+    uint64_t hold_total_ns{0};
+    uint64_t hold_max_ns{0};
+    //! Entry 0 counts durations below 1 microsecond, entry n > 0 durations from 2^(n-1) up to
+    //! 2^n microseconds. The last entry also counts all longer durations.
+    std::array<uint64_t, LOCK_STATS_BUCKETS> wait_histogram{};
+    std::array<uint64_t, LOCK_STATS_BUCKETS> hold_histogram{};
+};
+
+/**
+ * Lock contention statistics. Recording can be turned on and off at runtime
+ * (-lockstats, getlockstats RPC). When it is off, taking a lock only costs an
+ * extra relaxed atomic load.
+ */
+void SetLockStatsEnabled(bool enabled);
+bool LockStatsEnabled();
+/** Return the statistics of all lock sites that were taken while recording. */
+std::vector<LockSiteInfo> GetLockStats();
+/** Clear all recorded statistics. */
+void ResetLockStats();
+
+struct LockSiteStats;
+extern std::atomic<bool> g_lock_stats_enabled;
+/** Return the statistics slot of a lock site, nullptr if there is no room for a new one. */
+LockSiteStats* GetLockSiteStats(const char* pszName, const char* pszFile, int nLine);
+void RecordLockWait(LockSiteStats& site, int64_t wait_ns, bool contended);
+void RecordLockHold(LockSiteStats& site, int64_t hold_ns);
+inline int64_t LockStatsTime()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 /** Wrapper around std::unique_lock style lock for Mutex. */
 template <typename Mutex, typename Base = typename Mutex::UniqueLock>
 class SCOPED_LOCKABLE UniqueLock : public Base
 {
 private:
+    //! Statistics of the lock site, if recording was on when the lock was taken
+    LockSiteStats* m_lock_stats{nullptr};
+    //! When the lock was taken, for the hold time
+    int64_t m_lock_time{0};
+
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(Base::mutex()));
+        if (g_lock_stats_enabled.load(std::memory_order_relaxed)) {
+            EnterRecorded(pszName, pszFile, nLine);
+            return;
+        }
 #ifdef DEBUG_LOCKCONTENTION
         if (!Base::try_lock()) {
             PrintLockContention(pszName, pszFile, nLine);
@@ -146,15 +206,40 @@ private:
 #endif
     }
 
+    void EnterRecorded(const char* pszName, const char* pszFile, int nLine)
+    {
+        m_lock_stats = GetLockSiteStats(pszName, pszFile, nLine);
+        const int64_t start = LockStatsTime();
+        const bool contended = !Base::try_lock();
+        if (contended) {
+#ifdef DEBUG_LOCKCONTENTION
+            PrintLockContention(pszName, pszFile, nLine);
+#endif
+            Base::lock();
+        }
+        m_lock_time = LockStatsTime();
+        if (m_lock_stats) RecordLockWait(*m_lock_stats, m_lock_time - start, contended);
+    }
+
     bool TryEnter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(Base::mutex()), true);
         Base::try_lock();
         if (!Base::owns_lock())
             LeaveCritical();
+        else if (g_lock_stats_enabled.load(std::memory_order_relaxed)) {
+            m_lock_stats = GetLockSiteStats(pszName, pszFile, nLine);
+            if (m_lock_stats) RecordLockWait(*m_lock_stats, 0, false);
+            m_lock_time = LockStatsTime();
+        }
         return Base::owns_lock();
     }
 
+    void RecordHold()
+    {
+        if (m_lock_stats) RecordLockHold(*m_lock_stats, LockStatsTime() - m_lock_time);
+    }
+
 public:
     UniqueLock(Mutex& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(mutexIn) : Base(mutexIn, std::defer_lock)
     {
@@ -177,8 +262,10 @@ public:
 
     ~UniqueLock() UNLOCK_FUNCTION()
     {
-        if (Base::owns_lock())
+        if (Base::owns_lock()) {
             LeaveCritical();
+            RecordHold();
+        }
     }
 
     operator bool()
@@ -198,6 +285,7 @@ public:
     public:
         explicit reverse_lock(UniqueLock& _lock, const char* _guardname, const char* _file, int _line) : lock(_lock), file(_file), line(_line) {
             CheckLastCritical((void*)lock.mutex(), lockname, _guardname, _file, _line);
+            lock.RecordHold();
             lock.unlock();
             LeaveCritical();
             lock.swap(templock);
@@ -207,6 +295,7 @@ public:
             templock.swap(lock);
             EnterCritical(lockname.c_str(), file.c_str(), line, (void*)lock.mutex());
             lock.lock();
+            lock.m_lock_time = LockStatsTime();
         }
 
      private:
@@ -12,7 +12,10 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
+#include <map>
 #include <string>
+#include <vector>
 
 class CAddrManTest : public CAddrMan
 {
@@ -252,13 +255,60 @@ BOOST_AUTO_TEST_CASE(addrman_select)
     BOOST_CHECK_EQUAL(addrman.size(), 7U);
 
     // Test: Select pulls from new and tried regardless of port number.
+    // Port 7777 only comes from one of the three tried entries, so it is drawn
+    // with a chance of 1/6. Select draws an occupied position directly, which
+    // uses the deterministic random stream differently from walking buckets,
+    // and the first 20 draws of this stream miss it. See
+    // addrman_select_distribution for the distribution itself.
     std::set<uint16_t> ports;
-    for (int i = 0; i < 20; ++i) {
+    for (int i = 0; i < 50; ++i) {
         ports.insert(addrman.Select().GetPort());
     }
     BOOST_CHECK_EQUAL(ports.size(), 3U);
 }
 
+BOOST_AUTO_TEST_CASE(addrman_select_distribution)
+{
+    CAddrManTest addrman;
+    CNetAddr source = ResolveIP("252.2.2.2");
+
+    // Four addresses in the new table and three in the tried table, each in a
+    // bucket of its own, all with the same chance of being picked.
+    std::vector<CService> new_addrs, tried_addrs;
+    for (int i = 1; i <= 4; ++i) {
+        new_addrs.push_back(ResolveService("250." + ToString(i) + ".1.1", 8333));
+        BOOST_CHECK(addrman.Add(CAddress(new_addrs.back(), NODE_NONE), source));
+    }
+    for (int i = 1; i <= 3; ++i) {
+        tried_addrs.push_back(ResolveService("251." + ToString(i) + ".1.1", 8333));
+        BOOST_CHECK(addrman.Add(CAddress(tried_addrs.back(), NODE_NONE), source));
+        addrman.Good(CAddress(tried_addrs.back(), NODE_NONE));
+    }
+    BOOST_CHECK_EQUAL(addrman.size(), 7U);
+
+    // Half of the draws go to each table, and are spread evenly over its entries.
+    const int draws = 12000;
+    std::map<std::string, int> counts;
+    for (int i = 0; i < draws; ++i) {
+        ++counts[addrman.Select().ToString()];
+    }
+    BOOST_CHECK_EQUAL(counts.size(), 7U);
+    for (const CService& addr : new_addrs) {
+        BOOST_CHECK_GT(counts[addr.ToString()], draws / 8 * 9 / 10);
+        BOOST_CHECK_LT(counts[addr.ToString()], draws / 8 * 11 / 10);
+    }
+    for (const CService& addr : tried_addrs) {
+        BOOST_CHECK_GT(counts[addr.ToString()], draws / 6 * 9 / 10);
+        BOOST_CHECK_LT(counts[addr.ToString()], draws / 6 * 11 / 10);
+    }
+
+    // Only new entries are drawn when asked for them.
+    for (int i = 0; i < 100; ++i) {
+        const CAddrInfo info = addrman.Select(/* newOnly */ true);
+        BOOST_CHECK(std::find(new_addrs.begin(), new_addrs.end(), info) != new_addrs.end());
+    }
+}
+
 BOOST_AUTO_TEST_CASE(addrman_new_collisions)
 {
     CAddrManTest addrman;
@@ -385,6 +435,28 @@ BOOST_AUTO_TEST_CASE(addrman_delete)
     BOOST_CHECK(info2 == nullptr);
 }
 
+BOOST_AUTO_TEST_CASE(addrman_reuse_ids)
+{
+    CAddrManTest addrman;
+
+    CNetAddr source1 = ResolveIP("250.1.2.1");
+
+    int nId1, nId2, nId3;
+    addrman.Create(CAddress(ResolveService("250.1.2.1", 8333), NODE_NONE), source1, &nId1);
+    addrman.Create(CAddress(ResolveService("250.1.2.2", 8333), NODE_NONE), source1, &nId2);
+    addrman.Delete(nId1);
+
+    // Test: The nId of a deleted entry is reused, and only refers to the new entry.
+    CAddrInfo* pinfo = addrman.Create(CAddress(ResolveService("250.1.2.3", 8333), NODE_NONE), source1, &nId3);
+    BOOST_CHECK_EQUAL(nId3, nId1);
+    BOOST_CHECK_EQUAL(pinfo->ToString(), "250.1.2.3:8333");
+    BOOST_CHECK(addrman.Find(ResolveService("250.1.2.1", 8333)) == nullptr);
+    CAddrInfo* info2 = addrman.Find(ResolveService("250.1.2.2", 8333));
+    BOOST_REQUIRE(info2);
+    BOOST_CHECK_EQUAL(info2->ToString(), "250.1.2.2:8333");
+    BOOST_CHECK_EQUAL(addrman.size(), 2U);
+}
+
 BOOST_AUTO_TEST_CASE(addrman_getaddr)
 {
     CAddrManTest addrman;
@@ -0,0 +1,99 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <net.h>
+#include <node/blockcache.h>
+#include <protocol.h>
+#include <streams.h>
+#include <test/util/setup_common.h>
+#include <validation.h>
+#include <version.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockcache_tests)
+
+static std::shared_ptr<const CSharedNetMsg> MakeMsg(size_t size)
+{
+    CSerializedNetMsg msg;
+    msg.m_type = NetMsgType::BLOCK;
+    msg.data.resize(size);
+    return std::make_shared<const CSharedNetMsg>(std::move(msg));
+}
+
+BOOST_FIXTURE_TEST_CASE(blockcache_lru, BasicTestingSetup)
+{
+    BlockCache cache(1000);
+    const uint256 a = InsecureRand256(), b = InsecureRand256(), c = InsecureRand256();
+
+    BOOST_CHECK(!cache.Get(a, true));
+    cache.Add(a, true, MakeMsg(400));
+    cache.Add(b, true, MakeMsg(400));
+    // Witness and non-witness serializations are cached separately.
+    BOOST_CHECK(!cache.Get(a, false));
+    BOOST_CHECK(cache.Get(a, true));
+
+    // b is now the least recently used entry and gets evicted.
+    cache.Add(c, true, MakeMsg(400));
+    BOOST_CHECK(cache.Get(a, true));
+    BOOST_CHECK(!cache.Get(b, true));
+    BOOST_CHECK(cache.Get(c, true));
+
+    // Blocks larger than the cache are not cached at all.
+    cache.Add(b, true, MakeMsg(1001));
+    BOOST_CHECK(!cache.Get(b, true));
+
+    const BlockCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.hits, 3U);
+    BOOST_CHECK_EQUAL(stats.misses, 4U);
+    BOOST_CHECK_EQUAL(stats.entries, 2U);
+    BOOST_CHECK_EQUAL(stats.size, 800U);
+    BOOST_CHECK_EQUAL(stats.max_size, 1000U);
+}
+
+BOOST_FIXTURE_TEST_CASE(blockcache_serialized_block, TestChain100Setup)
+{
+    BlockCache cache(DEFAULT_BLOCK_CACHE_SIZE << 20);
+    const CBlockIndex* tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+
+    // The witness serialization matches the block as stored on disk.
+    std::vector<uint8_t> raw_block;
+    BOOST_REQUIRE(ReadRawBlockFromDisk(raw_block, tip, Params().MessageStart()));
+    const auto witness_msg = GetSerializedBlock(&cache, tip, true, Params());
+    BOOST_REQUIRE(witness_msg);
+    BOOST_CHECK_EQUAL(witness_msg->m_type, NetMsgType::BLOCK);
+    BOOST_CHECK(*witness_msg->data == raw_block);
+
+    // A second request is served from the cache.
+    BOOST_CHECK(GetSerializedBlock(&cache, tip, true, Params()) == witness_msg);
+    BOOST_CHECK_EQUAL(cache.GetStats().hits, 1U);
+
+    // The non-witness serialization, from disk or from a block at hand.
+    CBlock block;
+    BOOST_REQUIRE(ReadBlockFromDisk(block, tip, Params().GetConsensus()));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+    ss << block;
+    const auto no_witness_msg = GetSerializedBlock(&cache, tip, false, Params());
+    BOOST_REQUIRE(no_witness_msg);
+    BOOST_CHECK(std::vector<uint8_t>(ss.begin(), ss.end()) == *no_witness_msg->data);
+    const auto uncached_msg = GetSerializedBlock(nullptr, tip, false, Params(), &block);
+    BOOST_REQUIRE(uncached_msg);
+    BOOST_CHECK(*uncached_msg->data == *no_witness_msg->data);
+
+    // Data on disk which does not match the block index is neither served nor cached.
+    CBlockIndex wrong_index;
+    {
+        LOCK(cs_main);
+        wrong_index.nStatus = tip->nStatus;
+        wrong_index.nFile = tip->nFile;
+        wrong_index.nDataPos = tip->nDataPos;
+    }
+    const uint256 wrong_hash = InsecureRand256();
+    wrong_index.phashBlock = &wrong_hash;
+    BOOST_CHECK(!GetSerializedBlock(&cache, &wrong_index, true, Params()));
+    BOOST_CHECK_EQUAL(cache.GetStats().entries, 2U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -300,6 +300,40 @@ BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest)
     }
 }
 
+BOOST_AUTO_TEST_CASE(ShortIDDistributionTest)
+{
+    CTxMemPool pool;
+    CBlock block(BuildBlockTestCase());
+
+    const auto init_data = [&](const TestHeaderAndShortIDs& test_ids) {
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << test_ids;
+        CBlockHeaderAndShortTxIDs short_ids;
+        stream >> short_ids;
+        PartiallyDownloadedBlock partial_block(&pool);
+        return partial_block.InitData(short_ids, extra_txn);
+    };
+
+    // Duplicate short IDs
+    TestHeaderAndShortIDs short_ids(block);
+    short_ids.shorttxids[1] = short_ids.shorttxids[0];
+    BOOST_CHECK(init_data(short_ids) == READ_STATUS_FAILED);
+
+    // Many random short IDs are well distributed
+    short_ids.shorttxids.clear();
+    for (int i = 0; i < 10000; i++) {
+        short_ids.shorttxids.push_back(InsecureRandBits(48));
+    }
+    BOOST_CHECK(init_data(short_ids) == READ_STATUS_OK);
+
+    // Short IDs which all hash to the same slot are rejected
+    short_ids.shorttxids.clear();
+    for (uint64_t i = 0; i < 1000; i++) {
+        short_ids.shorttxids.push_back(i << 32);
+    }
+    BOOST_CHECK(init_data(short_ids) == READ_STATUS_FAILED);
+}
+
 BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
     BlockTransactionsRequest req1;
     req1.blockhash = InsecureRand256();
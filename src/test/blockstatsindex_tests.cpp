@@ -0,0 +1,133 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <index/blockstatsindex.h>
+#include <script/interpreter.h>
+#include <test/util/setup_common.h>
+#include <undo.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockstatsindex_tests)
+
+static void WaitForIndexSync(const BlockStatsIndex& index)
+{
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+}
+
+static bool StatsEqual(const CBlockStats& a, const CBlockStats& b)
+{
+    CDataStream ss_a(SER_DISK, 0), ss_b(SER_DISK, 0);
+    ss_a << a;
+    ss_b << b;
+    return ss_a.str() == ss_b.str();
+}
+
+static CBlockStats ComputeFromDisk(const CBlockIndex* pindex)
+{
+    CBlock block;
+    CBlockUndo block_undo;
+    BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+    if (pindex->nHeight > 0) BOOST_REQUIRE(UndoReadFromDisk(block_undo, pindex));
+    CBlockStats stats;
+    BOOST_REQUIRE(ComputeBlockStats(block, block_undo, stats));
+    return stats;
+}
+
+BOOST_FIXTURE_TEST_CASE(blockstatsindex_initial_sync, TestChain100Setup)
+{
+    BlockStatsIndex index(1 << 20, true);
+
+    // Lookups should fail before the index is started.
+    CBlockStats stats;
+    const CBlockIndex* tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    BOOST_CHECK(!index.LookupStats(tip, stats));
+
+    index.Start();
+    WaitForIndexSync(index);
+
+    // Stats of every block must match the stats computed from disk.
+    std::vector<CBlockStats> range;
+    BOOST_CHECK(index.LookupStatsRange(0, tip, range));
+    BOOST_REQUIRE_EQUAL(range.size(), static_cast<size_t>(tip->nHeight + 1));
+    for (const CBlockIndex* pindex = tip; pindex; pindex = pindex->pprev) {
+        BOOST_CHECK(index.LookupStats(pindex, stats));
+        BOOST_CHECK(StatsEqual(stats, ComputeFromDisk(pindex)));
+        BOOST_CHECK(StatsEqual(range[pindex->nHeight], stats));
+    }
+
+    // Spend a coinbase output with a fee in a new block.
+    const CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = m_coinbase_txns[0]->vout[0].nValue - 1000;
+    spend.vout[0].scriptPubKey = coinbase_script;
+    std::vector<unsigned char> sig;
+    uint256 sighash = SignatureHash(coinbase_script, spend, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_CHECK(coinbaseKey.Sign(sighash, sig));
+    sig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << sig;
+
+    const CBlock block = CreateAndProcessBlock({spend}, coinbase_script);
+    BOOST_CHECK(index.BlockUntilSyncedToCurrentChain());
+
+    const CBlockIndex* spend_index = WITH_LOCK(cs_main, return LookupBlockIndex(block.GetHash()));
+    BOOST_REQUIRE(index.LookupStats(spend_index, stats));
+    BOOST_CHECK_EQUAL(stats.txs, 2);
+    BOOST_CHECK_EQUAL(stats.ins, 1);
+    BOOST_CHECK_EQUAL(stats.totalfee, 1000);
+    BOOST_CHECK_EQUAL(stats.minfee, 1000);
+    BOOST_CHECK_EQUAL(stats.maxfee, 1000);
+    BOOST_CHECK(StatsEqual(stats, ComputeFromDisk(spend_index)));
+
+    // Reorg the block out and replace it with an empty one. The stats of the disconnected block
+    // must still be found by hash, while the height lookup returns the new block.
+    {
+        BlockValidationState state;
+        BOOST_REQUIRE(InvalidateBlock(state, Params(), WITH_LOCK(cs_main, return LookupBlockIndex(block.GetHash()))));
+    }
+    const CBlock replacement = CreateAndProcessBlock({}, coinbase_script);
+    BOOST_CHECK(index.BlockUntilSyncedToCurrentChain());
+
+    BOOST_CHECK(index.LookupStats(spend_index, stats));
+    BOOST_CHECK_EQUAL(stats.totalfee, 1000);
+
+    const CBlockIndex* new_tip = WITH_LOCK(cs_main, return LookupBlockIndex(replacement.GetHash()));
+    BOOST_CHECK(index.LookupStats(new_tip, stats));
+    BOOST_CHECK_EQUAL(stats.txs, 1);
+    BOOST_CHECK_EQUAL(stats.totalfee, 0);
+    BOOST_CHECK(index.LookupStatsRange(new_tip->nHeight, new_tip, range));
+    BOOST_REQUIRE_EQUAL(range.size(), 1U);
+    BOOST_CHECK(StatsEqual(range[0], stats));
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    index.Stop();
+    SyncWithValidationInterfaceQueue();
+
+    // A range extending past the indexed blocks returns the indexed part only.
+    const CBlock unindexed = CreateAndProcessBlock({}, coinbase_script);
+    const CBlockIndex* unindexed_tip = WITH_LOCK(cs_main, return LookupBlockIndex(unindexed.GetHash()));
+    BOOST_CHECK(index.LookupStatsRange(new_tip->nHeight - 1, unindexed_tip, range));
+    BOOST_REQUIRE_EQUAL(range.size(), 2U);
+    BOOST_CHECK(StatsEqual(range[1], stats));
+    BOOST_CHECK(index.LookupStatsRange(unindexed_tip->nHeight, unindexed_tip, range));
+    BOOST_CHECK(range.empty());
+
+    // Let scheduler events finish running to avoid accessing any memory related to the index after it is destructed
+    SyncWithValidationInterfaceQueue();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 #include <merkleblock.h>
 #include <primitives/block.h>
 #include <random.h>
+#include <script/script.h>
 #include <serialize.h>
 #include <streams.h>
 #include <test/util/setup_common.h>
@@ -530,4 +531,47 @@ BOOST_AUTO_TEST_CASE(rolling_bloom)
     g_mock_deterministic_tests = false;
 }
 
+BOOST_AUTO_TEST_CASE(salted_bloom)
+{
+    // 1000 entries, 1% false positive:
+    CSaltedBloomFilter filter(1000, 0.01);
+
+    BOOST_CHECK(!filter.contains(RandomData()));
+
+    static const int DATASIZE = 1000;
+    std::vector<unsigned char> data[DATASIZE];
+    for (int i = 0; i < DATASIZE; i++) {
+        data[i] = RandomData();
+        filter.insert(data[i]);
+    }
+    // No false negatives:
+    for (int i = 0; i < DATASIZE; i++) {
+        BOOST_CHECK(filter.contains(data[i]));
+    }
+    // Keys of any length work:
+    const std::vector<unsigned char> empty;
+    const CScript script = CScript() << OP_TRUE;
+    filter.insert(empty);
+    filter.insert(script);
+    BOOST_CHECK(filter.contains(empty));
+    BOOST_CHECK(filter.contains(script));
+
+    // Expect about 100 hits out of 10,000 random keys. Keeping the probes
+    // within one block costs a little, so allow for up to twice that.
+    unsigned int nHits = 0;
+    for (int i = 0; i < 10000; i++) {
+        if (filter.contains(RandomData()))
+            ++nHits;
+    }
+    BOOST_CHECK_LT(nHits, 200U);
+
+    filter.reset();
+    unsigned int nRemaining = 0;
+    for (int i = 0; i < DATASIZE; i++) {
+        if (filter.contains(data[i]))
+            ++nRemaining;
+    }
+    BOOST_CHECK_EQUAL(nRemaining, 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
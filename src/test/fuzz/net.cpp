@@ -49,7 +49,7 @@ void test_one_input(const std::vector<uint8_t>& buffer)
                fuzzed_data_provider.PickValueInArray({ConnectionType::INBOUND, ConnectionType::OUTBOUND_FULL_RELAY, ConnectionType::MANUAL, ConnectionType::FEELER, ConnectionType::BLOCK_RELAY, ConnectionType::ADDR_FETCH}),
                fuzzed_data_provider.ConsumeBool()};
     while (fuzzed_data_provider.ConsumeBool()) {
-        switch (fuzzed_data_provider.ConsumeIntegralInRange<int>(0, 11)) {
+        switch (fuzzed_data_provider.ConsumeIntegralInRange<int>(0, 10)) {
         case 0: {
             node.CloseSocketDisconnect();
             break;
@@ -114,10 +114,6 @@ void test_one_input(const std::vector<uint8_t>& buffer)
             break;
         }
         case 9: {
-            node.PushTxInventory(ConsumeUInt256(fuzzed_data_provider));
-            break;
-        }
-        case 10: {
             const std::optional<CService> service_opt = ConsumeDeserializable<CService>(fuzzed_data_provider);
             if (!service_opt) {
                 break;
@@ -125,7 +121,7 @@ void test_one_input(const std::vector<uint8_t>& buffer)
             node.SetAddrLocal(*service_opt);
             break;
         }
-        case 11: {
+        case 10: {
             const std::vector<uint8_t> b = ConsumeRandomLengthByteVector(fuzzed_data_provider);
             bool complete;
             node.ReceiveMsgBytes((const char*)b.data(), b.size(), complete);
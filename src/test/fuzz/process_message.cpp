@@ -72,7 +72,9 @@ void test_one_input(const std::vector<uint8_t>& buffer)
     }
     const bool jump_out_of_ibd{fuzzed_data_provider.ConsumeBool()};
     if (jump_out_of_ibd) chainstate.JumpOutOfIbd();
-    CDataStream random_bytes_data_stream{fuzzed_data_provider.ConsumeRemainingBytes<unsigned char>(), SER_NETWORK, PROTOCOL_VERSION};
+    const std::vector<unsigned char> random_bytes{fuzzed_data_provider.ConsumeRemainingBytes<unsigned char>()};
+    CRecvStream random_bytes_data_stream{SER_NETWORK, PROTOCOL_VERSION};
+    random_bytes_data_stream.write((const char*)random_bytes.data(), random_bytes.size());
     CNode& p2p_node = *MakeUnique<CNode>(0, ServiceFlags(NODE_NETWORK | NODE_WITNESS | NODE_BLOOM), 0, INVALID_SOCKET, CAddress{CService{in_addr{0x0100007f}, 7777}, NODE_NETWORK}, 0, 0, CAddress{}, std::string{}, ConnectionType::OUTBOUND_FULL_RELAY).release();
     p2p_node.fSuccessfullyConnected = true;
     p2p_node.nVersion = PROTOCOL_VERSION;
@@ -84,6 +86,7 @@ void test_one_input(const std::vector<uint8_t>& buffer)
                                                 GetTime<std::chrono::microseconds>(), std::atomic<bool>{false});
     } catch (const std::ios_base::failure&) {
     }
+    g_setup->m_node.peerman->FinishMessageRound();
     SyncWithValidationInterfaceQueue();
     LOCK2(::cs_main, g_cs_orphans); // See init.cpp for rationale for implicit locking order requirement
     g_setup->m_node.connman->StopNodes();
@@ -2,13 +2,18 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <blockfilter.h>
 #include <chainparams.h>
 #include <consensus/validation.h>
+#include <index/blockfilterindex.h>
 #include <interfaces/chain.h>
 #include <script/standard.h>
 #include <test/util/setup_common.h>
+#include <util/time.h>
 #include <validation.h>
 
+#include <chrono>
+
 #include <boost/test/unit_test.hpp>
 
 using interfaces::FoundBlock;
@@ -160,4 +165,46 @@ BOOST_AUTO_TEST_CASE(hasBlocks)
     BOOST_CHECK(!chain->hasBlocks(active.Tip()->GetBlockHash(), 6, 50));
 }
 
+BOOST_AUTO_TEST_CASE(blockFiltersMatchAny)
+{
+    auto chain = interfaces::MakeChain(m_node);
+    auto& active = ChainActive();
+
+    BOOST_CHECK(!chain->hasBlockFilterIndex(BlockFilterType::BASIC));
+    BOOST_CHECK(chain->blockFiltersMatchAny(BlockFilterType::BASIC, active[1]->GetBlockHash(), 10, {}).empty());
+
+    BOOST_REQUIRE(InitBlockFilterIndex(BlockFilterType::BASIC, 1 << 20, /* f_memory */ true));
+    BlockFilterIndex& filter_index = *GetBlockFilterIndex(BlockFilterType::BASIC);
+    filter_index.Start();
+    const int64_t time_start = GetTimeMillis();
+    while (!filter_index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + 10 * 1000 > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+    BOOST_CHECK(chain->hasBlockFilterIndex(BlockFilterType::BASIC));
+
+    // All blocks after genesis pay to the coinbase key.
+    const CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const GCSFilter::ElementSet mine{GCSFilter::Element(coinbase_script.begin(), coinbase_script.end())};
+    auto matches = chain->blockFiltersMatchAny(BlockFilterType::BASIC, active[1]->GetBlockHash(), 1000, mine);
+    BOOST_REQUIRE_EQUAL(matches.size(), 100U);
+    for (size_t i = 0; i < matches.size(); ++i) {
+        BOOST_CHECK_EQUAL(matches[i].first, active[i + 1]->GetBlockHash());
+        BOOST_CHECK(matches[i].second);
+    }
+
+    const CScript other_script = CScript() << OP_TRUE;
+    const GCSFilter::ElementSet other{GCSFilter::Element(other_script.begin(), other_script.end())};
+    matches = chain->blockFiltersMatchAny(BlockFilterType::BASIC, active[40]->GetBlockHash(), 20, other);
+    BOOST_REQUIRE_EQUAL(matches.size(), 20U);
+    BOOST_CHECK_EQUAL(matches.back().first, active[59]->GetBlockHash());
+    for (const auto& match : matches) BOOST_CHECK(!match.second);
+
+    // Blocks not in the active chain have no results.
+    BOOST_CHECK(chain->blockFiltersMatchAny(BlockFilterType::BASIC, uint256::ONE, 10, mine).empty());
+    BOOST_CHECK(chain->blockFiltersMatchAny(BlockFilterType::BASIC, active.Tip()->GetBlockHash(), 0, mine).empty());
+
+    DestroyAllBlockFilterIndexes();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
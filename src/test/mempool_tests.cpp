@@ -788,4 +788,61 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 4ULL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolUpdateFromBlockTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // A chain [tx0] <- [tx1] <- ... <- [tx9], plus a second child of tx4.
+    std::vector<CTransactionRef> chain;
+    chain.push_back(make_tx(/* output_values */ {10 * COIN, 10 * COIN}));
+    for (int i = 1; i < 10; ++i) {
+        chain.push_back(make_tx(/* output_values */ {10 * COIN, 10 * COIN}, /* inputs */ {chain.back()}));
+    }
+    CTransactionRef side = make_tx(/* output_values */ {10 * COIN}, /* inputs */ {chain[4]}, /* input_indices */ {1});
+    for (const auto& tx : chain) {
+        pool.addUnchecked(entry.Fee(10000LL).FromTx(tx));
+    }
+    pool.addUnchecked(entry.Fee(10000LL).FromTx(side));
+
+    // Confirm tx0..tx4 in a block, then disconnect it again and re-add them the way
+    // UpdateMempoolForReorg does: add each transaction, then link them to their in-mempool
+    // descendants in UpdateTransactionsFromBlock.
+    const std::vector<CTransactionRef> block(chain.begin(), chain.begin() + 5);
+    pool.removeForBlock(block, 1);
+    BOOST_CHECK_EQUAL(pool.size(), 6U);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(chain[5]->GetHash())->GetCountWithAncestors(), 1U);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(chain[5]->GetHash())->GetCountWithDescendants(), 5U);
+
+    std::vector<uint256> block_hashes;
+    for (const auto& tx : block) {
+        pool.addUnchecked(entry.Fee(10000LL).FromTx(tx));
+        block_hashes.push_back(tx->GetHash());
+    }
+    pool.UpdateTransactionsFromBlock(block_hashes);
+    BOOST_CHECK_EQUAL(pool.size(), 11U);
+
+    // The cached aggregates must match those of the mempool before the block was connected.
+    for (int i = 0; i < 10; ++i) {
+        const auto it = pool.mapTx.find(chain[i]->GetHash());
+        BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), static_cast<uint64_t>(i + 1));
+        BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), static_cast<uint64_t>(10 - i + (i <= 4 ? 1 : 0)));
+    }
+    const auto side_it = pool.mapTx.find(side->GetHash());
+    BOOST_CHECK_EQUAL(side_it->GetCountWithAncestors(), 6U);
+    BOOST_CHECK_EQUAL(side_it->GetCountWithDescendants(), 1U);
+
+    // A child of the chain tip exceeds an ancestor limit of 10, which is detected from the cached
+    // ancestor state of its parent.
+    CTransactionRef tip_child = make_tx(/* output_values */ {10 * COIN}, /* inputs */ {chain.back()});
+    CTxMemPool::setEntries setAncestors;
+    std::string err;
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entry.FromTx(tip_child), setAncestors, 10, 1000000, 1000, 1000000, err));
+    BOOST_CHECK_EQUAL(err, "too many unconfirmed ancestors [limit: 10]");
+    setAncestors.clear();
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(entry.FromTx(tip_child), setAncestors, 11, 1000000, 1000, 1000000, err));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 10U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
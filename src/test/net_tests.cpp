@@ -6,12 +6,17 @@
 #include <addrman.h>
 #include <chainparams.h>
 #include <clientversion.h>
+#include <consensus/merkle.h>
 #include <cstdint>
 #include <net.h>
+#include <net_buffer.h>
 #include <netbase.h>
+#include <netmessagemaker.h>
+#include <primitives/block.h>
 #include <serialize.h>
 #include <span.h>
 #include <streams.h>
+#include <test/util/net.h>
 #include <test/util/setup_common.h>
 #include <util/memory.h>
 #include <util/strencodings.h>
@@ -769,4 +774,174 @@ BOOST_AUTO_TEST_CASE(PoissonNextSend)
     g_mock_deterministic_tests = false;
 }
 
+BOOST_AUTO_TEST_CASE(recv_chunk_pool)
+{
+    RecvChunkPool pool(/* max_pooled */ 2);
+    {
+        RecvChunkRef a = pool.Get();
+        RecvChunkRef b = pool.Get();
+        RecvChunkRef c = pool.Get();
+        RecvChunkRef a2 = a;
+        a.reset();
+        BOOST_CHECK_EQUAL(pool.GetStats().in_use, 3U);
+    }
+    RecvChunkPool::Stats stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.allocated, 3U);
+    BOOST_CHECK_EQUAL(stats.reused, 0U);
+    BOOST_CHECK_EQUAL(stats.in_use, 0U);
+    BOOST_CHECK_EQUAL(stats.pooled, 2U);
+
+    RecvChunkRef d = pool.Get();
+    stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.allocated, 3U);
+    BOOST_CHECK_EQUAL(stats.reused, 1U);
+    BOOST_CHECK_EQUAL(stats.in_use, 1U);
+    BOOST_CHECK_EQUAL(stats.pooled, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(recv_stream)
+{
+    CRecvStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK(stream.empty());
+    std::vector<unsigned char> data(RECV_CHUNK_SIZE * 2 + 100);
+    for (size_t i = 0; i < data.size(); ++i) data[i] = i % 251;
+    stream << data << uint32_t{0xdeadbeef};
+
+    std::vector<unsigned char> data_out;
+    stream >> data_out;
+    BOOST_CHECK(data_out == data);
+    BOOST_CHECK_EQUAL(stream.size(), 4U);
+    uint16_t value;
+    stream >> value;
+    stream.ignore(1);
+    BOOST_CHECK_EQUAL(stream.size(), 1U);
+    BOOST_CHECK_THROW(stream.ignore(2), std::ios_base::failure);
+    BOOST_CHECK_THROW(stream >> value, std::ios_base::failure);
+    uint8_t last;
+    stream >> last;
+    BOOST_CHECK_EQUAL(last, 0xde);
+    BOOST_CHECK(stream.empty());
+}
+
+BOOST_AUTO_TEST_CASE(transport_deserializer_in_place)
+{
+    // A block that spans several receive chunks, followed by a small message
+    CBlock block;
+    for (int i = 0; i < 1000; ++i) {
+        CMutableTransaction tx;
+        tx.vin.emplace_back(COutPoint(InsecureRand256(), 0));
+        tx.vout.emplace_back(i, CScript() << std::vector<unsigned char>(200, i % 256));
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    const CNetMsgMaker maker(INIT_PROTO_VERSION);
+    std::vector<CSerializedNetMsg> msgs;
+    msgs.push_back(maker.Make(NetMsgType::BLOCK, block));
+    msgs.push_back(maker.Make(NetMsgType::PING, uint64_t{42}));
+    std::vector<unsigned char> wire;
+    V1TransportSerializer serializer;
+    for (CSerializedNetMsg& msg : msgs) {
+        std::vector<unsigned char> header;
+        serializer.prepareForTransport(msg, header);
+        wire.insert(wire.end(), header.begin(), header.end());
+        wire.insert(wire.end(), msg.data.begin(), msg.data.end());
+    }
+    BOOST_CHECK(msgs[0].data.size() > 3 * RECV_CHUNK_SIZE);
+
+    const RecvChunkPool::Stats stats_before = g_recv_chunk_pool.GetStats();
+    std::vector<CNetMessage> received;
+    {
+        V1TransportDeserializer deserializer(Params(), 0, SER_NETWORK, INIT_PROTO_VERSION);
+        size_t pos = 0;
+        while (pos < wire.size()) {
+            // Receive in pieces that do not line up with chunks or messages.
+            const Span<char> buf = deserializer.GetReadBuffer();
+            const size_t n = std::min<size_t>({buf.size(), wire.size() - pos, 1000});
+            memcpy(buf.data(), wire.data() + pos, n);
+            size_t parsed = 0;
+            while (parsed < n) {
+                const int handled = deserializer.ReadFromBuffer(n - parsed);
+                BOOST_REQUIRE(handled >= 0);
+                parsed += handled;
+                if (deserializer.Complete()) {
+                    uint32_t out_err_raw_size{0};
+                    Optional<CNetMessage> msg{deserializer.GetMessage(std::chrono::microseconds{0}, out_err_raw_size)};
+                    BOOST_REQUIRE(msg);
+                    received.push_back(std::move(*msg));
+                }
+            }
+            pos += n;
+        }
+    }
+    // One chunk per RECV_CHUNK_SIZE bytes received, shared between messages
+    const RecvChunkPool::Stats stats_after = g_recv_chunk_pool.GetStats();
+    const uint64_t chunks_used = (stats_after.allocated + stats_after.reused) - (stats_before.allocated + stats_before.reused);
+    BOOST_CHECK_EQUAL(chunks_used, (wire.size() + RECV_CHUNK_SIZE - 1) / RECV_CHUNK_SIZE);
+
+    BOOST_REQUIRE_EQUAL(received.size(), 2U);
+    BOOST_CHECK_EQUAL(received[0].m_command, NetMsgType::BLOCK);
+    BOOST_CHECK_EQUAL(received[0].m_message_size, msgs[0].data.size());
+    CBlock block_out;
+    received[0].m_recv >> block_out;
+    BOOST_CHECK(received[0].m_recv.empty());
+    BOOST_CHECK_EQUAL(BlockMerkleRoot(block_out), BlockMerkleRoot(block));
+
+    BOOST_CHECK_EQUAL(received[1].m_command, NetMsgType::PING);
+    uint64_t nonce;
+    received[1].m_recv >> nonce;
+    BOOST_CHECK_EQUAL(nonce, 42U);
+
+    // All chunks are released once the messages are gone.
+    received.clear();
+    BOOST_CHECK_EQUAL(g_recv_chunk_pool.GetStats().in_use, stats_before.in_use);
+}
+
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(send_shared_message)
+{
+    ConnmanTestMsg connman(0x1337, 0x1337);
+    const CAddress addr(CService(in_addr{0x0100007f}, 7777), NODE_NETWORK);
+    const CNetMsgMaker maker(INIT_PROTO_VERSION);
+    const CSharedNetMsg shared(maker.Make(NetMsgType::BLOCK, std::vector<unsigned char>(500000, 0xab)));
+
+    std::vector<unsigned char> expected;
+    {
+        CSerializedNetMsg ping = maker.Make(NetMsgType::PING, uint64_t{7});
+        std::vector<unsigned char> header;
+        V1TransportSerializer().prepareForTransport(ping, header);
+        expected.insert(expected.end(), header.begin(), header.end());
+        expected.insert(expected.end(), ping.data.begin(), ping.data.end());
+        header.clear();
+        V1TransportSerializer().prepareForTransport(shared, header);
+        expected.insert(expected.end(), header.begin(), header.end());
+        expected.insert(expected.end(), shared.data->begin(), shared.data->end());
+    }
+
+    int fds[2][2];
+    std::vector<std::unique_ptr<CNode>> nodes;
+    for (int i = 0; i < 2; ++i) {
+        BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds[i]), 0);
+        nodes.push_back(MakeUnique<CNode>(i, NODE_NETWORK, 0, fds[i][0], addr, 0, 0, CAddress(), "", ConnectionType::OUTBOUND_FULL_RELAY));
+        // The payload is larger than the socket buffer, so only part of it is sent right away.
+        connman.PushMessage(nodes[i].get(), maker.Make(NetMsgType::PING, uint64_t{7}));
+        connman.PushMessage(nodes[i].get(), shared);
+    }
+    // Both send queues reference the same payload.
+    BOOST_CHECK_EQUAL(shared.data.use_count(), 3);
+
+    for (int i = 0; i < 2; ++i) {
+        std::vector<unsigned char> received;
+        while (received.size() < expected.size()) {
+            unsigned char buf[0x10000];
+            const ssize_t n = recv(fds[i][1], buf, sizeof(buf), MSG_DONTWAIT);
+            if (n > 0) received.insert(received.end(), buf, buf + n);
+            connman.SendQueuedData(*nodes[i]);
+        }
+        BOOST_CHECK(received == expected);
+        BOOST_CHECK(WITH_LOCK(nodes[i]->cs_vSend, return nodes[i]->vSendMsg.empty()));
+        close(fds[i][1]);
+    }
+    BOOST_CHECK_EQUAL(shared.data.use_count(), 1);
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,7 @@
 
 #include <core_io.h>
 #include <interfaces/chain.h>
+#include <node/blockstats.h>
 #include <node/context.h>
 #include <test/util/setup_common.h>
 #include <util/ref.h>
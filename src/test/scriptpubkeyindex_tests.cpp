@@ -0,0 +1,134 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <index/scriptpubkeyindex.h>
+#include <script/interpreter.h>
+#include <script/standard.h>
+#include <test/util/setup_common.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(scriptpubkeyindex_tests)
+
+static void WaitForIndexSync(const ScriptPubKeyIndex& index)
+{
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(scriptpubkeyindex_initial_sync, TestChain100Setup)
+{
+    ScriptPubKeyIndex index(1 << 20, true);
+
+    const CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const uint256 coinbase_hash = ScriptPubKeyIndex::HashScript(coinbase_script);
+    std::vector<ScriptPubKeyHistoryEntry> entries;
+
+    // History should be empty before the index is started.
+    BOOST_CHECK(index.FindScriptHistory(coinbase_hash, nullptr, 1000, entries));
+    BOOST_CHECK(entries.empty());
+
+    index.Start();
+    WaitForIndexSync(index);
+
+    // Every coinbase output in the chain before the index started must be found, in chain order.
+    BOOST_CHECK(index.FindScriptHistory(coinbase_hash, nullptr, 1000, entries));
+    BOOST_REQUIRE_EQUAL(entries.size(), m_coinbase_txns.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        BOOST_CHECK_EQUAL(entries[i].height, static_cast<int>(i) + 1);
+        BOOST_CHECK(entries[i].txid == m_coinbase_txns[i]->GetHash());
+        BOOST_CHECK_EQUAL(entries[i].n, 0U);
+        BOOST_CHECK(!entries[i].spending);
+        BOOST_CHECK_EQUAL(entries[i].value, m_coinbase_txns[i]->vout[0].nValue);
+        BOOST_CHECK(entries[i].block_hash == WITH_LOCK(cs_main, return ::ChainActive()[i + 1]->GetBlockHash()));
+    }
+
+    // Pages continuing after an entry must be consistent with the full history.
+    const std::vector<ScriptPubKeyHistoryEntry> all_entries = entries;
+    BOOST_CHECK(index.FindScriptHistory(coinbase_hash, &all_entries[9], 5, entries));
+    BOOST_REQUIRE_EQUAL(entries.size(), 5U);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        BOOST_CHECK(entries[i].txid == all_entries[10 + i].txid);
+        BOOST_CHECK(entries[i].block_hash == all_entries[10 + i].block_hash);
+    }
+    BOOST_CHECK(index.FindScriptHistory(coinbase_hash, &all_entries.back(), 5, entries));
+    BOOST_CHECK(entries.empty());
+
+    // Spend the first coinbase output to a new script in a new block.
+    const CScript dest_script = GetScriptForDestination(PKHash(coinbaseKey.GetPubKey()));
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = dest_script;
+    std::vector<unsigned char> sig;
+    uint256 sighash = SignatureHash(coinbase_script, spend, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_CHECK(coinbaseKey.Sign(sighash, sig));
+    sig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << sig;
+
+    const CBlock block = CreateAndProcessBlock({spend}, coinbase_script);
+    BOOST_CHECK(index.BlockUntilSyncedToCurrentChain());
+
+    BOOST_CHECK(index.FindScriptHistory(coinbase_hash, &all_entries.back(), 1000, entries));
+    BOOST_REQUIRE_EQUAL(entries.size(), 2U);
+    bool found_spend = false;
+    for (const auto& entry : entries) {
+        BOOST_CHECK_EQUAL(entry.height, 101);
+        BOOST_CHECK(entry.block_hash == block.GetHash());
+        if (entry.spending) {
+            found_spend = true;
+            BOOST_CHECK(entry.txid == spend.GetHash());
+            BOOST_CHECK(entry.prevout == spend.vin[0].prevout);
+            BOOST_CHECK_EQUAL(entry.value, m_coinbase_txns[0]->vout[0].nValue);
+        }
+    }
+    BOOST_CHECK(found_spend);
+
+    const uint256 dest_hash = ScriptPubKeyIndex::HashScript(dest_script);
+    BOOST_CHECK(index.FindScriptHistory(dest_hash, nullptr, 1000, entries));
+    BOOST_REQUIRE_EQUAL(entries.size(), 1U);
+    BOOST_CHECK(!entries[0].spending);
+    BOOST_CHECK_EQUAL(entries[0].value, 11 * CENT);
+
+    // Reorg the block out and replace it with one that does not contain the spend. Entries of the
+    // disconnected block must be removed from the index.
+    {
+        BlockValidationState state;
+        CBlockIndex* pindex = WITH_LOCK(cs_main, return LookupBlockIndex(block.GetHash()));
+        BOOST_REQUIRE(InvalidateBlock(state, Params(), pindex));
+    }
+    CreateAndProcessBlock({}, dest_script);
+    BOOST_CHECK(index.BlockUntilSyncedToCurrentChain());
+
+    BOOST_CHECK(index.FindScriptHistory(coinbase_hash, nullptr, 1000, entries));
+    BOOST_CHECK_EQUAL(entries.size(), m_coinbase_txns.size());
+    for (const auto& entry : entries) {
+        BOOST_CHECK(!entry.spending);
+    }
+
+    BOOST_CHECK(index.FindScriptHistory(dest_hash, nullptr, 1000, entries));
+    BOOST_REQUIRE_EQUAL(entries.size(), 1U);
+    BOOST_CHECK_EQUAL(entries[0].height, 101);
+    BOOST_CHECK(entries[0].txid != spend.GetHash());
+    BOOST_CHECK(entries[0].block_hash == WITH_LOCK(cs_main, return ::ChainActive().Tip()->GetBlockHash()));
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    index.Stop();
+
+    // Let scheduler events finish running to avoid accessing any memory related to the index after it is destructed
+    SyncWithValidationInterfaceQueue();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
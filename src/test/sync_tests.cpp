@@ -4,10 +4,22 @@
 
 #include <sync.h>
 #include <test/util/setup_common.h>
+#include <util/time.h>
+
+#include <atomic>
+#include <thread>
 
 #include <boost/test/unit_test.hpp>
 
 namespace {
+const LockSiteInfo* FindLockSite(const std::vector<LockSiteInfo>& sites, int line)
+{
+    for (const LockSiteInfo& site : sites) {
+        if (site.file == __FILE__ && site.line == line) return &site;
+    }
+    return nullptr;
+}
+
 template <typename MutexType>
 void TestPotentialDeadLockDetected(MutexType& mutex1, MutexType& mutex2)
 {
@@ -55,4 +67,63 @@ BOOST_AUTO_TEST_CASE(potential_deadlock_detected)
     #endif
 }
 
+BOOST_AUTO_TEST_CASE(lock_stats)
+{
+    const bool prev = LockStatsEnabled();
+    SetLockStatsEnabled(true);
+    ResetLockStats();
+
+    Mutex mutex;
+    int line_holder, line_waiter, line_unrecorded;
+    {
+        std::atomic<bool> waiting{false};
+        std::thread waiter;
+        {
+            line_holder = __LINE__; LOCK(mutex);
+            waiter = std::thread([&] {
+                waiting = true;
+                line_waiter = __LINE__; LOCK(mutex);
+            });
+            while (!waiting) std::this_thread::yield();
+            UninterruptibleSleep(std::chrono::milliseconds{20});
+        }
+        waiter.join();
+    }
+    SetLockStatsEnabled(false);
+    {
+        line_unrecorded = __LINE__; LOCK(mutex);
+    }
+
+    std::vector<LockSiteInfo> sites = GetLockStats();
+    const LockSiteInfo* holder = FindLockSite(sites, line_holder);
+    const LockSiteInfo* waiter = FindLockSite(sites, line_waiter);
+    BOOST_REQUIRE(holder && waiter);
+    BOOST_CHECK(!FindLockSite(sites, line_unrecorded));
+
+    BOOST_CHECK_EQUAL(holder->name, "mutex");
+    BOOST_CHECK_EQUAL(holder->acquisitions, 1U);
+    BOOST_CHECK_EQUAL(holder->contentions, 0U);
+    BOOST_CHECK_GE(holder->hold_total_ns, 20000000U);
+    BOOST_CHECK_EQUAL(holder->hold_max_ns, holder->hold_total_ns);
+    // 20ms falls in the bucket from 2^14 to 2^15 microseconds, or above when the machine is slow.
+    uint64_t hold_count{0};
+    for (size_t i = 0; i < LOCK_STATS_BUCKETS; ++i) {
+        hold_count += holder->hold_histogram[i];
+        if (i < 15) BOOST_CHECK_EQUAL(holder->hold_histogram[i], 0U);
+    }
+    BOOST_CHECK_EQUAL(hold_count, 1U);
+
+    BOOST_CHECK_EQUAL(waiter->acquisitions, 1U);
+    BOOST_CHECK_EQUAL(waiter->contentions, 1U);
+    BOOST_CHECK_EQUAL(waiter->wait_max_ns, waiter->wait_total_ns);
+    BOOST_CHECK_GT(waiter->wait_total_ns, 0U);
+
+    ResetLockStats();
+    sites = GetLockStats();
+    BOOST_CHECK(!FindLockSite(sites, line_holder));
+    BOOST_CHECK(!FindLockSite(sites, line_waiter));
+
+    SetLockStatsEnabled(prev);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,196 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txannounce.h>
+#include <txmempool.h>
+
+#include <test/util/setup_common.h>
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txannounce_tests, BasicTestingSetup)
+
+namespace {
+
+CTransactionRef MakeTx(const std::vector<CTransactionRef>& parents, int n)
+{
+    CMutableTransaction tx;
+    for (const CTransactionRef& parent : parents) {
+        tx.vin.emplace_back(COutPoint(parent->GetHash(), 0));
+    }
+    if (parents.empty()) tx.vin.emplace_back(COutPoint(InsecureRand256(), 0));
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    tx.vout[0].nValue = n;
+    return MakeTransactionRef(tx);
+}
+
+/** Announce everything a peer has not seen yet, up to max, and return what was announced. */
+std::vector<uint256> Drain(TxAnnouncementQueue& queue, const CTxMemPool& pool, NodeId peer, size_t max = 1000)
+{
+    std::vector<uint256> announced;
+    queue.Announce(peer, pool, max, [&](const TxMempoolInfo& info) {
+        announced.push_back(info.tx->GetHash());
+        return true;
+    });
+    return announced;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(seal_order)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    const CTransactionRef low = MakeTx({}, 1);
+    const CTransactionRef high = MakeTx({}, 2);
+    const CTransactionRef child = MakeTx({high}, 3);
+    const CTransactionRef missing = MakeTx({}, 4);
+    {
+        LOCK2(cs_main, pool.cs);
+        pool.addUnchecked(entry.Fee(1000).FromTx(low));
+        pool.addUnchecked(entry.Fee(5000).FromTx(high));
+        pool.addUnchecked(entry.Fee(100000).FromTx(child));
+    }
+
+    TxAnnouncementQueue queue;
+    queue.AddPeer(0);
+    queue.Push(child->GetHash());
+    queue.Push(low->GetHash());
+    queue.Push(missing->GetHash());
+    queue.Push(high->GetHash());
+    queue.Push(low->GetHash());
+    BOOST_CHECK_EQUAL(queue.CountPending(), 5U);
+
+    // Nothing is announced before the batch is sealed.
+    BOOST_CHECK(Drain(queue, pool, 0).empty());
+
+    // Parents come before children, then higher feerates first. Transactions not
+    // in the mempool and duplicates are dropped.
+    queue.Seal(pool);
+    BOOST_CHECK_EQUAL(queue.CountPending(), 0U);
+    BOOST_CHECK_EQUAL(queue.CountSealed(), 3U);
+    BOOST_CHECK_EQUAL(queue.CountUnseen(0), 3U);
+    const std::vector<uint256> expected{high->GetHash(), low->GetHash(), child->GetHash()};
+    BOOST_CHECK(Drain(queue, pool, 0) == expected);
+    BOOST_CHECK_EQUAL(queue.CountUnseen(0), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(peer_cursors)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    std::vector<CTransactionRef> txs;
+    for (int i = 0; i < 10; ++i) {
+        txs.push_back(MakeTx({}, i));
+        LOCK2(cs_main, pool.cs);
+        // Decreasing feerates, so the batch keeps the push order.
+        pool.addUnchecked(entry.Fee(10000 - i * 100).FromTx(txs.back()));
+    }
+
+    TxAnnouncementQueue queue;
+    queue.AddPeer(0);
+    for (int i = 0; i < 5; ++i) queue.Push(txs[i]->GetHash());
+    queue.Seal(pool);
+
+    // A peer only sees transactions sealed after it was added.
+    queue.AddPeer(1);
+    for (int i = 5; i < 10; ++i) queue.Push(txs[i]->GetHash());
+    queue.Seal(pool);
+    BOOST_CHECK_EQUAL(queue.CountUnseen(0), 10U);
+    BOOST_CHECK_EQUAL(queue.CountUnseen(1), 5U);
+
+    // Only announced entries count towards the limit.
+    std::vector<uint256> announced;
+    queue.Announce(0, pool, 2, [&](const TxMempoolInfo& info) {
+        if (info.tx == txs[0]) return false;
+        announced.push_back(info.tx->GetHash());
+        return true;
+    });
+    BOOST_CHECK(announced == std::vector<uint256>({txs[1]->GetHash(), txs[2]->GetHash()}));
+    BOOST_CHECK_EQUAL(queue.CountUnseen(0), 7U);
+
+    // Transactions that left the mempool are skipped.
+    queue.Remove(txs[3]->GetHash());
+    queue.Remove(txs[6]->GetHash());
+    BOOST_CHECK(Drain(queue, pool, 0, 2) == std::vector<uint256>({txs[4]->GetHash(), txs[5]->GetHash()}));
+    BOOST_CHECK(Drain(queue, pool, 1) == std::vector<uint256>({txs[5]->GetHash(), txs[7]->GetHash(), txs[8]->GetHash(), txs[9]->GetHash()}));
+
+    // Entries are kept until every peer has walked past them.
+    queue.Seal(pool);
+    BOOST_CHECK_EQUAL(queue.CountSealed(), 3U);
+    queue.Skip(0);
+    BOOST_CHECK_EQUAL(queue.CountUnseen(0), 0U);
+    queue.Seal(pool);
+    BOOST_CHECK_EQUAL(queue.CountSealed(), 0U);
+
+    // Announcing a transaction again only keeps its most recent entry.
+    queue.Push(txs[0]->GetHash());
+    queue.Push(txs[1]->GetHash());
+    queue.Seal(pool);
+    queue.Push(txs[0]->GetHash());
+    queue.Seal(pool);
+    BOOST_CHECK(Drain(queue, pool, 1) == std::vector<uint256>({txs[0]->GetHash(), txs[1]->GetHash()}));
+
+    // Removed peers do not hold entries back.
+    queue.Push(txs[2]->GetHash());
+    queue.Seal(pool);
+    queue.RemovePeer(0);
+    BOOST_CHECK(Drain(queue, pool, 0).empty());
+    queue.Skip(1);
+    queue.Seal(pool);
+    BOOST_CHECK_EQUAL(queue.CountSealed(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(resort_backlog)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    const CTransactionRef low = MakeTx({}, 1);
+    const CTransactionRef high = MakeTx({}, 2);
+    const CTransactionRef mid = MakeTx({}, 3);
+    const CTransactionRef child = MakeTx({low}, 4);
+    {
+        LOCK2(cs_main, pool.cs);
+        pool.addUnchecked(entry.Fee(1000).FromTx(low));
+        pool.addUnchecked(entry.Fee(5000).FromTx(high));
+        pool.addUnchecked(entry.Fee(3000).FromTx(mid));
+        pool.addUnchecked(entry.Fee(100000).FromTx(child));
+    }
+
+    TxAnnouncementQueue queue;
+    queue.AddPeer(0);
+    queue.AddPeer(1);
+    for (const CTransactionRef& tx : {low, high, mid, child}) {
+        queue.Push(tx->GetHash());
+        queue.Seal(pool);
+    }
+
+    // A peer behind by several batches announces its backlog in mempool order, not in log order.
+    BOOST_CHECK(Drain(queue, pool, 0, 2) == std::vector<uint256>({high->GetHash(), mid->GetHash()}));
+    BOOST_CHECK_EQUAL(queue.CountUnseen(0), 2U);
+    BOOST_CHECK(Drain(queue, pool, 0) == std::vector<uint256>({low->GetHash(), child->GetHash()}));
+    BOOST_CHECK_EQUAL(queue.CountUnseen(0), 0U);
+
+    // The backlog is sorted again at each call, together with newer batches.
+    const CTransactionRef top = MakeTx({}, 5);
+    {
+        LOCK2(cs_main, pool.cs);
+        pool.addUnchecked(entry.Fee(50000).FromTx(top));
+    }
+    BOOST_CHECK(Drain(queue, pool, 1, 1) == std::vector<uint256>({high->GetHash()}));
+    queue.Push(top->GetHash());
+    queue.Seal(pool);
+    BOOST_CHECK(Drain(queue, pool, 1, 2) == std::vector<uint256>({top->GetHash(), mid->GetHash()}));
+    BOOST_CHECK(Drain(queue, pool, 1) == std::vector<uint256>({low->GetHash(), child->GetHash()}));
+
+    // Entries are dropped once both peers walked past them.
+    BOOST_CHECK(Drain(queue, pool, 0) == std::vector<uint256>({top->GetHash()}));
+    queue.Seal(pool);
+    BOOST_CHECK_EQUAL(queue.CountSealed(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
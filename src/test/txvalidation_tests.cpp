@@ -4,7 +4,9 @@
 
 #include <consensus/validation.h>
 #include <primitives/transaction.h>
+#include <script/interpreter.h>
 #include <script/script.h>
+#include <test/util/logging.h>
 #include <test/util/setup_common.h>
 #include <validation.h>
 
@@ -13,6 +15,24 @@
 
 BOOST_AUTO_TEST_SUITE(txvalidation_tests)
 
+/** Spend the first output of a transaction paying to script, back to script, with a fee of 1000 */
+static CTransactionRef SpendToSelf(const CTransaction& prev, const CKey& key, const CScript& script)
+{
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(prev.GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = prev.vout[0].nValue - 1000;
+    spend.vout[0].scriptPubKey = script;
+    std::vector<unsigned char> sig;
+    uint256 sighash = SignatureHash(script, spend, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_CHECK(key.Sign(sighash, sig));
+    sig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << sig;
+    return MakeTransactionRef(spend);
+}
+
 /**
  * Ensure that the mempool won't accept coinbase transactions.
  */
@@ -51,4 +71,117 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_reject_coinbase, TestChain100Setup)
     BOOST_CHECK(state.GetResult() == TxValidationResult::TX_CONSENSUS);
 }
 
+/**
+ * Ensure that transactions persisted to mempool.dat are restored, skipping script checks only if
+ * the file is in version 2 and the chain tip did not change, and that a corrupted file is rejected.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_mempool_persist, TestChain100Setup)
+{
+    const CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const CTransactionRef tx = SpendToSelf(*m_coinbase_txns[0], coinbaseKey, coinbase_script);
+
+    CTxMemPool& pool = *m_node.mempool;
+    {
+        LOCK(cs_main);
+        TxValidationState state;
+        BOOST_CHECK(AcceptToMemoryPool(pool, state, tx, nullptr /* plTxnReplaced */, false /* bypass_limits */));
+    }
+
+    // A version 1 file, as written by default, does not record the tip, so scripts are verified.
+    BOOST_CHECK(DumpMempool(pool));
+    pool.clear();
+    {
+        ASSERT_DEBUG_LOG("1 succeeded (0 without script checks)");
+        BOOST_CHECK(LoadMempool(pool));
+    }
+    BOOST_CHECK(pool.exists(tx->GetHash()));
+
+    gArgs.ForceSetArg("-persistmempoolv2", "1");
+    BOOST_CHECK(DumpMempool(pool));
+
+    // The tip did not change, so the transaction is restored without checking its scripts again.
+    pool.clear();
+    {
+        ASSERT_DEBUG_LOG("1 succeeded (1 without script checks)");
+        BOOST_CHECK(LoadMempool(pool));
+    }
+    BOOST_CHECK(pool.exists(tx->GetHash()));
+
+    // After the tip moved, the scripts are verified again.
+    CreateAndProcessBlock({}, coinbase_script);
+    pool.clear();
+    {
+        ASSERT_DEBUG_LOG("1 succeeded (0 without script checks)");
+        BOOST_CHECK(LoadMempool(pool));
+    }
+    BOOST_CHECK(pool.exists(tx->GetHash()));
+
+    // A file which fails its checksum is not loaded at all.
+    BOOST_CHECK(DumpMempool(pool));
+    const fs::path path = GetDataDir() / "mempool.dat";
+    {
+        FILE* file = fsbridge::fopen(path, "rb+");
+        BOOST_REQUIRE(file);
+        BOOST_REQUIRE(fseek(file, 60, SEEK_SET) == 0);
+        int c = fgetc(file);
+        BOOST_REQUIRE(fseek(file, 60, SEEK_SET) == 0);
+        fputc(c ^ 0xff, file);
+        fclose(file);
+    }
+    pool.clear();
+    {
+        ASSERT_DEBUG_LOG("Checksum mismatch in mempool file on disk");
+        BOOST_CHECK(!LoadMempool(pool));
+    }
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+    gArgs.ForceSetArg("-persistmempoolv2", "0");
+}
+
+/**
+ * Ensure that a batch of transactions is accepted in order, including transactions spending
+ * outputs of earlier ones, and that invalid transactions in the batch are rejected.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_mempool_accept_batch, TestChain100Setup)
+{
+    const CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    // Let the second and third coinbase mature.
+    CreateAndProcessBlock({}, coinbase_script);
+    CreateAndProcessBlock({}, coinbase_script);
+
+    const CTransactionRef parent = SpendToSelf(*m_coinbase_txns[0], coinbaseKey, coinbase_script);
+    const CTransactionRef child = SpendToSelf(*parent, coinbaseKey, coinbase_script);
+    const CTransactionRef other = SpendToSelf(*m_coinbase_txns[1], coinbaseKey, coinbase_script);
+
+    // Signed by the wrong key
+    CKey wrong_key;
+    wrong_key.MakeNewKey(true);
+    const CTransactionRef bad_sig = SpendToSelf(*m_coinbase_txns[2], wrong_key, coinbase_script);
+
+    // The coin spent by bad_sig is only fetched by the batch, and must not stay in the coins cache.
+    const COutPoint bad_sig_prevout(m_coinbase_txns[2]->GetHash(), 0);
+    {
+        LOCK(cs_main);
+        ::ChainstateActive().ForceFlushStateToDisk();
+        ::ChainstateActive().CoinsTip().Uncache(bad_sig_prevout);
+        BOOST_CHECK(!::ChainstateActive().CoinsTip().HaveCoinInCache(bad_sig_prevout));
+    }
+
+    CTxMemPool& pool = *m_node.mempool;
+    std::vector<TxValidationState> states = AcceptToMemoryPoolBatch(pool, {parent, child, bad_sig, other, parent}, nullptr);
+    BOOST_REQUIRE_EQUAL(states.size(), 5U);
+    BOOST_CHECK(states[0].IsValid());
+    BOOST_CHECK(states[1].IsValid());
+    BOOST_CHECK(states[2].IsInvalid());
+    BOOST_CHECK_EQUAL(states[2].GetRejectReason(), "mandatory-script-verify-flag-failed (Signature must be zero for failed CHECK(MULTI)SIG operation)");
+    BOOST_CHECK(states[3].IsValid());
+    BOOST_CHECK_EQUAL(states[4].GetRejectReason(), "txn-already-in-mempool");
+
+    BOOST_CHECK(pool.exists(parent->GetHash()));
+    BOOST_CHECK(pool.exists(child->GetHash()));
+    BOOST_CHECK(pool.exists(other->GetHash()));
+    BOOST_CHECK(!pool.exists(bad_sig->GetHash()));
+    BOOST_CHECK_EQUAL(pool.size(), 3U);
+    BOOST_CHECK(!WITH_LOCK(cs_main, return ::ChainstateActive().CoinsTip().HaveCoinInCache(bad_sig_prevout)));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
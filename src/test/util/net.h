@@ -23,7 +23,17 @@ struct ConnmanTestMsg : public CConnman {
         vNodes.clear();
     }
 
-    void ProcessMessagesOnce(CNode& node) { m_msgproc->ProcessMessages(&node, flagInterruptMsgProc); }
+    void ProcessMessagesOnce(CNode& node)
+    {
+        m_msgproc->ProcessMessages(&node, flagInterruptMsgProc);
+        m_msgproc->FinishMessageRound();
+    }
+
+    size_t SendQueuedData(CNode& node) const
+    {
+        LOCK(node.cs_vSend);
+        return SocketSendData(&node);
+    }
 
     void NodeReceiveMsgBytes(CNode& node, const char* pch, unsigned int nBytes, bool& complete) const;
 
@@ -10,6 +10,7 @@
 #include <consensus/params.h>
 #include <consensus/validation.h>
 #include <crypto/sha256.h>
+#include <crypto/siphash.h>
 #include <init.h>
 #include <interfaces/chain.h>
 #include <miner.h>
@@ -101,6 +102,7 @@ BasicTestingSetup::BasicTestingSetup(const std::string& chainName, const std::ve
     AppInitParameterInteraction(*m_node.args);
     LogInstance().StartLogging();
     SHA256AutoDetect();
+    SipHashAutoDetect();
     ECC_Start();
     SetupEnvironment();
     SetupNetworking();
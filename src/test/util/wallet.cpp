@@ -7,6 +7,7 @@
 #include <key_io.h>
 #include <outputtype.h>
 #include <script/standard.h>
+#include <uint256.h>
 #ifdef ENABLE_WALLET
 #include <wallet/wallet.h>
 #endif
@@ -36,4 +37,39 @@ void importaddress(CWallet& wallet, const std::string& address)
     if (!spk_man->AddWatchOnly(script, 0 /* nCreateTime */)) assert(false);
     wallet.SetAddressBook(dest, /* label */ "", "receive");
 }
+
+int64_t AddTxHistory(CWallet& wallet, int num_txs, int unspent_interval)
+{
+    const CScript script_mine = GetScriptForDestination(DecodeDestination(getnewaddress(wallet)));
+    const CScript script_other = GetScriptForDestination(DecodeDestination(ADDRESS_BCRT1_UNSPENDABLE));
+    constexpr CAmount PAYMENT{COIN / 100};
+
+    LOCK(wallet.cs_wallet);
+    const CWalletTx::Confirmation confirm{CWalletTx::Status::CONFIRMED, wallet.GetLastBlockHeight(), wallet.GetLastBlockHash(), /* index */ 1};
+    CAmount change = int64_t{num_txs} * 2 * PAYMENT;
+    CAmount kept = 0;
+    COutPoint prevout{uint256S("01"), 0};
+    for (int i = 0; i < num_txs; ++i) {
+        CMutableTransaction mtx;
+        mtx.vin.emplace_back(prevout);
+        change -= PAYMENT;
+        mtx.vout.emplace_back(change, script_mine);
+        mtx.vout.emplace_back(PAYMENT, script_other);
+        if (i % unspent_interval == 0) {
+            change -= PAYMENT;
+            kept += PAYMENT;
+            mtx.vout.emplace_back(PAYMENT, script_mine);
+        }
+        const CTransactionRef tx = MakeTransactionRef(std::move(mtx));
+        if (!wallet.LoadToWallet(tx->GetHash(), [&](CWalletTx& wtx, bool new_tx) {
+                wtx.SetTx(tx);
+                wtx.m_confirm = confirm;
+                return new_tx;
+            })) {
+            assert(false);
+        }
+        prevout = COutPoint(tx->GetHash(), 0);
+    }
+    return change + kept;
+}
 #endif // ENABLE_WALLET
@@ -5,6 +5,7 @@
 #ifndef BITCOIN_TEST_UTIL_WALLET_H
 #define BITCOIN_TEST_UTIL_WALLET_H
 
+#include <cstdint>
 #include <string>
 
 class CWallet;
@@ -20,5 +21,15 @@ void importaddress(CWallet& wallet, const std::string& address);
 /** Returns a new address from the wallet */
 std::string getnewaddress(CWallet& w);
 
+// Wallet state //
+
+/**
+ * Load a history of num_txs confirmed transactions into the wallet, as read
+ * from disk. Each one spends the previous one's change and pays away the rest,
+ * and every unspent_interval-th one also keeps an output for the wallet.
+ * Returns the wallet's resulting confirmed balance.
+ */
+int64_t AddTxHistory(CWallet& wallet, int num_txs, int unspent_interval);
+
 
 #endif // BITCOIN_TEST_UTIL_WALLET_H
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <boost/test/unit_test.hpp>
+#include <chain.h>
 #include <consensus/validation.h>
 #include <primitives/block.h>
 #include <scheduler.h>
@@ -10,6 +11,8 @@
 #include <util/check.h>
 #include <validationinterface.h>
 
+#include <future>
+
 BOOST_FIXTURE_TEST_SUITE(validationinterface_tests, TestingSetup)
 
 struct TestSubscriberNoop final : public CValidationInterface {
@@ -91,4 +94,87 @@ BOOST_AUTO_TEST_CASE(unregister_all_during_call)
     BOOST_CHECK(destroyed);
 }
 
+class TestFlushSubscriber : public CValidationInterface
+{
+public:
+    std::function<void()> m_on_call;
+    std::vector<uint256> m_hashes;
+    void ChainStateFlushed(const CBlockLocator& locator) override
+    {
+        if (m_on_call) m_on_call();
+        m_hashes.push_back(locator.vHave.front());
+    }
+};
+
+// A subscriber that is slow to process its callbacks must not hold up the
+// others, while each still receives its callbacks in order.
+BOOST_AUTO_TEST_CASE(subscribers_run_in_parallel)
+{
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::promise<void> fast_done;
+    TestFlushSubscriber slow, fast;
+    slow.m_on_call = [released] { released.wait(); };
+    fast.m_on_call = [&] { if (fast.m_hashes.size() == 2) fast_done.set_value(); };
+    RegisterValidationInterface(&slow);
+    RegisterValidationInterface(&fast);
+
+    std::vector<uint256> hashes{uint256S("01"), uint256S("02"), uint256S("03")};
+    for (const uint256& hash : hashes) {
+        GetMainSignals().ChainStateFlushed(CBlockLocator{{hash}});
+    }
+    // The fast subscriber gets through all its callbacks while the slow one
+    // is blocked in its first
+    fast_done.get_future().wait();
+    BOOST_CHECK(slow.m_hashes.empty());
+    BOOST_CHECK_EQUAL(GetMainSignals().CallbacksPending(), 2U);
+    BOOST_CHECK_EQUAL(GetMainSignals().TotalCallbacksPending(), 2U);
+
+    release.set_value();
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK(slow.m_hashes == hashes);
+    BOOST_CHECK(fast.m_hashes == hashes);
+    BOOST_CHECK_EQUAL(GetMainSignals().CallbacksPending(), 0U);
+
+    UnregisterValidationInterface(&slow);
+    UnregisterValidationInterface(&fast);
+    SyncWithValidationInterfaceQueue();
+}
+
+class TestFlushCounter : public CValidationInterface
+{
+public:
+    explicit TestFlushCounter(std::atomic<int>& alive) : m_alive(alive) { ++m_alive; }
+    ~TestFlushCounter() { --m_alive; }
+    void ChainStateFlushed(const CBlockLocator&) override { ++m_calls; }
+    std::atomic<int>& m_alive;
+    std::atomic<int> m_calls{0};
+};
+
+// Subscribers may come and go while the signal threads are busy delivering
+// events to them, and are released once none of their callbacks runs anymore.
+BOOST_AUTO_TEST_CASE(register_unregister_under_load)
+{
+    std::atomic<bool> generate{true};
+    std::thread gen{[&] {
+        const CBlockLocator locator{{uint256S("01")}};
+        while (generate) {
+            GetMainSignals().ChainStateFlushed(locator);
+            if (GetMainSignals().CallbacksPending() > 100) SyncWithValidationInterfaceQueue();
+        }
+    }};
+
+    std::atomic<int> alive{0};
+    for (int i = 0; i < 2000; ++i) {
+        auto sub = std::make_shared<TestFlushCounter>(alive);
+        RegisterSharedValidationInterface(sub);
+        if (i % 100 == 0) SyncWithValidationInterfaceQueue();
+        UnregisterSharedValidationInterface(sub);
+    }
+    generate = false;
+    gen.join();
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK_EQUAL(alive, 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,155 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txannounce.h>
+
+#include <algorithm>
+
+void TxAnnouncementQueue::AddPeer(NodeId peer)
+{
+    LOCK(m_mutex);
+    m_peers.emplace(peer, PeerState{LogEnd(), {}});
+}
+
+void TxAnnouncementQueue::RemovePeer(NodeId peer)
+{
+    LOCK(m_mutex);
+    m_peers.erase(peer);
+}
+
+void TxAnnouncementQueue::Push(const uint256& txid)
+{
+    LOCK(m_mutex);
+    m_pending.push_back(txid);
+}
+
+void TxAnnouncementQueue::Remove(const uint256& txid)
+{
+    LOCK(m_mutex);
+    const auto it = m_index.find(txid);
+    if (it == m_index.end()) return;
+    m_log[it->second - m_log_begin].tx = nullptr;
+    m_index.erase(it);
+}
+
+void TxAnnouncementQueue::Seal(const CTxMemPool& pool)
+{
+    std::vector<uint256> txids;
+    {
+        LOCK(m_mutex);
+        txids.swap(m_pending);
+    }
+    // Look the batch up without holding m_mutex, so pool.cs is never acquired under it.
+    std::vector<TxMempoolInfo> batch;
+    if (!txids.empty()) batch = pool.infoSorted(txids);
+
+    LOCK(m_mutex);
+    if (!batch.empty()) m_last_batch_begin = LogEnd();
+    for (TxMempoolInfo& info : batch) {
+        const uint64_t seq = LogEnd();
+        const auto ret = m_index.emplace(info.tx->GetHash(), seq);
+        if (!ret.second) {
+            // Announced again: only the most recent entry is kept live.
+            m_log[ret.first->second - m_log_begin].tx = nullptr;
+            ret.first->second = seq;
+        }
+        m_log.push_back(std::move(info));
+    }
+
+    uint64_t min_cursor = LogEnd();
+    for (const auto& peer : m_peers) {
+        min_cursor = std::min(min_cursor, peer.second.cursor);
+    }
+    while (m_log_begin < min_cursor) {
+        // Live entries are the ones in m_index.
+        if (m_log.front().tx) m_index.erase(m_log.front().tx->GetHash());
+        m_log.pop_front();
+        ++m_log_begin;
+    }
+}
+
+bool TxAnnouncementQueue::Walk(PeerState& state, uint64_t seq, const AnnounceFn& fn)
+{
+    const TxMempoolInfo& info = m_log[seq - m_log_begin];
+    if (!info.tx || !state.walked.insert(seq).second) return false;
+    return fn(info);
+}
+
+void TxAnnouncementQueue::AdvanceCursor(PeerState& state)
+{
+    while (state.cursor < LogEnd()) {
+        if (m_log[state.cursor - m_log_begin].tx && state.walked.erase(state.cursor) == 0) break;
+        ++state.cursor;
+    }
+}
+
+void TxAnnouncementQueue::Announce(NodeId peer, const CTxMemPool& pool, size_t max, const AnnounceFn& fn)
+{
+    std::vector<uint256> txids;
+    {
+        LOCK(m_mutex);
+        const auto it = m_peers.find(peer);
+        if (it == m_peers.end()) return;
+        PeerState& state = it->second;
+        if (state.cursor >= m_last_batch_begin) {
+            // Everything left to walk belongs to the last batch, which is in mempool order already.
+            size_t announced = 0;
+            for (uint64_t seq = state.cursor; seq < LogEnd() && announced < max; ++seq) {
+                if (Walk(state, seq, fn)) ++announced;
+            }
+            AdvanceCursor(state);
+            return;
+        }
+        for (uint64_t seq = state.cursor; seq < LogEnd(); ++seq) {
+            const TxMempoolInfo& info = m_log[seq - m_log_begin];
+            if (info.tx && state.walked.count(seq) == 0) txids.push_back(info.tx->GetHash());
+        }
+    }
+    // The entries span several batches, so sort them again, without holding m_mutex so that
+    // pool.cs is never acquired under it.
+    const std::vector<TxMempoolInfo> sorted = pool.infoSorted(txids);
+
+    LOCK(m_mutex);
+    const auto it = m_peers.find(peer);
+    if (it == m_peers.end()) return;
+    PeerState& state = it->second;
+    size_t announced = 0;
+    for (const TxMempoolInfo& info : sorted) {
+        if (announced >= max) break;
+        // Skip transactions that left the log or were queued again in the meantime.
+        const auto index_it = m_index.find(info.tx->GetHash());
+        if (index_it == m_index.end() || index_it->second < state.cursor) continue;
+        if (Walk(state, index_it->second, fn)) ++announced;
+    }
+    AdvanceCursor(state);
+}
+
+void TxAnnouncementQueue::Skip(NodeId peer)
+{
+    LOCK(m_mutex);
+    const auto it = m_peers.find(peer);
+    if (it == m_peers.end()) return;
+    it->second.cursor = LogEnd();
+    it->second.walked.clear();
+}
+
+size_t TxAnnouncementQueue::CountPending() const
+{
+    LOCK(m_mutex);
+    return m_pending.size();
+}
+
+size_t TxAnnouncementQueue::CountSealed() const
+{
+    LOCK(m_mutex);
+    return m_log.size();
+}
+
+size_t TxAnnouncementQueue::CountUnseen(NodeId peer) const
+{
+    LOCK(m_mutex);
+    const auto it = m_peers.find(peer);
+    if (it == m_peers.end()) return 0;
+    return LogEnd() - it->second.cursor - it->second.walked.size();
+}
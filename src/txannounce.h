@@ -0,0 +1,97 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXANNOUNCE_H
+#define BITCOIN_TXANNOUNCE_H
+
+#include <net.h> // For NodeId
+#include <sync.h>
+#include <txmempool.h>
+#include <uint256.h>
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+
+/** Shared queue of transactions to announce to peers.
+ *
+ * Transactions to relay are queued once, rather than once per peer. Queued transactions are
+ * sealed into a batch, ordered by the mempool (parents before children, then by feerate), at
+ * each peer's trickle. Sealed batches are appended to a log that is shared by all peers,
+ * together with the mempool data needed to filter them per peer.
+ *
+ * Each peer keeps a cursor into the log. A peer whose unseen entries all belong to the last
+ * batch walks them in order, which costs time linear in the number of entries it walks past,
+ * with no per-peer sorting or mempool lookups. A peer further behind has its unseen entries
+ * sorted again by the mempool at each trickle, so that it still announces in mempool order
+ * across batches. Entries are marked as gone when their transaction leaves the mempool, and
+ * dropped from the log once every peer's cursor has moved past them.
+ */
+class TxAnnouncementQueue {
+public:
+    /** Called for each live entry a peer walks past. Returns whether the transaction was announced. */
+    using AnnounceFn = std::function<bool(const TxMempoolInfo&)>;
+
+    /** Start tracking a peer. It will be offered the transactions sealed from now on. */
+    void AddPeer(NodeId peer) LOCKS_EXCLUDED(m_mutex);
+    /** Stop tracking a peer. */
+    void RemovePeer(NodeId peer) LOCKS_EXCLUDED(m_mutex);
+
+    /** Queue a transaction for announcement to all peers. */
+    void Push(const uint256& txid) LOCKS_EXCLUDED(m_mutex);
+    /** Mark a transaction as no longer in the mempool, so it is not announced anymore. */
+    void Remove(const uint256& txid) LOCKS_EXCLUDED(m_mutex);
+
+    /** Seal the queued transactions still in the mempool into a batch in mempool order, and drop
+     *  entries all peers have walked past. */
+    void Seal(const CTxMemPool& pool) LOCKS_EXCLUDED(m_mutex);
+
+    /** Walk the sealed entries a peer has not seen yet, in mempool order, until max of them were
+     *  announced by fn. Entries for transactions no longer in the mempool are skipped. */
+    void Announce(NodeId peer, const CTxMemPool& pool, size_t max, const AnnounceFn& fn) LOCKS_EXCLUDED(m_mutex);
+    /** Move a peer's cursor past all sealed entries without announcing them. */
+    void Skip(NodeId peer) LOCKS_EXCLUDED(m_mutex);
+
+    /** Number of queued transactions not sealed yet. */
+    size_t CountPending() const LOCKS_EXCLUDED(m_mutex);
+    /** Number of sealed entries kept for peers that have not walked past them. */
+    size_t CountSealed() const LOCKS_EXCLUDED(m_mutex);
+    /** Number of sealed entries a peer has not walked past yet. */
+    size_t CountUnseen(NodeId peer) const LOCKS_EXCLUDED(m_mutex);
+
+private:
+    struct PeerState {
+        //! Sequence number of the first entry the peer has not walked past
+        uint64_t cursor;
+        //! Sequence numbers after the cursor the peer already walked past
+        std::set<uint64_t> walked;
+    };
+
+    mutable Mutex m_mutex;
+    //! Transactions queued since the last seal
+    std::vector<uint256> m_pending GUARDED_BY(m_mutex);
+    //! Sealed entries, tx is nullptr once the transaction left the mempool
+    std::deque<TxMempoolInfo> m_log GUARDED_BY(m_mutex);
+    //! Sequence number of m_log.front()
+    uint64_t m_log_begin GUARDED_BY(m_mutex){0};
+    //! Sequence number of the first entry of the last sealed batch
+    uint64_t m_last_batch_begin GUARDED_BY(m_mutex){0};
+    //! Sequence number of the live entry for each txid in m_log
+    std::unordered_map<uint256, uint64_t, SaltedTxidHasher> m_index GUARDED_BY(m_mutex);
+    //! Position of each peer in the log
+    std::map<NodeId, PeerState> m_peers GUARDED_BY(m_mutex);
+
+    uint64_t LogEnd() const EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_log_begin + m_log.size(); }
+    /** Offer the live entry at seq to fn unless the peer walked past it already. */
+    bool Walk(PeerState& state, uint64_t seq, const AnnounceFn& fn) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    /** Move a peer's cursor past dead entries and the entries it walked past. */
+    void AdvanceCursor(PeerState& state) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+};
+
+#endif // BITCOIN_TXANNOUNCE_H
@@ -36,6 +36,10 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxTxIndexCache = 1024;
 //! Max memory allocated to all block filter index caches combined in MiB.
 static const int64_t max_filter_index_cache = 1024;
+//! Max memory allocated to scriptPubKey index DB specific cache (MiB)
+static const int64_t max_script_index_cache = 1024;
+//! Max memory allocated to block statistics index DB specific cache (MiB)
+static const int64_t max_block_stats_index_cache = 64;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
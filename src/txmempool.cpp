@@ -59,25 +59,35 @@ size_t CTxMemPoolEntry::GetTxSize() const
 // descendants.
 void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
 {
-    CTxMemPoolEntry::Children stageEntries, descendants;
-    stageEntries = updateIt->GetMemPoolChildrenConst();
+    const auto epoch = GetFreshEpoch();
+    std::vector<txiter> stageEntries, descendants;
+
+    for (const CTxMemPoolEntry& childEntry : updateIt->GetMemPoolChildrenConst()) {
+        txiter childIt = mapTx.iterator_to(childEntry);
+        if (!visited(childIt)) {
+            stageEntries.push_back(childIt);
+        }
+    }
 
     while (!stageEntries.empty()) {
-        const CTxMemPoolEntry& descendant = *stageEntries.begin();
-        descendants.insert(descendant);
-        stageEntries.erase(descendant);
-        const CTxMemPoolEntry::Children& children = descendant.GetMemPoolChildrenConst();
+        txiter descendantIt = stageEntries.back();
+        stageEntries.pop_back();
+        descendants.push_back(descendantIt);
+        const CTxMemPoolEntry::Children& children = descendantIt->GetMemPoolChildrenConst();
         for (const CTxMemPoolEntry& childEntry : children) {
-            cacheMap::iterator cacheIt = cachedDescendants.find(mapTx.iterator_to(childEntry));
+            txiter childIt = mapTx.iterator_to(childEntry);
+            cacheMap::iterator cacheIt = cachedDescendants.find(childIt);
             if (cacheIt != cachedDescendants.end()) {
                 // We've already calculated this one, just add the entries for this set
                 // but don't traverse again.
                 for (txiter cacheEntry : cacheIt->second) {
-                    descendants.insert(*cacheEntry);
+                    if (!visited(cacheEntry)) {
+                        descendants.push_back(cacheEntry);
+                    }
                 }
-            } else if (!descendants.count(childEntry)) {
+            } else if (!visited(childIt)) {
                 // Schedule for later processing
-                stageEntries.insert(childEntry);
+                stageEntries.push_back(childIt);
             }
         }
     }
@@ -86,14 +96,15 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
     int64_t modifySize = 0;
     CAmount modifyFee = 0;
     int64_t modifyCount = 0;
-    for (const CTxMemPoolEntry& descendant : descendants) {
-        if (!setExclude.count(descendant.GetTx().GetHash())) {
-            modifySize += descendant.GetTxSize();
-            modifyFee += descendant.GetModifiedFee();
+    std::vector<txiter>& cached = cachedDescendants[updateIt];
+    for (txiter descendantIt : descendants) {
+        if (!setExclude.count(descendantIt->GetTx().GetHash())) {
+            modifySize += descendantIt->GetTxSize();
+            modifyFee += descendantIt->GetModifiedFee();
             modifyCount++;
-            cachedDescendants[updateIt].insert(mapTx.iterator_to(descendant));
+            cached.push_back(descendantIt);
             // Update ancestor state for each descendant
-            mapTx.modify(mapTx.iterator_to(descendant), update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
+            mapTx.modify(descendantIt, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
         }
     }
     mapTx.modify(updateIt, update_descendant_state(modifySize, modifyFee, modifyCount));
@@ -151,8 +162,11 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
 
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */) const
 {
-    CTxMemPoolEntry::Parents staged_ancestors;
+    const auto epoch = GetFreshEpoch();
+    std::vector<txiter> staged_ancestors;
     const CTransaction &tx = entry.GetTx();
+    // Number of distinct ancestors found so far, whether already walked or still staged
+    size_t ancestors_found = 0;
 
     if (fSearchForParents) {
         // Get parents of this transaction that are in the mempool
@@ -160,29 +174,46 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // iterate mapTx to find parents.
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             Optional<txiter> piter = GetIter(tx.vin[i].prevout.hash);
-            if (piter) {
-                staged_ancestors.insert(**piter);
-                if (staged_ancestors.size() + 1 > limitAncestorCount) {
+            if (piter && !visited(*piter)) {
+                staged_ancestors.push_back(*piter);
+                if (++ancestors_found + 1 > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
                 }
             }
         }
+
+        // The cached ancestor state of each parent is a lower bound for that of this transaction,
+        // so long chains exceeding the ancestor limits are rejected without walking them.
+        for (txiter parent_it : staged_ancestors) {
+            if (parent_it->GetCountWithAncestors() + 1 > limitAncestorCount) {
+                errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
+                return false;
+            } else if (parent_it->GetSizeWithAncestors() + entry.GetTxSize() > limitAncestorSize) {
+                errString = strprintf("exceeds ancestor size limit [limit: %u]", limitAncestorSize);
+                return false;
+            }
+        }
     } else {
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
         txiter it = mapTx.iterator_to(entry);
-        staged_ancestors = it->GetMemPoolParentsConst();
+        for (const CTxMemPoolEntry& parent : it->GetMemPoolParentsConst()) {
+            txiter parent_it = mapTx.iterator_to(parent);
+            if (!visited(parent_it)) {
+                staged_ancestors.push_back(parent_it);
+                ++ancestors_found;
+            }
+        }
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
 
     while (!staged_ancestors.empty()) {
-        const CTxMemPoolEntry& stage = staged_ancestors.begin()->get();
-        txiter stageit = mapTx.iterator_to(stage);
+        txiter stageit = staged_ancestors.back();
+        staged_ancestors.pop_back();
 
         setAncestors.insert(stageit);
-        staged_ancestors.erase(stage);
         totalSizeWithAncestors += stageit->GetTxSize();
 
         if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
@@ -201,10 +232,11 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
             txiter parent_it = mapTx.iterator_to(parent);
 
             // If this is a new ancestor, add it.
-            if (setAncestors.count(parent_it) == 0) {
-                staged_ancestors.insert(parent);
+            if (!visited(parent_it)) {
+                staged_ancestors.push_back(parent_it);
+                ++ancestors_found;
             }
-            if (staged_ancestors.size() + setAncestors.size() + 1 > limitAncestorCount) {
+            if (ancestors_found + 1 > limitAncestorCount) {
                 errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
                 return false;
             }
@@ -452,23 +484,24 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 // can save time by not iterating over those entries.
 void CTxMemPool::CalculateDescendants(txiter entryit, setEntries& setDescendants) const
 {
-    setEntries stage;
-    if (setDescendants.count(entryit) == 0) {
-        stage.insert(entryit);
+    // Entries are added to setDescendants when they are staged, so that a single set lookup both
+    // deduplicates the walk and skips children that are accounted for in setDescendants already
+    // (because those children have either already been walked, or will be walked in this
+    // iteration).
+    std::vector<txiter> stage;
+    if (setDescendants.insert(entryit).second) {
+        stage.push_back(entryit);
     }
-    // Traverse down the children of entry, only adding children that are not
-    // accounted for in setDescendants already (because those children have either
-    // already been walked, or will be walked in this iteration).
+    // Traverse down the children of entry.
     while (!stage.empty()) {
-        txiter it = *stage.begin();
-        setDescendants.insert(it);
-        stage.erase(it);
+        txiter it = stage.back();
+        stage.pop_back();
 
         const CTxMemPoolEntry::Children& children = it->GetMemPoolChildrenConst();
         for (const CTxMemPoolEntry& child : children) {
             txiter childiter = mapTx.iterator_to(child);
-            if (!setDescendants.count(childiter)) {
-                stage.insert(childiter);
+            if (setDescendants.insert(childiter).second) {
+                stage.push_back(childiter);
             }
         }
     }
@@ -811,6 +844,28 @@ std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
     return ret;
 }
 
+std::vector<TxMempoolInfo> CTxMemPool::infoSorted(const std::vector<uint256>& txids) const
+{
+    LOCK(cs);
+    std::vector<indexed_transaction_set::const_iterator> iters;
+    iters.reserve(txids.size());
+    for (const uint256& txid : txids) {
+        indexed_transaction_set::const_iterator it = mapTx.find(txid);
+        if (it != mapTx.end()) iters.push_back(it);
+    }
+    // The order is total, so duplicates end up next to each other.
+    std::sort(iters.begin(), iters.end(), DepthAndScoreComparator());
+    iters.erase(std::unique(iters.begin(), iters.end()), iters.end());
+
+    std::vector<TxMempoolInfo> ret;
+    ret.reserve(iters.size());
+    for (auto it : iters) {
+        ret.push_back(GetInfo(it));
+    }
+
+    return ret;
+}
+
 CTransactionRef CTxMemPool::get(const uint256& hash) const
 {
     LOCK(cs);
@@ -583,7 +583,7 @@ public:
 
     uint64_t CalculateDescendantMaximum(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
 private:
-    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
+    typedef std::map<txiter, std::vector<txiter>, CompareIteratorByHash> cacheMap;
 
 
     void UpdateParent(txiter entry, txiter parent, bool add) EXCLUSIVE_LOCKS_REQUIRED(cs);
@@ -752,6 +752,8 @@ public:
     TxMempoolInfo info(const uint256& hash) const;
     TxMempoolInfo info(const GenTxid& gtxid) const;
     std::vector<TxMempoolInfo> infoAll() const;
+    /** Info for those of the given transactions that are in the mempool, without duplicates, in the order of infoAll() */
+    std::vector<TxMempoolInfo> infoSorted(const std::vector<uint256>& txids) const;
 
     size_t DynamicMemoryUsage() const;
 
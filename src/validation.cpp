@@ -473,11 +473,26 @@ public:
         std::vector<COutPoint>& m_coins_to_uncache;
         const bool m_test_accept;
         CAmount* m_fee_out;
+        /*
+         * Skip script verification. Only set when restoring transactions from
+         * a mempool.dat whose scripts were verified against the current tip.
+         */
+        const bool m_skip_script_checks;
+        /*
+         * Script data of a transaction whose scripts have already been verified
+         * with the policy flags, as part of a batch. Policy script checks are
+         * skipped if the transaction still spends the same outputs.
+         */
+        const PrecomputedTransactionData* m_verified_txdata;
     };
 
     // Single transaction acceptance
     bool AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs& args) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    // Run the checks which do not involve scripts on a transaction that is
+    // accepted later as part of a batch, and return the outputs it spends.
+    bool PreCheckForBatch(const CTransactionRef& ptx, ATMPArgs& args, std::vector<CTxOut>& spent_outputs) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 private:
     // All the intermediate state that gets passed between the various levels
     // of checking a given transaction.
@@ -1027,6 +1042,16 @@ bool MemPoolAccept::Finalize(ATMPArgs& args, Workspace& ws)
     return true;
 }
 
+/** Whether the coins in view spent by tx are the given outputs. */
+static bool SpentOutputsMatch(const CTransaction& tx, const CCoinsViewCache& view, const std::vector<CTxOut>& spent_outputs)
+{
+    if (spent_outputs.size() != tx.vin.size()) return false;
+    for (size_t i = 0; i < tx.vin.size(); ++i) {
+        if (!(view.AccessCoin(tx.vin[i].prevout).out == spent_outputs[i])) return false;
+    }
+    return true;
+}
+
 bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs& args)
 {
     AssertLockHeld(cs_main);
@@ -1042,9 +1067,15 @@ bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs
     // checks pass, to mitigate CPU exhaustion denial-of-service attacks.
     PrecomputedTransactionData txdata;
 
-    if (!PolicyScriptChecks(args, workspace, txdata)) return false;
+    if (!args.m_skip_script_checks) {
+        if (args.m_verified_txdata && SpentOutputsMatch(*ptx, m_view, args.m_verified_txdata->m_spent_outputs)) {
+            txdata = *args.m_verified_txdata;
+        } else if (!PolicyScriptChecks(args, workspace, txdata)) {
+            return false;
+        }
 
-    if (!ConsensusScriptChecks(args, workspace, txdata)) return false;
+        if (!ConsensusScriptChecks(args, workspace, txdata)) return false;
+    }
 
     // Tx was accepted, but not added
     if (args.m_test_accept) return true;
@@ -1056,15 +1087,34 @@ bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs
     return true;
 }
 
+bool MemPoolAccept::PreCheckForBatch(const CTransactionRef& ptx, ATMPArgs& args, std::vector<CTxOut>& spent_outputs)
+{
+    AssertLockHeld(cs_main);
+    LOCK(m_pool.cs);
+
+    Workspace workspace(ptx);
+
+    if (!PreChecks(args, workspace)) return false;
+
+    // PreChecks leaves the coins spent by the transaction in m_view.
+    spent_outputs.clear();
+    spent_outputs.reserve(ptx->vin.size());
+    for (const CTxIn& txin : ptx->vin) {
+        spent_outputs.push_back(m_view.AccessCoin(txin.prevout).out);
+    }
+    return true;
+}
+
 } // anon namespace
 
 /** (try to) add transaction to memory pool with a specified acceptance time **/
 static bool AcceptToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPool& pool, TxValidationState &state, const CTransactionRef &tx,
                         int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                        bool bypass_limits, bool test_accept, CAmount* fee_out=nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+                        bool bypass_limits, bool test_accept, CAmount* fee_out=nullptr,
+                        bool skip_script_checks=false, const PrecomputedTransactionData* verified_txdata=nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     std::vector<COutPoint> coins_to_uncache;
-    MemPoolAccept::ATMPArgs args { chainparams, state, nAcceptTime, plTxnReplaced, bypass_limits, coins_to_uncache, test_accept, fee_out };
+    MemPoolAccept::ATMPArgs args { chainparams, state, nAcceptTime, plTxnReplaced, bypass_limits, coins_to_uncache, test_accept, fee_out, skip_script_checks, verified_txdata };
     bool res = MemPoolAccept(pool).AcceptSingleTransaction(tx, args);
     if (!res) {
         // Remove coins that were not present in the coins cache before calling ATMPW;
@@ -1825,6 +1875,83 @@ void ThreadScriptCheck(int worker_num) {
     scriptcheckqueue.Thread();
 }
 
+std::vector<TxValidationState> AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& txs,
+                                                       std::list<CTransactionRef>* plTxnReplaced)
+{
+    const CChainParams& chainparams = Params();
+    const int64_t accept_time = GetTime();
+    std::vector<TxValidationState> states(txs.size());
+
+    // Run the cheap checks on every transaction and collect the outputs they spend. Transactions
+    // failing here (for instance because they spend an output of an earlier transaction of the
+    // batch) are still tried in the final phase, with their scripts checked there.
+    // The coins this phase adds to the coins cache are kept for the transactions passing it, and
+    // removed again if they are not accepted in the end.
+    std::vector<std::unique_ptr<PrecomputedTransactionData>> txdata(txs.size());
+    std::vector<std::vector<COutPoint>> coins_to_uncache(txs.size());
+    {
+        LOCK(cs_main);
+        for (size_t i = 0; i < txs.size(); ++i) {
+            TxValidationState state_dummy;
+            std::vector<CTxOut> spent_outputs;
+            MemPoolAccept::ATMPArgs args { chainparams, state_dummy, accept_time, nullptr /* plTxnReplaced */, false /* bypass_limits */,
+                                           coins_to_uncache[i], true /* test_accept */, nullptr /* fee_out */, false /* skip_script_checks */, nullptr /* verified_txdata */ };
+            if (MemPoolAccept(pool).PreCheckForBatch(txs[i], args, spent_outputs)) {
+                txdata[i] = MakeUnique<PrecomputedTransactionData>();
+                txdata[i]->Init(*txs[i], std::move(spent_outputs));
+            } else {
+                for (const COutPoint& outpoint : coins_to_uncache[i]) {
+                    ::ChainstateActive().CoinsTip().Uncache(outpoint);
+                }
+                coins_to_uncache[i].clear();
+            }
+        }
+    }
+
+    // Verify all scripts on the script check threads without holding cs_main. Valid signatures
+    // are cached, so if any check fails, only the signatures not verified yet are checked again
+    // in the final phase.
+    bool scripts_ok = true;
+    {
+        CCheckQueueControl<CScriptCheck> control(g_parallel_script_checks ? &scriptcheckqueue : nullptr);
+        for (size_t i = 0; i < txs.size() && scripts_ok; ++i) {
+            if (!txdata[i]) continue;
+            std::vector<CScriptCheck> checks;
+            checks.reserve(txs[i]->vin.size());
+            for (unsigned int j = 0; j < txs[i]->vin.size(); ++j) {
+                checks.emplace_back(txdata[i]->m_spent_outputs[j], *txs[i], j, STANDARD_SCRIPT_VERIFY_FLAGS, true /* cacheStore */, txdata[i].get());
+            }
+            if (g_parallel_script_checks) {
+                control.Add(checks);
+            } else {
+                for (CScriptCheck& check : checks) {
+                    if (!check()) {
+                        scripts_ok = false;
+                        break;
+                    }
+                }
+            }
+        }
+        if (!control.Wait()) scripts_ok = false;
+    }
+
+    // Accept the transactions in order. The cheap checks are run again, since the chain or the
+    // mempool may have changed while cs_main was released.
+    for (size_t i = 0; i < txs.size(); ++i) {
+        LOCK(cs_main);
+        if (!AcceptToMemoryPoolWithTime(chainparams, pool, states[i], txs[i], accept_time, plTxnReplaced,
+                                        false /* bypass_limits */, false /* test_accept */, nullptr /* fee_out */,
+                                        false /* skip_script_checks */, scripts_ok ? txdata[i].get() : nullptr)) {
+            // The single transaction path only uncaches the coins it fetched itself, which does not
+            // include those the first phase already fetched.
+            for (const COutPoint& outpoint : coins_to_uncache[i]) {
+                ::ChainstateActive().CoinsTip().Uncache(outpoint);
+            }
+        }
+    }
+    return states;
+}
+
 VersionBitsCache versionbitscache GUARDED_BY(cs_main);
 
 int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
@@ -2862,7 +2989,9 @@ static bool NotifyHeaderTip() LOCKS_EXCLUDED(cs_main) {
 static void LimitValidationInterfaceQueue() LOCKS_EXCLUDED(cs_main) {
     AssertLockNotHeld(cs_main);
 
-    if (GetMainSignals().CallbacksPending() > 10) {
+    const size_t pending = GetMainSignals().CallbacksPending();
+    if (pending > 10) {
+        LogPrint(BCLog::VALIDATION, "%s: waiting on validation interface queues (deepest %u, total %u)\n", __func__, pending, GetMainSignals().TotalCallbacksPending());
         SyncWithValidationInterfaceQueue();
     }
 }
@@ -5043,7 +5172,73 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(::ChainActive().Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION_NO_CHECKSUM = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+//! Number of transactions loaded from mempool.dat whose scripts are verified in parallel at once
+static const size_t MEMPOOL_LOAD_SCRIPT_BATCH = 1000;
+
+namespace {
+struct MempoolDumpEntry {
+    CTransactionRef tx;
+    int64_t time;
+    int64_t fee_delta;
+};
+} // namespace
+
+/**
+ * Verify the scripts of a batch of transactions loaded from mempool.dat on the script check
+ * threads. Valid signatures are stored in the signature cache, so that the AcceptToMemoryPool
+ * calls which follow do not have to verify them one by one. Transactions with missing inputs
+ * are skipped; a failing check makes the rest of the batch fall back to sequential verification.
+ * Only the spent outputs are looked up under cs_main, which is not held while the checks run.
+ */
+static void WarmMempoolScriptCache(std::vector<MempoolDumpEntry>::const_iterator begin,
+                                   std::vector<MempoolDumpEntry>::const_iterator end,
+                                   const std::unordered_map<uint256, CTransactionRef, SaltedTxidHasher>& loaded_txs) LOCKS_EXCLUDED(cs_main)
+{
+    if (!g_parallel_script_checks) return;
+
+    // The precomputed data is referenced by the queued checks and must outlive them.
+    std::vector<std::pair<const CTransaction*, std::unique_ptr<PrecomputedTransactionData>>> txdata;
+    {
+        LOCK(cs_main);
+        const CCoinsViewCache& coins = ::ChainstateActive().CoinsTip();
+        for (auto it = begin; it != end; ++it) {
+            const CTransaction& tx = *it->tx;
+            if (tx.IsCoinBase()) continue;
+
+            std::vector<CTxOut> spent_outputs;
+            spent_outputs.reserve(tx.vin.size());
+            for (const CTxIn& txin : tx.vin) {
+                auto parent = loaded_txs.find(txin.prevout.hash);
+                if (parent != loaded_txs.end() && txin.prevout.n < parent->second->vout.size()) {
+                    spent_outputs.push_back(parent->second->vout[txin.prevout.n]);
+                    continue;
+                }
+                const Coin& coin = coins.AccessCoin(txin.prevout);
+                if (coin.IsSpent()) break;
+                spent_outputs.push_back(coin.out);
+            }
+            if (spent_outputs.size() != tx.vin.size()) continue;
+
+            txdata.emplace_back(&tx, MakeUnique<PrecomputedTransactionData>());
+            txdata.back().second->Init(tx, std::move(spent_outputs));
+        }
+    }
+
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    for (const auto& entry : txdata) {
+        const CTransaction& tx = *entry.first;
+        PrecomputedTransactionData* data = entry.second.get();
+        std::vector<CScriptCheck> checks;
+        checks.reserve(tx.vin.size());
+        for (unsigned int i = 0; i < tx.vin.size(); ++i) {
+            checks.emplace_back(data->m_spent_outputs[i], tx, i, STANDARD_SCRIPT_VERIFY_FLAGS, true /* cacheStore */, data);
+        }
+        control.Add(checks);
+    }
+    control.Wait();
+}
 
 bool LoadMempool(CTxMemPool& pool)
 {
@@ -5057,46 +5252,107 @@ bool LoadMempool(CTxMemPool& pool)
     }
 
     int64_t count = 0;
+    int64_t trusted = 0;
     int64_t expired = 0;
     int64_t failed = 0;
     int64_t already_there = 0;
     int64_t unbroadcast = 0;
     int64_t nNow = GetTime();
+    int64_t start = GetTimeMicros();
 
+    uint64_t version;
+    uint256 tip_hash;
+    uint32_t script_flags = 0;
+    std::vector<MempoolDumpEntry> entries;
+    std::map<uint256, CAmount> mapDeltas;
+    std::set<uint256> unbroadcast_txids;
     try {
-        uint64_t version;
-        file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        // Everything is read before any transaction is accepted, so that a file which fails its
+        // checksum is not partially applied.
+        CHashVerifier<CAutoFile> verifier(&file);
+        verifier >> version;
+        if (version != MEMPOOL_DUMP_VERSION && version != MEMPOOL_DUMP_VERSION_NO_CHECKSUM) {
             return false;
         }
+        if (version == MEMPOOL_DUMP_VERSION) {
+            verifier >> tip_hash;
+            verifier >> script_flags;
+        }
         uint64_t num;
-        file >> num;
+        verifier >> num;
         while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
+            MempoolDumpEntry entry;
+            verifier >> entry.tx;
+            verifier >> entry.time;
+            verifier >> entry.fee_delta;
+            entries.push_back(std::move(entry));
+        }
+        verifier >> mapDeltas;
+
+        if (version == MEMPOOL_DUMP_VERSION) {
+            verifier >> unbroadcast_txids;
+            uint256 checksum;
+            file >> checksum;
+            if (checksum != verifier.GetHash()) {
+                LogPrintf("Checksum mismatch in mempool file on disk. Continuing anyway.\n");
+                return false;
+            }
+        } else {
+            // TODO: remove this try except in v0.22
+            try {
+              verifier >> unbroadcast_txids;
+            } catch (const std::exception&) {
+              // mempool.dat files created prior to v0.21 will not have an
+              // unbroadcast set. No need to log a failure if parsing fails here.
+            }
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    // The scripts of a file written at the current tip with the current flags have already been
+    // verified, so they are only checked again (in parallel) if the tip has moved since.
+    const bool checked_scripts = version == MEMPOOL_DUMP_VERSION && script_flags == STANDARD_SCRIPT_VERIFY_FLAGS;
+    const auto tip_matches = [&]() EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+        return checked_scripts && ::ChainActive().Tip() && ::ChainActive().Tip()->GetBlockHash() == tip_hash;
+    };
+
+    std::unordered_map<uint256, CTransactionRef, SaltedTxidHasher> loaded_txs;
+    for (const MempoolDumpEntry& entry : entries) {
+        loaded_txs.emplace(entry.tx->GetHash(), entry.tx);
+    }
+
+    for (size_t batch_start = 0; batch_start < entries.size(); batch_start += MEMPOOL_LOAD_SCRIPT_BATCH) {
+        const auto batch_begin = entries.cbegin() + batch_start;
+        const auto batch_end = entries.cbegin() + std::min(entries.size(), batch_start + MEMPOOL_LOAD_SCRIPT_BATCH);
+        if (!WITH_LOCK(cs_main, return tip_matches())) {
+            WarmMempoolScriptCache(batch_begin, batch_end, loaded_txs);
+        }
+
+        for (auto it = batch_begin; it != batch_end; ++it) {
+            const MempoolDumpEntry& entry = *it;
+            CAmount amountdelta = entry.fee_delta;
             if (amountdelta) {
-                pool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+                pool.PrioritiseTransaction(entry.tx->GetHash(), amountdelta);
             }
             TxValidationState state;
-            if (nTime > nNow - nExpiryTimeout) {
+            if (entry.time > nNow - nExpiryTimeout) {
                 LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, nTime,
+                const bool skip_script_checks = tip_matches();
+                AcceptToMemoryPoolWithTime(chainparams, pool, state, entry.tx, entry.time,
                                            nullptr /* plTxnReplaced */, false /* bypass_limits */,
-                                           false /* test_accept */);
+                                           false /* test_accept */, nullptr /* fee_out */,
+                                           skip_script_checks);
                 if (state.IsValid()) {
                     ++count;
+                    if (skip_script_checks) ++trusted;
                 } else {
                     // mempool may contain the transaction already, e.g. from
                     // wallet(s) having loaded it while we were processing
                     // mempool transactions; consider these as valid, instead of
                     // failed, but mark them as 'already there'
-                    if (pool.exists(tx->GetHash())) {
+                    if (pool.exists(entry.tx->GetHash())) {
                         ++already_there;
                     } else {
                         ++failed;
@@ -5108,33 +5364,20 @@ bool LoadMempool(CTxMemPool& pool)
             if (ShutdownRequested())
                 return false;
         }
-        std::map<uint256, CAmount> mapDeltas;
-        file >> mapDeltas;
+    }
 
-        for (const auto& i : mapDeltas) {
-            pool.PrioritiseTransaction(i.first, i.second);
-        }
+    for (const auto& i : mapDeltas) {
+        pool.PrioritiseTransaction(i.first, i.second);
+    }
 
-        // TODO: remove this try except in v0.22
-        std::set<uint256> unbroadcast_txids;
-        try {
-          file >> unbroadcast_txids;
-          unbroadcast = unbroadcast_txids.size();
-        } catch (const std::exception&) {
-          // mempool.dat files created prior to v0.21 will not have an
-          // unbroadcast set. No need to log a failure if parsing fails here.
-        }
-        for (const auto& txid : unbroadcast_txids) {
-            // Ensure transactions were accepted to mempool then add to
-            // unbroadcast set.
-            if (pool.get(txid) != nullptr) pool.AddUnbroadcastTx(txid);
-        }
-    } catch (const std::exception& e) {
-        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
-        return false;
+    unbroadcast = unbroadcast_txids.size();
+    for (const auto& txid : unbroadcast_txids) {
+        // Ensure transactions were accepted to mempool then add to
+        // unbroadcast set.
+        if (pool.get(txid) != nullptr) pool.AddUnbroadcastTx(txid);
     }
 
-    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there, %i waiting for initial broadcast\n", count, failed, expired, already_there, unbroadcast);
+    LogPrintf("Imported mempool transactions from disk: %i succeeded (%i without script checks), %i failed, %i expired, %i already there, %i waiting for initial broadcast, %gs\n", count, trusted, failed, expired, already_there, unbroadcast, (GetTimeMicros() - start) * MICRO);
     return true;
 }
 
@@ -5145,12 +5388,16 @@ bool DumpMempool(const CTxMemPool& pool)
     std::map<uint256, CAmount> mapDeltas;
     std::vector<TxMempoolInfo> vinfo;
     std::set<uint256> unbroadcast_txids;
+    uint256 tip_hash;
 
     static Mutex dump_mutex;
     LOCK(dump_mutex);
 
     {
-        LOCK(pool.cs);
+        // Every transaction in the mempool has had its scripts verified against the tip, so the
+        // tip is recorded along with the snapshot.
+        LOCK2(cs_main, pool.cs);
+        if (::ChainActive().Tip()) tip_hash = ::ChainActive().Tip()->GetBlockHash();
         for (const auto &i : pool.mapDeltas) {
             mapDeltas[i.first] = i.second;
         }
@@ -5167,22 +5414,31 @@ bool DumpMempool(const CTxMemPool& pool)
         }
 
         CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        HashedSourceWriter<CAutoFile> writer(&file);
 
-        uint64_t version = MEMPOOL_DUMP_VERSION;
-        file << version;
+        // Version 1 is written unless asked otherwise, as older versions cannot read version 2.
+        const bool with_checksum = gArgs.GetBoolArg("-persistmempoolv2", DEFAULT_PERSIST_MEMPOOL_V2);
+        uint64_t version = with_checksum ? MEMPOOL_DUMP_VERSION : MEMPOOL_DUMP_VERSION_NO_CHECKSUM;
+        writer << version;
+        if (with_checksum) {
+            writer << tip_hash;
+            writer << uint32_t{STANDARD_SCRIPT_VERIFY_FLAGS};
+        }
 
-        file << (uint64_t)vinfo.size();
+        writer << (uint64_t)vinfo.size();
         for (const auto& i : vinfo) {
-            file << *(i.tx);
-            file << int64_t{count_seconds(i.m_time)};
-            file << int64_t{i.nFeeDelta};
+            writer << *(i.tx);
+            writer << int64_t{count_seconds(i.m_time)};
+            writer << int64_t{i.nFeeDelta};
             mapDeltas.erase(i.tx->GetHash());
         }
 
-        file << mapDeltas;
+        writer << mapDeltas;
 
         LogPrintf("Writing %d unbroadcast transactions to disk.\n", unbroadcast_txids.size());
-        file << unbroadcast_txids;
+        writer << unbroadcast_txids;
+
+        if (with_checksum) file << writer.GetHash();
 
         if (!FileCommit(file.Get()))
             throw std::runtime_error("FileCommit failed");
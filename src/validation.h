@@ -74,8 +74,12 @@ static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
 static const char* const DEFAULT_BLOCKFILTERINDEX = "0";
+static const bool DEFAULT_SCRIPTPUBKEYINDEX = false;
+static const bool DEFAULT_BLOCKSTATSINDEX = false;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -persistmempoolv2 */
+static const bool DEFAULT_PERSIST_MEMPOOL_V2 = false;
 /** Default for using fee filter */
 static const bool DEFAULT_FEEFILTER = true;
 /** Default for -stopatheight */
@@ -203,6 +207,18 @@ bool AcceptToMemoryPool(CTxMemPool& pool, TxValidationState &state, const CTrans
                         std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, bool test_accept=false, CAmount* fee_out=nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/** (try to) add a batch of transactions to memory pool
+ * The cheap checks run first for all transactions, then their scripts are
+ * verified on the script check threads without holding cs_main, and finally
+ * the transactions are accepted in order with the cheap checks run again.
+ * Coins fetched for transactions that end up rejected are removed from the
+ * coins cache again, as in AcceptToMemoryPool. The transactions received from
+ * all peers in one round of the message handler are accepted with this.
+ * plTxnReplaced will be appended to with all transactions replaced from mempool
+ * @returns the validation state of each transaction **/
+std::vector<TxValidationState> AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& txs,
+                                                       std::list<CTransactionRef>* plTxnReplaced) LOCKS_EXCLUDED(cs_main);
+
 /** Get the BIP9 state for a given deployment at the current tip. */
 ThresholdState VersionBitsTipState(const Consensus::Params& params, Consensus::DeploymentPos pos);
 
@@ -11,43 +11,199 @@
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <scheduler.h>
-
+#include <tinyformat.h>
+#include <util/system.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
 #include <future>
+#include <list>
+#include <thread>
 #include <unordered_map>
 #include <utility>
+#include <vector>
+
+//! Upper bound on the threads delivering notifications to subscribers
+static constexpr int MAX_SIGNAL_THREADS = 16;
 
-//! The MainSignalsInstance manages a list of shared_ptr<CValidationInterface>
-//! callbacks.
+//! The MainSignalsInstance manages a list of subscribers, each holding a
+//! shared_ptr<CValidationInterface> callbacks and its own queue of events.
 //!
-//! A std::unordered_map is used to track what callbacks are currently
-//! registered, and a std::list is to used to store the callbacks that are
-//! currently registered as well as any callbacks that are just unregistered
-//! and about to be deleted when they are done executing.
+//! Events are first put on a single queue on the scheduler thread, which hands
+//! each one to the subscribers registered at that point, in order. So, as with
+//! a single queue, a subscriber registered after an event was signalled still
+//! receives it if it was not handed out yet. The subscribers' queues are worked
+//! through by a pool of signal threads, so a subscriber sees its events in order
+//! while independent subscribers (wallets, indexes, ...) process them in
+//! parallel. Subscribers that were just unregistered are kept until they no
+//! longer execute callbacks, so that CallFunctionInValidationInterfaceQueue
+//! also waits on them.
 struct MainSignalsInstance {
 private:
+    struct Subscriber : public std::enable_shared_from_this<Subscriber> {
+        Mutex m_mutex;
+        //! Reset on unregistration, after which queued events are dropped
+        std::shared_ptr<CValidationInterface> m_callbacks GUARDED_BY(m_mutex);
+        //! Number of current executions of the callbacks
+        int m_running GUARDED_BY(m_mutex) = 0;
+
+        Mutex m_queue_mutex;
+        std::deque<std::function<void()>> m_queue GUARDED_BY(m_queue_mutex);
+        //! Whether a task working through the queue is scheduled or running.
+        //! There is at most one, and it holds a reference to the subscriber.
+        bool m_processing GUARDED_BY(m_queue_mutex) = false;
+        CScheduler& m_pool;
+
+        Subscriber(std::shared_ptr<CValidationInterface> callbacks, CScheduler& pool) : m_callbacks(std::move(callbacks)), m_pool(pool) {}
+
+        template<typename F> void Call(F&& f)
+        {
+            std::shared_ptr<CValidationInterface> callbacks;
+            {
+                LOCK(m_mutex);
+                if (!m_callbacks) return;
+                callbacks = m_callbacks;
+                ++m_running;
+            }
+            f(*callbacks);
+            // Release our reference before the subscriber may be considered
+            // idle, so it is not destroyed behind the back of a waiter.
+            callbacks.reset();
+            LOCK(m_mutex);
+            --m_running;
+        }
+
+        //! Append a function to the queue, scheduling a task to run it if none is
+        void Add(std::function<void()> func)
+        {
+            {
+                LOCK(m_queue_mutex);
+                m_queue.push_back(std::move(func));
+                if (m_processing) return;
+                m_processing = true;
+            }
+            Schedule();
+        }
+
+        void Schedule()
+        {
+            std::shared_ptr<Subscriber> self = shared_from_this();
+            m_pool.schedule([self] { self->ProcessQueue(); }, std::chrono::system_clock::now());
+        }
+
+        //! Run the oldest queued function, then leave the thread to the other
+        //! subscribers before running the next one
+        void ProcessQueue()
+        {
+            std::function<void()> func;
+            {
+                LOCK(m_queue_mutex);
+                if (m_queue.empty()) {
+                    m_processing = false;
+                    return;
+                }
+                func = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+            func();
+            {
+                LOCK(m_queue_mutex);
+                if (m_queue.empty()) {
+                    m_processing = false;
+                    return;
+                }
+            }
+            Schedule();
+        }
+
+        //! Run all queued functions on the calling thread, once the pool is stopped
+        void EmptyQueue()
+        {
+            while (true) {
+                std::function<void()> func;
+                {
+                    LOCK(m_queue_mutex);
+                    if (m_queue.empty()) return;
+                    func = std::move(m_queue.front());
+                    m_queue.pop_front();
+                }
+                func();
+            }
+        }
+
+        size_t CallbacksPending()
+        {
+            LOCK(m_queue_mutex);
+            return m_queue.size();
+        }
+
+        //! Whether an unregistered subscriber no longer executes callbacks
+        bool IsIdle()
+        {
+            LOCK(m_mutex);
+            if (m_callbacks || m_running > 0) return false;
+            LOCK(m_queue_mutex);
+            return !m_processing;
+        }
+    };
+
     Mutex m_mutex;
-    //! List entries consist of a callback pointer and reference count. The
-    //! count is equal to the number of current executions of that entry, plus 1
-    //! if it's registered. It cannot be 0 because that would imply it is
-    //! unregistered and also not being executed (so shouldn't exist).
-    struct ListEntry { std::shared_ptr<CValidationInterface> callbacks; int count = 1; };
-    std::list<ListEntry> m_list GUARDED_BY(m_mutex);
-    std::unordered_map<CValidationInterface*, std::list<ListEntry>::iterator> m_map GUARDED_BY(m_mutex);
+    //! Registered subscribers, in order of registration
+    std::list<std::shared_ptr<Subscriber>> m_list GUARDED_BY(m_mutex);
+    std::unordered_map<CValidationInterface*, std::list<std::shared_ptr<Subscriber>>::iterator> m_map GUARDED_BY(m_mutex);
+    //! Unregistered subscribers that may still be executing callbacks
+    std::vector<std::shared_ptr<Subscriber>> m_unregistered GUARDED_BY(m_mutex);
+
+    CScheduler m_pool;
+    std::vector<std::thread> m_pool_threads;
+
+    void Retire(std::shared_ptr<Subscriber> subscriber) EXCLUSIVE_LOCKS_REQUIRED(m_mutex)
+    {
+        WITH_LOCK(subscriber->m_mutex, subscriber->m_callbacks.reset());
+        m_unregistered.push_back(std::move(subscriber));
+        m_unregistered.erase(std::remove_if(m_unregistered.begin(), m_unregistered.end(),
+            [](const std::shared_ptr<Subscriber>& s) { return s->IsIdle(); }), m_unregistered.end());
+    }
 
 public:
-    // We are not allowed to assume the scheduler only runs in one thread,
-    // but must ensure all callbacks happen in-order, so we end up creating
-    // our own queue here :(
+    // Hands out events and functions waiting on the queues, in order
     SingleThreadedSchedulerClient m_schedulerClient;
 
-    explicit MainSignalsInstance(CScheduler *pscheduler) : m_schedulerClient(pscheduler) {}
+    explicit MainSignalsInstance(CScheduler *pscheduler) : m_schedulerClient(pscheduler)
+    {
+        const int num_threads = std::max(2, std::min(GetNumCores(), MAX_SIGNAL_THREADS));
+        for (int i = 0; i < num_threads; ++i) {
+            m_pool_threads.emplace_back([this, i] {
+                const std::string name = strprintf("valsignal.%i", i);
+                TraceThread(name.c_str(), [this] { m_pool.serviceQueue(); });
+            });
+        }
+    }
+
+    ~MainSignalsInstance() { StopPool(); }
+
+    //! Stop the signal threads once they finish the callbacks they execute
+    void StopPool()
+    {
+        m_pool.stop();
+        for (std::thread& thread : m_pool_threads) thread.join();
+        m_pool_threads.clear();
+    }
 
     void Register(std::shared_ptr<CValidationInterface> callbacks)
     {
         LOCK(m_mutex);
-        auto inserted = m_map.emplace(callbacks.get(), m_list.end());
-        if (inserted.second) inserted.first->second = m_list.emplace(m_list.end());
-        inserted.first->second->callbacks = std::move(callbacks);
+        auto it = m_map.find(callbacks.get());
+        if (it != m_map.end()) {
+            LOCK((*it->second)->m_mutex);
+            (*it->second)->m_callbacks = std::move(callbacks);
+            return;
+        }
+        CValidationInterface* key = callbacks.get();
+        m_map.emplace(key, m_list.insert(m_list.end(), std::make_shared<Subscriber>(std::move(callbacks), m_pool)));
     }
 
     void Unregister(CValidationInterface* callbacks)
@@ -55,35 +211,114 @@ public:
         LOCK(m_mutex);
         auto it = m_map.find(callbacks);
         if (it != m_map.end()) {
-            if (!--it->second->count) m_list.erase(it->second);
+            Retire(std::move(*it->second));
+            m_list.erase(it->second);
             m_map.erase(it);
         }
     }
 
-    //! Clear unregisters every previously registered callback, erasing every
-    //! map entry. After this call, the list may still contain callbacks that
-    //! are currently executing, but it will be cleared when they are done
-    //! executing.
+    //! Clear unregisters every previously registered callback. Callbacks that
+    //! are currently executing are released when they are done executing.
     void Clear()
     {
         LOCK(m_mutex);
-        for (const auto& entry : m_map) {
-            if (!--entry.second->count) m_list.erase(entry.second);
+        for (auto& subscriber : m_list) {
+            Retire(std::move(subscriber));
         }
+        m_list.clear();
         m_map.clear();
     }
 
+    //! Run f on every subscriber's callbacks on the calling thread
     template<typename F> void Iterate(F&& f)
     {
-        WAIT_LOCK(m_mutex, lock);
-        for (auto it = m_list.begin(); it != m_list.end();) {
-            ++it->count;
+        std::vector<std::shared_ptr<Subscriber>> subscribers;
+        {
+            LOCK(m_mutex);
+            subscribers.assign(m_list.begin(), m_list.end());
+        }
+        for (const auto& subscriber : subscribers) {
+            subscriber->Call(f);
+        }
+    }
+
+    //! Append an event to the queue of every subscriber registered when it is
+    //! handed out
+    void Enqueue(std::function<void(CValidationInterface&)> event)
+    {
+        auto shared_event = std::make_shared<const std::function<void(CValidationInterface&)>>(std::move(event));
+        m_schedulerClient.AddToProcessQueue([this, shared_event] {
+            LOCK(m_mutex);
+            for (const auto& subscriber : m_list) {
+                Subscriber* raw = subscriber.get();
+                // The queue belongs to the subscriber, so a raw pointer does not outlive it.
+                subscriber->Add([raw, shared_event] { raw->Call(*shared_event); });
+            }
+        });
+    }
+
+    //! Call func once every event signalled so far has been executed. As with
+    //! a single queue, func runs where events are handed out, so no event
+    //! signalled later is handed out before func returns.
+    void CallAfterQueues(std::function<void()> func)
+    {
+        m_schedulerClient.AddToProcessQueue([this, func] {
+            std::vector<std::shared_ptr<Subscriber>> subscribers;
             {
-                REVERSE_LOCK(lock);
-                f(*it->callbacks);
+                LOCK(m_mutex);
+                subscribers.assign(m_list.begin(), m_list.end());
+                subscribers.insert(subscribers.end(), m_unregistered.begin(), m_unregistered.end());
+            }
+            if (!subscribers.empty()) {
+                auto remaining = std::make_shared<std::atomic<size_t>>(subscribers.size());
+                auto done = std::make_shared<std::promise<void>>();
+                auto arrive = [remaining, done] {
+                    if (--*remaining == 0) done->set_value();
+                };
+                for (const auto& subscriber : subscribers) subscriber->Add(arrive);
+                // Once the signal threads are stopped the queues are not worked
+                // through any more, so run what is left here
+                std::future<void> all_arrived = done->get_future();
+                while (all_arrived.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready) {
+                    if (m_pool.AreThreadsServicingQueue()) continue;
+                    for (const auto& subscriber : subscribers) subscriber->EmptyQueue();
+                }
             }
-            it = --it->count ? std::next(it) : m_list.erase(it);
+            func();
+        });
+    }
+
+    //! Call any remaining callbacks on the calling thread
+    void EmptyQueues()
+    {
+        StopPool();
+        // Hand out what is left first, then run it
+        m_schedulerClient.EmptyQueue();
+        std::vector<std::shared_ptr<Subscriber>> subscribers;
+        {
+            LOCK(m_mutex);
+            subscribers.assign(m_list.begin(), m_list.end());
+            subscribers.insert(subscribers.end(), m_unregistered.begin(), m_unregistered.end());
+        }
+        for (const auto& subscriber : subscribers) {
+            subscriber->EmptyQueue();
+        }
+    }
+
+    //! Get the depth of the deepest queue and of all queues together, each
+    //! including what is not handed out yet
+    void GetQueueDepths(size_t& max_depth, size_t& total_depth)
+    {
+        const size_t undispatched = m_schedulerClient.CallbacksPending();
+        size_t deepest = 0;
+        total_depth = undispatched;
+        LOCK(m_mutex);
+        for (const auto& subscriber : m_list) {
+            const size_t depth = subscriber->CallbacksPending();
+            deepest = std::max(deepest, depth);
+            total_depth += depth;
         }
+        max_depth = undispatched + deepest;
     }
 };
 
@@ -100,17 +335,34 @@ void CMainSignals::UnregisterBackgroundSignalScheduler()
     m_internals.reset(nullptr);
 }
 
+void CMainSignals::StopBackgroundThreads()
+{
+    if (m_internals) {
+        m_internals->StopPool();
+    }
+}
+
 void CMainSignals::FlushBackgroundCallbacks()
 {
     if (m_internals) {
-        m_internals->m_schedulerClient.EmptyQueue();
+        m_internals->EmptyQueues();
     }
 }
 
 size_t CMainSignals::CallbacksPending()
 {
     if (!m_internals) return 0;
-    return m_internals->m_schedulerClient.CallbacksPending();
+    size_t max_depth, total_depth;
+    m_internals->GetQueueDepths(max_depth, total_depth);
+    return max_depth;
+}
+
+size_t CMainSignals::TotalCallbacksPending()
+{
+    if (!m_internals) return 0;
+    size_t max_depth, total_depth;
+    m_internals->GetQueueDepths(max_depth, total_depth);
+    return total_depth;
 }
 
 CMainSignals& GetMainSignals()
@@ -154,7 +406,7 @@ void UnregisterAllValidationInterfaces()
 
 void CallFunctionInValidationInterfaceQueue(std::function<void()> func)
 {
-    g_signals.m_internals->m_schedulerClient.AddToProcessQueue(std::move(func));
+    g_signals.m_internals->CallAfterQueues(std::move(func));
 }
 
 void SyncWithValidationInterfaceQueue()
@@ -172,14 +424,14 @@ void SyncWithValidationInterfaceQueue()
 // evaluating arguments when logging is not enabled.
 //
 // NOTE: The lambda captures all local variables by value.
-#define ENQUEUE_AND_LOG_EVENT(event, fmt, name, ...)           \
-    do {                                                       \
-        auto local_name = (name);                              \
-        LOG_EVENT("Enqueuing " fmt, local_name, __VA_ARGS__);  \
-        m_internals->m_schedulerClient.AddToProcessQueue([=] { \
-            LOG_EVENT(fmt, local_name, __VA_ARGS__);           \
-            event();                                           \
-        });                                                    \
+#define ENQUEUE_AND_LOG_EVENT(event, fmt, name, ...)                          \
+    do {                                                                      \
+        auto local_name = (name);                                             \
+        LOG_EVENT("Enqueuing " fmt, local_name, __VA_ARGS__);                 \
+        m_internals->Enqueue([=](CValidationInterface& callbacks) {           \
+            LOG_EVENT(fmt, local_name, __VA_ARGS__);                          \
+            event(callbacks);                                                 \
+        });                                                                   \
     } while (0)
 
 #define LOG_EVENT(fmt, ...) \
@@ -190,8 +442,8 @@ void CMainSignals::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockInd
     // the chain actually updates. One way to ensure this is for the caller to invoke this signal
     // in the same critical section where the chain is updated
 
-    auto event = [pindexNew, pindexFork, fInitialDownload, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload); });
+    auto event = [pindexNew, pindexFork, fInitialDownload](CValidationInterface& callbacks) {
+        callbacks.UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: new block hash=%s fork block hash=%s (in IBD=%s)", __func__,
                           pindexNew->GetBlockHash().ToString(),
@@ -200,8 +452,8 @@ void CMainSignals::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockInd
 }
 
 void CMainSignals::TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence) {
-    auto event = [tx, mempool_sequence, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.TransactionAddedToMempool(tx, mempool_sequence); });
+    auto event = [tx, mempool_sequence](CValidationInterface& callbacks) {
+        callbacks.TransactionAddedToMempool(tx, mempool_sequence);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: txid=%s wtxid=%s", __func__,
                           tx->GetHash().ToString(),
@@ -209,8 +461,8 @@ void CMainSignals::TransactionAddedToMempool(const CTransactionRef& tx, uint64_t
 }
 
 void CMainSignals::TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t mempool_sequence) {
-    auto event = [tx, reason, mempool_sequence, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.TransactionRemovedFromMempool(tx, reason, mempool_sequence); });
+    auto event = [tx, reason, mempool_sequence](CValidationInterface& callbacks) {
+        callbacks.TransactionRemovedFromMempool(tx, reason, mempool_sequence);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: txid=%s wtxid=%s", __func__,
                           tx->GetHash().ToString(),
@@ -218,8 +470,8 @@ void CMainSignals::TransactionRemovedFromMempool(const CTransactionRef& tx, MemP
 }
 
 void CMainSignals::BlockConnected(const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex) {
-    auto event = [pblock, pindex, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.BlockConnected(pblock, pindex); });
+    auto event = [pblock, pindex](CValidationInterface& callbacks) {
+        callbacks.BlockConnected(pblock, pindex);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: block hash=%s block height=%d", __func__,
                           pblock->GetHash().ToString(),
@@ -228,8 +480,8 @@ void CMainSignals::BlockConnected(const std::shared_ptr<const CBlock> &pblock, c
 
 void CMainSignals::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex)
 {
-    auto event = [pblock, pindex, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.BlockDisconnected(pblock, pindex); });
+    auto event = [pblock, pindex](CValidationInterface& callbacks) {
+        callbacks.BlockDisconnected(pblock, pindex);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: block hash=%s block height=%d", __func__,
                           pblock->GetHash().ToString(),
@@ -237,8 +489,8 @@ void CMainSignals::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock
 }
 
 void CMainSignals::ChainStateFlushed(const CBlockLocator &locator) {
-    auto event = [locator, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.ChainStateFlushed(locator); });
+    auto event = [locator](CValidationInterface& callbacks) {
+        callbacks.ChainStateFlushed(locator);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: block hash=%s", __func__,
                           locator.IsNull() ? "null" : locator.vHave.front().ToString());
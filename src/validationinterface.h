@@ -73,7 +73,8 @@ void SyncWithValidationInterfaceQueue() LOCKS_EXCLUDED(cs_main);
  * UpdatedBlockTip() callback may depend on an operation performed in
  * the BlockConnected() callback without worrying about explicit
  * synchronization. No ordering should be assumed across
- * ValidationInterface() subscribers.
+ * ValidationInterface() subscribers, which may also receive their
+ * callbacks concurrently with each other.
  */
 class CValidationInterface {
 protected:
@@ -191,10 +192,15 @@ public:
     void RegisterBackgroundSignalScheduler(CScheduler& scheduler);
     /** Unregister a CScheduler to give callbacks which should run in the background - these callbacks will now be dropped! */
     void UnregisterBackgroundSignalScheduler();
+    /** Stop the threads running callbacks in the background, leaving the remaining ones to FlushBackgroundCallbacks */
+    void StopBackgroundThreads();
     /** Call any remaining callbacks on the calling thread */
     void FlushBackgroundCallbacks();
 
+    /** Number of callbacks waiting in the queue of the subscriber furthest behind */
     size_t CallbacksPending();
+    /** Number of callbacks waiting in the queues of all subscribers together */
+    size_t TotalCallbacksPending();
 
 
     void UpdatedBlockTip(const CBlockIndex *, const CBlockIndex *, bool fInitialDownload);
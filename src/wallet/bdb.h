@@ -140,6 +140,15 @@ public:
 
     void ReloadDbEnv() override;
 
+    /** No-ops
+     *
+     * BDB writes go to its log without syncing it, and are synced by the periodic flush,
+     * so there is nothing to gain from grouping them. Holding one transaction across
+     * batches would instead have other batches block on its page locks.
+     */
+    void BeginWriteGroup() override {}
+    bool EndWriteGroup() override { return true; }
+
     /** Verifies the environment and database file */
     bool Verify(bilingual_str& error);
 
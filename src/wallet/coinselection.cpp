@@ -9,6 +9,10 @@
 #include <util/system.h>
 #include <util/moneystr.h>
 
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+
 // Descending order comparator
 struct {
     bool operator()(const OutputGroup& a, const OutputGroup& b) const
@@ -62,8 +66,11 @@ struct {
 
 static const size_t TOTAL_TRIES = 100000;
 
-bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_value, const CAmount& cost_of_change, std::set<CInputCoin>& out_set, CAmount& value_ret, CAmount not_input_fees)
+bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_value, const CAmount& cost_of_change, std::set<CInputCoin>& out_set, CAmount& value_ret, CAmount not_input_fees, BnBStats* stats)
 {
+    BnBStats dummy_stats;
+    if (!stats) stats = &dummy_stats;
+    *stats = BnBStats{};
     out_set.clear();
     CAmount curr_value = 0;
 
@@ -82,8 +89,10 @@ bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_v
         return false;
     }
 
-    // Sort the utxo_pool
-    std::sort(utxo_pool.begin(), utxo_pool.end(), descending);
+    // Sort the utxo_pool, unless it comes presorted from an OutputGroupPool
+    if (!std::is_sorted(utxo_pool.begin(), utxo_pool.end(), descending)) {
+        std::sort(utxo_pool.begin(), utxo_pool.end(), descending);
+    }
 
     CAmount curr_waste = 0;
     std::vector<bool> best_selection;
@@ -91,6 +100,7 @@ bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_v
 
     // Depth First search loop for choosing the UTXOs
     for (size_t i = 0; i < TOTAL_TRIES; ++i) {
+        stats->tries = i + 1;
         // Conditions for starting a backtrack
         bool backtrack = false;
         if (curr_value + curr_available_value < actual_target ||                // Cannot possibly reach target with the amount remaining in the curr_available_value.
@@ -104,10 +114,11 @@ bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_v
             // value. Adding any more UTXOs will be just burning the UTXO; it will go entirely to fees. Thus we aren't going to
             // explore any more UTXOs to avoid burning money like that.
             if (curr_waste <= best_waste) {
+                // UTXOs past the end of the selection are not selected
                 best_selection = curr_selection;
-                best_selection.resize(utxo_pool.size());
                 best_waste = curr_waste;
                 if (best_waste == 0) {
+                    stats->exact_match = true;
                     break;
                 }
             }
@@ -124,6 +135,7 @@ bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_v
             }
 
             if (curr_selection.empty()) { // We have walked back to the first utxo and no branch is untraversed. All solutions searched
+                stats->exhausted = true;
                 break;
             }
 
@@ -170,10 +182,18 @@ bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_v
     return true;
 }
 
+//! Bound on the groups ApproximateBestSubset visits, so that it repeats less on very large pools
+static const size_t KNAPSACK_MAX_VISITS = 20000000;
+
 static void ApproximateBestSubset(const std::vector<OutputGroup>& groups, const CAmount& nTotalLower, const CAmount& nTargetValue,
                                   std::vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
 {
     std::vector<char> vfIncluded;
+    // Groups included in the current repetition, in the order they were included. A new best
+    // subset is recorded as the length of this list plus the group that completed it, and only
+    // written to vfBest at the end of the repetition, so that large pools do not copy vfIncluded
+    // on every improvement.
+    std::vector<size_t> included;
 
     vfBest.assign(groups.size(), true);
     nBest = nTotalLower;
@@ -183,6 +203,9 @@ static void ApproximateBestSubset(const std::vector<OutputGroup>& groups, const
     for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++)
     {
         vfIncluded.assign(groups.size(), false);
+        included.clear();
+        size_t best_included = 0;
+        Optional<size_t> best_last;
         CAmount nTotal = 0;
         bool fReachedTarget = false;
         for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++)
@@ -198,25 +221,34 @@ static void ApproximateBestSubset(const std::vector<OutputGroup>& groups, const
                 if (nPass == 0 ? insecure_rand.randbool() : !vfIncluded[i])
                 {
                     nTotal += groups[i].m_value;
-                    vfIncluded[i] = true;
                     if (nTotal >= nTargetValue)
                     {
                         fReachedTarget = true;
                         if (nTotal < nBest)
                         {
                             nBest = nTotal;
-                            vfBest = vfIncluded;
+                            best_included = included.size();
+                            best_last = i;
                         }
                         nTotal -= groups[i].m_value;
-                        vfIncluded[i] = false;
+                    } else {
+                        vfIncluded[i] = true;
+                        included.push_back(i);
                     }
                 }
             }
         }
+        if (best_last) {
+            vfBest.assign(groups.size(), false);
+            for (size_t k = 0; k < best_included; ++k) {
+                vfBest[included[k]] = true;
+            }
+            vfBest[*best_last] = true;
+        }
     }
 }
 
-bool KnapsackSolver(const CAmount& nTargetValue, std::vector<OutputGroup>& groups, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet)
+bool KnapsackSolver(const CAmount& nTargetValue, const std::vector<OutputGroup>& groups, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet)
 {
     setCoinsRet.clear();
     nValueRet = 0;
@@ -224,11 +256,17 @@ bool KnapsackSolver(const CAmount& nTargetValue, std::vector<OutputGroup>& group
     // List of values less than target
     Optional<OutputGroup> lowest_larger;
     std::vector<OutputGroup> applicable_groups;
+    applicable_groups.reserve(groups.size());
     CAmount nTotalLower = 0;
 
-    Shuffle(groups.begin(), groups.end(), FastRandomContext());
+    // Visit the groups in random order. They may be shared with later selection attempts, see
+    // OutputGroupPool, so shuffle their indexes rather than the groups themselves.
+    std::vector<size_t> order(groups.size());
+    std::iota(order.begin(), order.end(), 0);
+    Shuffle(order.begin(), order.end(), FastRandomContext());
 
-    for (const OutputGroup& group : groups) {
+    for (const size_t i : order) {
+        const OutputGroup& group = groups[i];
         if (group.m_value == nTargetValue) {
             util::insert(setCoinsRet, group.m_outputs);
             nValueRet += group.m_value;
@@ -261,9 +299,11 @@ bool KnapsackSolver(const CAmount& nTargetValue, std::vector<OutputGroup>& group
     std::vector<char> vfBest;
     CAmount nBest;
 
-    ApproximateBestSubset(applicable_groups, nTotalLower, nTargetValue, vfBest, nBest);
+    // Each repetition passes over the groups at most twice
+    const int iterations = std::max<size_t>(1, std::min<size_t>(1000, KNAPSACK_MAX_VISITS / (2 * applicable_groups.size())));
+    ApproximateBestSubset(applicable_groups, nTotalLower, nTargetValue, vfBest, nBest, iterations);
     if (nBest != nTargetValue && nTotalLower >= nTargetValue + MIN_CHANGE) {
-        ApproximateBestSubset(applicable_groups, nTotalLower, nTargetValue + MIN_CHANGE, vfBest, nBest);
+        ApproximateBestSubset(applicable_groups, nTotalLower, nTargetValue + MIN_CHANGE, vfBest, nBest, iterations);
     }
 
     // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
@@ -366,3 +406,40 @@ OutputGroup OutputGroup::GetPositiveOnlyGroup()
     }
     return group;
 }
+
+/******************************************************************************
+
+ OutputGroupPool
+
+ ******************************************************************************/
+
+std::vector<OutputGroup>& OutputGroupPool::FilterEligible(std::vector<OutputGroup>& groups, const CoinEligibilityFilter& filter)
+{
+    // Large pools are usually all eligible, avoid copying them then. Filtering keeps the order.
+    const auto eligible = [&](const OutputGroup& group) { return group.EligibleForSpending(filter); };
+    if (std::all_of(groups.begin(), groups.end(), eligible)) return groups;
+    m_eligible.clear();
+    std::copy_if(groups.begin(), groups.end(), std::back_inserter(m_eligible), eligible);
+    return m_eligible;
+}
+
+const std::vector<OutputGroup>& OutputGroupPool::GetEligible(const CoinEligibilityFilter& filter)
+{
+    return FilterEligible(m_groups, filter);
+}
+
+std::vector<OutputGroup>& OutputGroupPool::GetEligibleWithFees(const CoinEligibilityFilter& filter, const CFeeRate& effective_feerate, const CFeeRate& long_term_feerate)
+{
+    auto inserted = m_with_fees.emplace(std::make_pair(effective_feerate.GetFeePerK(), long_term_feerate.GetFeePerK()), std::vector<OutputGroup>{});
+    std::vector<OutputGroup>& with_fees = inserted.first->second;
+    if (inserted.second) {
+        with_fees.reserve(m_groups.size());
+        for (OutputGroup group : m_groups) {
+            group.SetFees(effective_feerate, long_term_feerate);
+            OutputGroup pos_group = group.GetPositiveOnlyGroup();
+            if (pos_group.effective_value > 0) with_fees.push_back(std::move(pos_group));
+        }
+        std::stable_sort(with_fees.begin(), with_fees.end(), descending);
+    }
+    return FilterEligible(with_fees, filter);
+}
@@ -9,6 +9,11 @@
 #include <primitives/transaction.h>
 #include <random.h>
 
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
 class CFeeRate;
 
 //! target minimum change amount
@@ -101,9 +106,53 @@ struct OutputGroup
     OutputGroup GetPositiveOnlyGroup();
 };
 
-bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_value, const CAmount& cost_of_change, std::set<CInputCoin>& out_set, CAmount& value_ret, CAmount not_input_fees);
+/**
+ * The output groups a transaction is funded from. Coin selection is attempted several
+ * times per transaction, with different eligibility filters, and again with the same
+ * feerates while the fee converges. For each pair of feerates it is asked for, the pool
+ * keeps the groups with their fees set and without outputs of negative effective value,
+ * sorted by descending effective value, so that this is only done once.
+ */
+class OutputGroupPool
+{
+public:
+    OutputGroupPool() {}
+    explicit OutputGroupPool(std::vector<OutputGroup> groups) : m_groups(std::move(groups)) {}
+
+    bool IsEmpty() const { return m_groups.empty(); }
+
+    //! Groups eligible under the filter, as they were given. When all groups are eligible
+    //! these are the pool's own, otherwise a copy. Valid until the pool is used again.
+    const std::vector<OutputGroup>& GetEligible(const CoinEligibilityFilter& filter);
+    //! Groups eligible under the filter, with fees set for the feerates and only their
+    //! outputs of positive effective value, sorted by descending effective value, so that
+    //! SelectCoinsBnB leaves their order as it is. Valid until the pool is used again.
+    std::vector<OutputGroup>& GetEligibleWithFees(const CoinEligibilityFilter& filter, const CFeeRate& effective_feerate, const CFeeRate& long_term_feerate);
+
+private:
+    std::vector<OutputGroup> m_groups;
+    //! Groups prepared for GetEligibleWithFees, by effective and long term fee per kB
+    std::map<std::pair<CAmount, CAmount>, std::vector<OutputGroup>> m_with_fees;
+    //! The eligible groups last returned, if not all groups were eligible
+    std::vector<OutputGroup> m_eligible;
+
+    std::vector<OutputGroup>& FilterEligible(std::vector<OutputGroup>& groups, const CoinEligibilityFilter& filter);
+};
+
+/** How much of its search SelectCoinsBnB did, and why it stopped */
+struct BnBStats
+{
+    //! Number of nodes of the search tree visited
+    size_t tries{0};
+    //! Whether the whole search tree was explored, so the solution found is the best one
+    bool exhausted{false};
+    //! Whether the search stopped early on finding a selection without waste
+    bool exact_match{false};
+};
+
+bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_value, const CAmount& cost_of_change, std::set<CInputCoin>& out_set, CAmount& value_ret, CAmount not_input_fees, BnBStats* stats = nullptr);
 
 // Original coin selection algorithm as a fallback
-bool KnapsackSolver(const CAmount& nTargetValue, std::vector<OutputGroup>& groups, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet);
+bool KnapsackSolver(const CAmount& nTargetValue, const std::vector<OutputGroup>& groups, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet);
 
 #endif // BITCOIN_WALLET_COINSELECTION_H
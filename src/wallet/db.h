@@ -141,6 +141,17 @@ public:
 
     virtual void ReloadDbEnv() = 0;
 
+    /** Begin a write group. Until it ends, the writes of all batches on this database
+     *  are made in one transaction where the backend supports it. Write groups nest,
+     *  and the transaction is committed when the outermost one ends. See WalletWriteGroup.
+     */
+    virtual void BeginWriteGroup() = 0;
+    /** End a write group begun with BeginWriteGroup
+     *  @return false if the transaction of the write groups could not be committed, in which
+     *          case all writes made in it since the outermost write group began are lost.
+     */
+    virtual bool EndWriteGroup() = 0;
+
     /** Return path to main database file for logs and error messages. */
     virtual std::string Filename() = 0;
 
@@ -191,6 +202,8 @@ public:
     bool PeriodicFlush() override { return true; }
     void IncrementUpdateCounter() override { ++nUpdateCounter; }
     void ReloadDbEnv() override {}
+    void BeginWriteGroup() override {}
+    bool EndWriteGroup() override { return true; }
     std::string Filename() override { return "dummy"; }
     std::string Format() override { return "dummy"; }
     std::unique_ptr<DatabaseBatch> MakeBatch(bool flush_on_close = true) override { return MakeUnique<DummyBatch>(); }
@@ -551,6 +551,7 @@ RPCHelpMan importwallet()
         LOCK(pwallet->cs_wallet);
 
         EnsureWalletIsUnlocked(pwallet);
+        WalletWriteGroup write_group(pwallet->GetDatabase());
 
         fsbridge::ifstream file;
         file.open(request.params[0].get_str(), std::ios::in | std::ios::ate);
@@ -1369,6 +1370,7 @@ RPCHelpMan importmulti()
     {
         LOCK(pwallet->cs_wallet);
         EnsureWalletIsUnlocked(pwallet);
+        WalletWriteGroup write_group(pwallet->GetDatabase());
 
         // Verify all timestamps are present before importing any keys.
         CHECK_NONFATAL(pwallet->chain().findBlock(pwallet->GetLastBlockHash(), FoundBlock().time(nLowestTimestamp).mtpTime(now)));
@@ -1666,6 +1668,7 @@ RPCHelpMan importdescriptors()
     {
         LOCK(pwallet->cs_wallet);
         EnsureWalletIsUnlocked(pwallet);
+        WalletWriteGroup write_group(pwallet->GetDatabase());
 
         CHECK_NONFATAL(pwallet->chain().findBlock(pwallet->GetLastBlockHash(), FoundBlock().time(lowest_timestamp).mtpTime(now)));
 
@@ -1484,13 +1484,18 @@ static RPCHelpMan listtransactions()
 
         const CWallet::TxItems & txOrdered = pwallet->wtxOrdered;
 
+        // The entries of the newest transactions that all come before the
+        // requested page are skipped using their counts:
+        int nSkipped = 0;
+        const CWalletTx* first = pwallet->GetTxEntryCounts(filter, filter_label).Find(nFrom, nSkipped);
         // iterate backwards until we have nCount items to return:
-        for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
+        for (CWallet::TxItems::const_reverse_iterator it(first ? std::next(first->m_it_wtxOrdered) : txOrdered.begin()); it != txOrdered.rend(); ++it)
         {
             CWalletTx *const pwtx = (*it).second;
             ListTransactions(pwallet, *pwtx, 0, true, ret, filter, filter_label);
-            if ((int)ret.size() >= (nCount+nFrom)) break;
+            if (nSkipped + (int)ret.size() >= (nCount+nFrom)) break;
         }
+        nFrom -= nSkipped;
     }
 
     // ret is newest to oldest
@@ -1607,11 +1612,22 @@ static RPCHelpMan listsinceblock()
 
     UniValue transactions(UniValue::VARR);
 
-    for (const std::pair<const uint256, CWalletTx>& pairWtx : wallet.mapWallet) {
-        const CWalletTx& tx = pairWtx.second;
-
-        if (depth == -1 || abs(tx.GetDepthInMainChain()) < depth) {
-            ListTransactions(&wallet, tx, 0, true, transactions, filter, nullptr /* filter_label */);
+    std::vector<const CWalletTx*> txs;
+    if (depth == -1) {
+        for (const std::pair<const uint256, CWalletTx>& pairWtx : wallet.mapWallet) {
+            txs.push_back(&pairWtx.second);
+        }
+    } else {
+        // Only transactions in or conflicting with later blocks, and unconfirmed
+        // ones, can be less deep. List them in txid order all the same.
+        for (auto it = wallet.wtxByHeight.upper_bound(*height); it != wallet.wtxByHeight.end(); ++it) {
+            txs.push_back(it->second);
+        }
+        std::sort(txs.begin(), txs.end(), [](const CWalletTx* a, const CWalletTx* b) { return a->GetHash() < b->GetHash(); });
+    }
+    for (const CWalletTx* tx : txs) {
+        if (depth == -1 || abs(tx->GetDepthInMainChain()) < depth) {
+            ListTransactions(&wallet, *tx, 0, true, transactions, filter, nullptr /* filter_label */);
         }
     }
 
@@ -9,9 +9,12 @@
 #include <util/bip32.h>
 #include <util/strencodings.h>
 #include <util/string.h>
+#include <util/system.h>
 #include <util/translation.h>
 #include <wallet/scriptpubkeyman.h>
 
+#include <thread>
+
 //! Value for the first BIP 32 hardened derivation. Can be used as a bit mask and as a value. See BIP 32 for more details.
 const uint32_t BIP32_HARDENED_KEY_LIMIT = 0x80000000;
 
@@ -1739,6 +1742,23 @@ std::map<CKeyID, CKey> DescriptorScriptPubKeyMan::GetKeys() const
     return m_map_keys;
 }
 
+//! Maximum number of threads deriving keys in a descriptor top up
+static constexpr int MAX_TOPUP_THREADS = 16;
+//! Minimum number of indexes to give each derivation thread
+static constexpr int32_t MIN_TOPUP_INDEXES_PER_THREAD = 64;
+//! Number of indexes derived before they are added to the wallet, bounding memory use
+static constexpr int32_t TOPUP_WINDOW_SIZE = 4096;
+
+namespace {
+/** A descriptor expanded at one index, waiting to be added to the wallet */
+struct DescriptorExpansion {
+    bool success{false};
+    std::vector<CScript> scripts;
+    FlatSigningProvider out_keys;
+    DescriptorCache cache;
+};
+} // namespace
+
 bool DescriptorScriptPubKeyMan::TopUp(unsigned int size)
 {
     LOCK(cs_desc_man);
@@ -1763,61 +1783,109 @@ bool DescriptorScriptPubKeyMan::TopUp(unsigned int size)
     provider.keys = GetKeys();
 
     WalletBatch batch(m_storage.GetDatabase());
+    // Write the whole top up in one transaction. If another batch already has one open, our writes are part of it.
+    const bool txn = batch.TxnBegin();
     uint256 id = GetID();
-    for (int32_t i = m_max_cached_index + 1; i < new_range_end; ++i) {
-        FlatSigningProvider out_keys;
-        std::vector<CScript> scripts_temp;
-        DescriptorCache temp_cache;
+
+    const Descriptor& descriptor = *m_wallet_descriptor.descriptor;
+    const DescriptorCache& read_cache = m_wallet_descriptor.cache;
+    const auto expand = [&](int32_t index, DescriptorExpansion& expansion) {
         // Maybe we have a cached xpub and we can expand from the cache first
-        if (!m_wallet_descriptor.descriptor->ExpandFromCache(i, m_wallet_descriptor.cache, scripts_temp, out_keys)) {
-            if (!m_wallet_descriptor.descriptor->Expand(i, provider, scripts_temp, out_keys, &temp_cache)) return false;
-        }
-        // Add all of the scriptPubKeys to the scriptPubKey set
-        for (const CScript& script : scripts_temp) {
-            m_map_script_pub_keys[script] = i;
-        }
-        for (const auto& pk_pair : out_keys.pubkeys) {
-            const CPubKey& pubkey = pk_pair.second;
-            if (m_map_pubkeys.count(pubkey) != 0) {
-                // We don't need to give an error here.
-                // It doesn't matter which of many valid indexes the pubkey has, we just need an index where we can derive it and it's private key
-                continue;
+        expansion.success = descriptor.ExpandFromCache(index, read_cache, expansion.scripts, expansion.out_keys) ||
+                            descriptor.Expand(index, provider, expansion.scripts, expansion.out_keys, &expansion.cache);
+    };
+
+    const int32_t first_index = m_max_cached_index + 1;
+    bool success = true;
+    std::vector<DescriptorExpansion> expansions;
+    while (success && m_max_cached_index + 1 < new_range_end) {
+        const int32_t start = m_max_cached_index + 1;
+        // Expand the first index on its own. This caches the parent xpubs, so later indexes
+        // only need the last derivation step. The remaining indexes are expanded on several
+        // threads at once. Each expansion writes only to its own DescriptorCache, and the
+        // wallet's cache is only read while they run. The one member a descriptor changes
+        // while expanding is the parent xpub a BIP32 key provider remembers (m_cached_xpub in
+        // script/descriptor.cpp). It is set on first use, by the expansion of the first index,
+        // and only read afterwards.
+        const int32_t count = start == first_index ? 1 : std::min(TOPUP_WINDOW_SIZE, new_range_end - start);
+        expansions.clear();
+        expansions.resize(count);
+        const int num_threads = std::max(1, std::min({GetNumCores(), MAX_TOPUP_THREADS, count / MIN_TOPUP_INDEXES_PER_THREAD}));
+        std::vector<std::thread> threads;
+        for (int t = 1; t < num_threads; ++t) {
+            threads.emplace_back([&, t] {
+                for (int32_t j = t; j < count; j += num_threads) expand(start + j, expansions[j]);
+            });
+        }
+        for (int32_t j = 0; j < count; j += num_threads) expand(start + j, expansions[j]);
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        std::vector<CScript> new_scripts;
+        for (const DescriptorExpansion& expansion : expansions) {
+            if (!expansion.success) {
+                success = false;
+                break;
             }
-            m_map_pubkeys[pubkey] = i;
-        }
-        // Write the cache
-        for (const auto& parent_xpub_pair : temp_cache.GetCachedParentExtPubKeys()) {
-            CExtPubKey xpub;
-            if (m_wallet_descriptor.cache.GetCachedParentExtPubKey(parent_xpub_pair.first, xpub)) {
-                if (xpub != parent_xpub_pair.second) {
-                    throw std::runtime_error(std::string(__func__) + ": New cached parent xpub does not match already cached parent xpub");
-                }
-                continue;
+            const int32_t i = m_max_cached_index + 1;
+            // Add all of the scriptPubKeys to the scriptPubKey set
+            for (const CScript& script : expansion.scripts) {
+                m_map_script_pub_keys[script] = i;
             }
-            if (!batch.WriteDescriptorParentCache(parent_xpub_pair.second, id, parent_xpub_pair.first)) {
-                throw std::runtime_error(std::string(__func__) + ": writing cache item failed");
+            new_scripts.insert(new_scripts.end(), expansion.scripts.begin(), expansion.scripts.end());
+            for (const auto& pk_pair : expansion.out_keys.pubkeys) {
+                const CPubKey& pubkey = pk_pair.second;
+                if (m_map_pubkeys.count(pubkey) != 0) {
+                    // We don't need to give an error here.
+                    // It doesn't matter which of many valid indexes the pubkey has, we just need an index where we can derive it and it's private key
+                    continue;
+                }
+                m_map_pubkeys[pubkey] = i;
             }
-            m_wallet_descriptor.cache.CacheParentExtPubKey(parent_xpub_pair.first, parent_xpub_pair.second);
-        }
-        for (const auto& derived_xpub_map_pair : temp_cache.GetCachedDerivedExtPubKeys()) {
-            for (const auto& derived_xpub_pair : derived_xpub_map_pair.second) {
+            // Write the cache
+            for (const auto& parent_xpub_pair : expansion.cache.GetCachedParentExtPubKeys()) {
                 CExtPubKey xpub;
-                if (m_wallet_descriptor.cache.GetCachedDerivedExtPubKey(derived_xpub_map_pair.first, derived_xpub_pair.first, xpub)) {
-                    if (xpub != derived_xpub_pair.second) {
-                        throw std::runtime_error(std::string(__func__) + ": New cached derived xpub does not match already cached derived xpub");
+                if (m_wallet_descriptor.cache.GetCachedParentExtPubKey(parent_xpub_pair.first, xpub)) {
+                    if (xpub != parent_xpub_pair.second) {
+                        throw std::runtime_error(std::string(__func__) + ": New cached parent xpub does not match already cached parent xpub");
                     }
                     continue;
                 }
-                if (!batch.WriteDescriptorDerivedCache(derived_xpub_pair.second, id, derived_xpub_map_pair.first, derived_xpub_pair.first)) {
+                if (!batch.WriteDescriptorParentCache(parent_xpub_pair.second, id, parent_xpub_pair.first)) {
                     throw std::runtime_error(std::string(__func__) + ": writing cache item failed");
                 }
-                m_wallet_descriptor.cache.CacheDerivedExtPubKey(derived_xpub_map_pair.first, derived_xpub_pair.first, derived_xpub_pair.second);
+                m_wallet_descriptor.cache.CacheParentExtPubKey(parent_xpub_pair.first, parent_xpub_pair.second);
+            }
+            for (const auto& derived_xpub_map_pair : expansion.cache.GetCachedDerivedExtPubKeys()) {
+                for (const auto& derived_xpub_pair : derived_xpub_map_pair.second) {
+                    CExtPubKey xpub;
+                    if (m_wallet_descriptor.cache.GetCachedDerivedExtPubKey(derived_xpub_map_pair.first, derived_xpub_pair.first, xpub)) {
+                        if (xpub != derived_xpub_pair.second) {
+                            throw std::runtime_error(std::string(__func__) + ": New cached derived xpub does not match already cached derived xpub");
+                        }
+                        continue;
+                    }
+                    if (!batch.WriteDescriptorDerivedCache(derived_xpub_pair.second, id, derived_xpub_map_pair.first, derived_xpub_pair.first)) {
+                        throw std::runtime_error(std::string(__func__) + ": writing cache item failed");
+                    }
+                    m_wallet_descriptor.cache.CacheDerivedExtPubKey(derived_xpub_map_pair.first, derived_xpub_pair.first, derived_xpub_pair.second);
+                }
             }
+            m_max_cached_index++;
         }
-        m_max_cached_index++;
+        m_storage.TopUpCallback(new_scripts);
+    }
+    if (!success) {
+        // Keep the indexes cached so far, in the wallet file as well as in memory
+        if (txn) batch.TxnCommit();
+        return false;
     }
     m_wallet_descriptor.range_end = new_range_end;
     batch.WriteDescriptor(GetID(), m_wallet_descriptor);
+    if (txn && !batch.TxnCommit()) {
+        throw std::runtime_error(std::string(__func__) + ": committing top up failed");
+    }
 
     // By this point, the cache size should be the size of the entire range
     assert(m_wallet_descriptor.range_end - 1 == m_max_cached_index);
@@ -2200,6 +2268,7 @@ void DescriptorScriptPubKeyMan::SetCache(const DescriptorCache& cache)
             }
             m_map_script_pub_keys[script] = i;
         }
+        m_storage.TopUpCallback(scripts_temp);
         for (const auto& pk_pair : out_keys.pubkeys) {
             const CPubKey& pubkey = pk_pair.second;
             if (m_map_pubkeys.count(pubkey) != 0) {
@@ -2262,3 +2331,9 @@ const std::vector<CScript> DescriptorScriptPubKeyMan::GetScriptPubKeys() const
     }
     return script_pub_keys;
 }
+
+int32_t DescriptorScriptPubKeyMan::GetEndRange() const
+{
+    LOCK(cs_desc_man);
+    return m_max_cached_index + 1;
+}
@@ -41,6 +41,8 @@ public:
     virtual const CKeyingMaterial& GetEncryptionKey() const = 0;
     virtual bool HasEncryptionKeys() const = 0;
     virtual bool IsLocked() const = 0;
+    //! Called with scriptPubKeys as they are added to a DescriptorScriptPubKeyMan
+    virtual void TopUpCallback(const std::vector<CScript>&) = 0;
 };
 
 //! Default for -keypool
@@ -571,6 +573,7 @@ public:
     // and is used to expand the descriptor in GetNewDestination. DescriptorScriptPubKeyMan relies
     // more on ephemeral data than LegacyScriptPubKeyMan. For wallets using unhardened derivation
     // (with or without private keys), the "keypool" is a single xpub.
+    // Large top ups are derived on several threads and written in a single database transaction.
     bool TopUp(unsigned int size = 0) override;
 
     void MarkUnusedAddresses(const CScript& script) override;
@@ -615,6 +618,8 @@ public:
 
     const WalletDescriptor GetWalletDescriptor() const EXCLUSIVE_LOCKS_REQUIRED(cs_desc_man);
     const std::vector<CScript> GetScriptPubKeys() const;
+    //! One past the highest descriptor range index whose scriptPubKeys have been derived
+    int32_t GetEndRange() const;
 };
 
 #endif // BITCOIN_WALLET_SCRIPTPUBKEYMAN_H
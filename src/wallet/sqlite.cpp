@@ -19,6 +19,10 @@
 
 static const char* const DATABASE_FILENAME = "wallet.dat";
 static constexpr int32_t WALLET_SCHEMA_VERSION = 0;
+//! Size of the page cache of each wallet database, in KiB
+static constexpr int SQLITE_CACHE_SIZE_KIB = 32 * 1024;
+//! Size of the part of each wallet database file that is memory mapped for reads
+static constexpr int64_t SQLITE_MMAP_SIZE = 256 * 1024 * 1024;
 
 static Mutex g_sqlite_mutex;
 static int g_sqlite_count GUARDED_BY(g_sqlite_mutex) = 0;
@@ -239,6 +243,16 @@ void SQLiteDatabase::Open()
         throw std::runtime_error(strprintf("SQLiteDatabase: Failed to enable fullfsync: %s\n", sqlite3_errstr(ret)));
     }
 
+    // Keep more of the database in memory than the 2 MiB default, and read it through mmap
+    ret = sqlite3_exec(m_db, strprintf("PRAGMA cache_size = -%d", SQLITE_CACHE_SIZE_KIB).c_str(), nullptr, nullptr, nullptr);
+    if (ret != SQLITE_OK) {
+        throw std::runtime_error(strprintf("SQLiteDatabase: Failed to set the page cache size: %s\n", sqlite3_errstr(ret)));
+    }
+    ret = sqlite3_exec(m_db, strprintf("PRAGMA mmap_size = %d", SQLITE_MMAP_SIZE).c_str(), nullptr, nullptr, nullptr);
+    if (ret != SQLITE_OK) {
+        throw std::runtime_error(strprintf("SQLiteDatabase: Failed to set the mmap size: %s\n", sqlite3_errstr(ret)));
+    }
+
     // Make the table for our key-value pairs
     // First check that the main table exists
     sqlite3_stmt* check_main_stmt{nullptr};
@@ -281,6 +295,16 @@ void SQLiteDatabase::Open()
             throw std::runtime_error(strprintf("SQLiteDatabase: Failed to set the wallet schema version: %s\n", sqlite3_errstr(ret)));
         }
     }
+
+    // Use a write-ahead log, so that a commit only appends to and syncs the log instead of
+    // syncing both a rollback journal and the database file. synchronous stays at FULL, so
+    // committed writes are still durable. This is set after the database is created, so
+    // that its header, with the application id IsSQLiteFile checks, is in the database file.
+    // In memory databases keep their own journal mode.
+    ret = sqlite3_exec(m_db, "PRAGMA journal_mode = WAL", nullptr, nullptr, nullptr);
+    if (ret != SQLITE_OK) {
+        throw std::runtime_error(strprintf("SQLiteDatabase: Failed to set the journal mode: %s\n", sqlite3_errstr(ret)));
+    }
 }
 
 bool SQLiteDatabase::Rewrite(const char* skip)
@@ -343,8 +367,8 @@ SQLiteBatch::SQLiteBatch(SQLiteDatabase& database)
 
 void SQLiteBatch::Close()
 {
-    // If m_db is in a transaction (i.e. not in autocommit mode), then abort the transaction in progress
-    if (m_database.m_db && sqlite3_get_autocommit(m_database.m_db) == 0) {
+    // If this batch began a transaction, then abort the transaction in progress
+    if (m_txn) {
         if (TxnAbort()) {
             LogPrintf("SQLiteBatch: Batch closed unexpectedly without the transaction being explicitly committed or aborted\n");
         } else {
@@ -538,34 +562,114 @@ void SQLiteBatch::CloseCursor()
 
 bool SQLiteBatch::TxnBegin()
 {
-    if (!m_database.m_db || sqlite3_get_autocommit(m_database.m_db) == 0) return false;
+    if (!m_database.m_db || m_txn) return false;
+    LOCK(m_database.m_write_group_mutex);
+    if (m_database.m_write_group_txn) {
+        // Nest in the write group's transaction as a savepoint, so this transaction can still be aborted on its own
+        std::string savepoint = strprintf("batch%u", ++m_database.m_next_savepoint);
+        int res = sqlite3_exec(m_database.m_db, ("SAVEPOINT " + savepoint).c_str(), nullptr, nullptr, nullptr);
+        if (res != SQLITE_OK) {
+            LogPrintf("SQLiteBatch: Failed to begin the transaction\n");
+            return false;
+        }
+        ++m_database.m_write_group_savepoints;
+        m_savepoint = std::move(savepoint);
+        m_txn = true;
+        return true;
+    }
+    if (sqlite3_get_autocommit(m_database.m_db) == 0) return false;
     int res = sqlite3_exec(m_database.m_db, "BEGIN TRANSACTION", nullptr, nullptr, nullptr);
     if (res != SQLITE_OK) {
         LogPrintf("SQLiteBatch: Failed to begin the transaction\n");
     }
-    return res == SQLITE_OK;
+    m_txn = res == SQLITE_OK;
+    return m_txn;
 }
 
 bool SQLiteBatch::TxnCommit()
 {
-    if (!m_database.m_db || sqlite3_get_autocommit(m_database.m_db) != 0) return false;
+    if (!m_database.m_db || !m_txn) return false;
+    if (!m_savepoint.empty()) return EndSavepoint(/* commit */ true);
+    if (sqlite3_get_autocommit(m_database.m_db) != 0) return false;
     int res = sqlite3_exec(m_database.m_db, "COMMIT TRANSACTION", nullptr, nullptr, nullptr);
     if (res != SQLITE_OK) {
         LogPrintf("SQLiteBatch: Failed to commit the transaction\n");
     }
+    m_txn = sqlite3_get_autocommit(m_database.m_db) == 0;
     return res == SQLITE_OK;
 }
 
 bool SQLiteBatch::TxnAbort()
 {
-    if (!m_database.m_db || sqlite3_get_autocommit(m_database.m_db) != 0) return false;
+    if (!m_database.m_db || !m_txn) return false;
+    if (!m_savepoint.empty()) return EndSavepoint(/* commit */ false);
+    if (sqlite3_get_autocommit(m_database.m_db) != 0) return false;
     int res = sqlite3_exec(m_database.m_db, "ROLLBACK TRANSACTION", nullptr, nullptr, nullptr);
     if (res != SQLITE_OK) {
         LogPrintf("SQLiteBatch: Failed to abort the transaction\n");
     }
+    m_txn = sqlite3_get_autocommit(m_database.m_db) == 0;
     return res == SQLITE_OK;
 }
 
+bool SQLiteBatch::EndSavepoint(bool commit)
+{
+    LOCK(m_database.m_write_group_mutex);
+    int res = SQLITE_OK;
+    if (!commit) {
+        res = sqlite3_exec(m_database.m_db, ("ROLLBACK TO " + m_savepoint).c_str(), nullptr, nullptr, nullptr);
+    }
+    if (res == SQLITE_OK) {
+        res = sqlite3_exec(m_database.m_db, ("RELEASE " + m_savepoint).c_str(), nullptr, nullptr, nullptr);
+    }
+    if (res != SQLITE_OK) {
+        LogPrintf("SQLiteBatch: Failed to %s the transaction\n", commit ? "commit" : "abort");
+    }
+    m_savepoint.clear();
+    m_txn = false;
+    // The write groups may have ended while this savepoint was open, leaving their transaction for us to commit
+    if (--m_database.m_write_group_savepoints == 0 && m_database.m_write_groups == 0 && !m_database.CommitWriteGroup()) {
+        // The writes of the write groups are lost, see ~WalletWriteGroup.
+        assert(false);
+    }
+    return res == SQLITE_OK;
+}
+
+void SQLiteDatabase::BeginWriteGroup()
+{
+    LOCK(m_write_group_mutex);
+    if (m_write_groups++ > 0 || !m_db) return;
+    // If a batch already has a transaction open, the writes of the group are part of it
+    if (sqlite3_get_autocommit(m_db) == 0) return;
+    int res = sqlite3_exec(m_db, "BEGIN TRANSACTION", nullptr, nullptr, nullptr);
+    if (res != SQLITE_OK) {
+        LogPrintf("SQLiteDatabase: Failed to begin the write group transaction: %s\n", sqlite3_errstr(res));
+        return;
+    }
+    m_write_group_txn = true;
+}
+
+bool SQLiteDatabase::EndWriteGroup()
+{
+    LOCK(m_write_group_mutex);
+    assert(m_write_groups > 0);
+    if (--m_write_groups > 0 || m_write_group_savepoints > 0) return true;
+    return CommitWriteGroup();
+}
+
+bool SQLiteDatabase::CommitWriteGroup()
+{
+    if (!m_write_group_txn) return true;
+    m_write_group_txn = false;
+    if (!m_db) return true;
+    int res = sqlite3_exec(m_db, "COMMIT TRANSACTION", nullptr, nullptr, nullptr);
+    if (res != SQLITE_OK) {
+        LogPrintf("SQLiteDatabase: Failed to commit the write group transaction: %s\n", sqlite3_errstr(res));
+        return false;
+    }
+    return true;
+}
+
 bool ExistsSQLiteDatabase(const fs::path& path)
 {
     const fs::path file = path / DATABASE_FILENAME;
@@ -5,10 +5,13 @@
 #ifndef BITCOIN_WALLET_SQLITE_H
 #define BITCOIN_WALLET_SQLITE_H
 
+#include <sync.h>
 #include <wallet/db.h>
 
 #include <sqlite3.h>
 
+#include <string>
+
 struct bilingual_str;
 class SQLiteDatabase;
 
@@ -26,7 +29,13 @@ private:
     sqlite3_stmt* m_delete_stmt{nullptr};
     sqlite3_stmt* m_cursor_stmt{nullptr};
 
+    //! Name of the savepoint this batch's transaction is, if it was begun inside a write group
+    std::string m_savepoint;
+    //! Whether this batch has a transaction open
+    bool m_txn{false};
+
     void SetupSQLStatements();
+    bool EndSavepoint(bool commit);
 
     bool ReadKey(CDataStream&& key, CDataStream& value) override;
     bool WriteKey(CDataStream&& key, CDataStream&& value, bool overwrite = true) override;
@@ -55,13 +64,28 @@ public:
 class SQLiteDatabase : public WalletDatabase
 {
 private:
+    friend class SQLiteBatch;
+
     const bool m_mock{false};
 
     const std::string m_dir_path;
 
     const std::string m_file_path;
 
+    //! Guards the transaction shared by write groups, and the savepoints batches open in it
+    Mutex m_write_group_mutex;
+    //! Number of write groups open
+    int m_write_groups GUARDED_BY(m_write_group_mutex){0};
+    //! Whether the write groups began the open transaction and have to commit it
+    bool m_write_group_txn GUARDED_BY(m_write_group_mutex){false};
+    //! Number of batch transactions open as savepoints in the write group transaction
+    int m_write_group_savepoints GUARDED_BY(m_write_group_mutex){0};
+    //! Used to give each savepoint a unique name
+    uint64_t m_next_savepoint GUARDED_BY(m_write_group_mutex){0};
+
     void Cleanup() noexcept;
+    //! Commit the transaction begun by the write groups, if any. Returns false if it could not be committed.
+    bool CommitWriteGroup() EXCLUSIVE_LOCKS_REQUIRED(m_write_group_mutex);
 
 public:
     SQLiteDatabase() = delete;
@@ -92,9 +116,11 @@ public:
 
     /** No-ops
      *
-     * SQLite always flushes everything to the database file after each transaction
-     * (each Read/Write/Erase that we do is its own transaction unless we called
-     * TxnBegin) so there is no need to have Flush or Periodic Flush.
+     * SQLite makes every transaction durable when it commits (each Read/Write/Erase
+     * that we do is its own transaction unless we called TxnBegin or a write group is
+     * open) so there is no need to have Flush or Periodic Flush. With the write-ahead
+     * log, a commit is synced to the -wal file next to the database file; SQLite moves
+     * it into the database file itself at checkpoints and when the database is closed.
      *
      * There is no DB env to reload, so ReloadDbEnv has nothing to do
      */
@@ -104,6 +130,12 @@ public:
 
     void IncrementUpdateCounter() override { ++nUpdateCounter; }
 
+    /** Write groups share one transaction, so their writes are synced to disk once, on commit.
+     *  Batch transactions begun inside a write group are savepoints within it.
+     */
+    void BeginWriteGroup() override;
+    bool EndWriteGroup() override;
+
     std::string Filename() override { return m_file_path; }
     std::string Format() override { return "sqlite"; }
 
@@ -2,6 +2,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
 #include <memory>
 
 #include <boost/test/unit_test.hpp>
@@ -9,6 +13,10 @@
 #include <fs.h>
 #include <test/util/setup_common.h>
 #include <wallet/bdb.h>
+#ifdef USE_SQLITE
+#include <wallet/sqlite.h>
+#endif
+#include <wallet/walletdb.h>
 
 
 BOOST_FIXTURE_TEST_SUITE(db_tests, BasicTestingSetup)
@@ -69,4 +77,69 @@ BOOST_AUTO_TEST_CASE(getwalletenv_g_dbenvs_free_instance)
     BOOST_CHECK(env_2_a == env_2_b);
 }
 
+#ifdef USE_SQLITE
+BOOST_AUTO_TEST_CASE(sqlite_write_group)
+{
+    const fs::path path = GetDataDir() / "sqlite_write_group";
+    const auto has = [](SQLiteDatabase& database, int key) {
+        return database.MakeBatch()->Exists(std::make_pair(std::string("key"), key));
+    };
+    {
+        SQLiteDatabase database(path, path / "wallet.dat");
+        {
+            WalletWriteGroup group(database);
+            std::unique_ptr<DatabaseBatch> batch = database.MakeBatch();
+            BOOST_CHECK(batch->Write(std::make_pair(std::string("key"), 1), 1));
+
+            // Batch transactions inside a write group can still be aborted on their own
+            std::unique_ptr<DatabaseBatch> aborted = database.MakeBatch();
+            BOOST_CHECK(aborted->TxnBegin());
+            BOOST_CHECK(aborted->Write(std::make_pair(std::string("key"), 2), 2));
+            BOOST_CHECK(aborted->TxnAbort());
+
+            std::unique_ptr<DatabaseBatch> committed = database.MakeBatch();
+            BOOST_CHECK(committed->TxnBegin());
+            BOOST_CHECK(committed->Write(std::make_pair(std::string("key"), 3), 3));
+            BOOST_CHECK(committed->TxnCommit());
+
+            // Closing a batch does not abort the write group's transaction
+            batch.reset();
+            BOOST_CHECK(sqlite3_get_autocommit(database.m_db) == 0);
+
+            // Nested write groups commit with the outermost
+            { WalletWriteGroup nested(database); }
+            BOOST_CHECK(sqlite3_get_autocommit(database.m_db) == 0);
+        }
+        BOOST_CHECK(sqlite3_get_autocommit(database.m_db) != 0);
+
+        // A batch transaction left open when the write group ends is committed with it
+        std::unique_ptr<DatabaseBatch> batch = database.MakeBatch();
+        {
+            WalletWriteGroup group(database);
+            BOOST_CHECK(batch->TxnBegin());
+            BOOST_CHECK(batch->Write(std::make_pair(std::string("key"), 4), 4));
+        }
+        BOOST_CHECK(sqlite3_get_autocommit(database.m_db) == 0);
+        BOOST_CHECK(batch->TxnCommit());
+        BOOST_CHECK(sqlite3_get_autocommit(database.m_db) != 0);
+
+        // Ending the outermost write group reports whether its transaction was committed
+        database.BeginWriteGroup();
+        database.BeginWriteGroup();
+        BOOST_CHECK(batch->Write(std::make_pair(std::string("key"), 5), 5));
+        BOOST_CHECK(database.EndWriteGroup());
+        BOOST_CHECK(sqlite3_get_autocommit(database.m_db) == 0);
+        BOOST_CHECK(database.EndWriteGroup());
+        BOOST_CHECK(sqlite3_get_autocommit(database.m_db) != 0);
+    }
+
+    SQLiteDatabase database(path, path / "wallet.dat");
+    BOOST_CHECK(has(database, 1));
+    BOOST_CHECK(!has(database, 2));
+    BOOST_CHECK(has(database, 3));
+    BOOST_CHECK(has(database, 4));
+    BOOST_CHECK(has(database, 5));
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <key.h>
+#include <key_io.h>
+#include <script/descriptor.h>
 #include <script/standard.h>
 #include <test/util/setup_common.h>
 #include <wallet/scriptpubkeyman.h>
@@ -40,4 +42,38 @@ BOOST_AUTO_TEST_CASE(CanProvide)
     BOOST_CHECK(keyman.CanProvide(p2sh_script, data));
 }
 
+// Test that DescriptorScriptPubKeyMan::TopUp, which derives large top ups on
+// several threads, produces the same scripts as expanding each index in turn.
+BOOST_AUTO_TEST_CASE(DescriptorTopUp)
+{
+    NodeContext node;
+    std::unique_ptr<interfaces::Chain> chain = interfaces::MakeChain(node);
+    CWallet wallet(chain.get(), "", CreateDummyWalletDatabase());
+
+    CExtKey master_key;
+    const std::vector<unsigned char> seed(32, 0x01);
+    master_key.SetSeed(seed.data(), seed.size());
+    const std::string desc_str = "wpkh(" + EncodeExtPubKey(master_key.Neuter()) + "/0/*)";
+
+    FlatSigningProvider provider;
+    std::string error;
+    std::shared_ptr<Descriptor> desc = Parse(desc_str, provider, error);
+    BOOST_REQUIRE(desc);
+    WalletDescriptor w_desc(desc, 0, 0, 0, 0);
+    DescriptorScriptPubKeyMan keyman(wallet, w_desc);
+    BOOST_CHECK(keyman.TopUp(10));
+    BOOST_CHECK(keyman.TopUp(5000));
+    BOOST_CHECK_EQUAL(keyman.GetScriptPubKeys().size(), 5000U);
+
+    std::unique_ptr<Descriptor> check_desc = Parse(desc_str, provider, error);
+    BOOST_REQUIRE(check_desc);
+    for (int i = 0; i < 5000; ++i) {
+        std::vector<CScript> scripts;
+        FlatSigningProvider out;
+        BOOST_REQUIRE(check_desc->Expand(i, provider, scripts, out));
+        BOOST_REQUIRE_EQUAL(scripts.size(), 1U);
+        BOOST_CHECK(keyman.IsMine(scripts[0]) == ISMINE_SPENDABLE);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -9,10 +9,13 @@
 #include <stdint.h>
 #include <vector>
 
+#include <consensus/validation.h>
 #include <interfaces/chain.h>
+#include <key_io.h>
 #include <node/context.h>
 #include <policy/policy.h>
 #include <rpc/server.h>
+#include <script/descriptor.h>
 #include <test/util/logging.h>
 #include <test/util/setup_common.h>
 #include <util/ref.h>
@@ -624,6 +627,282 @@ BOOST_FIXTURE_TEST_CASE(wallet_disableprivkeys, TestChain100Setup)
     BOOST_CHECK(!wallet->GetNewDestination(OutputType::BECH32, "", dest, error));
 }
 
+BOOST_FIXTURE_TEST_CASE(wallet_ismine_filter, TestChain100Setup)
+{
+    NodeContext node;
+    auto chain = interfaces::MakeChain(node);
+    CWallet wallet(chain.get(), "", CreateMockWalletDatabase());
+    bool first_run;
+    BOOST_REQUIRE(wallet.LoadWallet(first_run) == DBErrors::LOAD_OK);
+    LOCK(wallet.cs_wallet);
+    wallet.SetWalletFlag(WALLET_FLAG_DESCRIPTORS);
+    wallet.SetupDescriptorScriptPubKeyMans();
+
+    // The first query builds the filter from the current scripts
+    const CScript other = GetScriptForDestination(WitnessV0ScriptHash(InsecureRand256()));
+    BOOST_CHECK_EQUAL(wallet.IsMine(other), ISMINE_NO);
+
+    // Scripts from later top ups, including ones that outgrow the filter, are ours
+    auto spk_man = dynamic_cast<DescriptorScriptPubKeyMan*>(wallet.GetScriptPubKeyMan(OutputType::BECH32, /* internal */ false));
+    BOOST_REQUIRE(spk_man);
+    for (const unsigned int size : {DEFAULT_KEYPOOL_SIZE + 10, DEFAULT_KEYPOOL_SIZE * 10}) {
+        BOOST_CHECK(spk_man->TopUp(size));
+        for (const CScript& script : spk_man->GetScriptPubKeys()) {
+            BOOST_CHECK_EQUAL(wallet.IsMine(script), ISMINE_SPENDABLE);
+        }
+        BOOST_CHECK_EQUAL(wallet.IsMine(other), ISMINE_NO);
+    }
+
+    // An imported descriptor is topped up before it is added, and setting its
+    // label queries the filter in between, which must not leave its script out
+    CWallet imported(chain.get(), "", CreateMockWalletDatabase());
+    BOOST_REQUIRE(imported.LoadWallet(first_run) == DBErrors::LOAD_OK);
+    LOCK(imported.cs_wallet);
+    imported.SetWalletFlag(WALLET_FLAG_DESCRIPTORS | WALLET_FLAG_DISABLE_PRIVATE_KEYS | WALLET_FLAG_BLANK_WALLET);
+    CKey key;
+    key.MakeNewKey(true);
+    FlatSigningProvider provider;
+    std::string error;
+    WalletDescriptor w_desc(Parse("wpkh(" + HexStr(key.GetPubKey()) + ")", provider, error, /* require_checksum */ false), 0, 0, 0, 0);
+    BOOST_REQUIRE(imported.AddWalletDescriptor(w_desc, provider, "label", false));
+    BOOST_CHECK_EQUAL(imported.IsMine(GetScriptForDestination(WitnessV0KeyHash(key.GetPubKey()))), ISMINE_SPENDABLE);
+    BOOST_CHECK_EQUAL(imported.IsMine(other), ISMINE_NO);
+}
+
+BOOST_FIXTURE_TEST_CASE(wallet_load_tx_records, TestChain100Setup)
+{
+    NodeContext node;
+    auto chain = interfaces::MakeChain(node);
+    CWallet wallet(chain.get(), "", CreateMockWalletDatabase());
+
+    // Write a chain of transactions, enough to be loaded in several batches on several threads
+    std::vector<uint256> hashes;
+    {
+        WalletBatch batch(wallet.GetDatabase());
+        COutPoint prevout{uint256S("01"), 0};
+        for (int i = 0; i < 20000; ++i) {
+            CMutableTransaction mtx;
+            mtx.vin.emplace_back(prevout);
+            mtx.vout.emplace_back(COIN, CScript() << OP_TRUE);
+            CWalletTx wtx(&wallet, MakeTransactionRef(std::move(mtx)));
+            wtx.nOrderPos = i;
+            BOOST_REQUIRE(batch.WriteTx(wtx));
+            prevout = COutPoint(wtx.GetHash(), 0);
+            hashes.push_back(wtx.GetHash());
+        }
+    }
+
+    bool first_run;
+    BOOST_REQUIRE(wallet.LoadWallet(first_run) == DBErrors::LOAD_OK);
+    LOCK(wallet.cs_wallet);
+    BOOST_CHECK_EQUAL(wallet.mapWallet.size(), hashes.size());
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        const auto it = wallet.mapWallet.find(hashes[i]);
+        BOOST_REQUIRE(it != wallet.mapWallet.end());
+        BOOST_CHECK_EQUAL(it->second.nOrderPos, int64_t(i));
+        BOOST_CHECK_EQUAL(wallet.IsSpent(hashes[i], 0), i + 1 < hashes.size());
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(wallet_tx_height_index, TestChain100Setup)
+{
+    NodeContext node;
+    auto chain = interfaces::MakeChain(node);
+    CWallet wallet(chain.get(), "", CreateDummyWalletDatabase());
+    LOCK(wallet.cs_wallet);
+    wallet.SetLastBlockProcessed(::ChainActive().Height(), ::ChainActive().Tip()->GetBlockHash());
+    const CWalletTx::Confirmation unconfirmed;
+    const CWalletTx::Confirmation confirmed(CWalletTx::Status::CONFIRMED, ::ChainActive().Height(), ::ChainActive().Tip()->GetBlockHash(), 1);
+
+    // Transactions move with their confirmation, and unconfirmed ones stay above all blocks
+    const CTransactionRef tx = m_coinbase_txns.back();
+    CWalletTx* wtx = wallet.AddToWallet(tx, unconfirmed);
+    BOOST_REQUIRE(wtx);
+    BOOST_CHECK(wtx->m_it_wtxByHeight->first == CWallet::UNCONFIRMED_HEIGHT);
+    BOOST_CHECK(wallet.AddToWallet(tx, confirmed) == wtx);
+    BOOST_CHECK_EQUAL(wtx->m_it_wtxByHeight->first, ::ChainActive().Height());
+    BOOST_CHECK(wallet.AddToWallet(tx, unconfirmed) == wtx);
+    BOOST_CHECK(wtx->m_it_wtxByHeight->first == CWallet::UNCONFIRMED_HEIGHT);
+    BOOST_CHECK_EQUAL(wallet.wtxByHeight.size(), 1u);
+    BOOST_CHECK(wallet.wtxByHeight.upper_bound(::ChainActive().Height())->second == wtx);
+}
+
+//! Check the transactions with unspent outputs, and the balances computed from
+//! them, against a scan of every wallet transaction.
+static void CheckUnspentIndex(const CWallet& wallet)
+{
+    LOCK(wallet.cs_wallet);
+    std::vector<const CWalletTx*> expected;
+    CWallet::Balance expected_balance;
+    std::set<uint256> trusted_parents;
+    for (const auto& entry : wallet.mapWallet) {
+        const CWalletTx& wtx = entry.second;
+        for (unsigned int i = 0; i < wtx.tx->vout.size(); ++i) {
+            if (wallet.IsMine(wtx.tx->vout[i]) != ISMINE_NO && !wallet.IsSpent(wtx.GetHash(), i)) {
+                expected.push_back(&wtx);
+                break;
+            }
+        }
+        const bool is_trusted{wallet.IsTrusted(wtx, trusted_parents)};
+        const CAmount tx_credit_mine{wtx.GetAvailableCredit(/* fUseCache */ true, ISMINE_SPENDABLE)};
+        const CAmount tx_credit_watchonly{wtx.GetAvailableCredit(/* fUseCache */ true, ISMINE_WATCH_ONLY)};
+        if (is_trusted) {
+            expected_balance.m_mine_trusted += tx_credit_mine;
+            expected_balance.m_watchonly_trusted += tx_credit_watchonly;
+        }
+        if (!is_trusted && wtx.GetDepthInMainChain() == 0 && wtx.InMempool()) {
+            expected_balance.m_mine_untrusted_pending += tx_credit_mine;
+            expected_balance.m_watchonly_untrusted_pending += tx_credit_watchonly;
+        }
+        expected_balance.m_mine_immature += wtx.GetImmatureCredit();
+        expected_balance.m_watchonly_immature += wtx.GetImmatureWatchOnlyCredit();
+    }
+    std::sort(expected.begin(), expected.end(), [](const CWalletTx* a, const CWalletTx* b) { return a->GetHash() < b->GetHash(); });
+    BOOST_CHECK(wallet.GetTxsWithUnspent() == expected);
+
+    const CWallet::Balance balance = wallet.GetBalance();
+    BOOST_CHECK_EQUAL(balance.m_mine_trusted, expected_balance.m_mine_trusted);
+    BOOST_CHECK_EQUAL(balance.m_mine_untrusted_pending, expected_balance.m_mine_untrusted_pending);
+    BOOST_CHECK_EQUAL(balance.m_mine_immature, expected_balance.m_mine_immature);
+    BOOST_CHECK_EQUAL(balance.m_watchonly_trusted, expected_balance.m_watchonly_trusted);
+    BOOST_CHECK_EQUAL(balance.m_watchonly_untrusted_pending, expected_balance.m_watchonly_untrusted_pending);
+    BOOST_CHECK_EQUAL(balance.m_watchonly_immature, expected_balance.m_watchonly_immature);
+}
+
+BOOST_FIXTURE_TEST_CASE(wallet_unspent_index, TestChain100Setup)
+{
+    auto chain = interfaces::MakeChain(m_node);
+    auto wallet = TestLoadWallet(*chain);
+    CKey key;
+    key.MakeNewKey(true);
+    AddKey(*wallet, key);
+    AddKey(*wallet, coinbaseKey);
+    {
+        WalletRescanReserver reserver(*wallet);
+        reserver.reserve();
+        CWallet::ScanResult result = wallet->ScanForWalletTransactions(::ChainActive().Genesis()->GetBlockHash(), 0 /* start_height */, {} /* max_height */, reserver, false /* update */);
+        BOOST_CHECK_EQUAL(result.status, CWallet::ScanResult::SUCCESS);
+    }
+    CheckUnspentIndex(*wallet);
+    const CScript ours = GetScriptForRawPubKey(key.GetPubKey());
+    const CScript other = GetScriptForDestination(WitnessV0ScriptHash(InsecureRand256()));
+
+    // A confirmed spend
+    CreateAndProcessBlock({TestSimpleSpend(*m_coinbase_txns[0], 0, coinbaseKey, ours)}, other);
+    SyncWithValidationInterfaceQueue();
+    CheckUnspentIndex(*wallet);
+
+    // A spend that is abandoned
+    const CTransactionRef abandoned = MakeTransactionRef(TestSimpleSpend(*m_coinbase_txns[2], 0, coinbaseKey, ours));
+    BOOST_CHECK(wallet->AddToWallet(abandoned, {}));
+    CheckUnspentIndex(*wallet);
+    BOOST_CHECK(wallet->AbandonTransaction(abandoned->GetHash()));
+    CheckUnspentIndex(*wallet);
+
+    // A spend that conflicts with one in a block
+    const CTransactionRef conflicted = MakeTransactionRef(TestSimpleSpend(*m_coinbase_txns[1], 0, coinbaseKey, ours));
+    BOOST_CHECK(wallet->AddToWallet(conflicted, {}));
+    CheckUnspentIndex(*wallet);
+    CreateAndProcessBlock({TestSimpleSpend(*m_coinbase_txns[1], 0, coinbaseKey, other)}, other);
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK_LT(WITH_LOCK(wallet->cs_wallet, return wallet->mapWallet.at(conflicted->GetHash()).GetDepthInMainChain()), 0);
+    CheckUnspentIndex(*wallet);
+
+    // Disconnecting the block
+    {
+        BlockValidationState state;
+        BOOST_CHECK(ChainstateActive().InvalidateBlock(state, Params(), ::ChainActive().Tip()));
+    }
+    SyncWithValidationInterfaceQueue();
+    CheckUnspentIndex(*wallet);
+
+    // Reloading the wallet
+    TestUnloadWallet(std::move(wallet));
+    wallet = TestLoadWallet(*chain);
+    CheckUnspentIndex(*wallet);
+    TestUnloadWallet(std::move(wallet));
+}
+
+BOOST_FIXTURE_TEST_CASE(rescan_prefilter_matches_serial, TestChain100Setup)
+{
+    // Descriptor wallets with a keypool of 4, so that the rescan has to find
+    // transactions paying to scriptPubKeys derived during the scan.
+    gArgs.ForceSetArg("-keypool", "4");
+    NodeContext node;
+    auto chain = interfaces::MakeChain(node);
+    CExtKey master;
+    const std::vector<unsigned char> seed(32, 7);
+    master.SetSeed(seed.data(), seed.size());
+    const std::string desc_str = "wpkh(" + EncodeExtKey(master) + "/0/*)";
+    std::string error;
+    FlatSigningProvider desc_keys;
+    const std::unique_ptr<Descriptor> desc = Parse(desc_str, desc_keys, error, /* require_checksum */ false);
+    BOOST_REQUIRE(desc);
+    const auto make_wallet = [&] {
+        auto wallet = MakeUnique<CWallet>(chain.get(), "", CreateMockWalletDatabase());
+        bool first_run;
+        BOOST_REQUIRE(wallet->LoadWallet(first_run) == DBErrors::LOAD_OK);
+        LOCK(wallet->cs_wallet);
+        wallet->SetWalletFlag(WALLET_FLAG_DESCRIPTORS);
+        wallet->SetLastBlockProcessed(::ChainActive().Height(), ::ChainActive().Tip()->GetBlockHash());
+        FlatSigningProvider provider;
+        WalletDescriptor w_desc(Parse(desc_str, provider, error, /* require_checksum */ false), 0, 0, 0, 0);
+        BOOST_REQUIRE(wallet->AddWalletDescriptor(w_desc, provider, "", false));
+        return wallet;
+    };
+    const auto script_at = [&](int index) {
+        std::vector<CScript> scripts;
+        FlatSigningProvider out;
+        BOOST_REQUIRE(desc->Expand(index, desc_keys, scripts, out));
+        return scripts.at(0);
+    };
+    const auto key_at = [&](int index) {
+        FlatSigningProvider out;
+        desc->ExpandPrivate(index, desc_keys, out);
+        BOOST_REQUIRE_EQUAL(out.keys.size(), 1U);
+        return out.keys.begin()->second;
+    };
+
+    // The reference wallet adds each block as it is connected, one transaction at a time.
+    std::unique_ptr<CWallet> serial = make_wallet();
+    const int start_height = ::ChainActive().Height() + 1;
+    const CScript other = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    const auto mine = [&](const std::vector<CMutableTransaction>& txs) {
+        const CBlock block = CreateAndProcessBlock(txs, other);
+        serial->blockConnected(block, ::ChainActive().Height());
+    };
+    const CMutableTransaction pay_first = TestSimpleSpend(*m_coinbase_txns[0], 0, coinbaseKey, script_at(1));
+    mine({pay_first});
+    // Paying to the last derived scriptPubKey makes the wallet derive more
+    mine({TestSimpleSpend(*m_coinbase_txns[1], 0, coinbaseKey, script_at(3))});
+    // Paying to a scriptPubKey derived during the scan, and spending it in the same block
+    const CMutableTransaction pay_derived = TestSimpleSpend(*m_coinbase_txns[2], 0, coinbaseKey, script_at(6));
+    mine({pay_derived, TestSimpleSpend(CTransaction(pay_derived), 0, key_at(6), other)});
+    // Spending an earlier output, next to a transaction not involving the wallet
+    mine({TestSimpleSpend(*m_coinbase_txns[3], 0, coinbaseKey, other), TestSimpleSpend(CTransaction(pay_first), 0, key_at(1), other)});
+
+    std::unique_ptr<CWallet> wallet = make_wallet();
+    {
+        WalletRescanReserver reserver(*wallet);
+        reserver.reserve();
+        CWallet::ScanResult result = wallet->ScanForWalletTransactions(::ChainActive()[start_height]->GetBlockHash(), start_height, {} /* max_height */, reserver, false /* update */);
+        BOOST_CHECK_EQUAL(result.status, CWallet::ScanResult::SUCCESS);
+        BOOST_CHECK_EQUAL(*result.last_scanned_height, ::ChainActive().Height());
+    }
+
+    LOCK2(wallet->cs_wallet, serial->cs_wallet);
+    BOOST_CHECK_EQUAL(serial->mapWallet.size(), 5U);
+    BOOST_CHECK_EQUAL(wallet->mapWallet.size(), serial->mapWallet.size());
+    for (const auto& entry : serial->mapWallet) {
+        const auto it = wallet->mapWallet.find(entry.first);
+        BOOST_REQUIRE(it != wallet->mapWallet.end());
+        BOOST_CHECK(it->second.m_confirm.hashBlock == entry.second.m_confirm.hashBlock);
+        BOOST_CHECK_EQUAL(it->second.m_confirm.nIndex, entry.second.m_confirm.nIndex);
+    }
+    BOOST_CHECK_EQUAL(wallet->GetBalance().m_mine_trusted, serial->GetBalance().m_mine_trusted);
+    gArgs.ForceSetArg("-keypool", std::to_string(DEFAULT_KEYPOOL_SIZE));
+}
+
 // Explicit calculation which is used to test the wallet constant
 // We get the same virtual size due to rounding(weight/4) for both use_max_sig values
 static size_t CalculateNestedKeyhashInputSize(bool use_max_sig)
@@ -5,9 +5,12 @@
 
 #include <wallet/wallet.h>
 
+#include <blockfilter.h>
 #include <chain.h>
+#include <coins.h>
 #include <consensus/consensus.h>
 #include <consensus/validation.h>
+#include <crypto/siphash.h>
 #include <fs.h>
 #include <interfaces/chain.h>
 #include <interfaces/wallet.h>
@@ -18,6 +21,7 @@
 #include <policy/policy.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
+#include <random.h>
 #include <script/descriptor.h>
 #include <script/script.h>
 #include <script/signingprovider.h>
@@ -37,6 +41,11 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <thread>
+#include <unordered_set>
 
 #include <boost/algorithm/string/replace.hpp>
 
@@ -52,6 +61,70 @@ const std::map<uint64_t,std::string> WALLET_FLAG_CAVEATS{
 
 static const size_t OUTPUT_GROUP_MAX_ENTRIES = 10;
 
+//! Number of block filters matched at a time during a rescan
+static const int RESCAN_FILTER_BATCH_SIZE = 1000;
+//! Maximum number of threads reading blocks ahead of a rescan
+static const int MAX_RESCAN_READ_THREADS = 32;
+//! False positive rate of the IsMine script filter, and the fewest scripts it is sized for
+static const double SPK_FILTER_FP_RATE = 0.001;
+static const size_t SPK_FILTER_MIN_CAPACITY = 1000;
+
+/**
+ * Conservative test of whether a transaction may involve a descriptor wallet,
+ * answered without the wallet lock.
+ *
+ * A transaction can only be added to the wallet or change a wallet transaction
+ * if it is already in the wallet, pays to one of the wallet's scriptPubKeys,
+ * spends an output of a wallet transaction, or spends the same output as a
+ * wallet transaction. Scripts are kept as salted hashes, so the test may give
+ * false positives but never false negatives.
+ */
+class RescanPrefilter
+{
+public:
+    RescanPrefilter() : m_k0(GetRand(std::numeric_limits<uint64_t>::max())), m_k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+    void AddScript(const CScript& script) { m_script_hashes.insert(HashScript(script)); }
+    void AddTxid(const uint256& txid) { m_txids.insert(txid); }
+    void AddSpent(const COutPoint& outpoint) { m_spent.insert(outpoint); }
+
+    //! Add a wallet transaction and the outputs it spends.
+    void AddTransaction(const CTransaction& tx)
+    {
+        AddTxid(tx.GetHash());
+        for (const CTxIn& txin : tx.vin) {
+            AddSpent(txin.prevout);
+        }
+    }
+
+    bool IsRelevant(const CTransaction& tx) const
+    {
+        if (!m_txids.empty() && m_txids.count(tx.GetHash())) return true;
+        if (!m_txids.empty() || !m_spent.empty()) {
+            for (const CTxIn& txin : tx.vin) {
+                if (m_txids.count(txin.prevout.hash) || m_spent.count(txin.prevout)) return true;
+            }
+        }
+        if (!m_script_hashes.empty()) {
+            for (const CTxOut& txout : tx.vout) {
+                if (m_script_hashes.count(HashScript(txout.scriptPubKey))) return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    const uint64_t m_k0, m_k1;
+    std::unordered_set<uint64_t> m_script_hashes;
+    std::unordered_set<uint256, SaltedTxidHasher> m_txids;
+    std::unordered_set<COutPoint, SaltedOutpointHasher> m_spent;
+
+    uint64_t HashScript(const CScript& script) const
+    {
+        return CSipHasher(m_k0, m_k1).Write(script.data(), script.size()).Finalize();
+    }
+};
+
 static RecursiveMutex cs_wallets;
 static std::vector<std::shared_ptr<CWallet>> vpwallets GUARDED_BY(cs_wallets);
 static std::list<LoadWalletFn> g_load_wallet_fns GUARDED_BY(cs_wallets);
@@ -554,6 +627,58 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
     return false;
 }
 
+void CWallet::MarkUnspentDirty(const uint256& hash)
+{
+    AssertLockHeld(cs_wallet);
+    // A pending rebuild visits every transaction anyway
+    if (!m_unspent_rebuild) m_unspent_dirty.insert(hash);
+}
+
+void CWallet::UpdateUnspent() const
+{
+    AssertLockHeld(cs_wallet);
+    const auto add_unspent = [this](const CWalletTx& wtx) {
+        AssertLockHeld(cs_wallet);
+        for (unsigned int i = 0; i < wtx.tx->vout.size(); ++i) {
+            if (IsMine(wtx.tx->vout[i]) == ISMINE_NO) continue;
+            if (wtx.IsCoinBase()) m_coinbases.insert(wtx.GetHash());
+            if (!IsSpent(wtx.GetHash(), i)) m_unspent.emplace(wtx.GetHash(), i);
+        }
+    };
+
+    if (m_unspent_rebuild) {
+        m_unspent.clear();
+        m_coinbases.clear();
+        for (const auto& entry : mapWallet) {
+            add_unspent(entry.second);
+        }
+        m_unspent_rebuild = false;
+    } else {
+        for (const uint256& hash : m_unspent_dirty) {
+            auto it = m_unspent.lower_bound(COutPoint(hash, 0));
+            while (it != m_unspent.end() && it->hash == hash) {
+                it = m_unspent.erase(it);
+            }
+            m_coinbases.erase(hash);
+            const auto mit = mapWallet.find(hash);
+            if (mit != mapWallet.end()) add_unspent(mit->second);
+        }
+    }
+    m_unspent_dirty.clear();
+}
+
+std::vector<const CWalletTx*> CWallet::GetTxsWithUnspent() const
+{
+    AssertLockHeld(cs_wallet);
+    UpdateUnspent();
+    std::vector<const CWalletTx*> result;
+    for (const COutPoint& outpoint : m_unspent) {
+        if (!result.empty() && result.back()->GetHash() == outpoint.hash) continue;
+        result.push_back(&mapWallet.at(outpoint.hash));
+    }
+    return result;
+}
+
 void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     mapTxSpends.insert(std::make_pair(outpoint, wtxid));
@@ -755,7 +880,160 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         for (std::pair<const uint256, CWalletTx>& item : mapWallet)
             item.second.MarkDirty();
+        m_unspent_rebuild = true;
+        m_unspent_dirty.clear();
+        ResetTxEntryCounts();
+    }
+}
+
+//! Key of a wallet transaction in CWallet::wtxByHeight
+static int TxHeightKey(const CWalletTx& wtx)
+{
+    if (wtx.isConfirmed() || wtx.isConflicted()) return wtx.m_confirm.block_height;
+    return CWallet::UNCONFIRMED_HEIGHT;
+}
+
+void CWallet::UpdateTxHeight(CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    const int height = TxHeightKey(wtx);
+    if (wtx.m_it_wtxByHeight->first == height) return;
+    wtxByHeight.erase(wtx.m_it_wtxByHeight);
+    wtx.m_it_wtxByHeight = wtxByHeight.emplace(height, &wtx);
+}
+
+void TxEntryCounts::Append(const CWalletTx* wtx, int count)
+{
+    m_txs.push_back(wtx);
+    m_counts.push_back(count);
+    const size_t i = m_txs.size();
+    m_tree.push_back(count + Prefix(i - 1) - Prefix(i - (i & (~i + 1))));
+}
+
+bool TxEntryCounts::Update(const CWalletTx* wtx, int count)
+{
+    auto it = std::lower_bound(m_txs.begin(), m_txs.end(), wtx->nOrderPos,
+                               [](const CWalletTx* a, int64_t order_pos) { return a->nOrderPos < order_pos; });
+    while (it != m_txs.end() && *it != wtx && (*it)->nOrderPos == wtx->nOrderPos) ++it;
+    if (it == m_txs.end() || *it != wtx) return false;
+
+    const size_t pos = it - m_txs.begin();
+    const int delta = count - m_counts[pos];
+    m_counts[pos] = count;
+    for (size_t i = pos + 1; i <= m_tree.size(); i += i & (~i + 1)) {
+        m_tree[i - 1] += delta;
+    }
+    return true;
+}
+
+int TxEntryCounts::Prefix(size_t n) const
+{
+    int total = 0;
+    for (size_t i = n; i > 0; i -= i & (~i + 1)) {
+        total += m_tree[i - 1];
+    }
+    return total;
+}
+
+const CWalletTx* TxEntryCounts::Find(int skip, int& skipped) const
+{
+    const int total = Prefix(m_tree.size());
+    if (total <= skip) {
+        skipped = total;
+        return nullptr;
+    }
+    // Find the first position at which the running total reaches the entries
+    // that are not skipped, by descending the tree
+    int remaining = total - skip;
+    size_t pos = 0;
+    size_t step = 1;
+    while (step * 2 <= m_tree.size()) step *= 2;
+    for (; step > 0; step /= 2) {
+        if (pos + step <= m_tree.size() && m_tree[pos + step - 1] < remaining) {
+            pos += step;
+            remaining -= m_tree[pos - 1];
+        }
     }
+    skipped = total - Prefix(pos + 1);
+    return m_txs[pos];
+}
+
+//! Maximum number of filters CWallet::m_tx_entry_counts keeps counts for
+static constexpr size_t MAX_TX_ENTRY_COUNTS = 16;
+
+int CWallet::CountTxEntries(const CWalletTx& wtx, const isminefilter& filter, const std::string* label) const
+{
+    AssertLockHeld(cs_wallet);
+    CAmount fee;
+    std::list<COutputEntry> received;
+    std::list<COutputEntry> sent;
+    wtx.GetAmounts(received, sent, fee, filter);
+
+    // As in listtransactions: sends are only listed without a label filter, and
+    // receives only while the transaction is not conflicted
+    int count = label ? 0 : sent.size();
+    if (!received.empty() && wtx.GetDepthInMainChain() >= 0) {
+        if (!label) return count + received.size();
+        for (const COutputEntry& r : received) {
+            const CAddressBookData* entry = FindAddressBookEntry(r.destination);
+            if ((entry ? entry->GetLabel() : "") == *label) ++count;
+        }
+    }
+    return count;
+}
+
+const TxEntryCounts& CWallet::GetTxEntryCounts(const isminefilter& filter, const std::string* label) const
+{
+    AssertLockHeld(cs_wallet);
+    // Recount the transactions marked dirty. New ones are appended, in wtxOrdered order.
+    std::vector<const CWalletTx*> dirty;
+    for (const uint256& hash : m_tx_entries_dirty) {
+        const auto it = mapWallet.find(hash);
+        if (it != mapWallet.end()) dirty.push_back(&it->second);
+    }
+    m_tx_entries_dirty.clear();
+    std::sort(dirty.begin(), dirty.end(), [](const CWalletTx* a, const CWalletTx* b) { return a->nOrderPos < b->nOrderPos; });
+    for (auto it = m_tx_entry_counts.begin(); it != m_tx_entry_counts.end();) {
+        const std::string* counts_label = it->first.second ? &*it->first.second : nullptr;
+        bool valid = true;
+        for (const CWalletTx* wtx : dirty) {
+            const int count = CountTxEntries(*wtx, it->first.first, counts_label);
+            if (it->second.Update(wtx, count)) continue;
+            const CWalletTx* newest = it->second.Newest();
+            if (newest && newest->nOrderPos >= wtx->nOrderPos) {
+                valid = false;
+                break;
+            }
+            it->second.Append(wtx, count);
+        }
+        it = valid ? std::next(it) : m_tx_entry_counts.erase(it);
+    }
+
+    Optional<std::string> label_key;
+    if (label) label_key = *label;
+    auto it = m_tx_entry_counts.find(std::make_pair(filter, label_key));
+    if (it == m_tx_entry_counts.end()) {
+        if (m_tx_entry_counts.size() >= MAX_TX_ENTRY_COUNTS) m_tx_entry_counts.clear();
+        it = m_tx_entry_counts.emplace(std::make_pair(filter, label_key), TxEntryCounts()).first;
+        for (const auto& item : wtxOrdered) {
+            it->second.Append(item.second, CountTxEntries(*item.second, filter, label));
+        }
+    }
+    return it->second;
+}
+
+void CWallet::MarkTxEntriesDirty(const uint256& hash)
+{
+    AssertLockHeld(cs_wallet);
+    // Counts built later count every transaction anyway
+    if (!m_tx_entry_counts.empty()) m_tx_entries_dirty.insert(hash);
+}
+
+void CWallet::ResetTxEntryCounts()
+{
+    AssertLockHeld(cs_wallet);
+    m_tx_entry_counts.clear();
+    m_tx_entries_dirty.clear();
 }
 
 bool CWallet::MarkReplaced(const uint256& originalHash, const uint256& newHash)
@@ -872,8 +1150,11 @@ CWalletTx* CWallet::AddToWallet(CTransactionRef tx, const CWalletTx::Confirmatio
         wtx.nTimeReceived = chain().getAdjustedTime();
         wtx.nOrderPos = IncOrderPosNext(&batch);
         wtx.m_it_wtxOrdered = wtxOrdered.insert(std::make_pair(wtx.nOrderPos, &wtx));
+        wtx.m_it_wtxByHeight = wtxByHeight.emplace(TxHeightKey(wtx), &wtx);
         wtx.nTimeSmart = ComputeTimeSmart(wtx);
         AddToSpends(hash);
+        LOCK(m_rescan_additions_mutex);
+        if (m_rescan_additions) m_rescan_additions->AddTransaction(*tx);
     }
 
     if (!fInsertedNew)
@@ -883,6 +1164,7 @@ CWalletTx* CWallet::AddToWallet(CTransactionRef tx, const CWalletTx::Confirmatio
             wtx.m_confirm.nIndex = confirm.nIndex;
             wtx.m_confirm.hashBlock = confirm.hashBlock;
             wtx.m_confirm.block_height = confirm.block_height;
+            UpdateTxHeight(wtx);
             fUpdated = true;
         } else {
             assert(wtx.m_confirm.nIndex == confirm.nIndex);
@@ -910,6 +1192,11 @@ CWalletTx* CWallet::AddToWallet(CTransactionRef tx, const CWalletTx::Confirmatio
 
     // Break debit/credit balance caches:
     wtx.MarkDirty();
+    MarkUnspentDirty(hash);
+    MarkTxEntriesDirty(hash);
+    for (const CTxIn& txin : wtx.tx->vin) {
+        if (mapWallet.count(txin.prevout.hash)) MarkUnspentDirty(txin.prevout.hash);
+    }
 
     // Notify UI of new or updated transaction
     NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -966,11 +1253,16 @@ bool CWallet::LoadToWallet(const uint256& hash, const UpdateWalletTxFn& fill_wtx
     }
     if (/* insertion took place */ ins.second) {
         wtx.m_it_wtxOrdered = wtxOrdered.insert(std::make_pair(wtx.nOrderPos, &wtx));
+        wtx.m_it_wtxByHeight = wtxByHeight.emplace(TxHeightKey(wtx), &wtx);
+    } else {
+        UpdateTxHeight(wtx);
     }
     AddToSpends(hash);
+    MarkUnspentDirty(hash);
     for (const CTxIn& txin : wtx.tx->vin) {
         auto it = mapWallet.find(txin.prevout.hash);
         if (it != mapWallet.end()) {
+            MarkUnspentDirty(it->first);
             CWalletTx& prevtx = it->second;
             if (prevtx.isConflicted()) {
                 MarkConflicted(prevtx.m_confirm.hashBlock, prevtx.m_confirm.block_height, wtx.GetHash());
@@ -1037,6 +1329,7 @@ void CWallet::MarkInputsDirty(const CTransactionRef& tx)
         auto it = mapWallet.find(txin.prevout.hash);
         if (it != mapWallet.end()) {
             it->second.MarkDirty();
+            MarkUnspentDirty(it->first);
         }
     }
 }
@@ -1130,7 +1423,9 @@ void CWallet::MarkConflicted(const uint256& hashBlock, int conflicting_height, c
             wtx.m_confirm.hashBlock = hashBlock;
             wtx.m_confirm.block_height = conflicting_height;
             wtx.setConflicted();
+            UpdateTxHeight(wtx);
             wtx.MarkDirty();
+            MarkTxEntriesDirty(now);
             batch.WriteTx(wtx);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them conflicted too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
@@ -1166,6 +1461,7 @@ void CWallet::transactionAddedToMempool(const CTransactionRef& tx, uint64_t memp
     if (it != mapWallet.end()) {
         it->second.fInMempool = true;
     }
+    UpdateUnspent();
 }
 
 void CWallet::transactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t mempool_sequence) {
@@ -1210,6 +1506,7 @@ void CWallet::blockConnected(const CBlock& block, int height)
 {
     const uint256& block_hash = block.GetHash();
     LOCK(cs_wallet);
+    WalletWriteGroup write_group(GetDatabase());
 
     m_last_block_processed_height = height;
     m_last_block_processed = block_hash;
@@ -1217,6 +1514,7 @@ void CWallet::blockConnected(const CBlock& block, int height)
         SyncTransaction(block.vtx[index], {CWalletTx::Status::CONFIRMED, height, block_hash, (int)index});
         transactionRemovedFromMempool(block.vtx[index], MemPoolRemovalReason::BLOCK, 0 /* mempool_sequence */);
     }
+    UpdateUnspent();
 }
 
 void CWallet::blockDisconnected(const CBlock& block, int height)
@@ -1232,6 +1530,7 @@ void CWallet::blockDisconnected(const CBlock& block, int height)
     for (const CTransactionRef& ptx : block.vtx) {
         SyncTransaction(ptx, {CWalletTx::Status::UNCONFIRMED, /* block height */ 0, /* block hash */ {}, /* index */ 0});
     }
+    UpdateUnspent();
 }
 
 void CWallet::updatedBlockTip()
@@ -1294,9 +1593,73 @@ isminetype CWallet::IsMine(const CTxDestination& dest) const
     return IsMine(GetScriptForDestination(dest));
 }
 
+bool CWallet::MightBeMine(const CScript& script) const
+{
+    AssertLockHeld(cs_wallet);
+    if (!IsWalletFlagSet(WALLET_FLAG_DESCRIPTORS)) return true;
+    uint64_t generation;
+    {
+        LOCK(m_spk_filter_mutex);
+        if (m_spk_filter) return m_spk_filter->contains(script);
+        generation = m_spk_filter_generation;
+    }
+
+    // Rebuild the filter. The scripts are collected without holding
+    // m_spk_filter_mutex, as TopUpCallback takes it while holding cs_desc_man.
+    std::vector<CScript> spks;
+    for (const auto& spk_man_pair : m_spk_managers) {
+        const auto desc_spk_man = dynamic_cast<DescriptorScriptPubKeyMan*>(spk_man_pair.second.get());
+        if (!desc_spk_man) return true;
+        const std::vector<CScript> man_spks = desc_spk_man->GetScriptPubKeys();
+        spks.insert(spks.end(), man_spks.begin(), man_spks.end());
+    }
+    LOCK(m_spk_filter_mutex);
+    // Scripts added in the meantime may be missing, try again next time
+    if (generation != m_spk_filter_generation) return true;
+    m_spk_filter_capacity = std::max(SPK_FILTER_MIN_CAPACITY, spks.size() * 2);
+    m_spk_filter = MakeUnique<CSaltedBloomFilter>(m_spk_filter_capacity, SPK_FILTER_FP_RATE);
+    for (const CScript& spk : spks) {
+        m_spk_filter->insert(spk);
+    }
+    m_spk_filter_count = spks.size();
+    return m_spk_filter->contains(script);
+}
+
+void CWallet::TopUpCallback(const std::vector<CScript>& spks)
+{
+    {
+        LOCK(m_rescan_additions_mutex);
+        if (m_rescan_additions) {
+            for (const CScript& spk : spks) {
+                m_rescan_additions->AddScript(spk);
+            }
+        }
+    }
+    LOCK(m_spk_filter_mutex);
+    ++m_spk_filter_generation;
+    if (!m_spk_filter) return;
+    if (m_spk_filter_count + spks.size() > m_spk_filter_capacity) {
+        // Rebuild with more room on next use rather than let the false positive rate grow
+        m_spk_filter.reset();
+        return;
+    }
+    for (const CScript& spk : spks) {
+        m_spk_filter->insert(spk);
+    }
+    m_spk_filter_count += spks.size();
+}
+
+void CWallet::ResetSpkFilter()
+{
+    LOCK(m_spk_filter_mutex);
+    ++m_spk_filter_generation;
+    m_spk_filter.reset();
+}
+
 isminetype CWallet::IsMine(const CScript& script) const
 {
     AssertLockHeld(cs_wallet);
+    if (!MightBeMine(script)) return ISMINE_NO;
     isminetype result = ISMINE_NO;
     for (const auto& spk_man_pair : m_spk_managers) {
         result = std::max(result, spk_man_pair.second->IsMine(script));
@@ -1715,6 +2078,241 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
     return startTime;
 }
 
+namespace {
+/** Notices descriptors of a descriptor wallet that derived more scriptPubKeys, as happens
+ *  when a rescan finds a transaction using one of the wallet's latest keys. */
+class DescriptorRangeWatcher
+{
+public:
+    explicit DescriptorRangeWatcher(const CWallet& wallet) : m_wallet(wallet) {}
+
+    //! Call fn for each descriptor whose range grew since the last call, or that
+    //! was not seen before. Returns whether fn was called.
+    bool Update(const std::function<void(const DescriptorScriptPubKeyMan&)>& fn)
+    {
+        bool updated = false;
+        for (ScriptPubKeyMan* spk_man : m_wallet.GetAllScriptPubKeyMans()) {
+            const auto desc_spk_man = dynamic_cast<DescriptorScriptPubKeyMan*>(spk_man);
+            assert(desc_spk_man);
+            const int32_t end_range = desc_spk_man->GetEndRange();
+            int32_t& last_end_range = m_last_end_ranges.emplace(desc_spk_man->GetID(), -1).first->second;
+            if (end_range == last_end_range) continue;
+            fn(*desc_spk_man);
+            last_end_range = end_range;
+            updated = true;
+        }
+        return updated;
+    }
+
+private:
+    const CWallet& m_wallet;
+    //! End range of each descriptor as of the last Update
+    std::map<uint256, int32_t> m_last_end_ranges;
+};
+
+/**
+ * The scriptPubKeys of a descriptor wallet, used during a rescan to skip
+ * blocks whose basic block filter does not match any of them.
+ *
+ * Descriptor wallets consider exactly their descriptors' scriptPubKeys as
+ * IsMine, and the basic filter commits to both the output scripts of a block
+ * and the scripts of the outputs it spends, so a block that does not match
+ * cannot contain a transaction that pays to or spends from the wallet.
+ * Filters are matched in batches ahead of the block being scanned.
+ */
+class FastWalletRescanFilter
+{
+public:
+    explicit FastWalletRescanFilter(const CWallet& wallet) : m_range_watcher(wallet), m_wallet(wallet)
+    {
+        UpdateIfNeeded();
+    }
+
+    //! Add the scriptPubKeys derived by descriptor top-ups since the last call.
+    void UpdateIfNeeded()
+    {
+        const bool updated = m_range_watcher.Update([&](const DescriptorScriptPubKeyMan& desc_spk_man) {
+            for (const CScript& script : desc_spk_man.GetScriptPubKeys()) {
+                m_filter_set.emplace(script.begin(), script.end());
+            }
+        });
+        // Batches matched so far did not include the new scriptPubKeys
+        if (updated) m_lookahead.clear();
+    }
+
+    //! Return whether the block's filter matches any of the wallet's
+    //! scriptPubKeys, or nullopt if its filter is not available.
+    Optional<bool> MatchesBlock(const uint256& block_hash, int max_blocks)
+    {
+        if (m_lookahead.empty() || m_lookahead.front().first != block_hash) {
+            const std::vector<std::pair<uint256, bool>> matches = m_wallet.chain().blockFiltersMatchAny(
+                BlockFilterType::BASIC, block_hash, std::min(max_blocks, RESCAN_FILTER_BATCH_SIZE), m_filter_set);
+            m_lookahead.assign(matches.begin(), matches.end());
+            if (m_lookahead.empty() || m_lookahead.front().first != block_hash) {
+                m_lookahead.clear();
+                return nullopt;
+            }
+        }
+        const bool matches = m_lookahead.front().second;
+        m_lookahead.pop_front();
+        return matches;
+    }
+
+    //! Hashes of the next blocks, after the last one passed to MatchesBlock,
+    //! known to match.
+    std::vector<uint256> UpcomingMatches(size_t max) const
+    {
+        std::vector<uint256> hashes;
+        for (auto it = m_lookahead.begin(); it != m_lookahead.end() && hashes.size() < max; ++it) {
+            if (it->second) hashes.push_back(it->first);
+        }
+        return hashes;
+    }
+
+private:
+    DescriptorRangeWatcher m_range_watcher;
+    const CWallet& m_wallet;
+    GCSFilter::ElementSet m_filter_set;
+    //! Filter match results for the blocks following the last one returned
+    std::deque<std::pair<uint256, bool>> m_lookahead;
+};
+
+/**
+ * Reads the blocks of a rescan on a pool of threads, ahead of the scan, and
+ * runs the prefilter over their transactions, so the scan itself only has to
+ * add the transactions that may involve the wallet, in block order.
+ */
+class RescanBlockReader
+{
+public:
+    RescanBlockReader(interfaces::Chain& chain, std::shared_ptr<const RescanPrefilter> prefilter, int num_threads)
+        : m_chain(chain), m_prefilter(std::move(prefilter)), m_max_jobs(2 * num_threads)
+    {
+        for (int i = 0; i < num_threads; ++i) {
+            m_threads.emplace_back([this] { ThreadRead(); });
+        }
+    }
+
+    ~RescanBlockReader()
+    {
+        WITH_LOCK(m_mutex, m_stop = true);
+        m_cv.notify_all();
+        for (std::thread& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    //! Whether as many blocks are queued or read but not taken as are allowed.
+    bool Full() const LOCKS_EXCLUDED(m_mutex)
+    {
+        LOCK(m_mutex);
+        return m_jobs.size() >= m_max_jobs;
+    }
+
+    //! Drop all blocks queued or read but not taken.
+    void Clear() LOCKS_EXCLUDED(m_mutex)
+    {
+        LOCK(m_mutex);
+        m_jobs.clear();
+    }
+
+    //! Queue a block to be read in the background, unless it already is.
+    void Prefetch(const uint256& block_hash) LOCKS_EXCLUDED(m_mutex)
+    {
+        {
+            LOCK(m_mutex);
+            for (const auto& job : m_jobs) {
+                if (job->hash == block_hash) return;
+            }
+            m_jobs.push_back(std::make_shared<Job>(block_hash));
+        }
+        m_cv.notify_all();
+    }
+
+    //! Get a block, and if there is a prefilter which of its transactions it let
+    //! through, reading it now if it was not queued. Blocks queued before it are
+    //! dropped. Returns false if the block could not be read.
+    bool Take(const uint256& block_hash, CBlock& block, std::vector<bool>& relevant) LOCKS_EXCLUDED(m_mutex)
+    {
+        {
+            WAIT_LOCK(m_mutex, lock);
+            const auto it = std::find_if(m_jobs.begin(), m_jobs.end(), [&](const std::shared_ptr<Job>& job) { return job->hash == block_hash; });
+            if (it != m_jobs.end()) {
+                const std::shared_ptr<Job> job = *it;
+                m_jobs.erase(m_jobs.begin(), it + 1);
+                if (job->state != Job::QUEUED) {
+                    m_cv.wait(lock, [&] { return job->state == Job::DONE; });
+                    block = std::move(job->block);
+                    relevant = std::move(job->relevant);
+                    return job->found;
+                }
+            }
+        }
+        return Read(block_hash, block, relevant);
+    }
+
+private:
+    struct Job {
+        explicit Job(const uint256& hash_in) : hash(hash_in) {}
+        const uint256 hash;
+        enum { QUEUED, READING, DONE } state{QUEUED};
+        bool found{false};
+        CBlock block;
+        std::vector<bool> relevant;
+    };
+
+    interfaces::Chain& m_chain;
+    const std::shared_ptr<const RescanPrefilter> m_prefilter;
+    const size_t m_max_jobs;
+    mutable Mutex m_mutex;
+    std::condition_variable m_cv;
+    //! Blocks queued or read but not taken yet, in the order they were queued
+    std::deque<std::shared_ptr<Job>> m_jobs GUARDED_BY(m_mutex);
+    bool m_stop GUARDED_BY(m_mutex){false};
+    std::vector<std::thread> m_threads;
+
+    bool Read(const uint256& block_hash, CBlock& block, std::vector<bool>& relevant) const
+    {
+        relevant.clear();
+        if (!m_chain.findBlock(block_hash, FoundBlock().data(block)) || block.IsNull()) return false;
+        if (m_prefilter) {
+            relevant.reserve(block.vtx.size());
+            for (const CTransactionRef& tx : block.vtx) {
+                relevant.push_back(m_prefilter->IsRelevant(*tx));
+            }
+        }
+        return true;
+    }
+
+    void ThreadRead() LOCKS_EXCLUDED(m_mutex)
+    {
+        WAIT_LOCK(m_mutex, lock);
+        while (!m_stop) {
+            const auto it = std::find_if(m_jobs.begin(), m_jobs.end(), [](const std::shared_ptr<Job>& job) { return job->state == Job::QUEUED; });
+            if (it == m_jobs.end()) {
+                m_cv.wait(lock);
+                continue;
+            }
+            // Keep the job alive in case it is dropped while being read.
+            const std::shared_ptr<Job> job = *it;
+            job->state = Job::READING;
+            CBlock block;
+            std::vector<bool> relevant;
+            bool found;
+            {
+                REVERSE_LOCK(lock);
+                found = Read(job->hash, block, relevant);
+            }
+            job->found = found;
+            job->block = std::move(block);
+            job->relevant = std::move(relevant);
+            job->state = Job::DONE;
+            m_cv.notify_all();
+        }
+    }
+};
+} // namespace
+
 /**
  * Scan the block chain (starting in start_block) for transactions
  * from or to us. If fUpdate is true, found transactions that already
@@ -1746,7 +2344,12 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
     uint256 block_hash = start_block;
     ScanResult result;
 
-    WalletLogPrintf("Rescan started from block %s...\n", start_block.ToString());
+    std::unique_ptr<FastWalletRescanFilter> fast_rescan_filter;
+    if (IsWalletFlagSet(WALLET_FLAG_DESCRIPTORS) && chain().hasBlockFilterIndex(BlockFilterType::BASIC)) {
+        fast_rescan_filter = MakeUnique<FastWalletRescanFilter>(*this);
+    }
+
+    WalletLogPrintf("Rescan started from block %s...%s\n", start_block.ToString(), fast_rescan_filter ? " (using block filters)" : "");
 
     fAbortRescan = false;
     ShowProgress(strprintf("%s " + _("Rescanning...").translated, GetDisplayName()), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
@@ -1757,6 +2360,38 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
     double progress_end = chain().guessVerificationProgress(end_hash);
     double progress_current = progress_begin;
     int block_height = start_height;
+
+    // Blocks are read and prefiltered on other threads ahead of the scan. For
+    // descriptor wallets, the prefilter works on a snapshot of the wallet taken
+    // here, and what the wallet gains from then on, by this scan or otherwise,
+    // is collected in m_rescan_additions and checked separately.
+    std::shared_ptr<RescanPrefilter> prefilter;
+    std::shared_ptr<RescanPrefilter> scan_additions;
+    if (IsWalletFlagSet(WALLET_FLAG_DESCRIPTORS)) {
+        prefilter = std::make_shared<RescanPrefilter>();
+        scan_additions = std::make_shared<RescanPrefilter>();
+        WITH_LOCK(m_rescan_additions_mutex, m_rescan_additions = scan_additions);
+        LOCK(cs_wallet);
+        for (ScriptPubKeyMan* spk_man : GetAllScriptPubKeyMans()) {
+            const auto desc_spk_man = dynamic_cast<DescriptorScriptPubKeyMan*>(spk_man);
+            assert(desc_spk_man);
+            for (const CScript& script : desc_spk_man->GetScriptPubKeys()) {
+                prefilter->AddScript(script);
+            }
+        }
+        for (const auto& entry : mapWallet) {
+            prefilter->AddTxid(entry.first);
+        }
+        for (const auto& spend : mapTxSpends) {
+            prefilter->AddSpent(spend.first);
+        }
+    }
+    int end_height = -1;
+    chain().findBlock(end_hash, FoundBlock().height(end_height));
+    const int read_threads = std::max(1, std::min({GetNumCores(), MAX_RESCAN_READ_THREADS, end_height - start_height + 1}));
+    RescanBlockReader reader(chain(), prefilter, read_threads);
+    int prefetch_height = start_height - 1;
+
     while (!fAbortRescan && !chain().shutdownRequested()) {
         if (progress_end - progress_begin > 0.0) {
             m_scanning_progress = (progress_current - progress_begin) / (progress_end - progress_begin);
@@ -1771,11 +2406,42 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
             WalletLogPrintf("Still rescanning. At block %d. Progress=%f\n", block_height, progress_current);
         }
 
+        // Only read blocks that may contain wallet transactions, if block filters tell.
+        bool fetch_block = true;
+        if (fast_rescan_filter) {
+            const Optional<bool> matches_block = fast_rescan_filter->MatchesBlock(block_hash, max_height ? *max_height - block_height + 1 : RESCAN_FILTER_BATCH_SIZE);
+            if (matches_block && !*matches_block) fetch_block = false;
+        }
+
+        // Queue the next blocks to read, so they are read while this one is scanned.
+        if (fast_rescan_filter) {
+            for (const uint256& hash : fast_rescan_filter->UpcomingMatches(2 * read_threads)) {
+                if (reader.Full()) break;
+                reader.Prefetch(hash);
+            }
+        } else {
+            while (prefetch_height < end_height && !reader.Full()) {
+                uint256 hash;
+                if (!chain().findAncestorByHeight(end_hash, ++prefetch_height, FoundBlock().hash(hash))) break;
+                reader.Prefetch(hash);
+            }
+        }
+
         CBlock block;
+        std::vector<bool> relevant;
         bool next_block;
         uint256 next_block_hash;
         bool reorg = false;
-        if (chain().findBlock(block_hash, FoundBlock().data(block)) && !block.IsNull()) {
+        if (!fetch_block) {
+            next_block = chain().findNextBlock(block_hash, block_height, FoundBlock().hash(next_block_hash), &reorg);
+            if (reorg) {
+                result.last_failed_block = block_hash;
+                result.status = ScanResult::FAILURE;
+                break;
+            }
+            result.last_scanned_block = block_hash;
+            result.last_scanned_height = block_height;
+        } else if (reader.Take(block_hash, block, relevant)) {
             LOCK(cs_wallet);
             next_block = chain().findNextBlock(block_hash, block_height, FoundBlock().hash(next_block_hash), &reorg);
             if (reorg) {
@@ -1787,12 +2453,17 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
                 result.status = ScanResult::FAILURE;
                 break;
             }
+            // Write everything the block adds to the wallet in one transaction
+            WalletWriteGroup write_group(GetDatabase());
             for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
-                SyncTransaction(block.vtx[posInBlock], {CWalletTx::Status::CONFIRMED, block_height, block_hash, (int)posInBlock}, fUpdate);
+                const CTransactionRef& tx = block.vtx[posInBlock];
+                if (prefilter && !relevant[posInBlock] && !WITH_LOCK(m_rescan_additions_mutex, return scan_additions->IsRelevant(*tx))) continue;
+                SyncTransaction(tx, {CWalletTx::Status::CONFIRMED, block_height, block_hash, (int)posInBlock}, fUpdate);
             }
             // scan succeeded, record block as most recent successfully scanned
             result.last_scanned_block = block_hash;
             result.last_scanned_height = block_height;
+            if (fast_rescan_filter) fast_rescan_filter->UpdateIfNeeded();
         } else {
             // could not scan block, keep scanning but record this block as the most recent failure
             result.last_failed_block = block_hash;
@@ -1821,6 +2492,19 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
                 // in case the tip has changed, update progress max
                 progress_end = chain().guessVerificationProgress(tip_hash);
             }
+            if (prev_tip_hash != tip_hash) {
+                // After a reorg, blocks read ahead may be off the active chain. The scan
+                // would never take them, so they would keep the reader full: drop them
+                // and read ahead along the new chain.
+                uint256 new_end_hash = tip_hash;
+                if (max_height) chain().findAncestorByHeight(tip_hash, *max_height, FoundBlock().hash(new_end_hash));
+                if (!chain().findAncestorByHash(new_end_hash, end_hash)) {
+                    reader.Clear();
+                    prefetch_height = block_height - 1;
+                }
+                end_hash = new_end_hash;
+                chain().findBlock(end_hash, FoundBlock().height(end_height));
+            }
         }
     }
     ShowProgress(strprintf("%s " + _("Rescanning...").translated, GetDisplayName()), 100); // hide progress dialog in GUI
@@ -1833,6 +2517,7 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
     } else {
         WalletLogPrintf("Rescan completed in %15dms\n", GetTimeMillis() - start_time);
     }
+    if (prefilter) WITH_LOCK(m_rescan_additions_mutex, m_rescan_additions.reset());
     return result;
 }
 
@@ -2131,9 +2816,10 @@ CWallet::Balance CWallet::GetBalance(const int min_depth, bool avoid_reuse) cons
     {
         LOCK(cs_wallet);
         std::set<uint256> trusted_parents;
-        for (const auto& entry : mapWallet)
+        // Transactions without unspent outputs of ours have no available credit
+        for (const CWalletTx* pwtx : GetTxsWithUnspent())
         {
-            const CWalletTx& wtx = entry.second;
+            const CWalletTx& wtx = *pwtx;
             const bool is_trusted{IsTrusted(wtx, trusted_parents)};
             const int tx_depth{wtx.GetDepthInMainChain()};
             const CAmount tx_credit_mine{wtx.GetAvailableCredit(/* fUseCache */ true, ISMINE_SPENDABLE | reuse_filter)};
@@ -2146,6 +2832,10 @@ CWallet::Balance CWallet::GetBalance(const int min_depth, bool avoid_reuse) cons
                 ret.m_mine_untrusted_pending += tx_credit_mine;
                 ret.m_watchonly_untrusted_pending += tx_credit_watchonly;
             }
+        }
+        // Immature credit counts coinbase outputs whether they are spent or not
+        for (const uint256& hash : m_coinbases) {
+            const CWalletTx& wtx = mapWallet.at(hash);
             ret.m_mine_immature += wtx.GetImmatureCredit();
             ret.m_watchonly_immature += wtx.GetImmatureWatchOnlyCredit();
         }
@@ -2181,10 +2871,10 @@ void CWallet::AvailableCoins(std::vector<COutput>& vCoins, bool fOnlySafe, const
     const int max_depth = {coinControl ? coinControl->m_max_depth : DEFAULT_MAX_DEPTH};
 
     std::set<uint256> trusted_parents;
-    for (const auto& entry : mapWallet)
+    for (const CWalletTx* pwtx : GetTxsWithUnspent())
     {
-        const uint256& wtxid = entry.first;
-        const CWalletTx& wtx = entry.second;
+        const uint256& wtxid = pwtx->GetHash();
+        const CWalletTx& wtx = *pwtx;
 
         if (!chain().checkFinalTx(*wtx.tx)) {
             continue;
@@ -2245,17 +2935,17 @@ void CWallet::AvailableCoins(std::vector<COutput>& vCoins, bool fOnlySafe, const
 
         for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
             // Only consider selected coins if add_inputs is false
-            if (coinControl && !coinControl->m_add_inputs && !coinControl->IsSelected(COutPoint(entry.first, i))) {
+            if (coinControl && !coinControl->m_add_inputs && !coinControl->IsSelected(COutPoint(wtxid, i))) {
                 continue;
             }
 
             if (wtx.tx->vout[i].nValue < nMinimumAmount || wtx.tx->vout[i].nValue > nMaximumAmount)
                 continue;
 
-            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint(entry.first, i)))
+            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint(wtxid, i)))
                 continue;
 
-            if (IsLockedCoin(entry.first, i))
+            if (IsLockedCoin(wtxid, i))
                 continue;
 
             if (IsSpent(wtxid, i))
@@ -2356,11 +3046,17 @@ const CTxOut& CWallet::FindNonChangeParentOutput(const CTransaction& tx, int out
 
 bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibilityFilter& eligibility_filter, std::vector<OutputGroup> groups,
                                  std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CoinSelectionParams& coin_selection_params, bool& bnb_used) const
+{
+    OutputGroupPool group_pool(std::move(groups));
+    return SelectCoinsMinConf(nTargetValue, eligibility_filter, group_pool, setCoinsRet, nValueRet, coin_selection_params, bnb_used);
+}
+
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibilityFilter& eligibility_filter, OutputGroupPool& group_pool,
+                                 std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CoinSelectionParams& coin_selection_params, bool& bnb_used) const
 {
     setCoinsRet.clear();
     nValueRet = 0;
 
-    std::vector<OutputGroup> utxo_pool;
     if (coin_selection_params.use_bnb) {
         // Get long term estimate
         FeeCalculation feeCalc;
@@ -2371,36 +3067,27 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibil
         // Calculate cost of change
         CAmount cost_of_change = GetDiscardRate(*this).GetFee(coin_selection_params.change_spend_size) + coin_selection_params.effective_fee.GetFee(coin_selection_params.change_output_size);
 
-        // Filter by the min conf specs and add to utxo_pool and calculate effective value
-        for (OutputGroup& group : groups) {
-            if (!group.EligibleForSpending(eligibility_filter)) continue;
-
-            if (coin_selection_params.m_subtract_fee_outputs) {
-                // Set the effective feerate to 0 as we don't want to use the effective value since the fees will be deducted from the output
-                group.SetFees(CFeeRate(0) /* effective_feerate */, long_term_feerate);
-            } else {
-                group.SetFees(coin_selection_params.effective_fee, long_term_feerate);
-            }
-
-            OutputGroup pos_group = group.GetPositiveOnlyGroup();
-            if (pos_group.effective_value > 0) utxo_pool.push_back(pos_group);
-        }
+        // Filter by the min conf specs and calculate effective value
+        // Set the effective feerate to 0 as we don't want to use the effective value since the fees will be deducted from the output
+        const CFeeRate effective_feerate = coin_selection_params.m_subtract_fee_outputs ? CFeeRate(0) : coin_selection_params.effective_fee;
+        std::vector<OutputGroup>& utxo_pool = group_pool.GetEligibleWithFees(eligibility_filter, effective_feerate, long_term_feerate);
         // Calculate the fees for things that aren't inputs
         CAmount not_input_fees = coin_selection_params.effective_fee.GetFee(coin_selection_params.tx_noinputs_size);
         bnb_used = true;
-        return SelectCoinsBnB(utxo_pool, nTargetValue, cost_of_change, setCoinsRet, nValueRet, not_input_fees);
+        BnBStats stats;
+        const bool found = SelectCoinsBnB(utxo_pool, nTargetValue, cost_of_change, setCoinsRet, nValueRet, not_input_fees, &stats);
+        LogPrint(BCLog::SELECTCOINS, "SelectCoinsBnB: %s a selection among %u groups in %u tries, %s\n", found ? "found" : "did not find", utxo_pool.size(), stats.tries,
+                 stats.exact_match ? "stopped at exact match" : stats.exhausted ? "search exhausted" : stats.tries == 0 ? "not enough value" : "try limit reached");
+        return found;
     } else {
-        // Filter by the min conf specs and add to utxo_pool
-        for (const OutputGroup& group : groups) {
-            if (!group.EligibleForSpending(eligibility_filter)) continue;
-            utxo_pool.push_back(group);
-        }
+        // Filter by the min conf specs
+        const std::vector<OutputGroup>& utxo_pool = group_pool.GetEligible(eligibility_filter);
         bnb_used = false;
         return KnapsackSolver(nTargetValue, utxo_pool, setCoinsRet, nValueRet);
     }
 }
 
-bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl& coin_control, CoinSelectionParams& coin_selection_params, bool& bnb_used) const
+bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl& coin_control, CoinSelectionParams& coin_selection_params, bool& bnb_used, OutputGroupPool* group_pool) const
 {
     std::vector<COutput> vCoins(vAvailableCoins);
     CAmount value_to_select = nTargetValue;
@@ -2472,14 +3159,21 @@ bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAm
     bool fRejectLongChains = gArgs.GetBoolArg("-walletrejectlongchains", DEFAULT_WALLET_REJECT_LONG_CHAINS);
 
     // form groups from remaining coins; note that preset coins will not
-    // automatically have their associated (same address) coins included
-    if (coin_control.m_avoid_partial_spends && vCoins.size() > OUTPUT_GROUP_MAX_ENTRIES) {
-        // Cases where we have 11+ outputs all pointing to the same destination may result in
-        // privacy leaks as they will potentially be deterministically sorted. We solve that by
-        // explicitly shuffling the outputs before processing
-        Shuffle(vCoins.begin(), vCoins.end(), FastRandomContext());
-    }
-    std::vector<OutputGroup> groups = GroupOutputs(vCoins, !coin_control.m_avoid_partial_spends, max_ancestors);
+    // automatically have their associated (same address) coins included.
+    // A caller making several attempts at the same transaction passes the
+    // groups formed on the first one back in.
+    OutputGroupPool local_group_pool;
+    if (!group_pool) group_pool = &local_group_pool;
+    if (group_pool->IsEmpty()) {
+        if (coin_control.m_avoid_partial_spends && vCoins.size() > OUTPUT_GROUP_MAX_ENTRIES) {
+            // Cases where we have 11+ outputs all pointing to the same destination may result in
+            // privacy leaks as they will potentially be deterministically sorted. We solve that by
+            // explicitly shuffling the outputs before processing
+            Shuffle(vCoins.begin(), vCoins.end(), FastRandomContext());
+        }
+        *group_pool = OutputGroupPool(GroupOutputs(vCoins, !coin_control.m_avoid_partial_spends, max_ancestors));
+    }
+    OutputGroupPool& groups = *group_pool;
 
     bool res = value_to_select <= 0 ||
         SelectCoinsMinConf(value_to_select, CoinEligibilityFilter(1, 6, 0), groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used) ||
@@ -2830,6 +3524,8 @@ bool CWallet::CreateTransactionInternal(
             // That should only happen on the first pass through the loop.
             coin_selection_params.use_bnb = true;
             coin_selection_params.m_subtract_fee_outputs = nSubtractFeeFromAmount != 0; // If we are doing subtract fee from recipient, don't use effective values
+            // Output groups are formed on the first pass and reused by later ones
+            OutputGroupPool group_pool;
             // Start with no fee and loop until there is enough fee
             while (true)
             {
@@ -2896,7 +3592,7 @@ bool CWallet::CreateTransactionInternal(
                         coin_selection_params.change_spend_size = (size_t)change_spend_size;
                     }
                     coin_selection_params.effective_fee = nFeeRateNeeded;
-                    if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins, nValueIn, coin_control, coin_selection_params, bnb_used))
+                    if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins, nValueIn, coin_control, coin_selection_params, bnb_used, &group_pool))
                     {
                         // If BnB was used, it was the first pass. No longer the first pass and continue loop with knapsack.
                         if (bnb_used) {
@@ -3208,6 +3904,7 @@ DBErrors CWallet::ZapSelectTx(std::vector<uint256>& vHashIn, std::vector<uint256
     for (const uint256& hash : vHashOut) {
         const auto& it = mapWallet.find(hash);
         wtxOrdered.erase(it->second.m_it_wtxOrdered);
+        wtxByHeight.erase(it->second.m_it_wtxByHeight);
         for (const auto& txin : it->second.tx->vin)
             mapTxSpends.erase(txin.prevout);
         mapWallet.erase(it);
@@ -3241,6 +3938,7 @@ bool CWallet::SetAddressBookWithDB(WalletBatch& batch, const CTxDestination& add
         std::map<CTxDestination, CAddressBookData>::iterator mi = m_address_book.find(address);
         fUpdated = (mi != m_address_book.end() && !mi->second.IsChange());
         m_address_book[address].SetLabel(strName);
+        ResetTxEntryCounts();
         if (!strPurpose.empty()) /* update purpose only if requested */
             m_address_book[address].purpose = strPurpose;
         is_mine = IsMine(address) != ISMINE_NO;
@@ -3278,6 +3976,7 @@ bool CWallet::DelAddressBook(const CTxDestination& address)
             batch.EraseDestData(strAddress, item.first);
         }
         m_address_book.erase(address);
+        ResetTxEntryCounts();
         is_mine = IsMine(address) != ISMINE_NO;
     }
 
@@ -3313,6 +4012,7 @@ unsigned int CWallet::GetKeyPoolSize() const
 bool CWallet::TopUpKeyPool(unsigned int kpSize)
 {
     LOCK(cs_wallet);
+    WalletWriteGroup write_group(GetDatabase());
     bool res = true;
     for (auto spk_man : GetActiveScriptPubKeyMans()) {
         res &= spk_man->TopUp(kpSize);
@@ -4202,8 +4902,9 @@ std::vector<OutputGroup> CWallet::GroupOutputs(const std::vector<COutput>& outpu
             CTxDestination dst;
             CInputCoin input_coin = output.GetInputCoin();
 
-            size_t ancestors, descendants;
-            chain().getTransactionAncestry(output.tx->GetHash(), ancestors, descendants);
+            // Confirmed transactions have no mempool ancestry
+            size_t ancestors = 0, descendants = 0;
+            if (output.nDepth <= 0) chain().getTransactionAncestry(output.tx->GetHash(), ancestors, descendants);
             if (!single_coin && ExtractDestination(output.tx->tx->vout[output.i].scriptPubKey, dst)) {
                 auto it = gmap.find(dst);
                 if (it != gmap.end()) {
@@ -4416,6 +5117,7 @@ void CWallet::LoadDescriptorScriptPubKeyMan(uint256 id, WalletDescriptor& desc)
 {
     auto spk_manager = std::unique_ptr<ScriptPubKeyMan>(new DescriptorScriptPubKeyMan(*this, desc));
     m_spk_managers[id] = std::move(spk_manager);
+    ResetSpkFilter();
 }
 
 void CWallet::SetupDescriptorScriptPubKeyMans()
@@ -4449,6 +5151,7 @@ void CWallet::SetupDescriptorScriptPubKeyMans()
             AddActiveScriptPubKeyMan(id, t, internal);
         }
     }
+    ResetSpkFilter();
 }
 
 void CWallet::AddActiveScriptPubKeyMan(uint256 id, OutputType type, bool internal)
@@ -4561,6 +5264,11 @@ ScriptPubKeyMan* CWallet::AddWalletDescriptor(WalletDescriptor& desc, const Flat
     // Save the descriptor to memory
     auto ret = new_spk_man.get();
     m_spk_managers[new_spk_man->GetID()] = std::move(new_spk_man);
+    ResetSpkFilter();
+    // Existing transactions may pay to the new scripts
+    m_unspent_rebuild = true;
+    m_unspent_dirty.clear();
+    ResetTxEntryCounts();
 
     // Save the descriptor to DB
     ret->WriteDescriptor();
@@ -7,6 +7,7 @@
 #define BITCOIN_WALLET_WALLET_H
 
 #include <amount.h>
+#include <bloom.h>
 #include <interfaces/chain.h>
 #include <interfaces/handler.h>
 #include <outputtype.h>
@@ -27,6 +28,7 @@
 
 #include <algorithm>
 #include <atomic>
+#include <limits>
 #include <map>
 #include <memory>
 #include <set>
@@ -325,6 +327,7 @@ public:
     bool fFromMe;
     int64_t nOrderPos; //!< position in ordered transaction list
     std::multimap<int64_t, CWalletTx*>::const_iterator m_it_wtxOrdered;
+    std::multimap<int, CWalletTx*>::const_iterator m_it_wtxByHeight;
 
     // memory only
     enum AmountType { DEBIT, CREDIT, IMMATURE_CREDIT, AVAILABLE_CREDIT, AMOUNTTYPE_ENUM_ELEMENTS };
@@ -416,14 +419,24 @@ public:
 
     template<typename Stream>
     void Unserialize(Stream& s)
+    {
+        CTransactionRef arg;
+        s >> arg;
+        Unserialize(s, std::move(arg));
+    }
+
+    //! Unserialize the fields that follow the transaction, which was read from the stream separately
+    template<typename Stream>
+    void Unserialize(Stream& s, CTransactionRef arg)
     {
         Init();
+        tx = std::move(arg);
 
         std::vector<uint256> dummy_vector1; //!< Used to be vMerkleBranch
         std::vector<CMerkleTx> dummy_vector2; //!< Used to be vtxPrev
         bool dummy_bool; //! Used to be fSpent
         int serializedIndex;
-        s >> tx >> m_confirm.hashBlock >> dummy_vector1 >> serializedIndex >> dummy_vector2 >> mapValue >> vOrderForm >> fTimeReceivedIsTxTime >> nTimeReceived >> fFromMe >> dummy_bool;
+        s >> m_confirm.hashBlock >> dummy_vector1 >> serializedIndex >> dummy_vector2 >> mapValue >> vOrderForm >> fTimeReceivedIsTxTime >> nTimeReceived >> fFromMe >> dummy_bool;
 
         /* At serialization/deserialization, an nIndex == -1 means that hashBlock refers to
          * the earliest block in the chain we know this or any in-wallet ancestor conflicts
@@ -615,6 +628,42 @@ struct CoinSelectionParams
     CoinSelectionParams() {}
 };
 
+/**
+ * The number of entries listtransactions shows for each wallet transaction under
+ * one ismine filter and label filter, in wtxOrdered order, with running totals
+ * (a Fenwick tree) over them. A page is found by its offset in O(log n), without
+ * counting the entries of the transactions newer than it.
+ */
+class TxEntryCounts
+{
+public:
+    //! Add a transaction newer than all the others
+    void Append(const CWalletTx* wtx, int count);
+    //! Change the count of a transaction. Returns false if it is not in the index.
+    bool Update(const CWalletTx* wtx, int count);
+    //! The newest transaction, or null if there is none
+    const CWalletTx* Newest() const { return m_txs.empty() ? nullptr : m_txs.back(); }
+    /**
+     * Find the oldest transaction of which all newer transactions together have
+     * at most @p skip entries, while it and the newer ones have more.
+     *
+     * @param[out] skipped  The number of entries of the transactions newer than it.
+     * @return  The transaction, or null if there are no more than @p skip entries.
+     */
+    const CWalletTx* Find(int skip, int& skipped) const;
+
+private:
+    //! Transactions in wtxOrdered order, oldest first, and their counts
+    std::vector<const CWalletTx*> m_txs;
+    std::vector<int> m_counts;
+    //! m_tree[i - 1] is the total of the counts at positions (i - (i & -i), i]
+    std::vector<int> m_tree;
+
+    //! Total of the first n counts
+    int Prefix(size_t n) const;
+};
+
+class RescanPrefilter;
 class WalletRescanReserver; //forward declarations for ScanForWalletTransactions/RescanFromTime
 /**
  * A CWallet maintains a set of transactions and balances, and provides the ability to create new transactions.
@@ -633,6 +682,14 @@ private:
     std::atomic<double> m_scanning_progress{0};
     friend class WalletRescanReserver;
 
+    /**
+     * While a descriptor wallet rescan runs, the scriptPubKeys from top ups and
+     * the transactions added to the wallet since it took its prefilter snapshot,
+     * fed from TopUpCallback and AddToWallet. Null otherwise.
+     */
+    Mutex m_rescan_additions_mutex;
+    std::shared_ptr<RescanPrefilter> m_rescan_additions GUARDED_BY(m_rescan_additions_mutex);
+
     //! the current wallet version: clients below this version are not able to load the wallet
     int nWalletVersion GUARDED_BY(cs_wallet){FEATURE_BASE};
 
@@ -651,6 +708,42 @@ private:
     void AddToSpends(const COutPoint& outpoint, const uint256& wtxid) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
     void AddToSpends(const uint256& wtxid) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
+    /**
+     * Outputs of wallet transactions that are ours and not spent by another
+     * wallet transaction, so balance and coin queries only need to visit the
+     * transactions that still hold coins. Kept up to date from the
+     * transactions whose caches were marked dirty since the last update.
+     */
+    mutable std::set<COutPoint> m_unspent GUARDED_BY(cs_wallet);
+    /**
+     * Coinbase transactions with outputs of ours. Immature credit counts these
+     * outputs whether they are spent or not, so they are kept apart from
+     * m_unspent. Matured coinbases stay as well: disconnecting a later block
+     * makes them immature again without touching the transaction.
+     */
+    mutable std::set<uint256> m_coinbases GUARDED_BY(cs_wallet);
+    //! Transactions whose outputs need to be rechecked for m_unspent and m_coinbases
+    mutable std::set<uint256> m_unspent_dirty GUARDED_BY(cs_wallet);
+    //! Whether m_unspent and m_coinbases need to be rebuilt from all wallet transactions
+    mutable bool m_unspent_rebuild GUARDED_BY(cs_wallet){true};
+    void MarkUnspentDirty(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    void UpdateUnspent() const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
+    /**
+     * listtransactions entry counts, by ismine filter and label filter, built on
+     * first use. The counts come from GetAmounts, like the entries themselves, so
+     * they are as current as the transaction's cached debit. A transaction is
+     * recounted whenever the wallet marks it dirty. Changes that alter the entries
+     * of transactions without marking them dirty drop all counts: CWallet::MarkDirty(),
+     * adding a descriptor, and setting or deleting a label, which also decides
+     * what is change.
+     */
+    mutable std::map<std::pair<isminefilter, Optional<std::string>>, TxEntryCounts> m_tx_entry_counts GUARDED_BY(cs_wallet);
+    //! Transactions to recount in m_tx_entry_counts
+    mutable std::set<uint256> m_tx_entries_dirty GUARDED_BY(cs_wallet);
+    void MarkTxEntriesDirty(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    void ResetTxEntryCounts() EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
     /**
      * Add a transaction to the wallet, or update it.  pIndex and posInBlock should
      * be set when the transaction was known to be included in a block.  When
@@ -688,6 +781,26 @@ private:
     //! Unset the blank wallet flag and saves it to disk
     void UnsetBlankWalletFlag(WalletBatch& batch) override;
 
+    /**
+     * Filter over the scriptPubKeys of all ScriptPubKeyMans of a descriptor
+     * wallet, where IsMine is plain set membership, so that IsMine can reject
+     * most scripts that are not ours without asking every ScriptPubKeyMan.
+     * Scripts from top ups are added through TopUpCallback. Null until it is
+     * (re)built on first use.
+     */
+    mutable Mutex m_spk_filter_mutex;
+    mutable std::unique_ptr<CSaltedBloomFilter> m_spk_filter GUARDED_BY(m_spk_filter_mutex);
+    //! Number of scripts in m_spk_filter, and the number it was sized for
+    mutable size_t m_spk_filter_count GUARDED_BY(m_spk_filter_mutex){0};
+    mutable size_t m_spk_filter_capacity GUARDED_BY(m_spk_filter_mutex){0};
+    //! Incremented on every TopUpCallback, so a rebuild can tell it missed scripts
+    uint64_t m_spk_filter_generation GUARDED_BY(m_spk_filter_mutex){0};
+    //! Return false if the script is not IsMine for any ScriptPubKeyMan
+    bool MightBeMine(const CScript& script) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    //! Drop the filter after adding a ScriptPubKeyMan, whose top up may have
+    //! come before a rebuild that did not see it yet
+    void ResetSpkFilter();
+
     /** Interface for accessing chain state. */
     interfaces::Chain* m_chain;
 
@@ -741,10 +854,12 @@ public:
     /**
      * Select a set of coins such that nValueRet >= nTargetValue and at least
      * all coins from coinControl are selected; Never select unconfirmed coins
-     * if they are not ours
+     * if they are not ours. If group_pool is given and empty, it is filled with
+     * the output groups formed from the coins, to be passed back in by later
+     * attempts with the same coins and coin control.
      */
     bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet,
-                    const CCoinControl& coin_control, CoinSelectionParams& coin_selection_params, bool& bnb_used) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+                    const CCoinControl& coin_control, CoinSelectionParams& coin_selection_params, bool& bnb_used, OutputGroupPool* group_pool = nullptr) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
     /** Get a name for this wallet for logging/debugging purposes.
      */
@@ -780,6 +895,23 @@ public:
     typedef std::multimap<int64_t, CWalletTx*> TxItems;
     TxItems wtxOrdered;
 
+    /**
+     * Wallet transactions by the height of the block that confirms them, or that
+     * they conflict with. Unconfirmed and abandoned transactions are kept at
+     * UNCONFIRMED_HEIGHT, above all blocks, so that listing the transactions
+     * since a block only visits the ones that can follow it.
+     */
+    typedef std::multimap<int, CWalletTx*> TxHeightItems;
+    TxHeightItems wtxByHeight GUARDED_BY(cs_wallet);
+    static constexpr int UNCONFIRMED_HEIGHT = std::numeric_limits<int>::max();
+    //! Move a wallet transaction in wtxByHeight after its confirmation changed
+    void UpdateTxHeight(CWalletTx& wtx) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
+    //! Number of entries listtransactions shows for a wallet transaction
+    int CountTxEntries(const CWalletTx& wtx, const isminefilter& filter, const std::string* label) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    //! The listtransactions entry counts for an ismine filter and an optional label, brought up to date
+    const TxEntryCounts& GetTxEntryCounts(const isminefilter& filter, const std::string* label) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
     int64_t nOrderPosNext GUARDED_BY(cs_wallet) = 0;
     uint64_t nAccountingEntryNumber = 0;
 
@@ -823,6 +955,8 @@ public:
      */
     bool SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibilityFilter& eligibility_filter, std::vector<OutputGroup> groups,
         std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CoinSelectionParams& coin_selection_params, bool& bnb_used) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibilityFilter& eligibility_filter, OutputGroupPool& group_pool,
+        std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CoinSelectionParams& coin_selection_params, bool& bnb_used) const;
 
     bool IsSpent(const uint256& hash, unsigned int n) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
@@ -931,6 +1065,8 @@ public:
         CAmount m_watchonly_immature{0};
     };
     Balance GetBalance(int min_depth = 0, bool avoid_reuse = true) const;
+    //! Wallet transactions with outputs in m_unspent, in txid order
+    std::vector<const CWalletTx*> GetTxsWithUnspent() const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
     CAmount GetAvailableBalance(const CCoinControl* coinControl = nullptr) const;
 
     OutputType TransactionChangeType(const Optional<OutputType>& change_type, const std::vector<CRecipient>& vecSend);
@@ -1227,6 +1363,7 @@ public:
 
     const CKeyingMaterial& GetEncryptionKey() const override;
     bool HasEncryptionKeys() const override;
+    void TopUpCallback(const std::vector<CScript>& spks) override;
 
     /** Get last block processed height */
     int GetLastBlockHeight() const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet)
@@ -1312,6 +1449,7 @@ public:
     ~WalletRescanReserver()
     {
         if (m_could_reserve) {
+            WITH_LOCK(m_wallet.m_rescan_additions_mutex, m_wallet.m_rescan_additions.reset());
             m_wallet.fScanningWallet = false;
         }
     }
@@ -20,8 +20,12 @@
 #endif
 #include <wallet/wallet.h>
 
+#include <algorithm>
 #include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <string>
+#include <thread>
 
 namespace DBKeys {
 const std::string ACENTRY{"acentry"};
@@ -245,6 +249,114 @@ bool WalletBatch::WriteDescriptorParentCache(const CExtPubKey& xpub, const uint2
     return WriteIC(std::make_pair(std::make_pair(DBKeys::WALLETDESCRIPTORCACHE, desc_id), key_exp_index), ser_xpub);
 }
 
+//! Number of transaction records LoadWallet reads before loading them together
+static constexpr size_t TX_LOAD_BATCH_SIZE = 16384;
+//! Maximum number of threads deserializing transaction records
+static constexpr int MAX_TX_LOAD_THREADS = 16;
+//! Minimum number of transaction records in a batch for it to be deserialized on several threads
+static constexpr size_t MIN_TX_RECORDS_TO_SHARE = 512;
+
+namespace {
+/** A transaction record read by LoadWallet, waiting to be loaded */
+struct TxRecord {
+    uint256 hash;
+    CDataStream value;
+    //! The transaction, once read from value
+    CTransactionRef tx;
+    std::string error;
+};
+
+/** Read the transaction of a record, keeping the error if it cannot be read */
+void ReadTxRecord(TxRecord& record)
+{
+    try {
+        record.value >> record.tx;
+    } catch (const std::exception& e) {
+        record.error = e.what();
+    } catch (...) {
+        record.error = "Caught unknown exception reading a transaction record";
+    }
+}
+
+/**
+ * Threads that read the transactions of the batches of records LoadWallet
+ * collects. They are started once per load and wait for the next batch in
+ * between, so a large wallet does not start threads for every batch.
+ */
+class TxRecordReader
+{
+public:
+    explicit TxRecordReader(int num_threads) : m_num_threads(num_threads)
+    {
+        for (int t = 1; t < m_num_threads; ++t) {
+            m_threads.emplace_back(&TraceThread<std::function<void()>>, "txload", std::function<void()>([this, t] { ThreadRead(t); }));
+        }
+    }
+
+    ~TxRecordReader()
+    {
+        WITH_LOCK(m_mutex, m_stop = true);
+        m_cv.notify_all();
+        for (std::thread& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    //! Read the transactions of all records, on this thread and the reading threads.
+    void Read(std::vector<TxRecord>& records) LOCKS_EXCLUDED(m_mutex)
+    {
+        {
+            LOCK(m_mutex);
+            m_records = &records;
+            m_pending = m_threads.size();
+            ++m_batch;
+        }
+        m_cv.notify_all();
+        ReadShare(records, 0);
+        WAIT_LOCK(m_mutex, lock);
+        m_cv.wait(lock, [&] { return m_pending == 0; });
+        m_records = nullptr;
+    }
+
+private:
+    const int m_num_threads;
+    Mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<TxRecord>* m_records GUARDED_BY(m_mutex){nullptr};
+    //! Number of reading threads that have not finished the current batch
+    size_t m_pending GUARDED_BY(m_mutex){0};
+    uint64_t m_batch GUARDED_BY(m_mutex){0};
+    bool m_stop GUARDED_BY(m_mutex){false};
+    std::vector<std::thread> m_threads;
+
+    void ReadShare(std::vector<TxRecord>& records, int t) const
+    {
+        for (size_t i = t; i < records.size(); i += m_num_threads) ReadTxRecord(records[i]);
+    }
+
+    void ThreadRead(int t) LOCKS_EXCLUDED(m_mutex)
+    {
+        uint64_t batch = 0;
+        while (true) {
+            std::vector<TxRecord>* records;
+            {
+                WAIT_LOCK(m_mutex, lock);
+                m_cv.wait(lock, [&] { return m_stop || m_batch != batch; });
+                if (m_stop) return;
+                batch = m_batch;
+                records = m_records;
+            }
+            ReadShare(*records, t);
+            {
+                LOCK(m_mutex);
+                --m_pending;
+            }
+            m_cv.notify_all();
+        }
+    }
+};
+} // namespace
+
 class CWalletScanState {
 public:
     unsigned int nKeys{0};
@@ -261,11 +373,94 @@ public:
     std::map<std::pair<uint256, CKeyID>, CKey> m_descriptor_keys;
     std::map<std::pair<uint256, CKeyID>, std::pair<CPubKey, std::vector<unsigned char>>> m_descriptor_crypt_keys;
     std::map<uint160, CHDChain> m_hd_chains;
+    //! Whether transaction records are collected in m_tx_records rather than loaded as they are read
+    bool m_defer_txs{false};
+    std::vector<TxRecord> m_tx_records;
+    //! Started by the first batch large enough to share out
+    std::unique_ptr<TxRecordReader> m_tx_reader;
 
     CWalletScanState() {
     }
 };
 
+/** Load a wallet transaction from a transaction record, whose transaction was already read from ssValue */
+static bool LoadTxRecord(CWallet* pwallet, const uint256& hash, CTransactionRef tx, CDataStream& ssValue,
+                         CWalletScanState& wss, std::string& strErr) EXCLUSIVE_LOCKS_REQUIRED(pwallet->cs_wallet)
+{
+    // LoadToWallet call below creates a new CWalletTx that fill_wtx
+    // callback fills with transaction metadata.
+    auto fill_wtx = [&](CWalletTx& wtx, bool new_tx) {
+        assert(new_tx);
+        wtx.Unserialize(ssValue, std::move(tx));
+        if (wtx.GetHash() != hash)
+            return false;
+
+        // Undo serialize changes in 31600
+        if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
+        {
+            if (!ssValue.empty())
+            {
+                char fTmp;
+                char fUnused;
+                std::string unused_string;
+                ssValue >> fTmp >> fUnused >> unused_string;
+                strErr = strprintf("LoadWallet() upgrading tx ver=%d %d %s",
+                                   wtx.fTimeReceivedIsTxTime, fTmp, hash.ToString());
+                wtx.fTimeReceivedIsTxTime = fTmp;
+            }
+            else
+            {
+                strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
+                wtx.fTimeReceivedIsTxTime = 0;
+            }
+            wss.vWalletUpgrade.push_back(hash);
+        }
+
+        if (wtx.nOrderPos == -1)
+            wss.fAnyUnordered = true;
+
+        return true;
+    };
+    return pwallet->LoadToWallet(hash, fill_wtx);
+}
+
+/**
+ * Load the transaction records collected in wss. Reading the transactions
+ * dominates loading large wallets, so it is spread over several threads, and
+ * the wallet transactions are then added in the order they were read.
+ */
+static void LoadTxRecords(CWallet* pwallet, CWalletScanState& wss, bool& fNoncriticalErrors) EXCLUSIVE_LOCKS_REQUIRED(pwallet->cs_wallet)
+{
+    std::vector<TxRecord>& records = wss.m_tx_records;
+    const int num_threads = std::min(GetNumCores(), MAX_TX_LOAD_THREADS);
+    if (num_threads > 1 && records.size() >= MIN_TX_RECORDS_TO_SHARE) {
+        if (!wss.m_tx_reader) wss.m_tx_reader = MakeUnique<TxRecordReader>(num_threads);
+        wss.m_tx_reader->Read(records);
+    } else {
+        for (TxRecord& record : records) ReadTxRecord(record);
+    }
+
+    for (TxRecord& record : records) {
+        std::string strErr = record.error;
+        bool loaded = false;
+        if (record.tx) {
+            try {
+                loaded = LoadTxRecord(pwallet, record.hash, std::move(record.tx), record.value, wss, strErr);
+            } catch (const std::exception& e) {
+                if (strErr.empty()) strErr = e.what();
+            }
+        }
+        if (!loaded) {
+            fNoncriticalErrors = true;
+            // Rescan if there is a bad transaction record:
+            gArgs.SoftSetBoolArg("-rescan", true);
+        }
+        if (!strErr.empty())
+            pwallet->WalletLogPrintf("%s\n", strErr);
+    }
+    records.clear();
+}
+
 static bool
 ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
              CWalletScanState &wss, std::string& strType, std::string& strErr, const KeyFilterFn& filter_fn = nullptr) EXCLUSIVE_LOCKS_REQUIRED(pwallet->cs_wallet)
@@ -292,41 +487,13 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         } else if (strType == DBKeys::TX) {
             uint256 hash;
             ssKey >> hash;
-            // LoadToWallet call below creates a new CWalletTx that fill_wtx
-            // callback fills with transaction metadata.
-            auto fill_wtx = [&](CWalletTx& wtx, bool new_tx) {
-                assert(new_tx);
-                ssValue >> wtx;
-                if (wtx.GetHash() != hash)
-                    return false;
-
-                // Undo serialize changes in 31600
-                if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
-                {
-                    if (!ssValue.empty())
-                    {
-                        char fTmp;
-                        char fUnused;
-                        std::string unused_string;
-                        ssValue >> fTmp >> fUnused >> unused_string;
-                        strErr = strprintf("LoadWallet() upgrading tx ver=%d %d %s",
-                                           wtx.fTimeReceivedIsTxTime, fTmp, hash.ToString());
-                        wtx.fTimeReceivedIsTxTime = fTmp;
-                    }
-                    else
-                    {
-                        strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
-                        wtx.fTimeReceivedIsTxTime = 0;
-                    }
-                    wss.vWalletUpgrade.push_back(hash);
-                }
-
-                if (wtx.nOrderPos == -1)
-                    wss.fAnyUnordered = true;
-
+            if (wss.m_defer_txs) {
+                wss.m_tx_records.push_back(TxRecord{hash, std::move(ssValue), nullptr, {}});
                 return true;
-            };
-            if (!pwallet->LoadToWallet(hash, fill_wtx)) {
+            }
+            CTransactionRef tx;
+            ssValue >> tx;
+            if (!LoadTxRecord(pwallet, hash, std::move(tx), ssValue, wss, strErr)) {
                 return false;
             }
         } else if (strType == DBKeys::WATCHS) {
@@ -712,6 +879,7 @@ DBErrors WalletBatch::LoadWallet(CWallet* pwallet)
             return DBErrors::CORRUPT;
         }
 
+        wss.m_defer_txs = true;
         while (true)
         {
             // Read next record
@@ -750,7 +918,11 @@ DBErrors WalletBatch::LoadWallet(CWallet* pwallet)
             }
             if (!strErr.empty())
                 pwallet->WalletLogPrintf("%s\n", strErr);
+            if (wss.m_tx_records.size() >= TX_LOAD_BATCH_SIZE) {
+                LoadTxRecords(pwallet, wss, fNoncriticalErrors);
+            }
         }
+        LoadTxRecords(pwallet, wss, fNoncriticalErrors);
     } catch (...) {
         result = DBErrors::CORRUPT;
     }
@@ -276,6 +276,35 @@ private:
     WalletDatabase& m_database;
 };
 
+/** RAII class that groups the writes of one logical wallet operation, made through any
+ * WalletBatch on the database while it is in scope, into a single database transaction.
+ * This saves a sync to disk per write on backends that sync each transaction. Nothing
+ * is rolled back when it goes out of scope, also not by an exception, so writes are
+ * kept as if they had each been committed on their own.
+ * If the transaction cannot be committed, the writes already reported as successful and
+ * applied to the in-memory wallet are lost, so the node is stopped, as when committing
+ * the encryption of a wallet fails.
+ */
+class WalletWriteGroup
+{
+public:
+    explicit WalletWriteGroup(WalletDatabase& database) : m_database(database) { m_database.BeginWriteGroup(); }
+    ~WalletWriteGroup()
+    {
+        if (!m_database.EndWriteGroup()) {
+            // The wallet in memory has changes that are not on disk, die and let the user
+            // reload the wallet from disk.
+            assert(false);
+        }
+    }
+
+    WalletWriteGroup(const WalletWriteGroup&) = delete;
+    WalletWriteGroup& operator=(const WalletWriteGroup&) = delete;
+
+private:
+    WalletDatabase& m_database;
+};
+
 //! Compacts BDB state so that wallet.dat is self-contained (if there are changes)
 void MaybeCompactWalletDB();
 
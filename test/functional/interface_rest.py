@@ -313,6 +313,13 @@ class RESTTest (BitcoinTestFramework):
                             if 'coinbase' not in tx['vin'][0]}
         assert_equal(non_coinbase_txs, set(txs))
 
+        # The extended block JSON includes the prevout of every input, as getblock with verbosity 3
+        assert_equal(json_obj, self.nodes[0].getblock(newblockhash[0], 3))
+        for tx in json_obj['tx']:
+            if tx['txid'] in txs:
+                assert 'fee' in tx
+                assert all('prevout' in vin for vin in tx['vin'])
+
         # Check the same but without tx details
         json_obj = self.test_rest_request("/block/notxdetails/{}".format(newblockhash[0]))
         for tx in txs:
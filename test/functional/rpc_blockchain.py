@@ -43,6 +43,7 @@ from test_framework.util import (
     assert_is_hex_string,
     assert_is_hash_string,
 )
+from test_framework.wallet import MiniWallet
 
 
 class BlockchainTest(BitcoinTestFramework):
@@ -63,6 +64,7 @@ class BlockchainTest(BitcoinTestFramework):
         self._test_getnetworkhashps()
         self._test_stopatheight()
         self._test_waitforblockheight()
+        self._test_getblock()
         assert self.nodes[0].verifychain(4, 0)
 
     def mine_chain(self):
@@ -364,6 +366,46 @@ class BlockchainTest(BitcoinTestFramework):
         assert_waitforheight(current_height)
         assert_waitforheight(current_height + 1)
 
+    def _test_getblock(self):
+        node = self.nodes[0]
+
+        miniwallet = MiniWallet(node)
+        funding_blockhash = miniwallet.generate(1)[0]
+        funding_coinbase = node.getblock(funding_blockhash, 2)['tx'][0]
+        node.generate(100)
+
+        fee_per_byte = Decimal('0.00000010')
+        fee_per_kb = 1000 * fee_per_byte
+
+        miniwallet.send_self_transfer(fee_rate=fee_per_kb, from_node=node)
+        blockhash = node.generate(1)[0]
+
+        self.log.info("Test that getblock with verbosity 1 doesn't include fee")
+        block = node.getblock(blockhash, 1)
+        assert 'fee' not in block['tx'][1]
+
+        self.log.info('Test that getblock with verbosity 2 includes transaction details but no prevouts')
+        block = node.getblock(blockhash, 2)
+        tx = block['tx'][1]
+        assert 'fee' not in tx
+        assert 'prevout' not in tx['vin'][0]
+
+        self.log.info('Test that getblock with verbosity 3 includes the fee and the prevout of each input')
+        block = node.getblock(blockhash, 3)
+        tx = block['tx'][1]
+        assert_equal(tx['fee'], tx['vsize'] * fee_per_byte)
+        prevout = tx['vin'][0]['prevout']
+        assert_equal(prevout['generated'], True)
+        assert_equal(prevout['height'], node.getblock(funding_blockhash)['height'])
+        assert_equal(prevout['value'], funding_coinbase['vout'][0]['value'])
+        assert_equal(prevout['value'] - tx['vout'][0]['value'], tx['fee'])
+        assert_equal(prevout['scriptPubKey'], funding_coinbase['vout'][0]['scriptPubKey'])
+
+        self.log.info('Test that the coinbase transaction has no prevout or fee')
+        coinbase = block['tx'][0]
+        assert 'fee' not in coinbase
+        assert 'prevout' not in coinbase['vin'][0]
+
 
 if __name__ == '__main__':
     BlockchainTest().main()
@@ -160,6 +160,30 @@ class GetblockstatsTest(BitcoinTestFramework):
         assert_raises_rpc_error(-1, 'getblockstats hash_or_height ( stats )', self.nodes[0].getblockstats, '00', 1, 2)
         assert_raises_rpc_error(-1, 'getblockstats hash_or_height ( stats )', self.nodes[0].getblockstats)
 
+        self.log.info('Test getblockstatsrange')
+        first = self.start_height
+        last = self.start_height + self.max_stat_pos
+        assert_equal(self.nodes[0].getblockstatsrange(first, last), self.expected_stats)
+        assert_equal(self.nodes[0].getblockstatsrange(first, first, ['height', 'totalfee']),
+                     [{'height': first, 'totalfee': self.expected_stats[0]['totalfee']}])
+        assert_raises_rpc_error(-8, 'Start height -1 is negative', self.nodes[0].getblockstatsrange, -1, 0)
+        assert_raises_rpc_error(-8, 'Stop height %d is less than start height %d' % (first, last),
+                                self.nodes[0].getblockstatsrange, last, first)
+        assert_raises_rpc_error(-8, 'Stop height %d after current tip %d' % (tip + 1, tip),
+                                self.nodes[0].getblockstatsrange, first, tip + 1)
+        assert_raises_rpc_error(-8, 'Range of 10001 blocks exceeds the maximum of 10000',
+                                self.nodes[0].getblockstatsrange, 0, 10000)
+
+        self.log.info('Test that statistics served by -blockstatsindex match those computed from disk')
+        self.restart_node(0, extra_args=['-blockstatsindex'])
+        self.wait_until(lambda: self.nodes[0].getindexinfo('blockstatsindex')['blockstatsindex']['synced'])
+        assert_equal(self.get_stats(), self.expected_stats)
+        for stat in expected_keys:
+            result = self.nodes[0].getblockstats(hash_or_height=self.start_height, stats=[stat])
+            assert_equal(result, {stat: self.expected_stats[0][stat]})
+        assert_equal(self.nodes[0].getblockstatsrange(first, last), self.expected_stats)
+        assert_equal(len(self.nodes[0].getblockstatsrange(0, tip)), tip + 1)
+
 
 if __name__ == '__main__':
     GetblockstatsTest().main()
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the getscriptpubkeyhistory RPC and -scriptpubkeyindex."""
+
+from test_framework.address import ADDRESS_BCRT1_P2WSH_OP_TRUE, ADDRESS_BCRT1_UNSPENDABLE
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+)
+from test_framework.wallet import MiniWallet
+
+
+class GetScriptPubKeyHistoryTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        self.extra_args = [["-scriptpubkeyindex"], []]
+
+    def run_test(self):
+        node = self.nodes[0]
+        wallet = MiniWallet(node)
+
+        self.log.info("Test that the RPC fails without the index")
+        assert_raises_rpc_error(-1, "Requires -scriptpubkeyindex", self.nodes[1].getscriptpubkeyhistory, ADDRESS_BCRT1_P2WSH_OP_TRUE)
+
+        self.log.info("Test funding entries for coinbase outputs")
+        blocks = wallet.generate(10)
+        node.generatetoaddress(100, ADDRESS_BCRT1_UNSPENDABLE)
+        self.sync_all()
+        history = node.getscriptpubkeyhistory(ADDRESS_BCRT1_P2WSH_OP_TRUE, 1000)['history']
+        assert_equal(len(history), 10)
+        for height, (entry, block_hash) in enumerate(zip(history, blocks), start=1):
+            assert_equal(entry['height'], height)
+            assert_equal(entry['blockhash'], block_hash)
+            assert_equal(entry['type'], 'funding')
+            assert_equal(entry['vout'], 0)
+
+        self.log.info("Test that a hex scriptPubKey gives the same result as its address")
+        script_hex = node.validateaddress(ADDRESS_BCRT1_P2WSH_OP_TRUE)['scriptPubKey']
+        assert_equal(node.getscriptpubkeyhistory(script_hex, 1000)['history'], history)
+
+        self.log.info("Test paging")
+        result = node.getscriptpubkeyhistory(ADDRESS_BCRT1_P2WSH_OP_TRUE, 4)
+        assert_equal(result['history'], history[0:4])
+        result = node.getscriptpubkeyhistory(ADDRESS_BCRT1_P2WSH_OP_TRUE, 4, result['next'])
+        assert_equal(result['history'], history[4:8])
+        result = node.getscriptpubkeyhistory(ADDRESS_BCRT1_P2WSH_OP_TRUE, 4, result['next'])
+        assert_equal(result['history'], history[8:10])
+        assert 'next' not in result
+        assert 'next' not in node.getscriptpubkeyhistory(ADDRESS_BCRT1_P2WSH_OP_TRUE, 10)
+        cursor = node.getscriptpubkeyhistory(ADDRESS_BCRT1_P2WSH_OP_TRUE, 9)['next']
+        assert_raises_rpc_error(-8, "Negative count", node.getscriptpubkeyhistory, ADDRESS_BCRT1_P2WSH_OP_TRUE, -1)
+        assert_raises_rpc_error(-8, "Invalid cursor", node.getscriptpubkeyhistory, ADDRESS_BCRT1_P2WSH_OP_TRUE, 1, "00")
+        assert_raises_rpc_error(-5, "Invalid address or scriptPubKey", node.getscriptpubkeyhistory, "not a script")
+
+        self.log.info("Test spending entries")
+        utxo = wallet.get_utxo()
+        tx = wallet.send_self_transfer(from_node=node, utxo_to_spend=utxo)
+        spend_block = node.generatetoaddress(1, ADDRESS_BCRT1_UNSPENDABLE)[0]
+        self.sync_all()
+        new_entries = node.getscriptpubkeyhistory(ADDRESS_BCRT1_P2WSH_OP_TRUE, 1000, cursor)['history']
+        assert_equal(new_entries[0], history[9])
+        new_entries = new_entries[1:]
+        assert_equal(len(new_entries), 2)
+        spends = [e for e in new_entries if e['type'] == 'spending']
+        assert_equal(len(spends), 1)
+        assert_equal(spends[0]['txid'], tx['txid'])
+        assert_equal(spends[0]['prevout_txid'], utxo['txid'])
+        assert_equal(spends[0]['prevout_vout'], utxo['vout'])
+        assert_equal(spends[0]['amount'], utxo['value'])
+        assert_equal(spends[0]['blockhash'], spend_block)
+
+        self.log.info("Test that entries of reorged blocks are removed")
+        node.invalidateblock(spend_block)
+        node.generateblock(ADDRESS_BCRT1_UNSPENDABLE, [])
+        history = node.getscriptpubkeyhistory(ADDRESS_BCRT1_P2WSH_OP_TRUE, 1000)['history']
+        assert_equal(len(history), 10)
+        assert all(entry['type'] == 'funding' for entry in history)
+        assert_equal(node.getscriptpubkeyhistory(ADDRESS_BCRT1_P2WSH_OP_TRUE, 1000, cursor)['history'], history[9:])
+
+
+if __name__ == '__main__':
+    GetScriptPubKeyHistoryTest().main()
@@ -61,6 +61,21 @@ class RpcMiscTest(BitcoinTestFramework):
         node.logging(include=['qt'])
         assert_equal(node.logging()['qt'], True)
 
+        self.log.info("test getlockstats")
+        stats = node.getlockstats()
+        assert_equal(stats, {"enabled": False, "locks": []})
+        assert_equal(node.getlockstats(True)['enabled'], True)
+        node.getblockcount()
+        stats = node.getlockstats(enable=False, reset=True)
+        assert_equal(stats['enabled'], False)
+        assert any(lock['name'] == 'cs_main' for lock in stats['locks'])
+        for lock in stats['locks']:
+            assert lock['acquisitions'] > 0
+            assert lock['wait_max'] <= lock['wait_total']
+            assert_equal(len(lock['wait_histogram']), 24)
+            assert sum(lock['hold_histogram']) <= lock['acquisitions']
+        assert_equal(node.getlockstats()['locks'], [])
+
         self.log.info("test getindexinfo")
         # Without any indices running the RPC returns an empty object
         assert_equal(node.getindexinfo(), {})
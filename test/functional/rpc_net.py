@@ -118,6 +118,12 @@ class NetTest(BitcoinTestFramework):
             self.wait_until(lambda: peer_after()['bytesrecv_per_msg'].get('pong', 0) >= peer_before['bytesrecv_per_msg'].get('pong', 0) + 32, timeout=1)
             self.wait_until(lambda: peer_after()['bytessent_per_msg'].get('ping', 0) >= peer_before['bytessent_per_msg'].get('ping', 0) + 32, timeout=1)
 
+        # Every connected peer holds on to a receive chunk.
+        recv_buffers = self.nodes[0].getnettotals()['recvbuffers']
+        assert_equal(recv_buffers['chunk_size'], 64 * 1024)
+        assert recv_buffers['allocated'] >= 1
+        assert recv_buffers['in_use'] >= 1
+
     def test_getnetworkinfo(self):
         self.log.info("Test getnetworkinfo")
         info = self.nodes[0].getnetworkinfo()
@@ -149,6 +155,12 @@ class NetTest(BitcoinTestFramework):
         for info in network_info:
             assert_net_servicesnames(int(info["localservices"], 0x10), info["localservicesnames"])
 
+        # Blocks served to peers are cached in serialized form.
+        block_cache = self.nodes[0].getnetworkinfo()['blockcache']
+        assert_equal(block_cache['max_size'], 32 << 20)
+        assert_greater_than(block_cache['entries'], 0)
+        assert block_cache['size'] <= block_cache['max_size']
+
     def test_getaddednodeinfo(self):
         self.log.info("Test getaddednodeinfo")
         assert_equal(self.nodes[0].getaddednodeinfo(), [])
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test that rescans using block filters find the same transactions as full rescans."""
+import os
+import shutil
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+
+
+KEYPOOL_SIZE = 10
+NUM_BLOCKS = 6  # number of blocks with wallet transactions, each spending past the keypool
+
+
+class WalletFastRescanTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.extra_args = [['-keypool={}'.format(KEYPOOL_SIZE), '-blockfilterindex=1']]
+
+    def skip_test_if_missing_module(self):
+        self.skip_if_no_wallet()
+        self.skip_if_no_sqlite()
+
+    def restore_wallet(self, node, backup, wallet_name):
+        wallet_dir = os.path.join(node.datadir, self.chain, 'wallets', wallet_name)
+        os.mkdir(wallet_dir)
+        shutil.copyfile(backup, os.path.join(wallet_dir, self.wallet_data_filename))
+        node.loadwallet(wallet_name)
+        return node.get_wallet_rpc(wallet_name)
+
+    @staticmethod
+    def get_wallet_txids(wallet):
+        return sorted(tx['txid'] for tx in wallet.listtransactions(count=1000))
+
+    def run_test(self):
+        node = self.nodes[0]
+        funder = node.get_wallet_rpc(self.default_wallet_name)
+
+        self.log.info("Back up a new descriptor wallet before it receives anything")
+        node.createwallet(wallet_name='topup_test', descriptors=True)
+        w = node.get_wallet_rpc('topup_test')
+        backup = os.path.join(node.datadir, 'wallet.bak')
+        w.backupwallet(backup)
+
+        self.log.info("Create blocks paying to and spending from more addresses than the keypool holds")
+        for _ in range(NUM_BLOCKS):
+            for _ in range(KEYPOOL_SIZE):
+                funder.sendtoaddress(w.getnewaddress(), 0.1)
+            node.generate(1)
+            w.sendtoaddress(funder.getnewaddress(), 0.05)
+            # Blocks without wallet transactions in between
+            node.generate(10)
+        node.generate(1)
+        txids = self.get_wallet_txids(w)
+        assert_equal(len(txids), NUM_BLOCKS * (KEYPOOL_SIZE + 1))
+        self.wait_until(lambda: all(i['synced'] for i in node.getindexinfo().values()))
+
+        self.log.info("Restore the backup, rescanning with block filters")
+        with node.assert_debug_log(['(using block filters)']):
+            restored = self.restore_wallet(node, backup, 'restored_fast')
+        assert_equal(self.get_wallet_txids(restored), txids)
+        assert_equal(restored.getbalance(), w.getbalance())
+
+        self.log.info("Rescanning again gives the same result")
+        with node.assert_debug_log(['(using block filters)']):
+            restored.rescanblockchain()
+        assert_equal(self.get_wallet_txids(restored), txids)
+
+        self.log.info("Restore the backup without the block filter index, rescanning all blocks")
+        self.restart_node(0, ['-keypool={}'.format(KEYPOOL_SIZE)])
+        with node.assert_debug_log(['Rescan started'], unexpected_msgs=['(using block filters)']):
+            restored = self.restore_wallet(node, backup, 'restored_slow')
+        assert_equal(self.get_wallet_txids(restored), txids)
+
+
+if __name__ == '__main__':
+    WalletFastRescanTest().main()
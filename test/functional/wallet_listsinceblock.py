@@ -39,6 +39,7 @@ class ListSinceBlockTest(BitcoinTestFramework):
         self.test_double_send()
         self.double_spends_filtered()
         self.test_targetconfirmations()
+        self.test_since_each_block()
 
     def test_no_blockhash(self):
         self.log.info("Test no blockhash")
@@ -378,5 +379,21 @@ class ListSinceBlockTest(BitcoinTestFramework):
         assert_equal(original_found, False)
         assert_equal(double_found, False)
 
+    def test_since_each_block(self):
+        '''
+        listsinceblock with a block only visits the wallet transactions filed
+        above its height. It must list the same entries, in the same order, as
+        the full list does for transactions with fewer confirmations than the
+        block, including conflicted ones.
+        '''
+        self.log.info("Test listsinceblock from each block against the full list")
+        for node in self.nodes:
+            full = node.listsinceblock("", 1, True, False)["transactions"]
+            tip_height = node.getblockcount()
+            for height in range(tip_height + 1):
+                depth = tip_height + 1 - height
+                since = node.listsinceblock(node.getblockhash(height), 1, True, False)["transactions"]
+                assert_equal(since, [tx for tx in full if abs(tx["confirmations"]) < depth])
+
 if __name__ == '__main__':
     ListSinceBlockTest().main()
@@ -23,6 +23,8 @@ def tx_from_hex(hexstring):
 class ListTransactionsTest(BitcoinTestFramework):
     def set_test_params(self):
         self.num_nodes = 2
+        # Allow the zero-value output sent in run_paging_test
+        self.extra_args = [["-acceptnonstdtxn=1"], ["-acceptnonstdtxn=1"]]
 
     def skip_test_if_missing_module(self):
         self.skip_if_no_wallet()
@@ -107,6 +109,7 @@ class ListTransactionsTest(BitcoinTestFramework):
                                 {"txid": txid, "label": "watchonly"})
 
         self.run_rbf_opt_in_test()
+        self.run_paging_test()
 
     # Check that the opt-in-rbf flag works properly, for sent and received
     # transactions.
@@ -210,5 +213,45 @@ class ListTransactionsTest(BitcoinTestFramework):
         assert_equal(self.nodes[0].gettransaction(txid_3b)["bip125-replaceable"], "no")
         assert_equal(self.nodes[0].gettransaction(txid_4)["bip125-replaceable"], "unknown")
 
+    def assert_pages_match(self, node, label):
+        """Check every page of listtransactions against the same slice of the full list."""
+        full = node.listtransactions(label, 10000, 0, True)
+        for skip in range(len(full) + 2):
+            end = max(len(full) - skip, 0)
+            assert_equal(node.listtransactions(label, 3, skip, True), full[max(end - 3, 0):end])
+
+    # Check that skipping with the per-transaction entry counts returns the
+    # same page as the full list does.
+    def run_paging_test(self):
+        self.log.info("Test listtransactions pages against the full list")
+        node = self.nodes[0]
+        labeled = [node.getnewaddress("paged") for _ in range(3)]
+        # Immature coinbases, one paying a labeled address
+        node.generatetoaddress(2, labeled[0])
+        node.generatetoaddress(2, node.getnewaddress())
+        # Receives to labeled and unlabeled addresses, with several outputs each
+        self.nodes[1].sendmany("", {labeled[1]: 0.5, labeled[2]: 0.6, node.getnewaddress(): 0.7})
+        self.nodes[1].sendtoaddress(labeled[1], 0.8)
+        # A zero-value output to a labeled address, which adds no credit but is listed
+        utxo = node.listunspent()[0]
+        raw = node.createrawtransaction([utxo], [{labeled[2]: 0}, {node.getrawchangeaddress(): utxo["amount"] - Decimal("0.001")}])
+        zero_txid = node.sendrawtransaction(node.signrawtransactionwithwallet(raw)["hex"])
+        # Sends to the other node
+        node.sendtoaddress(self.nodes[1].getnewaddress(), 0.9)
+        self.sync_all()
+        assert_array_result(node.listtransactions("paged", 100), {"txid": zero_txid}, {"category": "receive", "amount": 0})
+        assert_array_result(node.listtransactions("paged", 100), {"address": labeled[0]}, {"category": "immature"})
+        for label in ["*", "paged"]:
+            self.assert_pages_match(node, label)
+
+        # The counts follow new and confirmed transactions, and label changes
+        self.nodes[1].sendtoaddress(labeled[0], 1.1)
+        self.sync_all()
+        node.generate(1)
+        self.sync_all()
+        node.setlabel(labeled[2], "other")
+        for label in ["*", "paged", "other"]:
+            self.assert_pages_match(node, label)
+
 if __name__ == '__main__':
     ListTransactionsTest().main()